@@ -1445,16 +1445,17 @@ char *rep_substring(const char *org_s, const char *tgt_s, const char *rep_s) {
     if (strcmp(org_s, tgt_s) == 0)
         return strdup(rep_s);
     char *out_s, *ip, *tmp;
-    uint tgt_l = strlen(tgt_s);
-    uint rep_l = strlen(rep_s);
-    uint head_l;
-    uint n = 0;
+    size_t tgt_l = strlen(tgt_s);
+    size_t rep_l = strlen(rep_s);
+    size_t head_l;
+    size_t n = 0;
     ip = (char *)org_s;
     while ((tmp = strstr(ip, tgt_s)) != nullptr) {
         n++;
         ip = tmp + tgt_l;
     }
-    out_s = malloc(strlen(org_s) + (rep_l - tgt_l) * n + 1);
+    // rep_s may be longer than MAXLEN, e.g. a list of pick objects
+    out_s = malloc(strlen(org_s) - tgt_l * n + rep_l * n + 1);
     if (!out_s) {
         return nullptr;
     }
@@ -1463,13 +1464,13 @@ char *rep_substring(const char *org_s, const char *tgt_s, const char *rep_s) {
     while (n--) {
         char *p = strstr(ip, tgt_s);
         head_l = p - ip;
-        strnz__cpy(tmp, ip, head_l);
+        memcpy(tmp, ip, head_l);
         tmp += head_l;
-        strnz__cpy(tmp, rep_s, MAXLEN - 1);
+        memcpy(tmp, rep_s, rep_l);
         tmp += rep_l;
         ip += head_l + tgt_l;
     }
-    strnz__cpy(tmp, ip, MAXLEN - 1);
+    strcpy(tmp, ip);
     return out_s;
 }
 /** @defgroup String_Objects String Objects
@@ -245,6 +245,8 @@ typedef enum {
     LF_REGEX = 0b00001000,     /**< 8 Include files matching regex */
     LF_EXEC = 0b00010000,      /**< 16 Execute command each file */
     LF_USER = 0b00100000,      /**< 32 Select User Name */
+    LF_PRUNE = 0b01000000,     /**< 64 Prune directories matching regex */
+    LF_IGNORE = 0b10000000,    /**< 128 Honor .gitignore and .ignore files */
                                /** << 16 */
     /** byte 1 - bits 8-15 */
     LF_IXUSR = 0b00000001, /**< 1 Select Files with Execute Permission */
@@ -132,6 +132,8 @@ typedef struct
     int optind;                /**< getopt pointer to non-option arguments in argv */
     bool f_ignore_case;        /**< View - ignore case in search */
     bool p_view_files;         /**< Pick - View Pick Files */
+    char match_mode[MAXLEN];   /**< Pick - search is fuzzy, exact or regex */
+    bool f_frecency;           /**< Pick - rank items by past selections */
     bool f_at_end_remove;      /**< obsolete, unneeded */
     bool f_strip_ansi;         /**< strip ansi escape sequences when writing buffer */
     bool f_squeeze;            /**< View - print one line for each group of blank lines
@@ -177,6 +179,7 @@ typedef struct
     char help_spec[MAXLEN]; /**< help file */
     // Pick
     int select_max; /**< Pick maximum number of selections */
+    int p_jobs;     /**< Pick - run cmd once per selection, this many at once */
     // View
     int tab_stop; /**< View - number of spapaces per tab */
     int h_shift;  /**< View - horizontal scroll shift width */
@@ -219,6 +222,7 @@ extern int init_form(Init *, int, char **, uint, uint);
 extern int init_pick(Init *, int, char **, uint, uint);
 extern int open_pick_win(Init *);
 extern int pick_engine(Init *);
+extern void new_view_file(Init *, char *);
 extern int cmd_processor(Init *);
 extern int view_file(Init *);
 extern int init_view_full_screen(Init *);
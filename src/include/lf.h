@@ -0,0 +1,136 @@
+/** @file lf.h
+    @brief lf search engine, for the lf command and in-process providers
+    @author Bill Waller
+    Copyright (c) 2025
+    MIT License
+    billxwaller@gmail.com
+    @date 2026-02-09
+ */
+
+#ifndef _LF_H
+#define _LF_H 1
+#include <regex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+/** Literal test derived from a regular expression by compile_prefilter().
+ * Most entries are rejected with a memcmp or memmem before regexec is
+ * called, and when the expression is nothing but a literal, prefix, suffix
+ * or set of suffixes, regexec is not called at all. */
+#define PF_MAX_LITS 16
+typedef enum {
+    PF_NONE,     /**< No usable literal, always call regexec */
+    PF_EQUAL,    /**< ^literal$ */
+    PF_PREFIX,   /**< ^literal */
+    PF_SUFFIX,   /**< literal$, or (lit1|lit2|...)$ */
+    PF_CONTAINS, /**< literal anywhere */
+} PrefilterType;
+typedef struct {
+    PrefilterType type;
+    bool exact;                    /**< Literal test decides the match */
+    bool icase;                    /**< Compare ignoring case */
+    int lit_cnt;                   /**< Alternative literals, any may match */
+    char *lits[PF_MAX_LITS];       /**< Literals */
+    size_t lit_lens[PF_MAX_LITS];  /**< Literal lengths */
+} Prefilter;
+
+/** Called by lf_search() with each batch of matching paths. Calls are
+ * serialized, the paths are valid only until the call returns, and
+ * returning false cancels the search. */
+typedef bool (*LfMatchFn)(void *ctx, char **paths, size_t cnt);
+
+/** Where an index is used, see --index and --use_index */
+enum { INDEX_OFF, INDEX_BUILD, INDEX_USE };
+
+/** Search options, filled in by lf_parse_args() or directly */
+typedef struct {
+    uintmax_t user_id;
+    off_t file_size_min;
+    long flags;
+    time_t after;
+    time_t before;
+    int max_depth;
+    int reg_flags;
+    int watch_interval;
+    int max_jobs;
+    int slow_dir_ms;
+    size_t max_results;
+    unsigned int nthreads;
+    unsigned int threads_used; /**< Set by lf_search(), most threads run */
+    int index_mode;
+    char *index_file;
+    char *base_path;
+    char *re;
+    char *ere;
+    char *prune;
+    char *contains;
+    char *exec;
+    char *user_name;
+    char *format;
+    char *fs_types;
+    char *exclude_fs_types;
+    regex_t compiled_re;
+    regex_t compiled_ere;
+    regex_t compiled_prune;
+    regex_t compiled_contains;
+    Prefilter re_pf;
+    Prefilter ere_pf;
+    Prefilter contains_pf;
+    unsigned char include_perms;
+    unsigned char include_types;
+    unsigned char suppress_types;
+    bool ignore_case;
+    bool sort;
+    bool sort_reverse;
+    bool include_hidden;
+    bool hidden_only;
+    bool follow_links;
+    bool exclude_dirs;
+    bool basename;
+    bool no_prefilter;
+    bool watch;
+    bool unique_inode;
+    bool dupes;
+    bool json;
+    bool null_sep;
+    bool xdev;
+    bool io_uring;
+    bool debug;
+    bool report_config;
+    bool report_info;
+    bool report_warnings;
+    bool report_errors;
+    bool report_badlinks;
+    bool report_trace;
+    bool report_all;
+    bool count;
+    bool count_silently;
+    bool only_errors;
+    LfMatchFn on_match; /**< Receives matches instead of stdout, if set */
+    void *match_ctx;    /**< Passed to on_match */
+    bool quiet;         /**< Discard diagnostics rather than write stderr */
+    bool failed;        /**< Set by lf_search() if memory ran out */
+} SearchFilters;
+
+/** A search is set up with lf_new_filters() and lf_parse_args(), which
+ * takes the same arguments as the lf command, and run with lf_search().
+ * Matches are printed on stdout unless on_match is set, in which case
+ * they are delivered in batches from the finder threads as they are found.
+ * Only one search may run at a time. */
+extern SearchFilters *lf_new_filters(void);
+extern bool lf_parse_args(SearchFilters *, int, char **, unsigned int);
+extern int lf_search(SearchFilters *, int, char **, size_t *);
+extern void lf_cancel(void);
+extern void lf_free_filters(SearchFilters *);
+/** Bytes of arguments a command run by lf -x, or by pick, may take */
+extern size_t lf_arg_room(void);
+/** Enters an io_uring, as io_uring_enter(2) without a signal mask. --io_uring
+ * calls it through lf_ring_enter, which a test may point elsewhere to make
+ * the ring fail. */
+typedef int (*LfRingEnterFn)(int fd, unsigned to_submit,
+                             unsigned min_complete, unsigned flags);
+extern LfRingEnterFn lf_ring_enter;
+#endif
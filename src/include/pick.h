@@ -10,15 +10,62 @@
 #ifndef _PICK_H
 #define _PICK_H 1
 #include <cm.h>
+#include <stdint.h>
 
 /** Pick structures, enums, and data types */
 
-#define OBJ_MAXLEN 80
-#define OBJ_MAXCNT 4096
+#define OBJ_POOL_INIT 65536 /**< initial bytes of the object string pool */
+#define OBJ_TBL_INIT 1024   /**< initial entries of the object tables */
+#define PICK_INPUT_TICK_MS 100 /**< how often arriving input is shown */
+#define PICK_FIRST_PAGE_MS 250 /**< longest wait for a full first page */
+#define PICK_FILTER_MAX 16     /**< search term prefixes kept, see PickFilter */
+#define PICK_SEARCH_TICK_MS 10 /**< how often a running search is checked */
+#define PICK_PREVIEW_DEBOUNCE_MS 60 /**< cursor rest before highlighting */
+#define PICK_PREVIEW_TICK_MS 20     /**< how often the highlighter is checked */
+#define PICK_PREVIEW_CACHE 8        /**< highlighted files kept for preview */
+#define PICK_HL_CACHE_MB 64         /**< on-disk cache of highlighted files */
+#define PICK_FRECENCY_SLOTS 4096    /**< objects in a frecency table, a power
+                                       of 2 */
+#define PICK_FRECENCY_WAIT_MS 50    /**< longest wait for it at startup */
 
 #ifndef _COMMON_H
 typedef struct Init Init;
 #endif
+typedef struct PickInput PickInput;
+typedef struct PickMatch PickMatch;
+typedef struct PickSearch PickSearch;
+typedef struct PickPreview PickPreview;
+typedef struct PickFrecency PickFrecency;
+
+/** @enum MatchMode
+    @brief How the search term selects pick objects */
+typedef enum {
+    MATCH_FUZZY, /**< term's characters in order, ranked by score */
+    MATCH_EXACT, /**< term as a substring, in input order */
+    MATCH_REGEX  /**< term as an extended regular expression */
+} MatchMode;
+
+/** @enum SearchState
+    @brief Progress of a search, see poll_search() */
+typedef enum {
+    SEARCH_IDLE,       /**< no search is running */
+    SEARCH_RUNNING,    /**< still running */
+    SEARCH_FIRST_PAGE, /**< a page of objects has been found so far */
+    SEARCH_DONE        /**< just finished */
+} SearchState;
+
+/** @struct PickFilter
+    @brief The objects a search term matched, kept so that a longer term
+   narrows them and backspacing returns to them */
+typedef struct {
+    char *term;      /**< search term */
+    MatchMode mode;  /**< how it was matched */
+    uint m_cnt;      /**< master objects it was matched against */
+    uint cnt;        /**< objects matched */
+    uint *object;    /**< their master indexes, see rank_chunks() */
+    int *score;      /**< and their match scores */
+    uint ranked;     /**< leading objects in rank order */
+} PickFilter;
 
 /** @struct Pick
    @brief Pick data structure */
@@ -62,21 +109,41 @@ typedef struct {
     bool f_read_theme;           /**< flag: read and process default theme */
     bool f_multiple_cmd_args;    /**< flag: multiple command arguments */
     bool p_view_files;           /**< flag: View pick files */
-    bool f_selected[OBJ_MAXCNT]; /**< flag: object selected */
+    uint64_t *f_selected;        /**< bitset: master object selected */
     bool help;                   /**< flag: help requested */
     bool f_provider_cmd;         /**< flag: provider command verified */
     bool f_receiver_cmd;         /**< flag: receiver command verified */
     bool f_cmd;                  /**< flag: command verified */
-    char in_buf[BUFSIZ];         /**< input buffer */
-    char **m_object;             /**< master object table (as read from input) */
+    char *obj_pool;              /**< object strings, as read from input */
+    size_t pool_len;             /**< bytes used in obj_pool */
+    size_t pool_size;            /**< bytes allocated to obj_pool */
+    size_t *obj_off;             /**< master object table, obj_pool offsets */
+    uint *obj_len;               /**< length of each master object */
+    uint64_t *obj_mask;          /**< characters in each master object */
+    uint obj_size;               /**< entries allocated to the object tables */
     uint select_idx;             /**< index of current selected object */
     uint select_cnt;             /**< count of selected objects */
     uint select_max;             /**< maximum number of selected objects */
+    uint p_jobs;                 /**< cmd runs once per selection, this many at
+                                    once, or 0 for all selections at once */
     uint m_cnt;
     uint d_cnt;
     uint m_idx;      /**< count of objects */
     uint d_idx;      /**< index of current object */
-    char **d_object; /**< derived object table */
+    uint *d_object;  /**< derived object table, master object indexes */
+    int *d_score;    /**< match score of each derived object */
+    uint d_ranked;   /**< leading derived objects in rank order */
+    bool f_rank;     /**< flag: derived objects are ranked by d_score */
+    bool f_ignore_case;  /**< flag: search ignores case, even in upper */
+    MatchMode match_mode; /**< how the search term is matched */
+    PickMatch *match;    /**< compiled search term */
+    PickFilter filter[PICK_FILTER_MAX]; /**< results of the term's prefixes */
+    uint filter_cnt;     /**< entries used in filter */
+    PickSearch *search;  /**< search workers and the running search */
+    PickInput *input;    /**< provider input still arriving, or nullptr */
+    PickPreview *preview; /**< preview of the file under the cursor */
+    bool f_frecency;     /**< flag: rank objects by past selections */
+    PickFrecency *frecency; /**< table of past selections, or nullptr */
     uint y_offset;
     uint pg_line;        /**< current line on page */
     uint pg_lines;       /**< lines per page */
@@ -92,11 +159,43 @@ typedef struct {
     uint separator_line; /**< separator between object selector and line editor
                           */
     Chyron *chyron;      /**< chyron data structure */
+    uint chyron_keys;    /**< active chyron keys as last shown, a bit each */
+    bool f_chyron_shown; /**< flag: chyron shown is current to chyron_keys */
+    char position[32];   /**< "Line x, Page y/z" as last shown */
 } Pick;
 // extern Pick *pick; /**< pointer to Pick data structure */
 
-extern void save_object(Pick *, char *);
+extern bool save_object(Pick *, char *);
+extern char *pick_object(Pick *, uint);
+extern char *display_object(Pick *, uint);
+extern bool object_selected(Pick *, uint);
+extern void select_object(Pick *, uint, bool);
+extern uint next_selected(Pick *, uint);
+extern void select_all_objects(Pick *);
+extern void invert_selection(Pick *);
 extern void display_pick_page(Pick *);
+extern uint64_t object_mask(const char *, uint);
+extern bool compile_match(Pick *, const char *);
+extern bool match_object(Pick *, uint, int *);
+extern int match_objects(Pick *, char *);
+extern bool search_objects(Pick *, char *);
+extern SearchState poll_search(Pick *);
+extern void finish_search(Pick *);
+extern bool search_running(Pick *);
+extern void free_search(Pick *);
+extern bool poll_preview(Pick *);
+extern void free_preview(Pick *);
+extern void rank_objects(Pick *, uint);
+extern void open_frecency(Pick *);
+extern void wait_frecency(Pick *, long);
+extern bool frecency_ready(Pick *);
+extern uint frecency_of(Pick *, const char *, uint, uint32_t);
+extern void record_frecency(Pick *);
+extern void free_frecency(Pick *);
+extern void free_filters(Pick *);
+extern void free_match(Pick *);
+extern MatchMode str_to_match_mode(const char *);
+extern const char *match_mode_name(MatchMode);
 extern void reverse_object(Pick *);
 extern void toggle_object(Pick *);
 extern int output_objects(Pick *);
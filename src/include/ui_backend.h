@@ -216,6 +216,9 @@ extern uint LINES, COLS;
 UiRuntime *ui_init(const UiConfig *config);
 void ui_shutdown();
 void ui_render();
+#ifdef DEBUG_RENDER
+unsigned long ui_render_count();
+#endif
 int ui_clear();
 int ui_erase();
 int ui_suspend();
@@ -276,6 +279,7 @@ int ui_scrollok(UiSurface *s, uint w, bool enable);
 int ui_keypad(UiSurface *s, uint w, bool enable);
 int ui_idlok(UiSurface *s, uint w, bool enable);
 int ui_idcok(UiSurface *s, uint w, bool enable);
+int ui_immedok(UiSurface *s, uint w, bool enable);
 void ui_update_panels();
 int ui_doupdate();
 int ui_wnoutrefresh(UiSurface *s, uint w);
@@ -67,6 +67,8 @@ typedef enum {
     XBYELLOW,
     XCYAN,
     CM_EDITOR,
+    CM_MATCH_MODE,
+    CM_FRECENCY,
     XGREEN,
     XMAGENTA,
     XRED,
@@ -131,6 +133,7 @@ static struct argp_option options[] = {
     {"provider_cmd", 'S', "file_spec", 0, "execute provider of piped input", 3},
     {"receiver_cmd", 'R', "file_spec", 0, "execute receiver of piped output", 3},
     {"select_max", 'n', "number", 0, "number of selections", 5},
+    {"p_jobs", 'J', "number", 0, "run cmd once per selection, number at once", 5},
     {"f_erase_remainder", 'e', "bool", OPTION_ARG_OPTIONAL, "erase remainder of line on enter", 5},
     {"f_strip_ansi", 'j', "bool", OPTION_ARG_OPTIONAL, "always strip ansi when writing", 5},
     {"f_multiple_cmd_args", 'M', "bool", OPTION_ARG_OPTIONAL, "allow multiple command arguments", 5},
@@ -138,6 +141,8 @@ static struct argp_option options[] = {
     {"f_squeeze", 's', "bool", OPTION_ARG_OPTIONAL, "squeeze multiple blank lines", 5},
     {"f_ignore_case", 'x', "bool", OPTION_ARG_OPTIONAL, "ignore case in search", 5},
     {"p_view_files", 'v', "bool", OPTION_ARG_OPTIONAL, "File View in Pick", 5},
+    {"match_mode", CM_MATCH_MODE, "mode", 0, "Pick search (fuzzy, exact, regex)", 5},
+    {"f_frecency", CM_FRECENCY, "bool", OPTION_ARG_OPTIONAL, "rank Pick items by past selections", 5},
     {"wrap", 'w', "bool", OPTION_ARG_OPTIONAL, "view wrap lines", 5},
     {"f_ln", 'N', "bool", OPTION_ARG_OPTIONAL, "line numbers in view", 5},
     {"fill_char", 'f', "char", 0, "field fill_char (_,.,empty)", 5},
@@ -270,6 +275,9 @@ parse_opt(int key, char *arg, struct argp_state *state) {
     case 'n':
         init->select_max = atoi(arg);
         break;
+    case 'J':
+        init->p_jobs = atoi(arg);
+        break;
     case 'N':
         if (arg)
             init->f_ln = str_to_bool(arg);
@@ -312,6 +320,19 @@ parse_opt(int key, char *arg, struct argp_state *state) {
         if (arg)
             init->p_view_files = str_to_bool(arg);
         break;
+    case 'x':
+        init->f_ignore_case = true;
+        if (arg)
+            init->f_ignore_case = str_to_bool(arg);
+        break;
+    case CM_MATCH_MODE:
+        strnz__cpy(init->match_mode, arg, MAXLEN - 1);
+        break;
+    case CM_FRECENCY:
+        init->f_frecency = true;
+        if (arg)
+            init->f_frecency = str_to_bool(arg);
+        break;
     case BG:
         strnz__cpy(sio->bg, arg, MAXLEN - 1);
         break;
@@ -547,6 +568,7 @@ void mapp_initialization(Init *init, int argc, char **argv) {
     init->f_erase_remainder = true;               /**< erase remainder on enter */
     init->brackets[0] = '\0';                     /**< field enclosure brackets */
     strnz__cpy(init->fill_char, " ", MAXLEN - 1); /**< field fill character */
+    strnz__cpy(init->match_mode, "fuzzy", MAXLEN - 1); /**< pick search */
     e = getenv("TERM");
     if (e == nullptr || *e == '\0')
         strnz__cpy(term, "xterm-256color", MAXLEN);
@@ -782,6 +804,14 @@ int process_config_file(char *config_file_name, Init *init) {
             init->p_view_files = str_to_bool(value);
             continue;
         }
+        if (!strcmp(key, "match_mode")) {
+            strnz__cpy(init->match_mode, value, MAXLEN - 1);
+            continue;
+        }
+        if (!strcmp(key, "f_frecency")) {
+            init->f_frecency = str_to_bool(value);
+            continue;
+        }
         if (!strcmp(key, "f_read_theme")) {
             init->f_read_theme = str_to_bool(value);
             continue;
@@ -802,6 +832,10 @@ int process_config_file(char *config_file_name, Init *init) {
             init->select_max = atoi(value);
             continue;
         }
+        if (!strcmp(key, "p_jobs")) {
+            init->p_jobs = atoi(value);
+            continue;
+        }
         if (!strcmp(key, "tab_stop")) {
             init->tab_stop = atoi(value);
             continue;
@@ -1184,6 +1218,8 @@ int write_config(Init *init) {
     print_argp_doc(minitrc_fp, config_s, "f_multiple_cmd_args");
     ssnprintf(config_s, MAXLEN - 1, "%s=%d", "select_max", init->select_max);
     print_argp_doc(minitrc_fp, config_s, "select_max");
+    ssnprintf(config_s, MAXLEN - 1, "%s=%d", "p_jobs", init->p_jobs);
+    print_argp_doc(minitrc_fp, config_s, "p_jobs");
 
     ssnprintf(config_s, MAXLEN - 1, "%s=%s", "f_ln", init->f_ln ? "true" : "false");
     print_argp_doc(minitrc_fp, config_s, "f_ln");
@@ -1204,6 +1240,10 @@ int write_config(Init *init) {
     print_argp_doc(minitrc_fp, config_s, "f_ignore_case");
     ssnprintf(config_s, MAXLEN - 1, "%s=%s", "p_view_files", init->p_view_files ? "true" : "false");
     print_argp_doc(minitrc_fp, config_s, "p_view_files");
+    ssnprintf(config_s, MAXLEN - 1, "%s=%s", "match_mode", init->match_mode);
+    print_argp_doc(minitrc_fp, config_s, "match_mode");
+    ssnprintf(config_s, MAXLEN - 1, "%s=%s", "f_frecency", init->f_frecency ? "true" : "false");
+    print_argp_doc(minitrc_fp, config_s, "f_frecency");
     ssnprintf(config_s, MAXLEN - 1, "%s=%s", "f_read_theme", init->f_read_theme ? "true" : "false");
     print_argp_doc(minitrc_fp, config_s, "f_read_theme");
     ssnprintf(config_s, MAXLEN - 1, "%s=%s", "editor", init->editor);
@@ -0,0 +1,662 @@
+/** @file lf_bench.c
+    @brief Benchmark lf on a synthetic directory tree
+    @details Builds a reproducible tree from its parameters, runs lf with a
+    set of option configurations, and prints one JSON object per line: the
+    tree and host, then each configuration with its entries per second,
+    CPU time, peak RSS, system calls per entry (with --strace) and, for
+    the thread counts, scaling efficiency. Lines from two releases can be
+    compared to catch regressions.
+    @author Bill Waller
+    Copyright (c) 2025
+    MIT License
+    billxwaller@gmail.com
+    @date 2026-02-09
+ */
+
+#define _GNU_SOURCE
+#include "cm.h"
+#include <argp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/sysinfo.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+const char *argp_program_version = CM_VERSION;
+const char *argp_program_bug_address = "billxwaller@gmail.com";
+
+/** Version of the tree layout, part of the parameters file, so a tree
+ * made by an older lf_bench is rebuilt */
+#define TREE_LAYOUT 1
+#define LONG_NAME_LEN 200
+#define MAX_RUNS 100
+
+typedef struct {
+    int fanout;      /**< Subdirectories per directory */
+    int depth;       /**< Levels of subdirectories */
+    int files;       /**< Files per directory */
+    int hidden_pct;  /**< Percent of files and directories that are hidden */
+    int long_pct;    /**< Percent of files with long names */
+    int cycles;      /**< Symbolic links to an ancestor directory */
+    unsigned seed;   /**< Seed of the tree's random numbers */
+    int runs;        /**< Runs of each configuration */
+    bool strace;     /**< Count system calls with strace -f -c */
+    bool cold;       /**< Drop the page cache before each run */
+    char *dir;       /**< Where the tree is kept */
+    char *only;      /**< Comma separated configurations to run */
+    char *lf;        /**< lf to benchmark */
+} BenchOpts;
+
+typedef struct {
+    size_t dirs;
+    size_t files;
+    size_t links;
+    size_t cycles;
+    size_t dirs_made; /**< Directories made so far, to place the cycles */
+    size_t cycle_stride;
+    uint64_t rng;
+} TreeCounts;
+
+typedef struct {
+    const char *name;
+    const char *args[8];
+    int threads; /**< -T of a scaling configuration, 0 for others */
+} BenchConfig;
+
+typedef struct {
+    double wall;
+    double user;
+    double sys;
+    long max_rss_kb;
+    size_t listed;
+    int status;
+} RunResult;
+
+/** Configurations, each run on the whole tree. The threads_N runs give
+ * the scaling efficiency, entries per second over N times that of
+ * threads_1. */
+static const BenchConfig configs[] = {
+    {"plain", {NULL}, 0},
+    {"regex_literal", {"-r", "\\.c$", NULL}, 0},
+    {"regex_complex", {"-r", "[0-9]{3}[a-f]?\\.(c|h)$", NULL}, 0},
+    {"regex_no_prefilter", {"--no_prefilter", "-r", "\\.c$", NULL}, 0},
+    {"ignore_case", {"-i", "-r", "readme", NULL}, 0},
+    {"basename", {"-B", "-r", "^f0", NULL}, 0},
+    {"exclude", {"-e", "\\.(txt|md)$", NULL}, 0},
+    {"types_size", {"-t", "f", "-s", "4K", NULL}, 0},
+    {"hidden_links", {"--include_hidden=a", "-L", NULL}, 0},
+    {"sort", {"-S", NULL}, 0},
+    {"count_only", {"-cs", NULL}, 0},
+    {"json", {"--json", NULL}, 0},
+    {"threads_1", {"-T", "1", NULL}, 1},
+    {"threads_2", {"-T", "2", NULL}, 2},
+    {"threads_4", {"-T", "4", NULL}, 4},
+    {"threads_8", {"-T", "8", NULL}, 8},
+};
+#define CONFIG_CNT (sizeof(configs) / sizeof(configs[0]))
+
+static const char *exts[] = {".c", ".h", ".txt", ".md", ".o", ""};
+#define EXT_CNT (sizeof(exts) / sizeof(exts[0]))
+
+static uint64_t rng_next(uint64_t *);
+static bool tree_ready(const BenchOpts *, const char *, TreeCounts *);
+static bool make_tree(const BenchOpts *, const char *, const char *,
+                      TreeCounts *);
+static bool make_dir(const BenchOpts *, char *, size_t, int, TreeCounts *);
+static int remove_entry(const char *, const struct stat *, int,
+                        struct FTW *);
+static bool run_lf(const BenchOpts *, const BenchConfig *, const char *,
+                   const char *, RunResult *);
+static long strace_calls(const char *);
+static bool in_path(const char *);
+static bool config_selected(const char *, const char *);
+static void drop_caches(void);
+static void json_str(const char *);
+static int cmp_double(const void *, const void *);
+
+static struct argp_option options[] = {
+    {"fanout", 'f', "number", 0, "Subdirectories per directory (8)", 0},
+    {"depth", 'd', "number", 0, "Levels of subdirectories (4)", 0},
+    {"files", 'n', "number", 0, "Files per directory (20)", 0},
+    {"hidden", 'H', "percent", 0, "Hidden files and directories (10)", 0},
+    {"long_names", 'l', "percent", 0, "Files with 200 byte names (5)", 0},
+    {"cycles", 'c', "number", 0, "Symbolic links to an ancestor (4)", 0},
+    {"seed", 's', "number", 0, "Seed of the tree's random numbers (1)", 0},
+    {"runs", 'r', "number", 0, "Runs of each configuration (5)", 0},
+    {"dir", 'o', "directory", 0,
+     "Where to build the tree ($TMPDIR/lf_bench)", 0},
+    {"bench", 'b', "names", 0, "Run only these configurations", 0},
+    {"strace", 'S', 0, 0, "Count system calls with strace", 0},
+    {"cold", 'C', 0, 0, "Drop the page cache before each run (root)", 0},
+    {0}};
+
+/** @brief Parse a single option. */
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    BenchOpts *o = state->input;
+    switch (key) {
+    case 'f':
+        o->fanout = atoi(arg);
+        break;
+    case 'd':
+        o->depth = atoi(arg);
+        break;
+    case 'n':
+        o->files = atoi(arg);
+        break;
+    case 'H':
+        o->hidden_pct = atoi(arg);
+        break;
+    case 'l':
+        o->long_pct = atoi(arg);
+        break;
+    case 'c':
+        o->cycles = atoi(arg);
+        break;
+    case 's':
+        o->seed = strtoul(arg, NULL, 10);
+        break;
+    case 'r':
+        o->runs = atoi(arg);
+        break;
+    case 'o':
+        o->dir = arg;
+        break;
+    case 'b':
+        o->only = arg;
+        break;
+    case 'S':
+        o->strace = true;
+        break;
+    case 'C':
+        o->cold = true;
+        break;
+    case ARGP_KEY_ARG:
+        if (state->arg_num > 0)
+            argp_usage(state);
+        o->lf = arg;
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = {
+    options, parse_opt, "[LF]",
+    "Benchmark lf (default: lf in PATH) on a synthetic directory tree. The "
+    "tree is kept and reused while its parameters are unchanged.",
+    NULL, NULL, NULL};
+
+int main(int argc, char **argv) {
+    BenchOpts o = {8, 4, 20, 10, 5, 4, 1, 5, false, false, NULL, NULL, "lf"};
+    argp_parse(&argp, argc, argv, 0, 0, &o);
+    if (o.fanout < 1 || o.depth < 0 || o.files < 0 || o.runs < 1 ||
+        o.runs > MAX_RUNS || o.hidden_pct < 0 || o.hidden_pct > 100 ||
+        o.long_pct < 0 || o.long_pct > 100 || o.cycles < 0) {
+        fprintf(stderr, "lf_bench: parameter out of range\n");
+        exit(EXIT_FAILURE);
+    }
+    char dir[PATH_MAX];
+    if (o.dir)
+        snprintf(dir, sizeof(dir), "%s", o.dir);
+    else {
+        const char *tmp = getenv("TMPDIR");
+        snprintf(dir, sizeof(dir), "%s/lf_bench", tmp && *tmp ? tmp : "/tmp");
+    }
+    char tree[PATH_MAX];
+    char params[PATH_MAX];
+    char strace_out[PATH_MAX] = {'\0'};
+    if (snprintf(tree, sizeof(tree), "%s/tree", dir) >= PATH_MAX - 64 ||
+        snprintf(params, sizeof(params), "%s/params", dir) >= PATH_MAX) {
+        fprintf(stderr, "lf_bench: %s: %s\n", dir, strerror(ENAMETOOLONG));
+        exit(EXIT_FAILURE);
+    }
+
+    TreeCounts tc = {0};
+    if (!tree_ready(&o, params, &tc)) {
+        fprintf(stderr, "lf_bench: building %s\n", tree);
+        if (!make_tree(&o, dir, params, &tc))
+            exit(EXIT_FAILURE);
+    }
+    size_t entries = tc.dirs + tc.files + tc.links;
+
+    if (o.strace && (!in_path("strace") ||
+                     snprintf(strace_out, sizeof(strace_out), "%s/strace.out",
+                              dir) >= PATH_MAX)) {
+        strace_out[0] = '\0';
+        fprintf(stderr, "lf_bench: strace not found, syscalls are null\n");
+    }
+
+    printf("{\"lf_bench\":%d,\"version\":", TREE_LAYOUT);
+    json_str(CM_VERSION);
+    printf(",\"lf\":");
+    json_str(o.lf);
+    printf(",\"nprocs\":%d,\"fanout\":%d,\"depth\":%d,\"files_per_dir\":%d,"
+           "\"hidden_pct\":%d,\"long_pct\":%d,\"cycles\":%zu,\"seed\":%u,"
+           "\"dirs\":%zu,\"files\":%zu,\"links\":%zu,\"entries\":%zu,"
+           "\"runs\":%d,\"cold\":%s}\n",
+           get_nprocs(), o.fanout, o.depth, o.files, o.hidden_pct, o.long_pct,
+           tc.cycles, o.seed, tc.dirs, tc.files, tc.links, entries, o.runs,
+           o.cold ? "true" : "false");
+    fflush(stdout);
+
+    int status = EXIT_SUCCESS;
+    double rate_1 = 0;
+    for (size_t i = 0; i < CONFIG_CNT; i++) {
+        const BenchConfig *c = &configs[i];
+        if (o.only && !config_selected(o.only, c->name))
+            continue;
+        double walls[MAX_RUNS];
+        RunResult sum = {0};
+        bool ok = true;
+        for (int r = 0; r < o.runs && ok; r++) {
+            RunResult rr;
+            if (o.cold)
+                drop_caches();
+            ok = run_lf(&o, c, tree, NULL, &rr);
+            walls[r] = rr.wall;
+            sum.user += rr.user;
+            sum.sys += rr.sys;
+            if (rr.max_rss_kb > sum.max_rss_kb)
+                sum.max_rss_kb = rr.max_rss_kb;
+            sum.listed = rr.listed;
+            sum.status = rr.status;
+        }
+        printf("{\"bench\":");
+        json_str(c->name);
+        printf(",\"args\":\"");
+        for (int a = 0; c->args[a]; a++) {
+            if (a)
+                putchar(' ');
+            for (const char *p = c->args[a]; *p; p++) {
+                if (*p == '\\' || *p == '"')
+                    putchar('\\');
+                putchar(*p);
+            }
+        }
+        printf("\"");
+        if (!ok) {
+            printf(",\"error\":\"lf exited with status %d\"}\n", sum.status);
+            fflush(stdout);
+            status = EXIT_FAILURE;
+            continue;
+        }
+        qsort(walls, o.runs, sizeof(double), cmp_double);
+        double median = o.runs % 2 ? walls[o.runs / 2]
+                                   : (walls[o.runs / 2 - 1] +
+                                      walls[o.runs / 2]) / 2;
+        double rate = median > 0 ? entries / median : 0;
+        printf(",\"listed\":%zu,\"wall_min\":%.4f,\"wall_median\":%.4f,"
+               "\"user\":%.4f,\"sys\":%.4f,\"max_rss_kb\":%ld,"
+               "\"entries_per_sec\":%.0f",
+               sum.listed, walls[0], median, sum.user / o.runs,
+               sum.sys / o.runs, sum.max_rss_kb, rate);
+        long calls = -1;
+        if (strace_out[0]) {
+            RunResult rr;
+            if (run_lf(&o, c, tree, strace_out, &rr))
+                calls = strace_calls(strace_out);
+        }
+        if (calls >= 0)
+            printf(",\"syscalls\":%ld,\"syscalls_per_entry\":%.3f", calls,
+                   entries ? (double)calls / entries : 0);
+        else
+            printf(",\"syscalls\":null,\"syscalls_per_entry\":null");
+        if (c->threads == 1)
+            rate_1 = rate;
+        if (c->threads > 0) {
+            printf(",\"threads\":%d", c->threads);
+            if (rate_1 > 0)
+                printf(",\"scaling_efficiency\":%.3f",
+                       rate / (rate_1 * c->threads));
+            else
+                printf(",\"scaling_efficiency\":null");
+        }
+        printf("}\n");
+        fflush(stdout);
+    }
+    if (strace_out[0])
+        unlink(strace_out);
+    return status;
+}
+
+/** @brief xorshift64*, so a seed always gives the same tree */
+static uint64_t rng_next(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/** @brief Format the parameters file of a tree. */
+static void format_params(const BenchOpts *o, const TreeCounts *tc,
+                          char *buf, size_t size) {
+    snprintf(buf, size,
+             "layout=%d fanout=%d depth=%d files=%d hidden=%d long=%d "
+             "cycles=%d seed=%u\n%zu %zu %zu %zu\n",
+             TREE_LAYOUT, o->fanout, o->depth, o->files, o->hidden_pct,
+             o->long_pct, o->cycles, o->seed, tc->dirs, tc->files, tc->links,
+             tc->cycles);
+}
+
+/** @brief Check that the kept tree was built with the same parameters.
+    @param o Options
+    @param params Path of the parameters file
+    @param tc Receives the counts of the tree
+    @return true if the tree can be reused
+   */
+static bool tree_ready(const BenchOpts *o, const char *params,
+                       TreeCounts *tc) {
+    FILE *fp = fopen(params, "r");
+    if (!fp)
+        return false;
+    char want[256], line[256];
+    format_params(o, &(TreeCounts){0}, want, sizeof(want));
+    *strchr(want, '\n') = '\0';
+    bool ok = fgets(line, sizeof(line), fp) != NULL;
+    if (ok) {
+        line[strcspn(line, "\n")] = '\0';
+        ok = strcmp(line, want) == 0 &&
+             fscanf(fp, "%zu %zu %zu %zu", &tc->dirs, &tc->files, &tc->links,
+                    &tc->cycles) == 4;
+    }
+    fclose(fp);
+    return ok;
+}
+
+/** @brief Build the tree, replacing any tree built with other parameters.
+    @param o Options
+    @param dir Directory holding the tree and its parameters
+    @param params Path of the parameters file
+    @param tc Receives the counts of the tree
+    @return false if the tree couldn't be built
+   */
+static bool make_tree(const BenchOpts *o, const char *dir, const char *params,
+                      TreeCounts *tc) {
+    char path[PATH_MAX];
+    unlink(params);
+    if (snprintf(path, sizeof(path), "%s/tree", dir) >= PATH_MAX)
+        return false;
+    nftw(path, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    mkdir(dir, 0755);
+    if (mkdir(path, 0755) == -1) {
+        fprintf(stderr, "lf_bench: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    // Spread the cycles evenly over the directories below the first level
+    size_t total = 0, level = 1;
+    for (int d = 1; d <= o->depth; d++) {
+        level *= o->fanout;
+        total += level;
+    }
+    tc->rng = o->seed ? o->seed : 1;
+    tc->cycle_stride = o->cycles ? total / o->cycles : 0;
+    if (tc->cycle_stride == 0)
+        tc->cycle_stride = 1;
+    if (!make_dir(o, path, strlen(path), 0, tc))
+        return false;
+    char buf[256];
+    format_params(o, tc, buf, sizeof(buf));
+    FILE *fp = fopen(params, "w");
+    if (!fp || fputs(buf, fp) == EOF) {
+        fprintf(stderr, "lf_bench: %s: %s\n", params, strerror(errno));
+        if (fp)
+            fclose(fp);
+        return false;
+    }
+    fclose(fp);
+    return true;
+}
+
+/** @brief Fill one directory of the tree and make its subdirectories.
+    @param o Options
+    @param path Path of the directory, in a buffer of PATH_MAX
+    @param len Length of path
+    @param level Depth of the directory, 0 for the top
+    @param tc Counts of the tree so far
+    @return false if an entry couldn't be made
+   */
+static bool make_dir(const BenchOpts *o, char *path, size_t len, int level,
+                     TreeCounts *tc) {
+    char *name = path + len;
+    char first[LONG_NAME_LEN + 16] = {'\0'};
+    for (int i = 0; i < o->files; i++) {
+        uint64_t r = rng_next(&tc->rng);
+        bool hidden = (int)(r % 100) < o->hidden_pct;
+        bool long_name = (int)((r >> 8) % 100) < o->long_pct;
+        const char *ext = exts[(r >> 16) % EXT_CNT];
+        int n;
+        if ((r >> 24) % 50 == 0)
+            n = snprintf(name, PATH_MAX - len, "/%sREADME%d", hidden ? "." : "",
+                         i);
+        else
+            n = snprintf(name, PATH_MAX - len, "/%sf%03d%c%s",
+                         hidden ? "." : "", i, 'a' + (int)((r >> 32) % 6),
+                         ext);
+        if (long_name && len + n + LONG_NAME_LEN < PATH_MAX - 8) {
+            memset(name + n, 'x', LONG_NAME_LEN - n);
+            snprintf(name + LONG_NAME_LEN, 8, "%s", ext);
+        }
+        int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        // Sizes up to 8K, without writing any data
+        if (fd == -1 || ftruncate(fd, (r >> 40) % 8192) == -1) {
+            fprintf(stderr, "lf_bench: %s: %s\n", path, strerror(errno));
+            if (fd != -1)
+                close(fd);
+            return false;
+        }
+        close(fd);
+        tc->files++;
+        if (!first[0])
+            snprintf(first, sizeof(first), "%s", name + 1);
+    }
+    // A link to a file, and now and then a link back to the grandparent
+    if (first[0]) {
+        snprintf(name, PATH_MAX - len, "/link.c");
+        if (symlink(first, path) == 0)
+            tc->links++;
+    }
+    if (level >= 2 && tc->cycles < (size_t)o->cycles &&
+        tc->dirs_made % tc->cycle_stride == 0) {
+        snprintf(name, PATH_MAX - len, "/loop");
+        if (symlink("../..", path) == 0) {
+            tc->links++;
+            tc->cycles++;
+        }
+    }
+    if (level < o->depth) {
+        for (int i = 0; i < o->fanout; i++) {
+            uint64_t r = rng_next(&tc->rng);
+            int n = snprintf(name, PATH_MAX - len, "/%sd%02d",
+                             (int)(r % 100) < o->hidden_pct ? "." : "", i);
+            if (mkdir(path, 0755) == -1) {
+                fprintf(stderr, "lf_bench: %s: %s\n", path, strerror(errno));
+                return false;
+            }
+            tc->dirs++;
+            tc->dirs_made++;
+            if (!make_dir(o, path, len + n, level + 1, tc))
+                return false;
+        }
+    }
+    path[len] = '\0';
+    return true;
+}
+
+/** @brief nftw() callback removing an old tree */
+static int remove_entry(const char *path, const struct stat *st, int type,
+                        struct FTW *ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+/** @brief Run lf once with a configuration.
+    @param o Options
+    @param c Configuration
+    @param tree Directory to search
+    @param strace_out If not NULL, run lf under strace -f -c writing here
+    @param rr Receives the times, peak RSS and lines listed
+    @return false if lf couldn't be run or failed. An exit status of 1,
+   nothing found, is not a failure.
+   */
+static bool run_lf(const BenchOpts *o, const BenchConfig *c, const char *tree,
+                   const char *strace_out, RunResult *rr) {
+    char *argv[24];
+    int argc = 0;
+    if (strace_out) {
+        argv[argc++] = "strace";
+        argv[argc++] = "-f";
+        argv[argc++] = "-c";
+        argv[argc++] = "-o";
+        argv[argc++] = (char *)strace_out;
+    }
+    argv[argc++] = o->lf;
+    for (int a = 0; c->args[a]; a++)
+        argv[argc++] = (char *)c->args[a];
+    argv[argc++] = (char *)tree;
+    argv[argc] = NULL;
+
+    memset(rr, 0, sizeof(*rr));
+    int fds[2];
+    if (pipe(fds) == -1)
+        return false;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid_t pid = fork();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd != -1)
+            dup2(null_fd, STDERR_FILENO);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    // Reading the output as lf writes it, as a pipe to another program
+    // would, and counting the lines
+    char buf[65536];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0 ||
+           (n == -1 && errno == EINTR)) {
+        for (ssize_t i = 0; i < n; i++)
+            if (buf[i] == '\n')
+                rr->listed++;
+    }
+    close(fds[0]);
+    int wstatus;
+    struct rusage ru;
+    while (wait4(pid, &wstatus, 0, &ru) == -1) {
+        if (errno != EINTR)
+            return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    rr->wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    rr->user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    rr->sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    rr->max_rss_kb = ru.ru_maxrss;
+    rr->status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128;
+    return rr->status <= 1;
+}
+
+/** @brief Read the total number of calls from strace -c output. */
+static long strace_calls(const char *file) {
+    FILE *fp = fopen(file, "r");
+    if (!fp)
+        return -1;
+    char line[512];
+    long calls = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        // 100.00    0.011250           0     30612      1052 total
+        double pct, secs, usecs;
+        long n;
+        if (strstr(line, " total") &&
+            sscanf(line, "%lf %lf %lf %ld", &pct, &secs, &usecs, &n) == 4)
+            calls = n;
+    }
+    fclose(fp);
+    return calls;
+}
+
+/** @brief Tell whether a program is in PATH. */
+static bool in_path(const char *prog) {
+    const char *path = getenv("PATH");
+    char file[PATH_MAX];
+    while (path && *path) {
+        size_t len = strcspn(path, ":");
+        snprintf(file, sizeof(file), "%.*s/%s", (int)len, path, prog);
+        if (access(file, X_OK) == 0)
+            return true;
+        path += len;
+        if (*path == ':')
+            path++;
+    }
+    return false;
+}
+
+/** @brief Tell whether a configuration is in the --bench list. */
+static bool config_selected(const char *list, const char *name) {
+    size_t name_len = strlen(name);
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        if (len == name_len && strncmp(list, name, len) == 0)
+            return true;
+        list += len;
+        if (*list == ',')
+            list++;
+    }
+    return false;
+}
+
+/** @brief Empty the page, dentry and inode caches for a cold run. */
+static void drop_caches(void) {
+    static bool warned;
+    sync();
+    int fd = open("/proc/sys/vm/drop_caches", O_WRONLY);
+    if (fd == -1 || write(fd, "3", 1) != 1) {
+        if (!warned)
+            fprintf(stderr, "lf_bench: can't drop caches: %s\n",
+                    strerror(errno));
+        warned = true;
+    }
+    if (fd != -1)
+        close(fd);
+}
+
+/** @brief Print a JSON string. */
+static void json_str(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            putchar('\\');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
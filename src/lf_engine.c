@@ -0,0 +1,5352 @@
+/** NOTICE: This file is part of the lf project, which is currently under
+ * development. There are two reasons not to use it at this time. First,
+ * it is not yet fully functional and may contain bugs or incomplete,
+ * unoptimized code. Second, the API and features are still being finalized,
+ * so using it now may lead to compatibility issues in the future as changes
+ * are made. Once the project is more mature and stable, this file will be
+ * ready for use. In the meantime, it serves as a work in progress and may
+ * be subject to significant changes as development continues.
+ *
+ * Thank you for your patience and understanding.
+ */
+
+/** @file lf_engine.c
+    @brief lf search engine: option parsing, directory traversal, filters
+   and output, shared by the lf command and in-process providers such as
+   pick. See lf.h.
+    @author Bill Waller
+    Copyright (c) 2025
+    MIT License
+    billxwaller@gmail.com
+    @date 2026-02-09
+ */
+#define _GNU_SOURCE
+#include "cm.h"
+#include "lf.h"
+#include <argp.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <grp.h>
+#include <linux/io_uring.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <poll.h>
+#include <pwd.h>
+#include <regex.h>
+#include <semaphore.h>
+#include <spawn.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <sys/sysmacros.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define print_file_type(mask, lf_type, dt_type, name)           \
+    {                                                           \
+        fprintf(errout, "%c %08b (%3d) %08b (%2d) %s\n",        \
+                (mask & lf_type) ? '*' : ' ', lf_type, lf_type, \
+                dt_type, dt_type, name);                        \
+    }
+
+static const char doc[] = "lf list files\vIf specified, DIRECTORY is the top-level "
+                   "directory to search. REGULAR_EXPRESSION is a properly "
+                   "formatted regular expression for which matching files "
+                   "will be listed.";
+static bool is_hidden(const char *);
+static bool is_dirsys(const char *);
+static char args_doc[] = "[DIRECTORY] [REGULAR_EXPRESSION]";
+
+#define DT_LNK_DIR 14
+static unsigned char const lf_mask[15] = {
+    0, 0b00000001, 0b00000010, 0, 0b00000100, 0, 0b00001000, 0, 0b00010000, 0,
+    0b00100000, 0, 0b01000000, 0, 0b10000000};
+
+/** Entry in the chain of directories leading to a TaskNode. Each node is
+ * immutable once created and shared by all subdirectories of the directory
+ * it describes, so enqueuing a subdirectory costs one node rather than a
+ * copy of the whole chain. */
+typedef struct History History;
+struct History {
+    History *parent; /**< Entry for the parent directory, NULL at the base */
+    atomic_int refs; /**< Child entries and TaskNodes referencing this */
+    dev_t dev;       /**< Device of this directory */
+    ino_t ino;       /**< Inode of this directory */
+    uint64_t chain;  /**< history_bit() of this entry and its ancestors */
+};
+
+/** Concurrent set of dev/ino pairs. The set is split into stripes, each
+ * an open-addressed table with its own lock, so threads inserting
+ * different inodes rarely contend. */
+#define INODE_STRIPES 64
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+} DevIno;
+typedef struct {
+    pthread_mutex_t lock;
+    DevIno *slots; /**< Open-addressed table, ino 0 marks an empty slot */
+    size_t cap;    /**< Number of slots, a power of two */
+    size_t cnt;    /**< Number of occupied slots */
+} InodeStripe;
+typedef struct {
+    InodeStripe stripe[INODE_STRIPES];
+} InodeSet;
+
+/** TaskNodes and History entries are allocated from per-thread bump
+ * arenas. Each chunk counts its outstanding allocations, plus one while
+ * its owning thread is still filling it, and is freed in one piece when
+ * the count reaches zero, whichever thread releases the last object. */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+typedef struct {
+    atomic_int live; /**< Outstanding allocations, +1 while being filled */
+    size_t used;     /**< Bytes used, including this header */
+} ArenaChunk;
+static _Thread_local ArenaChunk *arena_chunk;
+
+/** A single pattern from a .gitignore or .ignore file */
+typedef struct {
+    char *pattern; /**< fnmatch(3) pattern, leading '/' removed */
+    bool negate;   /**< "!pattern" re-includes a previously ignored entry */
+    bool dir_only; /**< "pattern/" matches directories only */
+    bool anchored; /**< pattern contains '/', match the relative path */
+} IgnoreRule;
+
+/** Ignore rules loaded from one directory, linked to the rules inherited
+ * from its ancestors. A list is shared by every TaskNode below the
+ * directory that defined it and freed when the last reference is dropped. */
+typedef struct IgnoreList IgnoreList;
+struct IgnoreList {
+    IgnoreList *parent;  /**< Rules inherited from ancestor directories */
+    atomic_int refs;     /**< TaskNodes and child lists referencing this */
+    size_t base_len;     /**< Length of "dir_path/" the rules are relative to */
+    int rule_cnt;        /**< Number of rules */
+    IgnoreRule *rules;   /**< Rules in file order, last match wins */
+};
+
+typedef struct TaskNode TaskNode;
+struct TaskNode {
+    History *history;    /**< This directory's entry in the ancestor chain */
+    TaskNode *next_task; /**< Pointer to the next node in the queue */
+    IgnoreList *ignore;  /**< Ignore rules in effect for this directory */
+    int depth;           /**< Current depth in the directory tree */
+    bool content;        /**< A file to search for --contains, not a dir */
+    bool slow;           /**< On a device found slow by --slow_dir */
+    char dir_path[];     /**< Directory path to process */
+}; /**< Queue TaskNode (for work-stealing) */
+
+/** Files searched by --contains are read into a per-thread buffer up to
+ * this size and mapped above it. At most CONTENT_MAX_OPEN are open at
+ * once, however many threads are searching. */
+#define CONTENT_READ_MAX (256 * 1024)
+#define CONTENT_MAX_OPEN 32
+#define CONTENT_BINARY_PEEK 8192
+static _Thread_local char *content_buf;
+static _Thread_local size_t content_buf_size;
+
+/** A directory being watched by --watch. Directories are watched with
+ * inotify, and polled every watch_interval seconds once the inotify watch
+ * limit is reached. */
+typedef struct {
+    char *path;              /**< Directory path, NULL once it is gone */
+    int depth;               /**< Depth in the directory tree */
+    int wd;                  /**< inotify watch descriptor, -1 if polled */
+    IgnoreList *ignore;      /**< Ignore rules inherited by the directory */
+    History *history;        /**< The directory's entry, for -L cycles */
+    struct timespec mtime;   /**< Directory mtime when last polled */
+    struct timespec checked; /**< When the directory was last polled */
+} WatchDir;
+
+/** Path selected for -x, queued for the launcher thread */
+typedef struct ExecItem ExecItem;
+struct ExecItem {
+    ExecItem *next;
+    char path[];
+};
+/** A command started by the launcher thread and not yet reaped */
+typedef struct {
+    pid_t pid;
+    int pidfd;  /**< Readable once the command ends, -1 if unsupported */
+    char *desc; /**< Path, or count of paths, for the exit status report */
+} ExecJob;
+/** Commands run for -x. Finder threads queue the selected paths and a
+ * single launcher thread spawns the commands, so no finder thread ever
+ * waits for a process to start. With "{} +" at the end of the command,
+ * paths are passed in batches as large as ARG_MAX allows; otherwise one
+ * command is run per path, with "{}" replaced by the path or, if there is
+ * no "{}", the path appended. Up to max_jobs commands run at once. */
+typedef struct {
+    char *argv[MAXARGS]; /**< Command template */
+    int argc;
+    bool batch;          /**< Command ended with "{} +" */
+    int max_jobs;        /**< Commands allowed to run at once */
+    size_t arg_max;      /**< Bytes of arguments allowed per command */
+    ExecJob *jobs;       /**< Running commands */
+    struct pollfd *pfds; /**< For waiting on the running commands */
+    int running;         /**< Number of running commands */
+    pthread_t thread;    /**< Launcher thread */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ExecItem *head;      /**< Paths waiting to be run */
+    ExecItem *tail;
+    bool round;          /**< A --watch round ended, run the partial batch */
+    bool done;           /**< No more paths will be queued */
+} ExecPool;
+/** Paths selected by a thread are passed to the launcher this many at a
+ * time, so that it isn't woken for every path */
+#define EXEC_FLUSH_ITEMS 64
+static _Thread_local ExecItem *exec_pending_head;
+static _Thread_local ExecItem *exec_pending_tail;
+static _Thread_local size_t exec_pending_cnt;
+
+/** Matches found by one thread for on_match, passed on when the batch is
+ * full and when the thread runs out of work */
+#define MATCH_BATCH_MAX 256
+#define MATCH_BATCH_BYTES (32 * 1024)
+typedef struct {
+    char *paths[MATCH_BATCH_MAX];
+    size_t cnt;
+    size_t used;                  /**< Bytes used in buf */
+    char buf[MATCH_BATCH_BYTES];
+} MatchBatch;
+static _Thread_local MatchBatch *match_batch;
+
+/** Devices found by --slow_dir to be slow. Entries are only ever added,
+ * each written before slow_dev_cnt is raised, so they are read without a
+ * lock. Directories on these devices wait in a queue of their own, which
+ * no more than half of the pool serves at once while other work is
+ * queued, so a stalled network file system can't hold up local ones. */
+#define SLOW_DEVS_MAX 64
+static dev_t slow_devs[SLOW_DEVS_MAX];
+static atomic_int slow_dev_cnt;
+static pthread_mutex_t slow_dev_mutex = PTHREAD_MUTEX_INITIALIZER;
+static TaskNode *slow_head;
+static TaskNode *slow_tail;
+static unsigned int slow_active;
+static _Thread_local bool on_slow_task;
+
+/** File system types from /proc/self/mountinfo, for --fs_type and
+ * --exclude_fs_type */
+typedef struct {
+    dev_t dev;
+    char *type;
+} MountEntry;
+static MountEntry *mounts;
+static size_t mount_cnt;
+
+/** Entries of a directory, read a batch at a time. With --io_uring the
+ * stat of every entry in the batch is requested at once, and the entries
+ * are visited as the results come in. Otherwise each entry is stated when
+ * it is visited. */
+#define STAT_BATCH 256
+#define STAT_PENDING 1 /**< res value of a stat not requested */
+typedef struct {
+    char *names;
+    size_t names_len;
+    size_t names_max;
+    size_t cnt;
+    uint32_t off[STAT_BATCH];    /**< Name of each entry in names */
+    int res[2][STAT_BATCH];      /**< Result of the lstat and the stat */
+    bool visited[STAT_BATCH];
+    struct statx stx[2][STAT_BATCH];
+} StatBatch;
+static _Thread_local StatBatch *stat_batch;
+
+/** An io_uring instance of a finder thread, set up with raw system calls.
+ * The kernel runs the statx requests in its own worker threads, so a few
+ * finders keep hundreds of them in flight on a cold cache. */
+typedef struct {
+    int fd;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} StatRing;
+static _Thread_local StatRing *stat_ring;
+static _Thread_local bool ring_failed;
+/** Set by lf_search() when --io_uring is given and the kernel allows it */
+static bool use_uring;
+
+/** Output of one thread. Records are added whole and the buffer is
+ * written with a single fwrite when it may not have room for another, so
+ * records from different threads never interleave. */
+#define OUT_BUF_SIZE (64 * 1024)
+#define OUT_RECORD_MAX (16 * 1024)
+typedef struct {
+    size_t len;
+    char buf[OUT_BUF_SIZE];
+} OutBuf;
+static _Thread_local OutBuf *out_buf;
+#define out_lit(o, s) out_add(o, s, sizeof(s) - 1)
+/** Set by lf_search() when --format or --json needs an entry's stat */
+static bool output_stat;
+
+/** Regular files gathered by --dupes. Each finder thread keeps its own
+ * list, which is added to dupe_files when the thread runs out of work.
+ * Only files whose size is shared are read and hashed. */
+#define DUPE_READ_SIZE (128 * 1024)
+typedef struct {
+    char *path;
+    off_t size;
+    uint64_t hash;
+    bool hashed; /**< The whole file was read */
+} DupeFile;
+typedef struct {
+    DupeFile *v;
+    size_t cnt;
+    size_t max;
+} DupeList;
+static DupeList dupe_files;
+static pthread_mutex_t dupe_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local DupeList dupe_local;
+static atomic_size_t dupe_next;
+
+/** Persistent index of a directory tree, written by --index and mapped
+ * read-only by --use_index. The file holds the header, the directory
+ * records sorted by path, the entry records, and a block of strings. A
+ * directory whose dev, inode and mtime still match its record is listed
+ * from the index; any other directory is read from disk. */
+#define INDEX_MAGIC "LFINDEX1"
+#define INDEX_VERSION 1
+typedef struct {
+    char magic[8];        /**< INDEX_MAGIC */
+    uint32_t version;     /**< INDEX_VERSION */
+    uint32_t dir_cnt;     /**< Number of directory records */
+    uint64_t entry_cnt;   /**< Number of entry records */
+    uint64_t strings_len; /**< Size of the string block */
+    uint64_t root_off;    /**< Real path of the indexed directory */
+    int64_t started;      /**< Time the scan that built the index began */
+} IndexHeader;
+typedef struct {
+    uint64_t path_off;    /**< Path relative to the base, "" for the base */
+    uint64_t names_off;   /**< Start of this directory's entry names */
+    uint64_t first_entry; /**< Index of the first entry record */
+    uint64_t dev;         /**< Device of the directory */
+    uint64_t ino;         /**< Inode of the directory */
+    int64_t mtime_sec;    /**< Modification time of the directory */
+    int64_t mtime_nsec;
+    uint32_t path_len;    /**< Length of the relative path */
+    uint32_t entry_cnt;   /**< Number of entries, excluding . and .. */
+} IndexDir;
+typedef struct {
+    uint32_t name_off;   /**< Offset of the name from the directory's names */
+    uint16_t name_len;   /**< Length of the name */
+    uint8_t type;        /**< DT_* type of the entry itself */
+    uint8_t target_type; /**< DT_* type of a link's target, 0 if dangling */
+} IndexEntry;
+
+/** An index file mapped for reading */
+typedef struct {
+    void *map;
+    size_t map_len;
+    const IndexHeader *hdr;
+    const IndexDir *dirs;
+    const IndexEntry *entries;
+    const char *strings;
+} LfIndex;
+
+/** Entries of one directory, collected by a finder thread while building
+ * an index and handed to the IndexBuilder when the directory is done. */
+typedef struct {
+    IndexEntry *ents;
+    size_t cnt;
+    size_t max;
+    char *names;
+    size_t names_len;
+    size_t names_max;
+} DirRecord;
+
+/** State of a directory being read, shared by its entries */
+typedef struct {
+    TaskNode *task;
+    IgnoreList *ignore;
+    char *full_path; /**< Directory path and '/', PATH_MAX + 1 */
+    size_t name_off; /**< Length of the directory path and '/' */
+    DirRecord *record;
+    const SearchFilters *f;
+} DirScan;
+
+/** Index being built, shared by all finder threads */
+typedef struct {
+    pthread_mutex_t lock;
+    IndexDir *dirs;
+    size_t dir_cnt;
+    size_t dir_max;
+    IndexEntry *entries;
+    size_t entry_cnt;
+    size_t entry_max;
+    char *strings;
+    size_t strings_len;
+    size_t strings_max;
+} IndexBuilder;
+
+// typedef struct { /** not used yet */
+//     TaskNode *qhead;
+//     TaskNode *qtail;
+// } TaskQueue;
+// ---------------------------------------------------------------
+//                              ╭───────────╮
+// ╭───────────╮     ╭──────────╯ dir_path  ╰───────────╮
+// │ TaskQueue ├─────┤ TaskNode   history ──▶ parent... │
+// ╰───────────╯     ╰──────────╮ depth     ╭───────────╯
+//                              │ next_task │
+//                              ╰───────────╯
+// ---------------------------------------------------------------
+static TaskNode *qhead = NULL;
+static TaskNode *qtail = NULL;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_var = PTHREAD_COND_INITIALIZER;
+static atomic_int active_tasks = 0;
+static InodeSet visited_dirs;
+/** Files listed so far, for --unique_inode */
+static InodeSet seen_files;
+static int index_mode = INDEX_OFF;
+static const char *index_file;
+static LfIndex *lf_index;
+static IndexBuilder *index_builder;
+static size_t index_base_len;
+static atomic_size_t index_hits = 0;
+static atomic_size_t index_rescans = 0;
+static sem_t content_slots;
+static WatchDir *watch_dirs;
+static size_t watch_cnt;
+static size_t watch_max;
+static int *watch_wd_map;
+static size_t watch_wd_map_size;
+static int watch_fd = -1;
+static pthread_mutex_t watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int shut_down = 0;
+
+/** Finder thread pool. With -T it has that many threads. Otherwise it
+ * starts small and pool_adapt(), run by lf_search() every POOL_TICK_MS,
+ * grows it while the queue holds work and the threads are blocked, so
+ * more threads mean more requests in flight, and shrinks it when the
+ * threads are CPU bound and outnumber the CPUs. Threads beyond
+ * pool_target park in dequeue_dir(). All pool fields are protected by
+ * queue_mutex. */
+#define POOL_TICK_MS 50
+#define POOL_MAX_THREADS 256
+typedef struct {
+    struct timespec wall; /**< Time of the last sample */
+    double cpu;           /**< Process CPU seconds at the last sample */
+    size_t entries;       /**< entries_read at the last sample */
+    double rate_before;   /**< Entries per second before the last growth */
+    unsigned int grew_from; /**< Pool size before the last growth, or 0 */
+    int hold;             /**< Ticks to wait before growing again */
+} PoolSample;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int pool_target; /**< Threads allowed to take tasks */
+static unsigned int pool_running; /**< Threads not parked */
+static unsigned int pool_peak;   /**< Largest pool_target of the search */
+static size_t queue_len;         /**< Tasks in both queues */
+/** Directory entries read, the pool's measure of throughput */
+static atomic_size_t entries_read;
+/** Set when the search should end early, because --max_results files have
+ * been listed, the output has been closed or lf_cancel() was called */
+static atomic_bool stop_search = false;
+/** Set when memory ran out, which ends the search and fails it */
+static atomic_bool search_failed = false;
+static atomic_size_t result_count = 0;
+/** Written by lf_cancel() to wake watch_tree() */
+static int stop_fd = -1;
+/** Serializes calls to on_match */
+static pthread_mutex_t match_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int termination_status = EXIT_SUCCESS;
+static int lfargc;
+static char *lfargs[3];
+static ExecPool exec_pool;
+/** Where diagnostics are written, see set_errout() */
+static FILE *errout;
+static FILE *null_out;
+static char *file_types_p;
+static char *perms_p;
+static char *debug_p;
+static size_t file_count = 0;
+static void debug_out(SearchFilters *, int, char **, unsigned int,
+                      unsigned int);
+static void stop_finders(void);
+static void no_memory(void);
+static void match_emit(const char *, const SearchFilters *);
+static void match_flush(const SearchFilters *);
+static void watch_free(void);
+static void enqueue_dir(TaskNode *);
+static TaskNode *dequeue_dir();
+static TaskNode *new_task(const char *, int, History *, const struct stat *,
+                          IgnoreList *);
+static TaskNode *new_content_task(const char *);
+static bool dev_slow(dev_t);
+static void slow_check(const TaskNode *, const struct timespec *,
+                       const SearchFilters *);
+static bool fs_type_listed(const char *, const char *);
+static bool cross_mount(const char *, dev_t, const SearchFilters *);
+static void load_mounts(void);
+static void free_mounts(void);
+static StatRing *ring_open(void);
+static void ring_close(StatRing *);
+static bool ring_statx(StatRing *, int, StatBatch *, int, DirScan *);
+static void ring_drain(StatRing *, unsigned);
+static int ring_enter(int, unsigned, unsigned, unsigned);
+static StatBatch *batch_new(void);
+static bool batch_fill(StatBatch *, DIR *);
+static void batch_fetch(StatBatch *, int, DirScan *);
+static int batch_stat(const StatBatch *, size_t, int, const char *,
+                      struct stat *);
+static void statx_to_stat(const struct statx *, struct stat *);
+static void read_entry(DirScan *, StatBatch *, size_t);
+static void free_task(TaskNode *);
+static void pool_adapt(PoolSample *, pthread_t *, unsigned int *,
+                       unsigned int, SearchFilters *);
+static double process_cpu(void);
+static void release_history(History *);
+static bool is_ancestor(const History *, const struct stat *,
+                        const SearchFilters *);
+static uint64_t history_bit(dev_t, ino_t);
+static void *arena_alloc(size_t);
+static void arena_free(void *);
+static void arena_retire(void);
+static void inode_set_init(InodeSet *);
+static bool inode_set_insert(InodeSet *, dev_t, ino_t);
+static uint64_t devino_hash(dev_t, ino_t);
+static void inode_set_free(InodeSet *);
+static void *finder(void *);
+static void visit_entry(TaskNode *, IgnoreList *, char *, const char *,
+                        size_t, size_t, struct stat *, bool, unsigned char,
+                        const SearchFilters *);
+static bool index_scan_dir(TaskNode *, const SearchFilters *, DirRecord *);
+static void watch_add(const TaskNode *, const SearchFilters *);
+static void watch_tree(SearchFilters *);
+static void watch_entry(WatchDir *, const char *, const SearchFilters *);
+static void watch_poll_dir(WatchDir *, const struct timespec *,
+                           const SearchFilters *);
+static bool file_writing(const char *, const struct stat *);
+static bool index_path(const char *, char *, size_t, char *);
+static LfIndex *index_open(const char *, const char *);
+static void index_close(LfIndex *);
+static const IndexDir *index_lookup(const LfIndex *, const char *, size_t);
+static bool index_dir_fresh(const LfIndex *, const IndexDir *,
+                            const struct stat *);
+static void dir_record_add(DirRecord *, const char *, size_t, unsigned char,
+                           unsigned char);
+static void index_add_dir(IndexBuilder *, const char *, const struct stat *,
+                          const DirRecord *);
+static bool index_write(IndexBuilder *, const char *, const char *, time_t);
+static bool prune_dir(char *, const SearchFilters *);
+static IgnoreList *load_ignore_files(int, const char *, IgnoreList *);
+static void release_ignore(IgnoreList *);
+static bool is_ignored(const IgnoreList *, const char *, const char *, bool);
+static int scan_file(char *, const SearchFilters *, const unsigned char,
+                     size_t, size_t, const struct stat *);
+static void dupe_add(const char *, const struct stat *, const SearchFilters *);
+static void dupe_merge(void);
+static void dupes_report(const SearchFilters *, unsigned int);
+static ssize_t dupe_fill(int, char *);
+static bool dupe_same(const char *, const char *, char *, char *);
+static bool content_match(const char *, const SearchFilters *);
+static void set_errout(const SearchFilters *);
+static bool exec_init(const SearchFilters *);
+static void exec_enqueue(const char *);
+static void exec_flush(void);
+static void exec_round(void);
+static void *exec_launcher(void *);
+static void exec_finish(void);
+static void list_file(char *, const SearchFilters *, const unsigned char,
+                      const struct stat *);
+static void out_flush(void);
+static void out_add(OutBuf *, const char *, size_t);
+static bool format_check(const char *);
+static bool format_stat(const char *);
+static void format_record(OutBuf *, const char *, const char *, unsigned char,
+                          const struct stat *);
+static void json_record(OutBuf *, const char *, unsigned char,
+                        const struct stat *);
+static void compile_prefilter(const char *, bool, Prefilter *);
+static void free_prefilter(Prefilter *);
+static void free_patterns(SearchFilters *, unsigned int);
+static int regex_match(const regex_t *, const Prefilter *, const char *,
+                       size_t);
+// ---------------------------------------------------------------
+
+/** Keys for options that have no short form */
+enum { OPT_NO_PREFILTER = 256, OPT_INDEX, OPT_USE_INDEX, OPT_CONTAINS,
+       OPT_WATCH, OPT_MAX_RESULTS, OPT_FIRST, OPT_UNIQUE_INODE, OPT_DUPES,
+       OPT_FORMAT, OPT_JSON, OPT_XDEV, OPT_FS_TYPE, OPT_EXCLUDE_FS_TYPE,
+       OPT_SLOW_DIR, OPT_IO_URING };
+
+/** Patterns lf_search() has compiled, see free_patterns() */
+enum { PAT_RE = 1, PAT_ERE = 2, PAT_PRUNE = 4, PAT_CONTAINS = 8 };
+
+static struct argp_option options[] = {
+    {"after", 'a', "time", 0, "Modified after YYYY-MM-DDTHH:MM:SS", 0},
+    {"before", 'b', "time", 0, "Modified before YYYY-MM-DDTHH:MM:SS", 0},
+    {"contains", OPT_CONTAINS, "regex", 0,
+     "List regular files with a line matching regex", 0},
+    {"basename", 'B', 0, 0, "Match regex against file name only", 0},
+    {"max_depth", 'd', "number", 0, "Depth into directory tree", 0},
+    {"ere", 'e', "regex", 0, "Exclude regular expression", 0},
+    {"exclude_dirs", 'E', 0, 0,
+     "Apply exclude regex to directories, pruning matches", 0},
+    {"ignore_files", 'g', 0, 0, "Honor .gitignore and .ignore files", 0},
+    {"ignore_case", 'i', 0, 0, "Search ignore case", 0},
+    {"include_perms", 'p', "sgrwx", 0,
+     "x-execute, w-write, r-read, s-setuid, g-setgid", 0},
+    {"re", 'r', "regex", 0, "Regular expression to search for", 0},
+    {"include_types", 't', "pcdbflsu", 0,
+     "p-pipe, c-character_dev, d-directory, b-block_dev, f-regular_file, l-link, s-socket, u-unknown",
+     0},
+    {"file_size_min", 's', "size", 0,
+     "No Suffix-bytes, K-kilobytes, M-Megabytes, or G-Gigabytes", 0},
+    {"user", 'u', "user name", 0, "User Name of file owner ", 0},
+    {"exec", 'x', "command", 0,
+     "Run command for each file, {} is the file, end with {} + to batch",
+     0},
+    {"jobs", 'P', "number", 0, "Run up to number commands at once", 0},
+    {"debug", 'D', "12345678", 0,
+     "1-config, 2-info, 3-warnings, 4-errors, 5-badlinks, 6-trace, 7-all, "
+     "8-only_errors",
+     0},
+    {"include_hidden", 'H', "o", 0, "Include hidden files (o=hidden only)", 0},
+    {"follow_links", 'L', 0, 0, "Follow symbolic links", 0},
+    {"prune", 'N', "regex", 0, "Don't descend into directories matching regex",
+     0},
+    {"sort_reverse", 'R', 0, 0, "Sort in Reverse order", 0},
+    {"sort", 'S', 0, 0, "Sort in Ascending order", 0},
+    {"nthreads", 'T', "threads", 0, "Number of nthreads", 0},
+    {"count", 'c', "s", 0, "Count (s only report count)", 0},
+    {"no_prefilter", OPT_NO_PREFILTER, 0, 0,
+     "Always use the regex engine (for benchmarking)", 0},
+    {"index", OPT_INDEX, "file", OPTION_ARG_OPTIONAL,
+     "Build or refresh the index of DIRECTORY and exit", 0},
+    {"use_index", OPT_USE_INDEX, "file", OPTION_ARG_OPTIONAL,
+     "List unchanged directories from the index", 0},
+    {"watch", OPT_WATCH, "seconds", OPTION_ARG_OPTIONAL,
+     "Keep running, listing new and changed files", 0},
+    {"max_results", OPT_MAX_RESULTS, "number", 0,
+     "Stop after listing number files", 0},
+    {"first", OPT_FIRST, 0, 0, "Stop after listing the first file", 0},
+    {"unique_inode", OPT_UNIQUE_INODE, 0, 0,
+     "List a file with several links under one name only", 0},
+    {"dupes", OPT_DUPES, 0, 0,
+     "List groups of regular files with the same contents", 0},
+    {"format", OPT_FORMAT, "format", 0,
+     "Print each file as format, with %p path, %s size, %t mtime...", 0},
+    {"json", OPT_JSON, 0, 0, "Print each file as a JSON object", 0},
+    {"null", '0', 0, 0, "End each file with NUL instead of newline", 0},
+    {"xdev", OPT_XDEV, 0, 0, "Don't descend into other file systems", 0},
+    {"fs_type", OPT_FS_TYPE, "types", 0,
+     "Only descend into mounted file systems of these types", 0},
+    {"exclude_fs_type", OPT_EXCLUDE_FS_TYPE, "types", 0,
+     "Don't descend into mounted file systems of these types", 0},
+    {"slow_dir", OPT_SLOW_DIR, "ms", 0,
+     "Put file systems that take longer than ms to read a directory last",
+     0},
+    {"io_uring", OPT_IO_URING, 0, 0,
+     "Stat the entries of each directory in batches with io_uring", 0},
+    {0}};
+
+/** @brief Parse a single option.  */
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    SearchFilters *f = state->input;
+    int i = 0;
+    bool a_toi_error = false;
+
+    switch (key) {
+    case 'a':
+        parse_local_timestamp(arg, &f->after);
+        if (f->after && f->before && f->before < f->after) {
+            fprintf(errout, "-b time must be greater than -a time.\n");
+            f->after = 0;
+        }
+        break;
+    case 'b':
+        parse_local_timestamp(arg, &f->before);
+        if (f->after && f->before && f->before < f->after) {
+            fprintf(errout, "-b time must be greater than -a time.\n");
+            f->before = 0;
+        }
+        break;
+    case 'B':
+        f->basename = true;
+        break;
+    case OPT_NO_PREFILTER:
+        f->no_prefilter = true;
+        break;
+    case OPT_WATCH:
+        f->watch = true;
+        f->watch_interval = 2;
+        if (arg && arg[0] != '\0')
+            f->watch_interval = a_toi(arg, &a_toi_error);
+        if (f->watch_interval < 1)
+            f->watch_interval = 1;
+        break;
+    case OPT_CONTAINS:
+        f->contains = strdup(arg);
+        break;
+    case OPT_MAX_RESULTS:
+        f->max_results = a_toi(arg, &a_toi_error);
+        break;
+    case OPT_FIRST:
+        f->max_results = 1;
+        break;
+    case OPT_UNIQUE_INODE:
+        f->unique_inode = true;
+        break;
+    case OPT_DUPES:
+        f->dupes = true;
+        break;
+    case OPT_FORMAT:
+        if (!format_check(arg))
+            return EINVAL;
+        free(f->format);
+        f->format = strdup(arg);
+        break;
+    case OPT_JSON:
+        f->json = true;
+        break;
+    case '0':
+        f->null_sep = true;
+        break;
+    case OPT_XDEV:
+        f->xdev = true;
+        break;
+    case OPT_FS_TYPE:
+        free(f->fs_types);
+        f->fs_types = strdup(arg);
+        break;
+    case OPT_EXCLUDE_FS_TYPE:
+        free(f->exclude_fs_types);
+        f->exclude_fs_types = strdup(arg);
+        break;
+    case OPT_SLOW_DIR:
+        f->slow_dir_ms = a_toi(arg, &a_toi_error);
+        break;
+    case OPT_IO_URING:
+        f->io_uring = true;
+        break;
+    case OPT_INDEX:
+    case OPT_USE_INDEX:
+        f->index_mode = key == OPT_INDEX ? INDEX_BUILD : INDEX_USE;
+        free(f->index_file);
+        f->index_file = arg && arg[0] != '\0' ? strdup(arg) : nullptr;
+        break;
+    case 'c':
+        f->count = true;
+        if (arg && arg[0] != '\0') {
+            if (strcmp(arg, "s") == 0)
+                f->count_silently |= true;
+        }
+        break;
+    case 'd':
+        if (arg && arg[0] != '\0')
+            f->max_depth = a_toi(arg, &a_toi_error);
+        break;
+    case 'D':
+        f->debug = true;
+        if (arg && arg[0] != '\0') {
+            debug_p = strdup(arg);
+            i = 0;
+            while (debug_p[i]) {
+                switch (debug_p[i]) {
+                case '1':
+                    f->report_config = true;
+                    break;
+                case '2':
+                    f->report_info = true;
+                    break;
+                case '3':
+                    f->report_warnings = true;
+                    break;
+                case '4':
+                    f->report_errors = true;
+                    break;
+                case '5':
+                    f->report_badlinks = true;
+                    break;
+                case '6':
+                    f->report_trace = true;
+                    break;
+                case '7':
+                    f->report_config = true;
+                    f->report_info = true;
+                    f->report_warnings = true;
+                    f->report_errors = true;
+                    f->report_badlinks = true;
+                    f->report_all = true;
+                    break;
+                case '8':
+                    f->only_errors = true;
+                    break;
+                default:
+                    break;
+                }
+                i++;
+            }
+            free(debug_p);
+        }
+        break;
+    case 'e':
+        f->ere = strdup(arg);
+        f->flags |= LF_EXC_REGEX;
+        break;
+    case 'E':
+        f->exclude_dirs = true;
+        break;
+    case 'g':
+        f->flags |= LF_IGNORE;
+        break;
+    case 'H':
+        f->include_hidden = true; // Include hidden files
+        if (arg && arg[0] == 'o') {
+            f->hidden_only = true;
+            f->include_hidden = true;
+        }
+        f->flags &= ~(LF_HIDE); // Turn hide flag off
+                                // LF_HIDE = 0 - include hidden files,
+                                // LF_HIDE = 1 - suppress hidden files
+        break;
+    case 'i':
+        f->flags |= LF_ICASE;
+        break;
+    case 'L':
+        f->follow_links = true; // follow symbolic links
+        break;
+    case 'N':
+        f->prune = strdup(arg);
+        f->flags |= LF_PRUNE;
+        break;
+    case 'p':
+        perms_p = arg;
+        while (perms_p[i]) {
+            switch (perms_p[i++]) {
+            case 'g':
+                f->include_perms |= LF_ISGID;
+                break;
+            case 'r':
+                f->include_perms |= LF_IRUSR;
+                break;
+            case 's':
+                f->include_perms |= LF_ISUID;
+                break;
+            case 'w':
+                f->include_perms |= LF_IWUSR;
+                break;
+            case 'x':
+                f->include_perms |= LF_IXUSR;
+                break;
+            default:
+                break;
+            }
+        }
+        break;
+    case 'R':
+        f->sort_reverse = true;
+        break;
+    case 'r':
+        f->re = strdup(arg);
+        f->flags |= LF_REGEX;
+        break;
+    case 'S':
+        f->sort = true;
+        break;
+    case 's':
+        f->file_size_min = (intmax_t)(a_to_ul(arg));
+        break;
+    case 'T':
+        if (arg && arg[0] != '\0')
+            f->nthreads = a_toi(arg, &a_toi_error);
+        break;
+    case 't':
+        file_types_p = arg;
+        while (file_types_p[i]) {
+            switch (file_types_p[i++]) {
+            case 'b':
+                f->include_types |= LF_BLK;
+                break;
+            case 'c':
+                f->include_types |= LF_CHR;
+                break;
+            case 'd':
+                f->include_types |= LF_DIR;
+                break;
+            case 'p':
+                f->include_types |= LF_FIFO;
+                break;
+            case 'l':
+                f->include_types |= LF_LNK;
+                break;
+            case 'f': // for regular files, 'f' is more intuitive than 'r'
+            case 'r': // regular files are the most common type, so 'r' is also
+                      // accepted
+                f->include_types |= LF_REG;
+                break;
+            case 's':
+                f->include_types |= LF_SOCK;
+                break;
+            case 'u':
+                f->include_types |= LF_UNKNOWN;
+                break;
+            default:
+                break;
+            }
+        }
+        break;
+    case 'u':
+        f->user_name = strdup(arg);
+        struct passwd *pwd = getpwnam(arg);
+        if (pwd) {
+            f->user_id = (uintmax_t)pwd->pw_uid;
+            f->flags |= LF_USER;
+        } else {
+            fprintf(errout, "User '%s' not found.\n", arg);
+            return EINVAL;
+        }
+        break;
+    case 'x':
+        f->exec = strdup(arg);
+        break;
+    case 'P':
+        f->max_jobs = a_toi(arg, &a_toi_error);
+        if (f->max_jobs <= 0)
+            f->max_jobs = get_nprocs();
+        break;
+    case ARGP_KEY_ARG:
+        if (state->arg_num == 0 || state->arg_num == 1) {
+            lfargs[state->arg_num] = arg;
+            lfargc = state->arg_num + 1;
+        } else {
+            argp_usage(state);
+        }
+        break;
+    case ARGP_KEY_END:
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+static struct argp argp = {options, parse_opt, args_doc, doc,
+                           nullptr, nullptr, nullptr};
+
+/** @brief Allocate a SearchFilters struct with the lf defaults.
+    @return The new struct, to be released with lf_free_filters()
+   */
+SearchFilters *lf_new_filters(void) {
+    SearchFilters *f = (SearchFilters *)calloc(1, sizeof(SearchFilters));
+    f->ignore_case = false;
+    f->sort = false;
+    f->sort_reverse = false;
+    f->include_hidden = false; // By default, hidden files are suppressed. Use
+                               // -H to include them.
+    // LF_HIDE = 0 - include hidden files,
+    // LF_HIDE = 1 - suppress hidden files
+    f->hidden_only = false;
+    f->flags |= LF_HIDE;     // Turn hide flag on
+    f->follow_links = false; // By default, symbolic links are not followed. Use
+                             // -L to follow them.
+    f->count = false;
+    f->count_silently = false;
+    set_errout(f);
+    return f;
+}
+/** @brief Write diagnostics to stderr, or discard them if f->quiet is set,
+   as pick does while it owns the terminal.
+    @param f SearchFilters struct
+   */
+static void set_errout(const SearchFilters *f) {
+    if (f->quiet && !null_out)
+        null_out = fopen("/dev/null", "we");
+    errout = f->quiet && null_out ? null_out : stderr;
+}
+/** @brief Fill in a SearchFilters struct from lf command line arguments.
+    @param f SearchFilters struct from lf_new_filters()
+    @param argc Number of arguments
+    @param argv Arguments, argv[0] being the program name
+    @param argp_flags Flags for argp_parse(), such as ARGP_NO_EXIT when the
+   caller must not exit on --help or a usage error
+    @return true if the arguments are valid; otherwise a message has been
+   written to stderr, unless f->quiet is set
+   */
+bool lf_parse_args(SearchFilters *f, int argc, char **argv,
+                   unsigned int argp_flags) {
+    char tmp_str[PATH_MAX];
+    set_errout(f);
+    lfargc = 0;
+    if (argp_parse(&argp, argc, argv, argp_flags, 0, f) != 0)
+        return false;
+    if (lfargc > 0) {
+        strnz__cpy(tmp_str, lfargs[0], MAXLEN - 1);
+        expand_tilde(tmp_str, MAXLEN - 1);
+        if (is_directory(tmp_str) || is_symlink_to_dir(tmp_str)) {
+            f->base_path = strdup(tmp_str);
+        } else if (is_valid_regex(lfargs[0])) {
+            f->re = strdup(lfargs[0]);
+            f->flags |= LF_REGEX;
+        } else {
+            fprintf(
+                errout,
+                "lf: arg1: '%s' is neither a directory nor a valid regex.\n",
+                lfargs[0]);
+            return false;
+        }
+    }
+    if (lfargc > 1) {
+        if (!f->base_path || f->base_path[0] == '\0') {
+            strnz__cpy(tmp_str, lfargs[1], MAXLEN - 1);
+            expand_tilde(tmp_str, MAXLEN - 1);
+            if (is_directory(tmp_str) || is_symlink_to_dir(tmp_str))
+                f->base_path = strdup(tmp_str);
+        }
+        if ((!(f->flags & LF_REGEX)) && is_valid_regex(lfargs[1])) {
+            f->re = strdup(lfargs[1]);
+            f->flags |= LF_REGEX;
+        } else {
+            fprintf(errout,
+                    "lf: '%s' is neither a directory nor a valid regular "
+                    "expression.\n",
+                    lfargs[1]);
+            return false;
+        }
+    }
+    if (f->base_path == nullptr || f->base_path[0] == '\0')
+        f->base_path = strdup(".");
+    if (f->watch && f->index_mode == INDEX_BUILD)
+        f->watch = false;
+    if (f->exec && f->sort) {
+        // Matches are passed to the command, not printed
+        f->sort = false;
+    }
+    if (f->watch && f->sort) {
+        // sort can't write anything until its input ends
+        fprintf(errout, "lf: --watch output is not sorted\n");
+        f->sort = false;
+    }
+    if (f->dupes) {
+        // Links to one file are the same file, not duplicates
+        f->unique_inode = true;
+        // Groups are already in order, largest files first
+        f->sort = false;
+        if (f->watch) {
+            fprintf(errout, "lf: --dupes can't be used with --watch\n");
+            return false;
+        }
+    }
+    return true;
+}
+/** @brief Release a SearchFilters struct and the strings it holds.
+    @param f SearchFilters struct from lf_new_filters(), may be NULL
+   */
+void lf_free_filters(SearchFilters *f) {
+    if (!f)
+        return;
+    free(f->base_path);
+    free(f->user_name);
+    free(f->re);
+    free(f->ere);
+    free(f->prune);
+    free(f->contains);
+    free(f->exec);
+    free(f->index_file);
+    free(f->format);
+    free(f->fs_types);
+    free(f->exclude_fs_types);
+    free(f);
+}
+
+/** @brief Run a search based on the provided SearchFilters using finder
+   threads.
+    @param f A pointer to a SearchFilters struct containing the options and
+   flags for filtering.
+    @param argc The number of command-line arguments, for debug output.
+    @param argv The array of command-line argument strings.
+    @param found If not NULL, receives the number of files listed.
+    @return EXIT_SUCCESS, or EXIT_FAILURE if a pattern is invalid, a
+   directory couldn't be read, an index couldn't be written or a -x command
+   failed.
+    @details This function processes the flags and options specified in the
+   SearchFilters struct to set up the search criteria. It compiles any
+   regular expressions provided by the user and initializes the queue with
+   the base directory. It then creates a number of finder threads equal to
+   the number of CPU cores to perform the directory traversal and file
+   scanning concurrently. The function waits for all finder threads to
+   complete before cleaning up resources and returning. f itself is left
+   as it was, so the same search can be run again.
+   */
+int lf_search(SearchFilters *f, int argc, char **argv, size_t *found) {
+    set_errout(f);
+    file_count = 0;
+    atomic_store(&result_count, 0);
+    atomic_store(&stop_search, false);
+    atomic_store(&search_failed, false);
+    f->failed = false;
+    atomic_store(&active_tasks, 0);
+    atomic_store(&index_hits, 0);
+    atomic_store(&index_rescans, 0);
+    atomic_store(&slow_dev_cnt, 0);
+    slow_active = 0;
+    shut_down = 0;
+    termination_status = EXIT_SUCCESS;
+    output_stat = f->json || (f->format && format_stat(f->format));
+    index_mode = f->index_mode;
+    index_file = f->index_file;
+    if (found)
+        *found = 0;
+    /** suppress file types that aren't included */
+    if (!f->include_types)
+        f->include_types = 0xff;
+    if (f->include_types)
+        f->suppress_types = f->include_types ^ 0xff;
+    // LF_HIDE = 0 - include hidden files,
+    // LF_HIDE = 1 - suppress hidden files
+    f->include_hidden = !(f->flags & LF_HIDE);
+    int reti = 0;
+    unsigned int compiled = 0;
+    f->reg_flags = REG_EXTENDED;
+    if (f->flags & LF_ICASE)
+        f->reg_flags |= REG_ICASE;
+    if (f->flags & LF_REGEX) {
+        reti = regcomp(&f->compiled_re, f->re, f->reg_flags);
+        if (reti) {
+            fprintf(errout, "lf: '%s' Invalid pattern\n", f->re);
+            return EXIT_FAILURE;
+        }
+        compiled |= PAT_RE;
+    }
+    if (f->flags & LF_EXC_REGEX) {
+        reti = regcomp(&f->compiled_ere, f->ere, f->reg_flags);
+        if (reti) {
+            fprintf(errout, "lf: '%s' Invalid exclude pattern\n", f->ere);
+            free_patterns(f, compiled);
+            return EXIT_FAILURE;
+        }
+        compiled |= PAT_ERE;
+    }
+    if (!f->no_prefilter) {
+        if (f->flags & LF_REGEX)
+            compile_prefilter(f->re, f->flags & LF_ICASE, &f->re_pf);
+        if (f->flags & LF_EXC_REGEX)
+            compile_prefilter(f->ere, f->flags & LF_ICASE, &f->ere_pf);
+    }
+    if (f->flags & LF_PRUNE) {
+        reti = regcomp(&f->compiled_prune, f->prune, f->reg_flags);
+        if (reti) {
+            fprintf(errout, "lf: '%s' Invalid prune pattern\n", f->prune);
+            free_patterns(f, compiled);
+            return EXIT_FAILURE;
+        }
+        compiled |= PAT_PRUNE;
+    }
+    if (f->contains) {
+        // Lines are matched separately, as grep does: '.' and bracket
+        // expressions don't match a newline, and ^ and $ match at the
+        // start and end of each line.
+        reti = regcomp(&f->compiled_contains, f->contains,
+                       f->reg_flags | REG_NEWLINE);
+        if (reti) {
+            fprintf(errout, "lf: '%s' Invalid contains pattern\n",
+                    f->contains);
+            free_patterns(f, compiled);
+            return EXIT_FAILURE;
+        }
+        if (!f->no_prefilter)
+            compile_prefilter(f->contains, f->flags & LF_ICASE,
+                              &f->contains_pf);
+        sem_init(&content_slots, 0, CONTENT_MAX_OPEN);
+        compiled |= PAT_CONTAINS;
+    }
+    // -T sets the number of threads. Without it the pool adapts, starting
+    // with two to four threads and growing up to four per CPU, at least 8
+    // and at most 64, since threads blocked on a slow disk or NFS server
+    // cost little.
+    unsigned int nprocs = get_nprocs();
+    bool adaptive = f->nthreads == 0;
+    unsigned int nthreads = f->nthreads;
+    if (adaptive) {
+        nthreads = nprocs * 4;
+        if (nthreads < 8)
+            nthreads = 8;
+        if (nthreads > 64)
+            nthreads = 64;
+    } else if (nthreads > POOL_MAX_THREADS)
+        nthreads = POOL_MAX_THREADS;
+    pool_target = nthreads;
+    if (adaptive) {
+        pool_target = nprocs / 2;
+        if (pool_target < 2)
+            pool_target = 2;
+        if (pool_target > 4)
+            pool_target = 4;
+    }
+    pool_running = 0;
+    pool_peak = pool_target;
+    queue_len = 0;
+    atomic_store(&entries_read, 0);
+
+    //--------------------------------------------------------------------
+    // With --use_index, unchanged directories are listed from the index.
+    // --index also lists them from the previous index, if there is one,
+    // while recording every directory for the new one.
+    char idx_path[PATH_MAX] = {'\0'};
+    char idx_root[PATH_MAX];
+    time_t idx_started = time(NULL);
+    if (index_mode != INDEX_OFF) {
+        if (index_path(f->base_path, idx_path, sizeof(idx_path), idx_root)) {
+            lf_index = index_open(idx_path, idx_root);
+            if (!lf_index && index_mode == INDEX_USE)
+                fprintf(errout,
+                        "lf: no usable index '%s', searching without it\n",
+                        idx_path);
+            index_base_len = strlen(f->base_path);
+        } else {
+            fprintf(errout, "lf: cannot locate index for '%s'\n",
+                    f->base_path);
+            if (index_mode == INDEX_BUILD) {
+                free_patterns(f, compiled);
+                return EXIT_FAILURE;
+            }
+        }
+        if (index_mode == INDEX_BUILD) {
+            index_builder = calloc(1, sizeof(IndexBuilder));
+            pthread_mutex_init(&index_builder->lock, NULL);
+        }
+    }
+
+    debug_out(f, argc, argv, adaptive ? 0 : nthreads, nthreads);
+    if (idx_path[0] && f->debug && (f->report_config || f->report_info))
+        fprintf(errout, "%s index: %s%s\n\n",
+                index_mode == INDEX_BUILD ? "Build" : "Use", idx_path,
+                lf_index ? "" : " (not found)");
+    //--------------------------------------------------------------------
+    // Create and enqueue the first TaskNode, unless -D1 only reports the
+    // configuration
+    bool config_only = f->debug && f->report_config && !f->report_all;
+    struct stat st;
+    if (!config_only && stat(f->base_path, &st) == 0) {
+        if (!S_ISDIR(st.st_mode)) {
+            fprintf(errout,
+                    "Warning: Base path '%s' is not a directory. No "
+                    "files will be found.\n",
+                    f->base_path);
+        } else if (f->exec && !exec_init(f)) {
+            termination_status = EXIT_FAILURE;
+        } else {
+            if (f->follow_links) {
+                inode_set_init(&visited_dirs);
+                inode_set_insert(&visited_dirs, st.st_dev, st.st_ino);
+            }
+            if (f->unique_inode)
+                inode_set_init(&seen_files);
+            if (f->watch) {
+                watch_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+                stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            }
+            if (f->xdev || f->fs_types || f->exclude_fs_types)
+                load_mounts();
+            use_uring = false;
+            if (f->io_uring) {
+                // Each finder sets up its own ring; this one only checks
+                // that the kernel allows it
+                StatRing *ring = ring_open();
+                if (ring) {
+                    use_uring = true;
+                    ring_close(ring);
+                } else if (f->debug && (f->report_info || f->report_all))
+                    fprintf(errout, "IO_URING,unavailable,%s\n",
+                            strerror(errno));
+            }
+            enqueue_dir(new_task(f->base_path, 0, NULL, &st, NULL));
+            arena_retire();
+            pthread_t threads[nthreads];
+            unsigned int spawned = 0;
+            pthread_mutex_lock(&queue_mutex);
+            while (spawned < pool_target &&
+                   pthread_create(&threads[spawned], NULL, finder, f) == 0) {
+                spawned++;
+                pool_running++;
+            }
+            pool_target = spawned;
+            PoolSample sample = {0};
+            clock_gettime(CLOCK_MONOTONIC, &sample.wall);
+            sample.cpu = process_cpu();
+            while (!shut_down) {
+                if (!adaptive) {
+                    pthread_cond_wait(&pool_cond, &queue_mutex);
+                    continue;
+                }
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                deadline.tv_nsec += POOL_TICK_MS * 1000000L;
+                if (deadline.tv_nsec >= 1000000000L) {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000L;
+                }
+                if (pthread_cond_timedwait(&pool_cond, &queue_mutex,
+                                           &deadline) == ETIMEDOUT &&
+                    !shut_down)
+                    pool_adapt(&sample, threads, &spawned, nthreads, f);
+            }
+            pthread_mutex_unlock(&queue_mutex);
+            for (unsigned int i = 0; i < spawned; i++)
+                pthread_join(threads[i], NULL);
+            pool_running = 0;
+            f->threads_used = pool_peak;
+            if (f->debug && (f->report_info || f->report_all))
+                fprintf(errout, "THREADS,%u at most,%u at the end\n",
+                        pool_peak, pool_target);
+            if (f->watch) {
+                watch_tree(f);
+                watch_free();
+            }
+            if (f->dupes)
+                dupes_report(f, pool_target);
+            if (f->exec)
+                exec_finish();
+            if (f->follow_links)
+                inode_set_free(&visited_dirs);
+            if (f->unique_inode)
+                inode_set_free(&seen_files);
+            free_mounts();
+            // An index of a search cut short would hide what it missed
+            if (index_builder && !atomic_load(&search_failed) &&
+                !index_write(index_builder, idx_path, idx_root, idx_started))
+                termination_status = EXIT_FAILURE;
+            if (lf_index && f->debug && (f->report_info || f->report_all))
+                fprintf(errout, "INDEX,%zu directories from index,%zu read\n",
+                        atomic_load(&index_hits), atomic_load(&index_rescans));
+        }
+    }
+    //--------------------------------------------------------------------
+    // End Program
+    index_close(lf_index);
+    lf_index = NULL;
+    if (index_builder) {
+        pthread_mutex_destroy(&index_builder->lock);
+        free(index_builder->dirs);
+        free(index_builder->entries);
+        free(index_builder->strings);
+        free(index_builder);
+        index_builder = NULL;
+    }
+    index_file = NULL;
+    // Matches listed on this thread, as by dupes_report()
+    if (f->on_match)
+        match_flush(f);
+    free(match_batch);
+    match_batch = NULL;
+    out_flush();
+    free(out_buf);
+    out_buf = NULL;
+    free_patterns(f, compiled);
+    if (atomic_load(&search_failed)) {
+        f->failed = true;
+        termination_status = EXIT_FAILURE;
+    }
+    if (found)
+        *found = file_count;
+    return termination_status;
+}
+/** @brief Output debug information about the search filters and configuration.
+    @param f A pointer to a SearchFilters struct containing the options and
+   flags for filtering.
+    @param argc The number of command-line arguments.
+    @param argv The array of command-line argument strings.
+    @param threads The number of threads set by -T, 0 if the pool adapts.
+    @param limit The most threads the pool may have.
+    @details This function prints detailed information about the configuration and search filters as well as each of the options and arguments used on the command line invoking lf. The output is sent to the standard error stream, which can be redirected to standard output making it suitable as documentation for an audit trail.
+   */
+
+static void debug_out(SearchFilters *f, int argc, char **argv,
+                      unsigned int threads, unsigned int limit) {
+    char user_str[100];
+    char ip_str[MAXLEN];
+    int len = 0;
+    int i;
+    bool addspace_before = false;
+    if (f->debug && (f->report_config || f->report_info || f->report_all)) {
+        fprintf(errout, "%s,%s,%s,", get_local_timestamp(), get_user_str(user_str, 100), get_ip_addresses(ip_str, MAXLEN));
+        for (i = 0; i < argc; i++) {
+            len = len + strlen(argv[i]);
+            if (len > 72) {
+                fprintf(errout, "\n");
+                len = strlen(argv[i]);
+                addspace_before = false;
+            }
+            if (addspace_before) {
+                fprintf(errout, " ");
+                len++;
+            }
+            fprintf(errout, "%s", argv[i]);
+            addspace_before = true;
+        }
+        fprintf(errout, "\n\n");
+        fprintf(errout, "%s\n\n", CM_VERSION);
+        fprintf(errout, "lf debug      %s\n",
+                f->debug ? "true" : "     false");
+        fprintf(errout, "  1-config      %s\n",
+                f->report_config ? "true" : "|    false");
+        fprintf(errout, "  2-info        %s\n",
+                f->report_info ? "true" : "|    false");
+        fprintf(errout, "  3-warnings    %s\n",
+                f->report_warnings ? "true" : "|    false");
+        fprintf(errout, "  4-errors      %s\n",
+                f->report_errors ? "true" : "|    false");
+        fprintf(errout, "  5-badlinks    %s\n",
+                f->report_trace ? "true" : "|    false");
+        fprintf(errout, "  6-trace       %s\n",
+                f->report_trace ? "true" : "|    false");
+        fprintf(errout, "  7-all         %s\n",
+                f->report_all ? "true" : "|    false");
+        fprintf(errout, "  8-only_errors %s\n",
+                f->only_errors ? "true" : "|    false");
+        fprintf(errout, "\n");
+        fprintf(errout, "Count files: %s\n", f->count ? "true" : "false");
+        fprintf(errout, "Count only: %s\n", f->count_silently ? "true" : "false");
+        fprintf(errout, "\n");
+        fprintf(errout, "Search directory: %s\n\n", f->base_path);
+        if (f->max_depth == 0)
+            fprintf(errout, "Max depth 0 (unlimited)\n\n");
+        else
+            fprintf(errout, "Max depth %d\n\n", f->max_depth);
+        if (threads)
+            fprintf(errout, "Using %u threads\n\n", threads);
+        else
+            fprintf(errout, "Using %u to %u threads, adapting to the load\n\n",
+                    pool_target, limit);
+        fprintf(errout, "File types preceeded by an asterisk (\"*\") will be included:\n\n");
+        fprintf(errout, "  LF type        DT type\n");
+        print_file_type(f->include_types, LF_FIFO, DT_FIFO, "FIFO    p-named pipe");
+        print_file_type(f->include_types, LF_CHR, DT_CHR, "CHR     c-character device");
+        print_file_type(f->include_types, LF_DIR, DT_DIR, "DIR     d-directory");
+        print_file_type(f->include_types, LF_BLK, DT_BLK, "BLK     b-block device");
+        print_file_type(f->include_types, LF_REG, DT_REG, "REG     f-regular file");
+        print_file_type(f->include_types, LF_LNK, DT_LNK, "LINK    l-symbolic link");
+        print_file_type(f->include_types, LF_SOCK, DT_SOCK, "SOCK    s-socket");
+        print_file_type(f->include_types, LF_UNKNOWN, DT_UNKNOWN, "UNKNOWN u-unknown");
+        fprintf(errout, "\n");
+        fprintf(errout, "f->include_types  = %08b\n", f->include_types);
+        fprintf(errout, "f->suppress_types = %08b\n", f->suppress_types);
+        fprintf(errout, "\n");
+        if (f->flags & LF_USER)
+            fprintf(errout, "User: %s (%ju)\n", f->user_name, f->user_id);
+        if (f->include_perms) {
+            if (f->include_perms & LF_IXUSR)
+                fprintf(errout, "    %08b Execute\n", LF_IXUSR);
+            if (f->include_perms & LF_IWUSR)
+                fprintf(errout, "    %08b Write\n", LF_IWUSR);
+            if (f->include_perms & LF_IRUSR)
+                fprintf(errout, "    %08b Read\n", LF_IRUSR);
+            if (f->include_perms & LF_ISUID)
+                fprintf(errout, "    %08b SETUID\n", LF_ISUID);
+            if (f->include_perms & LF_ISGID)
+                fprintf(errout, "    %08b SETGID\n", LF_ISGID);
+        }
+        fprintf(errout, "\n");
+        static const char *const pf_names[] = {"none", "equal", "prefix",
+                                               "suffix", "contains"};
+        if (f->flags & LF_REGEX) {
+            fprintf(errout, "Include regex: %s%s\n", f->re,
+                    f->basename ? " (file name only)" : "");
+            fprintf(errout, "  prefilter: %s", pf_names[f->re_pf.type]);
+            for (i = 0; i < f->re_pf.lit_cnt; i++)
+                fprintf(errout, " \"%s\"", f->re_pf.lits[i]);
+            fprintf(errout, "%s\n\n",
+                    f->re_pf.exact ? " (regex engine not used)" : "");
+        }
+        if (f->flags & LF_EXC_REGEX)
+            fprintf(errout, "Exclude regex: %s%s\n\n", f->ere,
+                    f->exclude_dirs ? " (files and directories)" : "");
+        if (f->flags & LF_PRUNE)
+            fprintf(errout, "Prune regex: %s\n\n", f->prune);
+        if (f->contains) {
+            fprintf(errout, "Contains regex: %s\n", f->contains);
+            fprintf(errout, "  prefilter: %s", pf_names[f->contains_pf.type]);
+            for (i = 0; i < f->contains_pf.lit_cnt; i++)
+                fprintf(errout, " \"%s\"", f->contains_pf.lits[i]);
+            fprintf(errout, "\n\n");
+        }
+        if (f->flags & LF_IGNORE)
+            fprintf(errout, "Honor .gitignore and .ignore files.\n\n");
+
+        if (f->after) {
+            char buf[32];
+            format_local_timestamp(f->after, buf, sizeof(buf));
+            fprintf(errout, "Modified after: %s\n\n", buf);
+        }
+
+        if (f->before) {
+            char buf[32];
+            format_local_timestamp(f->before, buf, sizeof(buf));
+            fprintf(errout, "Modified before: %s\n\n", buf);
+        }
+
+        if (f->file_size_min) {
+            const char *units[] = {"b", "Kb", "Mb", "Gb", "Tb", "Pb", "Eb"};
+            off_t size = f->file_size_min;
+            i = 0;
+            while (size >= 1024 && i < 6) {
+                size /= 1024;
+                i++;
+            }
+            char buffer[32];
+            ssnprintf(buffer, 32, "%ld %s", size, units[i]);
+            fprintf(errout, "Minimum file size: %s\n\n", buffer);
+        }
+        if (f->max_depth)
+            fprintf(errout, "Max depth: %d\n\n", f->max_depth);
+        if (f->ignore_case)
+            fprintf(errout, "Ignore case in regex matching.\n\n");
+        if (f->include_hidden)
+            fprintf(errout, "Include hidden files.\n\n");
+        if (f->follow_links)
+            fprintf(errout, "Follow symbolic links.\n\n");
+        if (f->sort)
+            fprintf(errout, "Sort output in ascending order.\n\n");
+        if (f->sort_reverse)
+            fprintf(errout, "Sort output in reverse order.\n\n");
+    }
+    return;
+}
+/** @brief Report that memory ran out, once, and end the search, which
+   lf_search() then fails. Called without the queue lock held.
+   */
+static void no_memory(void) {
+    if (!atomic_exchange(&search_failed, true))
+        fprintf(errout, "lf: out of memory\n");
+    stop_finders();
+}
+/** @brief End the search early.
+    @details Called when --max_results files have been listed or the
+   output has been closed. Queued directories are discarded, finder
+   threads stop reading at the next entry, and anything they find after
+   this is dropped by enqueue_dir(). Setting shut_down releases the waiting
+   threads and init_find().
+   */
+static void stop_finders(void) {
+    atomic_store(&stop_search, true);
+    pthread_mutex_lock(&queue_mutex);
+    TaskNode *task = qhead;
+    TaskNode *slow = slow_head;
+    qhead = qtail = NULL;
+    slow_head = slow_tail = NULL;
+    queue_len = 0;
+    shut_down = 1;
+    pthread_cond_broadcast(&cond_var);
+    pthread_cond_broadcast(&pool_cond);
+    pthread_mutex_unlock(&queue_mutex);
+    while (task || slow) {
+        if (!task) {
+            task = slow;
+            slow = NULL;
+        }
+        TaskNode *next = task->next_task;
+        free_task(task);
+        task = next;
+    }
+}
+/** @brief Cancel the running search, from any thread, including from
+   on_match. lf_search() returns once the finder threads have stopped and,
+   with -x, the commands already queued have run.
+   */
+void lf_cancel(void) {
+    stop_finders();
+    if (stop_fd != -1)
+        eventfd_write(stop_fd, 1);
+}
+/** @brief Enqueue a directory dir_path for processing by finder threads.
+    @param new_task A pointer to a TaskNode containing the directory path
+ and depth to be enqueued for processing by finder threads.
+    @details This function adds a new TaskNode to the global queue of
+ directories to be processed by finder threads.
+ // It uses a mutex to ensure thread-safe access to the queue and signals
+ one waiting thread that a new task is available.
+ // If shut_down has been initiated, the signal will wake up any waiting
+ threads so they can check the shut_down condition and exit gracefully.
+   */
+static void enqueue_dir(TaskNode *new_task) {
+    // NULL if memory ran out, which has ended the search
+    if (!new_task)
+        return;
+    if (atomic_load_explicit(&stop_search, memory_order_relaxed)) {
+        free_task(new_task);
+        return;
+    }
+    pthread_mutex_lock(&queue_mutex);
+    if (new_task->slow) {
+        if (slow_tail)
+            slow_tail->next_task = new_task;
+        else
+            slow_head = new_task;
+        slow_tail = new_task;
+    } else {
+        if (qtail)
+            // Add the new task to the end of the queue. If qtail is not
+            // NULL, it means there are already tasks in the queue, so we
+            // set the next_task pointer of the current tail to point to the
+            // new task. This effectively adds the new task to the end of
+            // the queue.
+            qtail->next_task = new_task;
+        else
+            // If qtail is NULL, it means the queue is currently empty, so
+            // we set qhead to point to the new task, making it the first
+            // and only task in the queue
+            qhead = new_task;
+        // Finally, we update qtail to point to the new task, ensuring that
+        // it always points to the last task in the queue.
+        qtail = new_task;
+    }
+    queue_len++;
+    // Signal one waiting thread that a new task is available. If shut_down
+    // hasn't been initiated, this will wake up a finder thread to process
+    // the new task. If shut_down has been initiated, the signal will wake up
+    // any waiting threads so they can check the shut_down condition and exit
+    // gracefully.
+    pthread_cond_signal(&cond_var);
+    pthread_mutex_unlock(&queue_mutex);
+}
+/** @brief Dequeue a directory dir_path for processing by finder threads.
+    @return A pointer to a TaskNode containing the directory dir_path and
+   depth, or NULL if the queue is empty and shut_down has been initiated.
+    @details This function removes and returns the next TaskNode from the
+   global queue. It uses a mutex to ensure thread-safe access to the queue,
+   and waits on a condition variable if the queue is empty. The function
+   also checks for shut_down conditions to allow finder threads to exit
+   gracefully when there is no more work to process.
+   */
+static TaskNode *dequeue_dir() {
+    pthread_mutex_lock(&queue_mutex);
+    // The task this thread had before is done
+    if (on_slow_task) {
+        on_slow_task = false;
+        slow_active--;
+    }
+    // Park while the pool is larger than pool_adapt() wants it
+    while (pool_running > pool_target && !shut_down) {
+        pool_running--;
+        pthread_cond_wait(&pool_cond, &queue_mutex);
+        pool_running++;
+    }
+
+    // Wait until there is a task in the queue or shut_down has been
+    // initiated. The loop condition checks if the queue is empty (qhead ==
+    // NULL) and if shut_down has not been initiated (!shut_down). If both
+    // conditions are true, it means there are no tasks to process and the
+    // thread should wait. The thread will be woken up when a new task is
+    // enqueued (via pthread_cond_signal in enqueue_dir) or when shut_down is
+    // initiated (via pthread_cond_broadcast in enqueue_dir or when
+    // active_tasks count reaches zero). This ensures that threads do not
+    // wait indefinitely when there are no tasks left to process and allows
+    // for a graceful shut_down of the program.
+    while (qhead == NULL && slow_head == NULL && !shut_down) {
+        // If there are no active tasks and the queue is empty, we can
+        // safely initiate shut_down. This check is necessary to prevent a
+        // potential race condition where a thread could be waiting
+        // indefinitely on the condition variable if all tasks have been
+        // completed and no new tasks will be enqueued. By checking the
+        // active_tasks count, we can determine when it's safe to signal
+        // shut_down
+        if (atomic_load(&active_tasks) == 0) {
+            shut_down = 1;
+            // and wake up any waiting threads so they can exit gracefully.
+            pthread_cond_broadcast(&cond_var);
+            pthread_cond_broadcast(&pool_cond);
+            break;
+        }
+        // Wait for a task to be enqueued or shut_down initiated. The thread
+        // will be woken up when a new task is added to the queue (via
+        // pthread_cond_signal in enqueue_dir) or when shut_down is initiated
+        // (via pthread_cond_broadcast in enqueue_dir or when active_tasks
+        // count reaches zero). This allows the thread to check the
+        // conditions again and either process a new task or exit if
+        // shut_down has been initiated.
+        pthread_cond_wait(&cond_var, &queue_mutex);
+    }
+    if (shut_down && qhead == NULL && slow_head == NULL) {
+        pthread_mutex_unlock(&queue_mutex);
+        return NULL;
+    }
+    // A directory on a slow device is taken when fewer than half of the
+    // pool is reading them, or when there is nothing else to do
+    if (slow_head && (slow_active < pool_target / 2 || !qhead)) {
+        TaskNode *temp = slow_head;
+        slow_head = slow_head->next_task;
+        if (!slow_head)
+            slow_tail = NULL;
+        slow_active++;
+        on_slow_task = true;
+        queue_len--;
+        atomic_fetch_add(&active_tasks, 1);
+        pthread_mutex_unlock(&queue_mutex);
+        return temp;
+    }
+    TaskNode *temp = qhead;
+    // Move the head pointer to the next task in the queue. If the queue
+    // becomes empty after this operation (qhead becomes NULL), we also set
+    // qtail to NULL to indicate that the queue is empty. This ensures that
+    // both qhead and qtail accurately reflect the state of the queue,
+    // preventing potential issues with enqueuing new tasks or checking for
+    // an empty queue in future operations.
+    qhead = qhead->next_task;
+    if (!qhead)
+        qtail = NULL;
+    queue_len--;
+    atomic_fetch_add(&active_tasks, 1);
+    pthread_mutex_unlock(&queue_mutex);
+    return temp;
+}
+/** @brief Resize the finder pool from the throughput and CPU use since
+   the last sample. Called by lf_search() with queue_mutex held.
+    @param sample Previous sample, replaced by this one
+    @param threads Finder threads, room for limit
+    @param spawned Threads created so far
+    @param limit Most threads the pool may have
+    @param f SearchFilters struct
+    @details busy is the CPU time used over the time the pool's threads,
+   up to one per CPU, could have run. Below 0.8, threads spend much of
+   their time blocked in I/O, and while the queue holds a task for every
+   thread, half again as many are let run. A growth that doesn't raise
+   the entries read per second by 5% is undone, and growing waits for
+   POOL_HOLD_TICKS. When busy is above 0.9 with more threads than CPUs,
+   the pool shrinks.
+   */
+#define POOL_HOLD_TICKS 10
+static void pool_adapt(PoolSample *sample, pthread_t *threads,
+                       unsigned int *spawned, unsigned int limit,
+                       SearchFilters *f) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double cpu = process_cpu();
+    size_t entries = atomic_load_explicit(&entries_read, memory_order_relaxed);
+    double dt = (now.tv_sec - sample->wall.tv_sec) +
+                (now.tv_nsec - sample->wall.tv_nsec) / 1e9;
+    if (dt <= 0)
+        return;
+    unsigned int nprocs = get_nprocs();
+    unsigned int cpus = pool_target < nprocs ? pool_target : nprocs;
+    double rate = (entries - sample->entries) / dt;
+    double busy = (cpu - sample->cpu) / (dt * cpus);
+    sample->wall = now;
+    sample->cpu = cpu;
+    sample->entries = entries;
+
+    unsigned int target = pool_target;
+    if (sample->grew_from) {
+        if (rate < sample->rate_before * 1.05) {
+            target = sample->grew_from;
+            sample->hold = POOL_HOLD_TICKS;
+        }
+        sample->grew_from = 0;
+    } else if (sample->hold > 0)
+        sample->hold--;
+    else if (queue_len >= pool_target && pool_target < limit &&
+             (pool_target < nprocs || busy < 0.8)) {
+        target = pool_target + (pool_target + 1) / 2;
+        if (target > limit)
+            target = limit;
+        sample->grew_from = pool_target;
+        sample->rate_before = rate;
+    } else if (busy > 0.9 && pool_target > nprocs)
+        target = pool_target - (pool_target + 3) / 4;
+    if (target == pool_target)
+        return;
+    if (f->debug && (f->report_info || f->report_all))
+        fprintf(errout, "THREADS,%u,%.0f entries/s,%.0f%% busy\n", target,
+                rate, busy * 100);
+    pool_target = target;
+    if (pool_target > pool_peak)
+        pool_peak = pool_target;
+    while (*spawned < pool_target) {
+        if (pthread_create(&threads[*spawned], NULL, finder, f) != 0) {
+            pool_target = *spawned;
+            break;
+        }
+        (*spawned)++;
+        pool_running++;
+    }
+    pthread_cond_broadcast(&pool_cond);
+}
+/** @brief CPU time used by the process, in seconds */
+static double process_cpu(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/** @brief Create a TaskNode for a directory.
+    @param dir_path Path of the directory
+    @param depth Depth of the directory in the tree
+    @param parent History entry of the parent directory, NULL for the base
+    @param st stat of the directory
+    @param ignore Ignore rules in effect for the directory, may be NULL
+    @return The new TaskNode, with the path stored inline, or NULL if memory
+   ran out
+    @details The node and its History entry come from the calling thread's
+   arena. The new entry links to the parent's, which is shared with the
+   directory's siblings, and both the parent entry and the ignore list gain
+   a reference.
+   */
+static TaskNode *new_task(const char *dir_path, int depth, History *parent,
+                          const struct stat *st, IgnoreList *ignore) {
+    size_t len = strlen(dir_path);
+    TaskNode *task = arena_alloc(sizeof(TaskNode) + len + 1);
+    History *h = task ? arena_alloc(sizeof(History)) : NULL;
+    if (!h) {
+        if (task)
+            arena_free(task);
+        return NULL;
+    }
+    memcpy(task->dir_path, dir_path, len + 1);
+    task->depth = depth;
+    task->content = false;
+    task->slow = false;
+    task->next_task = NULL;
+    task->ignore = ignore;
+    if (ignore)
+        atomic_fetch_add(&ignore->refs, 1);
+    h->parent = parent;
+    atomic_init(&h->refs, 1);
+    h->dev = st->st_dev;
+    h->ino = st->st_ino;
+    h->chain = history_bit(h->dev, h->ino);
+    if (parent) {
+        atomic_fetch_add(&parent->refs, 1);
+        h->chain |= parent->chain;
+    }
+    task->history = h;
+    return task;
+}
+/** @brief Create a TaskNode for a regular file to be searched for the
+   --contains pattern.
+    @param file_spec Path of the file
+    @return The new TaskNode, which has no history or ignore list, or NULL
+   if memory ran out
+    @details Queuing files, rather than searching them in the thread that
+   read their directory, spreads a directory of large files over all the
+   finder threads.
+   */
+static TaskNode *new_content_task(const char *file_spec) {
+    size_t len = strlen(file_spec);
+    TaskNode *task = arena_alloc(sizeof(TaskNode) + len + 1);
+    if (!task)
+        return NULL;
+    memcpy(task->dir_path, file_spec, len + 1);
+    task->depth = 0;
+    task->content = true;
+    task->slow = false;
+    task->next_task = NULL;
+    task->ignore = NULL;
+    task->history = NULL;
+    return task;
+}
+/** @brief Tell whether --slow_dir has found a device to be slow.
+    @param dev Device to look up
+    @return true if directories on dev go to the slow queue
+   */
+static bool dev_slow(dev_t dev) {
+    int cnt = atomic_load_explicit(&slow_dev_cnt, memory_order_acquire);
+    for (int i = 0; i < cnt; i++)
+        if (slow_devs[i] == dev)
+            return true;
+    return false;
+}
+/** @brief Mark the device of a directory slow if reading the directory
+   took longer than --slow_dir allows.
+    @param task Task of the directory just read
+    @param started When the directory was opened
+    @param f SearchFilters struct
+   */
+static void slow_check(const TaskNode *task, const struct timespec *started,
+                       const SearchFilters *f) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    long ms = (now.tv_sec - started->tv_sec) * 1000 +
+              (now.tv_nsec - started->tv_nsec) / 1000000;
+    dev_t dev = task->history->dev;
+    if (ms < f->slow_dir_ms || dev_slow(dev))
+        return;
+    pthread_mutex_lock(&slow_dev_mutex);
+    int cnt = atomic_load(&slow_dev_cnt);
+    if (cnt < SLOW_DEVS_MAX && !dev_slow(dev)) {
+        slow_devs[cnt] = dev;
+        atomic_store_explicit(&slow_dev_cnt, cnt + 1, memory_order_release);
+        if (f->debug && (f->report_info || f->report_all))
+            fprintf(errout, "SLOW_DIR,%s,%ld ms\n", task->dir_path, ms);
+    }
+    pthread_mutex_unlock(&slow_dev_mutex);
+}
+/** @brief Tell whether a type is in a comma separated list of
+   fnmatch(3) patterns, such as "nfs*,cifs,fuse.*".
+   */
+static bool fs_type_listed(const char *list, const char *type) {
+    char pat[64];
+    while (*list) {
+        size_t len = strcspn(list, ",");
+        if (len > 0 && len < sizeof(pat)) {
+            memcpy(pat, list, len);
+            pat[len] = '\0';
+            if (fnmatch(pat, type, 0) == 0)
+                return true;
+        }
+        list += len;
+        if (*list == ',')
+            list++;
+    }
+    return false;
+}
+/** @brief Decide whether to descend into a directory on another device
+   than its parent, that is, a mount point.
+    @param path Path of the directory
+    @param dev Device of the directory
+    @param f SearchFilters struct
+    @return false if --xdev is given, or the file system's type is not
+   allowed by --fs_type and --exclude_fs_type. Skipped mount points are
+   reported with -D2. The directory itself is still listed, as find -xdev
+   does.
+   */
+static bool cross_mount(const char *path, dev_t dev, const SearchFilters *f) {
+    if (!f->xdev && !f->fs_types && !f->exclude_fs_types)
+        return true;
+    const char *type = NULL;
+    for (size_t i = 0; i < mount_cnt; i++) {
+        if (mounts[i].dev == dev) {
+            type = mounts[i].type;
+            break;
+        }
+    }
+    // A device missing from the mount table can't be judged by type
+    bool allowed = !f->xdev;
+    if (allowed && type) {
+        if (f->fs_types && !fs_type_listed(f->fs_types, type))
+            allowed = false;
+        if (f->exclude_fs_types && fs_type_listed(f->exclude_fs_types, type))
+            allowed = false;
+    }
+    if (!allowed && f->debug && (f->report_info || f->report_all))
+        fprintf(errout, "MOUNT_SKIPPED,%s,%s\n", path, type ? type : "");
+    return allowed;
+}
+/** @brief Load the device and file system type of each mount from
+   /proc/self/mountinfo.
+    @details A line reads "36 35 98:0 /mnt1 /mnt2 rw,noatime master:1 -
+   ext3 /dev/root rw,errors=continue", with the type after the " - "
+   separator. If the table can't be read, no mount point is judged by type.
+   */
+static void load_mounts(void) {
+    FILE *fp = fopen("/proc/self/mountinfo", "r");
+    if (!fp)
+        return;
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t alloc = 0;
+    while (getline(&line, &line_size, fp) != -1) {
+        unsigned int major, minor;
+        char type[64];
+        char *sep = strstr(line, " - ");
+        if (!sep || sscanf(line, "%*d %*d %u:%u", &major, &minor) != 2 ||
+            sscanf(sep + 3, "%63s", type) != 1)
+            continue;
+        if (mount_cnt == alloc) {
+            alloc = alloc ? alloc * 2 : 64;
+            MountEntry *grown = realloc(mounts, alloc * sizeof(MountEntry));
+            if (!grown)
+                break;
+            mounts = grown;
+        }
+        mounts[mount_cnt].dev = makedev(major, minor);
+        mounts[mount_cnt].type = strdup(type);
+        mount_cnt++;
+    }
+    free(line);
+    fclose(fp);
+}
+/** @brief Free the mount table. */
+static void free_mounts(void) {
+    for (size_t i = 0; i < mount_cnt; i++)
+        free(mounts[i].type);
+    free(mounts);
+    mounts = NULL;
+    mount_cnt = 0;
+}
+/** @brief Allocate a batch of directory entries.
+    @return The batch, or NULL if memory ran out, which ends the search
+   */
+static StatBatch *batch_new(void) {
+    StatBatch *batch = calloc(1, sizeof(StatBatch));
+    if (!batch)
+        no_memory();
+    return batch;
+}
+/** @brief Read the next batch of entries of a directory.
+    @param batch Batch to fill
+    @param dir Directory stream
+    @return false when the directory is exhausted or the search stopped
+   */
+static bool batch_fill(StatBatch *batch, DIR *dir) {
+    struct dirent *entry;
+    batch->cnt = 0;
+    batch->names_len = 0;
+    while (batch->cnt < STAT_BATCH && (entry = readdir(dir)) != NULL) {
+        if (atomic_load_explicit(&stop_search, memory_order_relaxed))
+            return false;
+        size_t len = strlen(entry->d_name) + 1;
+        if (batch->names_len + len > batch->names_max) {
+            size_t max = batch->names_max ? batch->names_max * 2 : 8192;
+            while (max < batch->names_len + len)
+                max *= 2;
+            char *names = realloc(batch->names, max);
+            if (!names)
+                break;
+            batch->names = names;
+            batch->names_max = max;
+        }
+        memcpy(batch->names + batch->names_len, entry->d_name, len);
+        size_t i = batch->cnt++;
+        batch->off[i] = batch->names_len;
+        batch->names_len += len;
+        batch->res[0][i] = STAT_PENDING;
+        batch->res[1][i] = STAT_PENDING;
+        batch->visited[i] = false;
+    }
+    return batch->cnt > 0;
+}
+/** @brief Get the stat of an entry in a batch.
+    @param batch Batch holding the entry
+    @param i Index of the entry
+    @param follow 0 for the entry itself, 1 for a link's target
+    @param path Path of the entry
+    @param st Receives the stat
+    @return 0, or -1 with errno set, as fstatat()
+   */
+static int batch_stat(const StatBatch *batch, size_t i, int follow,
+                      const char *path, struct stat *st) {
+    int res = batch->res[follow][i];
+    if (res == STAT_PENDING)
+        return fstatat(AT_FDCWD, path, st, follow ? 0 : AT_SYMLINK_NOFOLLOW);
+    if (res < 0) {
+        errno = -res;
+        return -1;
+    }
+    statx_to_stat(&batch->stx[follow][i], st);
+    return 0;
+}
+/** @brief Convert the result of a statx request to a struct stat. */
+static void statx_to_stat(const struct statx *stx, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    st->st_ino = stx->stx_ino;
+    st->st_mode = stx->stx_mode;
+    st->st_nlink = stx->stx_nlink;
+    st->st_uid = stx->stx_uid;
+    st->st_gid = stx->stx_gid;
+    st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+    st->st_size = stx->stx_size;
+    st->st_blksize = stx->stx_blksize;
+    st->st_blocks = stx->stx_blocks;
+    st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+    st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+/** @brief Stat a batch of entries with io_uring, visiting each entry as
+   its results arrive.
+    @param batch Batch of entries read from dir_fd
+    @param dir_fd Directory the entries are in
+    @param scan State of the directory being read
+    @details The entries are requested with AT_SYMLINK_NOFOLLOW, then the
+   targets of the symbolic links among them. If the ring fails, it is
+   given up for the rest of the search and the entries not yet visited
+   are stated with fstatat(). ring_statx() has drained the ring by then,
+   so the batch is kept for the rest of the directory.
+   */
+static void batch_fetch(StatBatch *batch, int dir_fd, DirScan *scan) {
+    if (ring_statx(stat_ring, dir_fd, batch, 0, scan) &&
+        ring_statx(stat_ring, dir_fd, batch, 1, scan))
+        return;
+    ring_close(stat_ring);
+    stat_ring = NULL;
+    ring_failed = true;
+    for (size_t i = 0; i < batch->cnt; i++) {
+        if (!batch->visited[i]) {
+            batch->res[0][i] = STAT_PENDING;
+            batch->res[1][i] = STAT_PENDING;
+            read_entry(scan, batch, i);
+        }
+    }
+}
+/** @brief Submit statx requests for a batch and visit the entries as they
+   complete.
+    @param ring io_uring of this thread
+    @param dir_fd Directory the entries are in
+    @param batch Batch of entries
+    @param follow 0 to stat every entry itself, 1 to stat the targets of
+   the entries found to be symbolic links
+    @param scan State of the directory being read
+    @return false if io_uring_enter failed, once the requests it had
+   taken are done
+   */
+static bool ring_statx(StatRing *ring, int dir_fd, StatBatch *batch,
+                       int follow, DirScan *scan) {
+    unsigned tail = *ring->sq_tail;
+    unsigned queued = 0;
+    for (size_t i = 0; i < batch->cnt; i++) {
+        if (follow && (batch->res[0][i] != 0 ||
+                       !S_ISLNK(batch->stx[0][i].stx_mode)))
+            continue;
+        unsigned idx = tail & ring->sq_mask;
+        struct io_uring_sqe *sqe = &ring->sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = dir_fd;
+        sqe->addr = (uintptr_t)(batch->names + batch->off[i]);
+        sqe->len = STATX_BASIC_STATS;
+        sqe->off = (uintptr_t)&batch->stx[follow][i];
+        sqe->statx_flags = AT_NO_AUTOMOUNT | (follow ? 0 : AT_SYMLINK_NOFOLLOW);
+        sqe->user_data = i;
+        ring->sq_array[idx] = idx;
+        tail++;
+        queued++;
+    }
+    atomic_store_explicit((_Atomic unsigned *)ring->sq_tail, tail,
+                          memory_order_release);
+    unsigned to_submit = queued;
+    while (queued > 0) {
+        int ret = lf_ring_enter(ring->fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                // Those not yet submitted stay in the submission queue
+                ring_drain(ring, queued - to_submit);
+                return false;
+            }
+            ret = 0;
+        }
+        to_submit -= ret;
+        unsigned head = *ring->cq_head;
+        unsigned ready = atomic_load_explicit(
+            (_Atomic unsigned *)ring->cq_tail, memory_order_acquire);
+        while (head != ready) {
+            const struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+            size_t i = cqe->user_data;
+            batch->res[follow][i] = cqe->res;
+            head++;
+            queued--;
+            // A link is visited when its target's stat arrives
+            if (follow || cqe->res < 0 || !S_ISLNK(batch->stx[0][i].stx_mode))
+                read_entry(scan, batch, i);
+        }
+        atomic_store_explicit((_Atomic unsigned *)ring->cq_head, head,
+                              memory_order_release);
+    }
+    return true;
+}
+/** @brief Wait for the requests still in flight on a ring that failed.
+    @param ring io_uring of this thread
+    @param pending Count of requests submitted and not yet completed
+    @details The kernel writes each result to the batch, so the batch may
+   not be reused, nor the ring closed, until they are all done. If
+   io_uring_enter keeps failing, the completion queue is polled.
+   */
+static void ring_drain(StatRing *ring, unsigned pending) {
+    while (pending > 0) {
+        if (lf_ring_enter(ring->fd, 0, pending, IORING_ENTER_GETEVENTS) < 0 &&
+            errno != EINTR)
+            nanosleep(&(struct timespec){.tv_nsec = 1000 * 1000}, NULL);
+        unsigned head = *ring->cq_head;
+        unsigned ready = atomic_load_explicit(
+            (_Atomic unsigned *)ring->cq_tail, memory_order_acquire);
+        pending -= ready - head;
+        atomic_store_explicit((_Atomic unsigned *)ring->cq_head, ready,
+                              memory_order_release);
+    }
+}
+/** @brief Enter an io_uring, as io_uring_enter(2) without a signal mask.
+    @details The default lf_ring_enter. */
+static int ring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                      unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+LfRingEnterFn lf_ring_enter = ring_enter;
+/** @brief Set up an io_uring for batched statx requests.
+    @return The ring, or NULL if the kernel doesn't allow io_uring or
+   doesn't support IORING_OP_STATX
+   */
+static StatRing *ring_open(void) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = syscall(__NR_io_uring_setup, STAT_BATCH, &p);
+    if (fd < 0)
+        return NULL;
+    size_t probe_size =
+        sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_size);
+    bool statx_ok =
+        probe &&
+        syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+                256) == 0 &&
+        probe->last_op >= IORING_OP_STATX &&
+        (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    StatRing *ring = statx_ok ? calloc(1, sizeof(StatRing)) : NULL;
+    if (!ring) {
+        close(fd);
+        errno = ENOTSUP;
+        return NULL;
+    }
+    ring->fd = fd;
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size =
+        p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && ring->cq_ring_size > ring->sq_ring_size)
+        ring->sq_ring_size = ring->cq_ring_size;
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cq_ring = single ? ring->sq_ring
+                           : mmap(NULL, ring->cq_ring_size,
+                                  PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, fd,
+                                  IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED ||
+        ring->sqes == MAP_FAILED) {
+        ring_close(ring);
+        return NULL;
+    }
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return ring;
+}
+/** @brief Unmap and close an io_uring set up by ring_open(). */
+static void ring_close(StatRing *ring) {
+    if (ring->sqes && ring->sqes != MAP_FAILED)
+        munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != MAP_FAILED &&
+        ring->cq_ring != ring->sq_ring)
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring && ring->sq_ring != MAP_FAILED)
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    close(ring->fd);
+    free(ring);
+}
+/** @brief Release a TaskNode and the resources it owns.
+    @param task A pointer to the TaskNode to be freed.
+    @details The history chain and ignore list are shared with sibling and
+   descendant tasks, so only this task's references to them are dropped.
+   */
+static void free_task(TaskNode *task) {
+    release_ignore(task->ignore);
+    release_history(task->history);
+    arena_free(task);
+}
+/** @brief Drop one reference to a History entry, releasing its ancestors
+   as their last references are dropped.
+    @param h The entry to release, may be NULL
+   */
+static void release_history(History *h) {
+    while (h && atomic_fetch_sub(&h->refs, 1) == 1) {
+        History *parent = h->parent;
+        arena_free(h);
+        h = parent;
+    }
+}
+/** @brief Check whether a directory is one of its own ancestors.
+    @param h History entry of the directory being read
+    @param st stat of the subdirectory found in it
+    @param f SearchFilters struct, for trace output
+    @return true if the subdirectory's dev/ino appears in the chain, which
+   means descending into it would loop
+    @details The chain is only walked if the subdirectory's bit is set in
+   the directory's chain mask, so most directories are cleared at once,
+   however deep they are.
+   */
+static bool is_ancestor(const History *h, const struct stat *st,
+                        const SearchFilters *f) {
+    bool trace = f->debug && (f->report_trace || f->report_all);
+    if (!trace && !(h->chain & history_bit(st->st_dev, st->st_ino)))
+        return false;
+    for (int i = 0; h; h = h->parent, i++) {
+        if (trace)
+            fprintf(errout, "%3d %ju %ju%s\n", i, h->ino, st->st_ino,
+                    h->ino == st->st_ino ? "<===========" : "");
+        if (h->dev == st->st_dev && h->ino == st->st_ino)
+            return true;
+    }
+    return false;
+}
+/** @brief The bit a directory sets in the chain masks of its History
+   entry and its descendants' entries. */
+static uint64_t history_bit(dev_t dev, ino_t ino) {
+    return 1ULL << (devino_hash(dev, ino) >> 58);
+}
+/** @brief Allocate memory from the calling thread's arena.
+    @param size Number of bytes, at most ARENA_CHUNK_SIZE less the header
+    @return Pointer to memory aligned for any type
+    @details Chunks are aligned to their own size, so arena_free() finds
+   the chunk header by masking the pointer.
+   */
+static void *arena_alloc(size_t size) {
+    const size_t align = alignof(max_align_t);
+    const size_t header = (sizeof(ArenaChunk) + align - 1) & ~(align - 1);
+    size = (size + align - 1) & ~(align - 1);
+    if (!arena_chunk || arena_chunk->used + size > ARENA_CHUNK_SIZE) {
+        arena_retire();
+        arena_chunk = aligned_alloc(ARENA_CHUNK_SIZE, ARENA_CHUNK_SIZE);
+        if (!arena_chunk) {
+            no_memory();
+            return NULL;
+        }
+        atomic_init(&arena_chunk->live, 1);
+        arena_chunk->used = header;
+    }
+    void *p = (char *)arena_chunk + arena_chunk->used;
+    arena_chunk->used += size;
+    atomic_fetch_add(&arena_chunk->live, 1);
+    return p;
+}
+/** @brief Release memory obtained from arena_alloc(), from any thread.
+    @param p Pointer returned by arena_alloc()
+   */
+static void arena_free(void *p) {
+    ArenaChunk *chunk =
+        (ArenaChunk *)((uintptr_t)p & ~(uintptr_t)(ARENA_CHUNK_SIZE - 1));
+    if (atomic_fetch_sub(&chunk->live, 1) == 1)
+        free(chunk);
+}
+/** @brief Stop allocating from the calling thread's current chunk, so it
+   can be freed once its objects are released. Called when a chunk fills
+   and when a thread is done allocating.
+   */
+static void arena_retire(void) {
+    if (arena_chunk) {
+        ArenaChunk *chunk = arena_chunk;
+        arena_chunk = NULL;
+        if (atomic_fetch_sub(&chunk->live, 1) == 1)
+            free(chunk);
+    }
+}
+/** @brief Initialize an empty InodeSet. */
+static void inode_set_init(InodeSet *set) {
+    for (int i = 0; i < INODE_STRIPES; i++) {
+        pthread_mutex_init(&set->stripe[i].lock, NULL);
+        set->stripe[i].cap = 64;
+        set->stripe[i].cnt = 0;
+        set->stripe[i].slots = calloc(64, sizeof(DevIno));
+    }
+}
+/** @brief Hash a dev/ino pair with the splitmix64 finalizer. The low bits
+   pick the stripe and the remaining bits the slot, so the two are
+   independent.
+   */
+static uint64_t devino_hash(dev_t dev, ino_t ino) {
+    uint64_t h = (uint64_t)ino ^ ((uint64_t)dev << 32 | (uint64_t)dev >> 32);
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+/** @brief Insert a dev/ino pair into an InodeSet.
+    @return true if the pair was inserted, false if it was already present
+   */
+static bool inode_set_insert(InodeSet *set, dev_t dev, ino_t ino) {
+    uint64_t h = devino_hash(dev, ino);
+    InodeStripe *s = &set->stripe[h % INODE_STRIPES];
+    h /= INODE_STRIPES;
+    pthread_mutex_lock(&s->lock);
+    if ((s->cnt + 1) * 10 > s->cap * 7) {
+        size_t cap = s->cap * 2;
+        DevIno *slots = calloc(cap, sizeof(DevIno));
+        for (size_t i = 0; i < s->cap; i++) {
+            if (s->slots[i].ino == 0)
+                continue;
+            uint64_t k = devino_hash(s->slots[i].dev, s->slots[i].ino);
+            size_t j = (k / INODE_STRIPES) & (cap - 1);
+            while (slots[j].ino != 0)
+                j = (j + 1) & (cap - 1);
+            slots[j] = s->slots[i];
+        }
+        free(s->slots);
+        s->slots = slots;
+        s->cap = cap;
+    }
+    size_t i = h & (s->cap - 1);
+    while (s->slots[i].ino != 0) {
+        if (s->slots[i].ino == ino && s->slots[i].dev == dev) {
+            pthread_mutex_unlock(&s->lock);
+            return false;
+        }
+        i = (i + 1) & (s->cap - 1);
+    }
+    s->slots[i].dev = dev;
+    s->slots[i].ino = ino;
+    s->cnt++;
+    pthread_mutex_unlock(&s->lock);
+    return true;
+}
+/** @brief Free the tables of an InodeSet. */
+static void inode_set_free(InodeSet *set) {
+    for (int i = 0; i < INODE_STRIPES; i++) {
+        free(set->stripe[i].slots);
+        pthread_mutex_destroy(&set->stripe[i].lock);
+    }
+}
+/** @brief Worker thread function to process directories from the queue.
+    @param arg Pointer to the SearchFilters struct containing the options
+   and flags for filtering.
+    @return NULL
+    @details This function continuously dequeues directory dir_path from the
+   global queue and processes them. For each directory, it lists its
+   contents and applies the specified filters to each file. If a
+   subdirectory is found and it meets the criteria for further searching
+   (e.g., not hidden if hidden files are suppressed, and within max depth),
+   it is enqueued for processing. The function uses atomic operations to
+   track active tasks and condition variables to manage thread
+   synchronization and shut_down when all work is complete.
+   */
+static void *finder(void *arg) {
+    SearchFilters *f = (SearchFilters *)arg;
+    DirRecord record = {0};
+    // regmatch_t pmatch;
+
+    while (1) {
+        TaskNode *current_task = dequeue_dir();
+        if (!current_task)
+            break;
+        record.cnt = 0;
+        record.names_len = 0;
+        if (current_task->content) {
+            if (content_match(current_task->dir_path, f)) {
+                if (f->dupes)
+                    dupe_add(current_task->dir_path, NULL, f);
+                else
+                    list_file(current_task->dir_path, f, DT_REG, NULL);
+            }
+            free_task(current_task);
+            atomic_fetch_sub(&active_tasks, 1);
+            continue;
+        }
+        if (f->watch)
+            watch_add(current_task, f);
+
+        //-------------------------------------------------------------
+        // A directory that hasn't changed since the index was built is
+        // listed from the index, without reading it or stating its
+        // entries.
+        if (lf_index && index_scan_dir(current_task, f, &record)) {
+            free_task(current_task);
+            atomic_fetch_sub(&active_tasks, 1);
+            continue;
+        }
+        //-------------------------------------------------------------
+        // Open the directory for reading. We use openat with AT_FDCWD to
+        // open the directory specified by current_task->dir_path, and then
+        // use fdopendir to get a DIR* stream for reading the directory
+        // entries. This approach allows us to handle directories with
+        // special characters in their names more robustly, as it avoids
+        // issues that can arise with functions like opendir that take a
+        // path string directly. If openat or fdopendir fails, we log the
+        // error (if debugging is enabled), clean up resources for the
+        // current task, and continue to the next iteration of the loop to
+        // process another task.
+        struct timespec started;
+        if (f->slow_dir_ms > 0)
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &started);
+        int dir_fd =
+            openat(AT_FDCWD, current_task->dir_path, O_RDONLY | O_DIRECTORY);
+        if (dir_fd == -1) {
+            if (f->debug && (f->report_warnings || f->report_errors ||
+                             f->report_badlinks || f->report_all))
+                fprintf(errout, "OPEN_FAIL,%s,%s\n", current_task->dir_path,
+                        strerror(errno));
+            termination_status = EXIT_FAILURE;
+            free_task(current_task);
+            atomic_fetch_sub(&active_tasks, 1);
+            pthread_cond_broadcast(&cond_var);
+            continue;
+        }
+        // The directory's own stat goes into the index, taken before
+        // reading so a change made during the scan leaves the record stale
+        struct stat dir_st;
+        if (index_builder && fstat(dir_fd, &dir_st) == -1) {
+            close(dir_fd);
+            termination_status = EXIT_FAILURE;
+            free_task(current_task);
+            atomic_fetch_sub(&active_tasks, 1);
+            pthread_cond_broadcast(&cond_var);
+            continue;
+        }
+        DIR *dir = fdopendir(dir_fd);
+        if (dir == NULL) {
+            if (f->debug && (f->report_warnings || f->report_errors ||
+                             f->report_badlinks || f->report_all))
+                fprintf(errout, "\nFDOPENDIR_FAIL,%s,%s\n",
+                        current_task->dir_path, strerror(errno));
+            close(dir_fd);
+            termination_status = EXIT_FAILURE;
+            free_task(current_task);
+            atomic_fetch_sub(&active_tasks, 1);
+            pthread_cond_broadcast(&cond_var);
+            continue;
+        }
+        if (lf_index)
+            atomic_fetch_add(&index_rescans, 1);
+        // Rules from .gitignore and .ignore in this directory are layered
+        // over the rules inherited from its ancestors. Each subdirectory
+        // enqueued below takes a reference to the resulting list.
+        IgnoreList *ignore = current_task->ignore;
+        if (f->flags & LF_IGNORE)
+            ignore = load_ignore_files(dir_fd, current_task->dir_path, ignore);
+        // unsigned char real_type;
+        //-------------------------------------------------------------
+        char full_path[PATH_MAX + 1] = {'\0'};
+        char *name_p = stpcpy(stpcpy(full_path, current_task->dir_path), "/");
+        DirScan scan = {current_task, ignore, full_path,
+                        (size_t)(name_p - full_path), &record, f};
+        if (!stat_batch)
+            stat_batch = batch_new();
+        if (use_uring && !stat_ring && !ring_failed) {
+            stat_ring = ring_open();
+            ring_failed = !stat_ring;
+        }
+        while (stat_batch && batch_fill(stat_batch, dir)) {
+            atomic_fetch_add_explicit(&entries_read, stat_batch->cnt,
+                                      memory_order_relaxed);
+            if (stat_ring)
+                batch_fetch(stat_batch, dirfd(dir), &scan);
+            else {
+                for (size_t i = 0; i < stat_batch->cnt; i++)
+                    read_entry(&scan, stat_batch, i);
+            }
+        }
+        closedir(dir);
+        if (f->slow_dir_ms > 0)
+            slow_check(current_task, &started, f);
+        if (index_builder) {
+            const char *rel = current_task->depth == 0
+                                  ? ""
+                                  : current_task->dir_path + index_base_len + 1;
+            index_add_dir(index_builder, rel, &dir_st, &record);
+        }
+        if (ignore != current_task->ignore)
+            release_ignore(ignore);
+        free_task(current_task);
+        atomic_fetch_sub(&active_tasks, 1);
+    }
+    free(record.ents);
+    free(record.names);
+    if (stat_batch) {
+        free(stat_batch->names);
+        free(stat_batch);
+        stat_batch = NULL;
+    }
+    if (stat_ring) {
+        ring_close(stat_ring);
+        stat_ring = NULL;
+    }
+    ring_failed = false;
+    free(content_buf);
+    content_buf = NULL;
+    if (f->exec)
+        exec_flush();
+    if (f->on_match) {
+        match_flush(f);
+        free(match_batch);
+        match_batch = NULL;
+    }
+    if (f->dupes)
+        dupe_merge();
+    out_flush();
+    free(out_buf);
+    out_buf = NULL;
+    arena_retire();
+    return NULL;
+}
+/** @brief Stat one entry of a directory and visit it.
+    @param scan State of the directory being read
+    @param batch Batch holding the entry
+    @param i Index of the entry in the batch
+    @details The stat results come from the batch when --io_uring has
+   fetched them, and from fstatat() otherwise.
+   */
+static void read_entry(DirScan *scan, StatBatch *batch, size_t i) {
+    const SearchFilters *f = scan->f;
+    char *full_path = scan->full_path;
+    size_t name_off = scan->name_off;
+    const char *name = batch->names + batch->off[i];
+    batch->visited[i] = true;
+    if (atomic_load_explicit(&stop_search, memory_order_relaxed))
+        return;
+    struct stat st;
+    size_t path_len = stpcpy(full_path + name_off, name) - full_path;
+    // Get link's metadata
+    int rc;
+    // We use fstatat with AT_SYMLINK_NOFOLLOW to get the metadata
+    // of the symbolic link itself, rather than the target it points
+    // to. This allows us to determine if the entry is a symbolic
+    // link and handle it according to the user's options (e.g.,
+    // whether to follow links or not). If fstatat fails, we log the
+    // error (if debugging is enabled) and continue to the next
+    // entry without processing this one further.
+    rc = batch_stat(batch, i, 0, full_path, &st);
+    if (rc == -1) {
+        if (f->debug && (f->report_errors || f->report_warnings ||
+                         f->report_badlinks || f->report_all))
+            fprintf(errout, "LSTAT_FAIL,%s,%s\n", full_path, strerror(errno));
+        termination_status = EXIT_FAILURE;
+        return;
+    }
+    unsigned char effective_type = (st.st_mode & S_IFMT) >> 12;
+    unsigned char lnk_type = effective_type;
+    // Determine the real type of the entry. If the entry is a
+    // symbolic link, we set real_type to DT_LNK and then attempt to
+    // get the metadata of the target it points to using fstatat
+    // without AT_SYMLINK_NOFOLLOW. This allows us to determine the
+    // effective type of the entry based on the target's metadata,
+    // which is important for deciding how to process it (e.g.,
+    // whether it's a directory that we should enqueue for further
+    // searching). If fstatat fails when trying to get the target's
+    // metadata, we log the error (if debugging is enabled) but
+    // continue processing the entry based on its symbolic link
+    // metadata.
+    if (S_ISLNK(st.st_mode)) {
+        // Get the target's metadata
+        rc = batch_stat(batch, i, 1, full_path, &st);
+        if (rc == -1) {
+            if (index_builder && !is_dirsys(name))
+                dir_record_add(scan->record, name, path_len - name_off,
+                               lnk_type, 0);
+            if (f->debug && (f->report_all || f->report_warnings ||
+                             f->report_errors || f->report_badlinks)) {
+                fprintf(errout, "STAT_FAIL,%s,%s\n", full_path,
+                        strerror(errno));
+            }
+            termination_status = EXIT_FAILURE;
+            return;
+        }
+        if (f->follow_links)
+            effective_type = (st.st_mode & S_IFMT) >> 12;
+    }
+    if (index_builder && !is_dirsys(name))
+        dir_record_add(scan->record, name, path_len - name_off, lnk_type,
+                       lnk_type == DT_LNK ? (st.st_mode & S_IFMT) >> 12 : 0);
+    visit_entry(scan->task, scan->ignore, full_path, name, name_off, path_len,
+                &st, true, effective_type, f);
+}
+/** @brief Apply the filters to one directory entry, enqueue it if it is a
+   directory to descend into, and list it if it is selected.
+    @param current_task Task of the directory being read
+    @param ignore Ignore rules in effect for the directory, may be NULL
+    @param full_path Path of the entry, in a buffer of PATH_MAX + 1
+    @param name Entry name (basename)
+    @param name_off Offset of the name in full_path
+    @param path_len Length of full_path
+    @param st stat of the entry, or of its target if it is a link
+    @param stated false if only st_dev and st_ino of a directory are set,
+   as for entries listed from the index. Otherwise st is passed on to
+   scan_file() so that the filters needn't stat the entry again.
+    @param effective_type DT_* type of the entry, or of its target when
+   links are followed
+    @param f SearchFilters struct
+   */
+static void visit_entry(TaskNode *current_task, IgnoreList *ignore,
+                        char *full_path, const char *name, size_t name_off,
+                        size_t path_len, struct stat *st, bool stated,
+                        unsigned char effective_type,
+                        const SearchFilters *f) {
+    if (effective_type != DT_DIR) {
+        if (is_hidden(name)) {
+            if (!f->include_hidden)
+                return;
+        } else if (f->hidden_only)
+            return;
+        if (ignore && is_ignored(ignore, full_path, name, false))
+            return;
+    } else {
+        if (is_dirsys(name))
+            return;
+        // Pruned and ignored directories are neither listed nor
+        // enqueued, so nothing beneath them is ever read.
+        if (ignore && is_ignored(ignore, full_path, name, true)) {
+            if (f->debug && (f->report_info || f->report_all))
+                fprintf(errout, "IGNORED,%s\n", full_path);
+            return;
+        }
+        if (prune_dir(full_path, f)) {
+            if (f->debug && (f->report_info || f->report_all))
+                fprintf(errout, "PRUNED,%s\n", full_path);
+            return;
+        }
+        // Determine the effective type of the entry. We use the st_mode
+        // field from the stat struct to determine the file type by
+        // applying the S_IFMT mask and shifting it to get a value that
+        // corresponds to the DT_* constants. If the entry is a symbolic
+        // link and the user has chosen not to follow links, we treat it
+        // as a directory for the purpose of deciding whether to enqueue
+        // it for further searching. This allows us to handle symbolic
+        // links that point to directories in a way that respects the
+        // user's options while still allowing for traversal of linked
+        // directories if desired.
+        //
+        // Check for cycles by comparing the current
+        // directory's dev/inode with the chain of dev/inode pairs
+        // of its ancestors. If a match is found, it indicates a
+        // cycle and we skip processing this directory.
+        //
+        // When following links, the same directory may be reached
+        // through any number of paths. Every directory is entered
+        // in the visited set, and the ancestor chain is only walked
+        // for a directory already seen, to tell a cycle from a
+        // duplicate. A duplicate is read again, so the paths listed
+        // don't depend on which thread reached it first, unless
+        // --unique_inode asks for each directory once.
+        bool cycle_found = false;
+        bool visited = false;
+        if (f->debug && (f->report_trace || f->report_all))
+            fprintf(errout, "Checking for cycles in: %s\n", full_path);
+        if (f->follow_links) {
+            visited = !inode_set_insert(&visited_dirs, st->st_dev, st->st_ino);
+            if (visited)
+                cycle_found = is_ancestor(current_task->history, st, f);
+        } else
+            cycle_found = is_ancestor(current_task->history, st, f);
+        if (cycle_found) {
+            if (f->debug && (f->report_warnings || f->report_errors ||
+                             f->report_trace || f->report_badlinks ||
+                             f->report_all)) {
+                char lnk_path[PATH_MAX];
+                ssize_t len = readlink(full_path, lnk_path, sizeof(lnk_path) - 1);
+                if (len != -1) {
+                    lnk_path[len] = '\0';
+                    fprintf(errout, "CYCLIC_LINK,%s,%s\n", full_path, lnk_path);
+                } else
+                    fprintf(errout, "CYCLIC_LINK,%s\n", full_path);
+            }
+            termination_status = EXIT_FAILURE;
+            return;
+        }
+        //-------------------------------------------------------
+        // Create a new TaskNode for the subdirectory and enqueue it
+        // for processing by finder threads. The child's history
+        // entry records the subdirectory's dev/inode and links to
+        // this directory's entry, which all of its subdirectories
+        // share. Following the links from any task leads back
+        // through its ancestors to the base directory, which is
+        // what cycle detection needs, without copying the chain.
+        if (f->max_depth != 0 && current_task->depth + 1 == f->max_depth)
+            return;
+        if (visited && f->unique_inode) {
+            // A duplicate path to a directory already read
+            if (f->debug && (f->report_info || f->report_all))
+                fprintf(errout, "VISITED,%s\n", full_path);
+        } else if (st->st_dev == current_task->history->dev ||
+                   cross_mount(full_path, st->st_dev, f)) {
+            TaskNode *task = new_task(full_path, current_task->depth + 1,
+                                      current_task->history, st, ignore);
+            if (task)
+                task->slow = f->slow_dir_ms > 0 && dev_slow(st->st_dev);
+            enqueue_dir(task);
+        }
+    }
+    if (f->hidden_only && !is_hidden(name))
+        return;
+    if (index_builder)
+        return;
+    scan_file(full_path, f, effective_type, name_off, path_len,
+              stated ? st : NULL);
+}
+/** @brief List a directory from the index if it hasn't changed since the
+   index was built.
+    @param current_task Task of the directory
+    @param f SearchFilters struct
+    @param record Buffer for the directory's entries when an index is being
+   built
+    @return true if the directory was listed from the index, false if it
+   must be read from disk
+    @details Entry types come from the index. Subdirectories take their
+   dev/inode from their own records, so no entry is stated unless it is a
+   directory missing from the index, or a symbolic link followed by -L,
+   whose target may have changed. Filters that need an entry's stat, such
+   as -s and -u, still stat it in scan_file().
+   */
+static bool index_scan_dir(TaskNode *current_task, const SearchFilters *f,
+                           DirRecord *record) {
+    const char *rel = current_task->depth == 0
+                          ? ""
+                          : current_task->dir_path + index_base_len + 1;
+    const IndexDir *idir = index_lookup(lf_index, rel, strlen(rel));
+    if (!idir)
+        return false;
+    struct stat dir_st;
+    int dir_fd = -1;
+    if (f->flags & LF_IGNORE) {
+        // The ignore files are still read, and fstat of the open
+        // directory serves for the freshness check
+        dir_fd = openat(AT_FDCWD, current_task->dir_path, O_RDONLY | O_DIRECTORY);
+        if (dir_fd == -1)
+            return false;
+        if (fstat(dir_fd, &dir_st) == -1) {
+            close(dir_fd);
+            return false;
+        }
+    } else if (stat(current_task->dir_path, &dir_st) == -1)
+        return false;
+    if (!index_dir_fresh(lf_index, idir, &dir_st)) {
+        if (dir_fd != -1)
+            close(dir_fd);
+        return false;
+    }
+    atomic_fetch_add(&index_hits, 1);
+    IgnoreList *ignore = current_task->ignore;
+    if (dir_fd != -1) {
+        ignore = load_ignore_files(dir_fd, current_task->dir_path, ignore);
+        close(dir_fd);
+    }
+    char full_path[PATH_MAX + 1] = {'\0'};
+    char *name_p = stpcpy(stpcpy(full_path, current_task->dir_path), "/");
+    size_t name_off = name_p - full_path;
+    const char *names = lf_index->strings + idir->names_off;
+    const IndexEntry *e = lf_index->entries + idir->first_entry;
+    for (uint32_t i = 0; i < idir->entry_cnt; i++, e++) {
+        if (name_off + e->name_len > PATH_MAX ||
+            idir->names_off + e->name_off + e->name_len >
+                lf_index->hdr->strings_len)
+            continue;
+        memcpy(name_p, names + e->name_off, e->name_len);
+        name_p[e->name_len] = '\0';
+        size_t path_len = name_off + e->name_len;
+        unsigned char effective_type = e->type;
+        unsigned char target_type = e->target_type;
+        struct stat st;
+        bool stated = false;
+        int err = ENOENT;
+        // A link's target may be replaced without changing the link's
+        // directory, so -L, which goes by the target, stats it again
+        if (e->type == DT_LNK && f->follow_links) {
+            stated = stat(full_path, &st) == 0;
+            target_type = stated ? (st.st_mode & S_IFMT) >> 12 : 0;
+            err = stated ? 0 : errno;
+        }
+        if (index_builder)
+            dir_record_add(record, name_p, e->name_len, e->type, target_type);
+        if (e->type == DT_LNK) {
+            if (target_type == 0) {
+                if (f->debug && (f->report_all || f->report_warnings ||
+                                 f->report_errors || f->report_badlinks))
+                    fprintf(errout, "STAT_FAIL,%s,%s\n", full_path,
+                            strerror(err));
+                termination_status = EXIT_FAILURE;
+                continue;
+            }
+            if (f->follow_links)
+                effective_type = target_type;
+        }
+        if (effective_type == DT_DIR && !is_dirsys(name_p) && !stated) {
+            size_t rel_len = path_len - index_base_len - 1;
+            const IndexDir *child =
+                index_lookup(lf_index, full_path + index_base_len + 1, rel_len);
+            if (child) {
+                st.st_dev = child->dev;
+                st.st_ino = child->ino;
+            } else if (stat(full_path, &st) == -1)
+                continue;
+        }
+        visit_entry(current_task, ignore, full_path, name_p, name_off,
+                    path_len, &st, stated, effective_type, f);
+    }
+    if (index_builder)
+        index_add_dir(index_builder, rel, &dir_st, record);
+    if (ignore != current_task->ignore)
+        release_ignore(ignore);
+    return true;
+}
+/** @brief Watch a directory that is about to be read.
+    @param task Task of the directory
+    @param f SearchFilters struct
+    @details The watch is added before the directory is read, so nothing
+   created after it was read is missed. Once inotify is out of watches,
+   the directory is polled instead.
+   */
+static void watch_add(const TaskNode *task, const SearchFilters *f) {
+    static bool warned = false;
+    int wd = -1;
+    if (watch_fd != -1)
+        wd = inotify_add_watch(watch_fd, task->dir_path,
+                               IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO |
+                                   IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF |
+                                   IN_ONLYDIR);
+    if (wd == -1 && watch_fd != -1 && errno != ENOSPC)
+        return; // Gone already, or not readable
+    pthread_mutex_lock(&watch_mutex);
+    if (watch_cnt == watch_max) {
+        size_t max = watch_max ? watch_max * 2 : 256;
+        WatchDir *dirs = realloc(watch_dirs, max * sizeof(WatchDir));
+        if (!dirs) {
+            pthread_mutex_unlock(&watch_mutex);
+            no_memory();
+            return;
+        }
+        watch_dirs = dirs;
+        watch_max = max;
+    }
+    if (wd != -1 && (size_t)wd >= watch_wd_map_size) {
+        size_t n = watch_wd_map_size ? watch_wd_map_size : 256;
+        while ((size_t)wd >= n)
+            n *= 2;
+        watch_wd_map = realloc(watch_wd_map, n * sizeof(int));
+        for (size_t i = watch_wd_map_size; i < n; i++)
+            watch_wd_map[i] = -1;
+        watch_wd_map_size = n;
+    }
+    if (wd == -1 && !warned) {
+        if (f->debug && (f->report_warnings || f->report_all))
+            fprintf(errout, "WATCH_LIMIT,%s,polling every %d seconds\n",
+                    task->dir_path, f->watch_interval);
+        warned = true;
+    }
+    if (wd != -1) {
+        // A directory reached again, e.g. after being moved, reuses its
+        // watch descriptor
+        if (watch_wd_map[wd] != -1) {
+            WatchDir *old = &watch_dirs[watch_wd_map[wd]];
+            free(old->path);
+            old->path = NULL;
+            release_ignore(old->ignore);
+            old->ignore = NULL;
+            release_history(old->history);
+            old->history = NULL;
+        }
+        watch_wd_map[wd] = watch_cnt;
+    }
+    WatchDir *w = &watch_dirs[watch_cnt++];
+    w->path = strdup(task->dir_path);
+    w->depth = task->depth;
+    w->wd = wd;
+    w->ignore = task->ignore;
+    if (w->ignore)
+        atomic_fetch_add(&w->ignore->refs, 1);
+    w->history = task->history;
+    atomic_fetch_add(&w->history->refs, 1);
+    // Taken before the directory is read, so a file created while it is
+    // being read is seen by the first poll
+    clock_gettime(CLOCK_REALTIME_COARSE, &w->checked);
+    w->mtime.tv_sec = 0;
+    w->mtime.tv_nsec = 0;
+    struct stat st;
+    if (wd == -1 && stat(w->path, &st) == 0)
+        w->mtime = st.st_mtim;
+    pthread_mutex_unlock(&watch_mutex);
+}
+/** @brief Stop watching a directory that has been removed or moved. */
+static void watch_drop(WatchDir *w) {
+    if (w->wd != -1) {
+        inotify_rm_watch(watch_fd, w->wd);
+        watch_wd_map[w->wd] = -1;
+    }
+    w->wd = -1;
+    free(w->path);
+    w->path = NULL;
+    release_ignore(w->ignore);
+    w->ignore = NULL;
+    release_history(w->history);
+    w->history = NULL;
+}
+/** @brief Process one new or changed entry of a watched directory.
+    @param w The directory
+    @param name Name of the entry
+    @param f SearchFilters struct
+    @details The entry goes through the same filters as during the scan.
+   A new subdirectory is queued, to be scanned by the caller, which also
+   watches it.
+   */
+static void watch_entry(WatchDir *w, const char *name, const SearchFilters *f) {
+    char full_path[PATH_MAX + 1];
+    char *name_p = stpcpy(stpcpy(full_path, w->path), "/");
+    size_t name_off = name_p - full_path;
+    if (name_off + strlen(name) > PATH_MAX)
+        return;
+    size_t path_len = stpcpy(name_p, name) - full_path;
+    struct stat st, dir_st;
+    if (stat(w->path, &dir_st) == -1 ||
+        fstatat(AT_FDCWD, full_path, &st, AT_SYMLINK_NOFOLLOW) == -1)
+        return;
+    unsigned char effective_type = (st.st_mode & S_IFMT) >> 12;
+    if (S_ISLNK(st.st_mode)) {
+        if (fstatat(AT_FDCWD, full_path, &st, 0) == -1)
+            return;
+        if (f->follow_links)
+            effective_type = (st.st_mode & S_IFMT) >> 12;
+    }
+    // A subdirectory whose attributes changed is already watched, and
+    // scanning it again would list everything beneath it
+    if (effective_type == DT_DIR) {
+        for (size_t i = 0; i < watch_cnt; i++)
+            if (watch_dirs[i].path && strcmp(watch_dirs[i].path, full_path) == 0)
+                return;
+    }
+    IgnoreList *ignore = w->ignore;
+    if (f->flags & LF_IGNORE) {
+        int dir_fd = open(w->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd != -1) {
+            ignore = load_ignore_files(dir_fd, w->path, ignore);
+            close(dir_fd);
+        }
+    }
+    // Chained as the scan chained it, so -L still finds cycles through
+    // the directory's ancestors
+    TaskNode *task = new_task(w->path, w->depth, w->history->parent, &dir_st,
+                              w->ignore);
+    if (task) {
+        visit_entry(task, ignore, full_path, name_p, name_off, path_len, &st,
+                    true, effective_type, f);
+        free_task(task);
+    }
+    if (ignore != w->ignore)
+        release_ignore(ignore);
+}
+/** @brief Look for new entries in a directory that isn't watched by
+   inotify.
+    @param w The directory
+    @param since Entries whose ctime is at or after this are new. Creating,
+   renaming or changing a file sets its ctime.
+    @param f SearchFilters struct
+    @details The directory is only read when its mtime has changed, or
+   after inotify events were lost, when mtime is cleared. The mtime of a
+   polled directory is recorded by watch_add() before it is first read.
+   */
+static void watch_poll_dir(WatchDir *w, const struct timespec *since,
+                           const SearchFilters *f) {
+    struct stat dir_st;
+    if (stat(w->path, &dir_st) == -1) {
+        watch_drop(w);
+        return;
+    }
+    if (dir_st.st_mtim.tv_sec == w->mtime.tv_sec &&
+        dir_st.st_mtim.tv_nsec == w->mtime.tv_nsec)
+        return;
+    w->mtime = dir_st.st_mtim;
+    DIR *dir = opendir(w->path);
+    if (!dir)
+        return;
+    char full_path[PATH_MAX + 1];
+    char *name_p = stpcpy(stpcpy(full_path, w->path), "/");
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (is_dirsys(entry->d_name) ||
+            name_p - full_path + strlen(entry->d_name) > PATH_MAX)
+            continue;
+        strcpy(name_p, entry->d_name);
+        struct stat st;
+        if (fstatat(AT_FDCWD, full_path, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+            (st.st_ctim.tv_sec > since->tv_sec ||
+             (st.st_ctim.tv_sec == since->tv_sec &&
+              st.st_ctim.tv_nsec >= since->tv_nsec)))
+            watch_entry(w, entry->d_name, f);
+    }
+    closedir(dir);
+}
+/** @brief Tell whether a new regular file may still be open for writing.
+    @param path Path of the file
+    @param st lstat of the file
+    @return true if an IN_CLOSE_WRITE event is still to come
+    @details A read lease is refused while any process has the file open
+   for writing. Where no lease can be taken, as on another user's file, an
+   empty file with a single link is taken to be still being written.
+   */
+static bool file_writing(const char *path, const struct stat *st) {
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+    if (fd != -1) {
+        int rc = fcntl(fd, F_SETLEASE, F_RDLCK);
+        int err = errno;
+        if (rc == 0)
+            fcntl(fd, F_SETLEASE, F_UNLCK);
+        close(fd);
+        if (rc == 0)
+            return false;
+        if (err == EAGAIN)
+            return true;
+    }
+    return st->st_nlink == 1 && st->st_size == 0;
+}
+/** @brief After the initial scan, keep listing new and changed entries.
+    @param f SearchFilters struct
+    @details Every directory read is watched with inotify, see watch_add().
+   Entries that are created, written, moved in or have their attributes
+   changed go through the same filters as during the scan, and new
+   subdirectories are scanned and watched in turn. Directories beyond the
+   inotify watch limit are polled every watch_interval seconds. Output is
+   flushed after each batch of events, so a reader such as pick sees new
+   entries as they arrive. Returns when no directories are left to watch.
+   */
+static void watch_tree(SearchFilters *f) {
+    alignas(struct inotify_event) char buf[16 * 1024];
+    const struct inotify_event *seen[sizeof(buf) / sizeof(struct inotify_event)];
+    struct timespec synced, last_poll;
+    clock_gettime(CLOCK_REALTIME_COARSE, &synced);
+    last_poll = synced;
+    fflush(stdout);
+    // The initial scan was the first round
+    if (f->exec)
+        exec_round();
+
+    while (1) {
+        size_t live = 0, polled = 0;
+        for (size_t i = 0; i < watch_cnt; i++) {
+            if (watch_dirs[i].path) {
+                live++;
+                if (watch_dirs[i].wd == -1)
+                    polled++;
+            }
+        }
+        if (live == 0 || atomic_load(&stop_search))
+            break;
+        // Standard output is polled too, so that lf ends as soon as a
+        // reader on a pipe goes away, rather than at the next file, and
+        // stop_fd so that lf_cancel() can end the watch
+        struct pollfd pfd[3] = {
+            {.fd = watch_fd, .events = POLLIN},
+            {.fd = f->on_match ? -1 : STDOUT_FILENO, .events = 0},
+            {.fd = stop_fd, .events = POLLIN}};
+        int rc = poll(pfd, 3, polled ? f->watch_interval * 1000 : -1);
+        if (rc == -1 && errno != EINTR)
+            break;
+        if (rc > 0 && ((pfd[1].revents & (POLLERR | POLLHUP)) ||
+                       (pfd[2].revents & POLLIN)))
+            break;
+        rc = rc > 0 && (pfd[0].revents & POLLIN);
+        bool overflow = false;
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME_COARSE, &now);
+        // Let the events of one operation, such as creating a file and
+        // setting its times, arrive together so they are coalesced
+        if (rc > 0)
+            nanosleep(&(struct timespec){.tv_nsec = 50 * 1000 * 1000}, NULL);
+        ssize_t len;
+        while (rc > 0 && (len = read(watch_fd, buf, sizeof(buf))) > 0) {
+            size_t seen_cnt = 0;
+            for (char *p = buf; p < buf + len;) {
+                struct inotify_event *ev = (struct inotify_event *)p;
+                p += sizeof(struct inotify_event) + ev->len;
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                    continue;
+                }
+                if (ev->wd < 0 || (size_t)ev->wd >= watch_wd_map_size ||
+                    watch_wd_map[ev->wd] == -1)
+                    continue;
+                WatchDir *w = &watch_dirs[watch_wd_map[ev->wd]];
+                if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                    watch_drop(w);
+                    continue;
+                }
+                if (ev->len == 0 || is_dirsys(ev->name))
+                    continue;
+                // A new file that is being written is listed when it is
+                // closed, not when it is created empty. One made by link()
+                // or mknod() has no writer, and only this event.
+                if ((ev->mask & IN_CREATE) && !(ev->mask & IN_ISDIR)) {
+                    struct stat st;
+                    char path[PATH_MAX + 1];
+                    ssnprintf(path, sizeof(path), "%s/%s", w->path, ev->name);
+                    if (lstat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+                        file_writing(path, &st))
+                        continue;
+                }
+                // Creating or saving a file raises several events; list
+                // it once per batch
+                size_t k;
+                for (k = 0; k < seen_cnt; k++)
+                    if (seen[k]->wd == ev->wd &&
+                        strcmp(seen[k]->name, ev->name) == 0)
+                        break;
+                if (k < seen_cnt)
+                    continue;
+                seen[seen_cnt++] = ev;
+                watch_entry(w, ev->name, f);
+            }
+        }
+        // Events were lost: look for entries changed since the last
+        // complete batch in every directory
+        if (overflow)
+            for (size_t i = 0; i < watch_cnt; i++)
+                if (watch_dirs[i].path && watch_dirs[i].wd != -1) {
+                    watch_dirs[i].mtime.tv_sec = -1;
+                    watch_poll_dir(&watch_dirs[i], &synced, f);
+                }
+        if (polled && now.tv_sec - last_poll.tv_sec >= f->watch_interval) {
+            for (size_t i = 0; i < watch_cnt; i++) {
+                WatchDir *w = &watch_dirs[i];
+                if (w->path && w->wd == -1) {
+                    struct timespec since = w->checked;
+                    w->checked = now;
+                    watch_poll_dir(w, &since, f);
+                }
+            }
+            last_poll = now;
+        }
+        // Scan, and watch, the subdirectories queued above
+        if (qhead || slow_head) {
+            shut_down = 0;
+            finder(f);
+        }
+        if (!overflow)
+            synced = now;
+        if (f->exec) {
+            exec_flush();
+            exec_round();
+        }
+        if (f->on_match)
+            match_flush(f);
+        out_flush();
+        fflush(stdout);
+    }
+}
+/** @brief Release the watched directories and close the watch descriptors,
+   so that another search can start from a clean state.
+   */
+static void watch_free(void) {
+    for (size_t i = 0; i < watch_cnt; i++) {
+        free(watch_dirs[i].path);
+        release_ignore(watch_dirs[i].ignore);
+        release_history(watch_dirs[i].history);
+    }
+    free(watch_dirs);
+    free(watch_wd_map);
+    watch_dirs = NULL;
+    watch_wd_map = NULL;
+    watch_cnt = watch_max = watch_wd_map_size = 0;
+    if (watch_fd != -1)
+        close(watch_fd);
+    if (stop_fd != -1)
+        close(stop_fd);
+    watch_fd = stop_fd = -1;
+}
+/** @brief Decide whether a directory should be pruned before descending.
+    @param dir_path Path of the directory. The buffer must have room for one
+   more character, as a trailing '/' is appended temporarily so that
+   patterns such as '/node_modules/' match the directory itself.
+    @param f SearchFilters struct
+    @return true if the directory matches the prune regex, or the exclude
+   regex when -E is in effect
+   */
+static bool prune_dir(char *dir_path, const SearchFilters *f) {
+    if (!(f->flags & LF_PRUNE) &&
+        !(f->exclude_dirs && (f->flags & LF_EXC_REGEX)))
+        return false;
+    bool pruned = false;
+    size_t len = strlen(dir_path);
+    dir_path[len] = '/';
+    dir_path[len + 1] = '\0';
+    if ((f->flags & LF_PRUNE) &&
+        regexec(&f->compiled_prune, dir_path, 0, nullptr, 0) == 0)
+        pruned = true;
+    else if (f->exclude_dirs && (f->flags & LF_EXC_REGEX) &&
+             regex_match(&f->compiled_ere, &f->ere_pf, dir_path, len + 1) == 0)
+        pruned = true;
+    dir_path[len] = '\0';
+    return pruned;
+}
+/** @brief Parse one line of a .gitignore or .ignore file into a rule.
+    @param line The line, with its newline removed
+    @param rule The rule to fill in
+    @return true if the line holds a pattern, false for blank lines and
+   comments
+    @details A subset of gitignore(5) is supported: '#' comments, '!'
+   negation, trailing '/' for directories only, and patterns containing '/'
+   anchored to the directory of the ignore file. A leading two-star
+   component matches in any directory, and patterns containing two
+   consecutive stars are matched without FNM_PATHNAME so the stars may
+   span directories.
+   */
+static bool parse_ignore_line(char *line, IgnoreRule *rule) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\r' ||
+                       (line[len - 1] == ' ' &&
+                        (len < 2 || line[len - 2] != '\\'))))
+        line[--len] = '\0';
+    if (len == 0 || line[0] == '#')
+        return false;
+    rule->negate = false;
+    rule->dir_only = false;
+    rule->anchored = false;
+    if (line[0] == '!') {
+        rule->negate = true;
+        line++;
+        len--;
+    } else if (line[0] == '\\' && (line[1] == '!' || line[1] == '#')) {
+        line++;
+        len--;
+    }
+    if (len > 0 && line[len - 1] == '/') {
+        rule->dir_only = true;
+        line[--len] = '\0';
+    }
+    while (strncmp(line, "**/", 3) == 0) {
+        line += 3;
+        len -= 3;
+    }
+    if (len == 0)
+        return false;
+    if (line[0] == '/') {
+        rule->anchored = true;
+        line++;
+    } else if (strchr(line, '/'))
+        rule->anchored = true;
+    rule->pattern = strdup(line);
+    return true;
+}
+/** @brief Load .gitignore and .ignore from a directory being scanned.
+    @param dir_fd Open descriptor of the directory
+    @param dir_path Path of the directory
+    @param parent Rules inherited from ancestor directories, or NULL
+    @return A new list linked to parent if the directory holds ignore rules,
+   otherwise parent itself
+    @details The returned list starts with one reference, owned by the
+   caller, and holds a reference to its parent.
+   */
+static IgnoreList *load_ignore_files(int dir_fd, const char *dir_path,
+                                     IgnoreList *parent) {
+    static const char *const names[] = {".gitignore", ".ignore"};
+    IgnoreList *list = NULL;
+    int rule_max = 0;
+    char *line = nullptr;
+    size_t line_len = 0;
+
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); n++) {
+        int fd = openat(dir_fd, names[n], O_RDONLY);
+        if (fd == -1)
+            continue;
+        FILE *fp = fdopen(fd, "r");
+        if (!fp) {
+            close(fd);
+            continue;
+        }
+        while (getline(&line, &line_len, fp) != -1) {
+            line[strcspn(line, "\n")] = '\0';
+            IgnoreRule rule;
+            if (!parse_ignore_line(line, &rule))
+                continue;
+            if (!list) {
+                list = calloc(1, sizeof(IgnoreList));
+                list->parent = parent;
+                atomic_init(&list->refs, 1);
+                list->base_len = strlen(dir_path) + 1;
+                if (parent)
+                    atomic_fetch_add(&parent->refs, 1);
+            }
+            if (list->rule_cnt == rule_max) {
+                rule_max = rule_max ? rule_max * 2 : 16;
+                list->rules = realloc(list->rules, rule_max * sizeof(IgnoreRule));
+            }
+            list->rules[list->rule_cnt++] = rule;
+        }
+        fclose(fp);
+    }
+    free(line);
+    return list ? list : parent;
+}
+/** @brief Drop one reference to an ignore list, freeing it and releasing
+   its parent when the last reference is gone.
+    @param list The list to release, may be NULL
+   */
+static void release_ignore(IgnoreList *list) {
+    while (list && atomic_fetch_sub(&list->refs, 1) == 1) {
+        IgnoreList *parent = list->parent;
+        for (int i = 0; i < list->rule_cnt; i++)
+            free(list->rules[i].pattern);
+        free(list->rules);
+        free(list);
+        list = parent;
+    }
+}
+/** @brief Test an entry against the ignore rules in effect.
+    @param list Innermost ignore list
+    @param full_path Path of the entry
+    @param name Entry name (basename)
+    @param is_dir true if the entry is a directory
+    @return true if the entry is ignored
+    @details Rules from deeper directories take precedence over those from
+   their ancestors, and within one directory the last matching rule wins.
+   */
+static bool is_ignored(const IgnoreList *list, const char *full_path,
+                       const char *name, bool is_dir) {
+    for (; list; list = list->parent) {
+        const char *rel_path = full_path + list->base_len;
+        for (int i = list->rule_cnt - 1; i >= 0; i--) {
+            const IgnoreRule *rule = &list->rules[i];
+            if (rule->dir_only && !is_dir)
+                continue;
+            int rc;
+            if (rule->anchored)
+                rc = fnmatch(rule->pattern, rel_path,
+                             strstr(rule->pattern, "**") ? 0 : FNM_PATHNAME);
+            else
+                rc = fnmatch(rule->pattern, name, 0);
+            if (rc == 0)
+                return !rule->negate;
+        }
+    }
+    return false;
+}
+/** @brief Locate the index file for a directory.
+    @param base_path Directory to be indexed or searched
+    @param out Buffer for the index file path
+    @param n Size of out
+    @param root Buffer of PATH_MAX bytes for the real path of base_path
+    @return false if base_path can't be resolved or there is no cache
+   directory
+    @details Without an explicit file, the index lives in
+   $XDG_CACHE_HOME/cmenu/lf, or ~/.cache/cmenu/lf, named for a hash of the
+   directory's real path, so each tree has its own index whatever path it
+   is reached by.
+   */
+static bool index_path(const char *base_path, char *out, size_t n, char *root) {
+    if (!realpath(base_path, root))
+        return false;
+    if (index_file) {
+        strnz__cpy(out, index_file, n - 1);
+        return true;
+    }
+    char cache_dir[PATH_MAX];
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && xdg[0] == '/')
+        ssnprintf(cache_dir, sizeof(cache_dir), "%s", xdg);
+    else if (home && home[0] != '\0')
+        ssnprintf(cache_dir, sizeof(cache_dir), "%s/.cache", home);
+    else
+        return false;
+    uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+    for (const char *p = root; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 0x100000001b3ULL;
+    }
+    ssnprintf(out, n, "%s/cmenu/lf/%016llx.idx", cache_dir,
+              (unsigned long long)h);
+    return true;
+}
+/** @brief Map an index file and check that it is intact and describes
+   root.
+    @param path Index file
+    @param root Real path of the directory being searched
+    @return The mapped index, or NULL if it is missing, damaged, or belongs
+   to another directory
+   */
+static LfIndex *index_open(const char *path, const char *root) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || (size_t)sb.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t len = sb.st_size;
+    void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+    madvise(map, len, MADV_WILLNEED);
+    const IndexHeader *hdr = map;
+    size_t dirs_off = sizeof(IndexHeader);
+    size_t entries_off = dirs_off + (size_t)hdr->dir_cnt * sizeof(IndexDir);
+    bool ok = memcmp(hdr->magic, INDEX_MAGIC, sizeof(hdr->magic)) == 0 &&
+              hdr->version == INDEX_VERSION && entries_off <= len &&
+              hdr->entry_cnt <= (len - entries_off) / sizeof(IndexEntry);
+    size_t strings_off = entries_off + hdr->entry_cnt * sizeof(IndexEntry);
+    ok = ok && hdr->strings_len == len - strings_off &&
+         hdr->root_off < hdr->strings_len &&
+         ((char *)map)[len - 1] == '\0' &&
+         strcmp((char *)map + strings_off + hdr->root_off, root) == 0;
+    const IndexDir *dirs = (const IndexDir *)((char *)map + dirs_off);
+    for (uint32_t i = 0; ok && i < hdr->dir_cnt; i++)
+        ok = dirs[i].path_off + dirs[i].path_len < hdr->strings_len &&
+             dirs[i].names_off <= hdr->strings_len &&
+             dirs[i].first_entry + dirs[i].entry_cnt <= hdr->entry_cnt;
+    if (!ok) {
+        munmap(map, len);
+        return NULL;
+    }
+    LfIndex *ix = calloc(1, sizeof(LfIndex));
+    ix->map = map;
+    ix->map_len = len;
+    ix->hdr = hdr;
+    ix->dirs = dirs;
+    ix->entries = (const IndexEntry *)((char *)map + entries_off);
+    ix->strings = (char *)map + strings_off;
+    return ix;
+}
+/** @brief Unmap an index opened with index_open(). */
+static void index_close(LfIndex *ix) {
+    if (ix) {
+        munmap(ix->map, ix->map_len);
+        free(ix);
+    }
+}
+/** @brief Order relative paths bytewise, a prefix before its extensions */
+static int index_path_cmp(const char *a, size_t a_len, const char *b,
+                                 size_t b_len) {
+    int rc = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (rc)
+        return rc;
+    return (a_len > b_len) - (a_len < b_len);
+}
+/** @brief Find the record of a directory by its path relative to the base.
+    @return The record, or NULL if the directory isn't in the index
+   */
+static const IndexDir *index_lookup(const LfIndex *ix, const char *rel,
+                                    size_t rel_len) {
+    size_t lo = 0, hi = ix->hdr->dir_cnt;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const IndexDir *d = &ix->dirs[mid];
+        int rc = index_path_cmp(ix->strings + d->path_off, d->path_len, rel,
+                                rel_len);
+        if (rc == 0)
+            return d;
+        if (rc < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return NULL;
+}
+/** @brief Decide whether a directory's record can stand in for reading it.
+    @param ix The index
+    @param d The directory's record
+    @param st Current stat of the directory
+    @return true if dev, inode and mtime are unchanged. A directory modified
+   in the second the index build began, or later, may have changed while
+   it was being read and is never trusted.
+   */
+static bool index_dir_fresh(const LfIndex *ix, const IndexDir *d,
+                            const struct stat *st) {
+    return d->dev == (uint64_t)st->st_dev && d->ino == (uint64_t)st->st_ino &&
+           d->mtime_sec == st->st_mtim.tv_sec &&
+           d->mtime_nsec == st->st_mtim.tv_nsec &&
+           d->mtime_sec < ix->hdr->started;
+}
+/** @brief Add an entry to the record of the directory being read.
+    @param rec The record
+    @param name Entry name
+    @param len Length of name
+    @param type DT_* type of the entry itself
+    @param target_type DT_* type of a link's target, 0 if it is dangling or
+   the entry isn't a link
+   */
+static void dir_record_add(DirRecord *rec, const char *name, size_t len,
+                           unsigned char type, unsigned char target_type) {
+    if (rec->cnt == rec->max) {
+        size_t max = rec->max ? rec->max * 2 : 256;
+        IndexEntry *ents = realloc(rec->ents, max * sizeof(IndexEntry));
+        if (!ents) {
+            no_memory();
+            return;
+        }
+        rec->ents = ents;
+        rec->max = max;
+    }
+    if (rec->names_len + len > rec->names_max) {
+        size_t max = rec->names_max;
+        while (rec->names_len + len > max)
+            max = max ? max * 2 : 4096;
+        char *names = realloc(rec->names, max);
+        if (!names) {
+            no_memory();
+            return;
+        }
+        rec->names = names;
+        rec->names_max = max;
+    }
+    IndexEntry *e = &rec->ents[rec->cnt++];
+    e->name_off = rec->names_len;
+    e->name_len = len;
+    e->type = type;
+    e->target_type = target_type;
+    memcpy(rec->names + rec->names_len, name, len);
+    rec->names_len += len;
+}
+/** @brief Grow one of the IndexBuilder arrays to hold n more elements
+    @return The array, or NULL if memory ran out, leaving p as it was */
+static void *index_reserve(void *p, size_t *max, size_t cnt, size_t n,
+                           size_t size) {
+    if (cnt + n <= *max)
+        return p;
+    size_t new_max = *max;
+    while (cnt + n > new_max)
+        new_max = new_max ? new_max * 2 : 4096;
+    p = realloc(p, new_max * size);
+    if (p)
+        *max = new_max;
+    return p;
+}
+/** @brief Append a directory and its entries to the index being built.
+    @param b The IndexBuilder
+    @param rel Path of the directory relative to the base
+    @param st stat of the directory, taken before it was read
+    @param rec The directory's entries
+   */
+static void index_add_dir(IndexBuilder *b, const char *rel,
+                          const struct stat *st, const DirRecord *rec) {
+    size_t rel_len = strlen(rel);
+    pthread_mutex_lock(&b->lock);
+    char *strings = index_reserve(b->strings, &b->strings_max, b->strings_len,
+                                  rel_len + 1 + rec->names_len, 1);
+    if (strings)
+        b->strings = strings;
+    IndexEntry *entries = index_reserve(b->entries, &b->entry_max,
+                                        b->entry_cnt, rec->cnt,
+                                        sizeof(IndexEntry));
+    if (entries)
+        b->entries = entries;
+    IndexDir *dirs = index_reserve(b->dirs, &b->dir_max, b->dir_cnt, 1,
+                                   sizeof(IndexDir));
+    if (dirs)
+        b->dirs = dirs;
+    if (!strings || !entries || !dirs) {
+        pthread_mutex_unlock(&b->lock);
+        no_memory();
+        return;
+    }
+    IndexDir *d = &b->dirs[b->dir_cnt++];
+    d->path_off = b->strings_len;
+    d->path_len = rel_len;
+    memcpy(b->strings + b->strings_len, rel, rel_len + 1);
+    b->strings_len += rel_len + 1;
+    d->names_off = b->strings_len;
+    memcpy(b->strings + b->strings_len, rec->names, rec->names_len);
+    b->strings_len += rec->names_len;
+    d->first_entry = b->entry_cnt;
+    d->entry_cnt = rec->cnt;
+    memcpy(b->entries + b->entry_cnt, rec->ents, rec->cnt * sizeof(IndexEntry));
+    b->entry_cnt += rec->cnt;
+    d->dev = st->st_dev;
+    d->ino = st->st_ino;
+    d->mtime_sec = st->st_mtim.tv_sec;
+    d->mtime_nsec = st->st_mtim.tv_nsec;
+    pthread_mutex_unlock(&b->lock);
+}
+/** @brief qsort_r comparator ordering IndexDir records by path */
+static int index_dir_cmp(const void *a, const void *b, void *strings) {
+    const IndexDir *da = a, *db = b;
+    return index_path_cmp((char *)strings + da->path_off, da->path_len,
+                          (char *)strings + db->path_off, db->path_len);
+}
+/** @brief Sort the directories of a finished index and write it.
+    @param b The IndexBuilder
+    @param path Index file. Missing parent directories are created.
+    @param root Real path of the indexed directory
+    @param started Time the scan began
+    @return true if the index was written
+    @details The index is written to a temporary file and renamed over
+   path, so a search running at the same time sees either the old index or
+   the new one.
+   */
+static bool index_write(IndexBuilder *b, const char *path, const char *root,
+                        time_t started) {
+    if (b->dir_cnt > UINT32_MAX) {
+        fprintf(errout, "lf: too many directories to index\n");
+        return false;
+    }
+    size_t root_len = strlen(root);
+    char *strings = index_reserve(b->strings, &b->strings_max, b->strings_len,
+                                  root_len + 1, 1);
+    if (!strings) {
+        fprintf(errout, "lf: out of memory\n");
+        return false;
+    }
+    b->strings = strings;
+    IndexHeader hdr = {0};
+    memcpy(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = INDEX_VERSION;
+    hdr.dir_cnt = b->dir_cnt;
+    hdr.entry_cnt = b->entry_cnt;
+    hdr.root_off = b->strings_len;
+    hdr.started = started;
+    memcpy(b->strings + b->strings_len, root, root_len + 1);
+    b->strings_len += root_len + 1;
+    hdr.strings_len = b->strings_len;
+    qsort_r(b->dirs, b->dir_cnt, sizeof(IndexDir), index_dir_cmp, b->strings);
+
+    char tmp_path[PATH_MAX];
+    strnz__cpy(tmp_path, path, PATH_MAX - 1);
+    for (char *p = strchr(tmp_path + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        mkdir(tmp_path, 0755);
+        *p = '/';
+    }
+    ssnprintf(tmp_path, sizeof(tmp_path), "%s.%d", path, (int)getpid());
+    FILE *fp = fopen(tmp_path, "w");
+    if (!fp) {
+        fprintf(errout, "lf: cannot write index '%s': %s\n", path,
+                strerror(errno));
+        return false;
+    }
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(b->dirs, sizeof(IndexDir), b->dir_cnt, fp);
+    fwrite(b->entries, sizeof(IndexEntry), b->entry_cnt, fp);
+    fwrite(b->strings, 1, b->strings_len, fp);
+    if (ferror(fp) | fclose(fp) || rename(tmp_path, path) == -1) {
+        fprintf(errout, "lf: cannot write index '%s': %s\n", path,
+                strerror(errno));
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
+static bool is_hidden(const char *name) {
+    if (name[0] == '.') {
+        if (name[1] == '\0')
+            return false;
+        if (name[1] == '.' && name[2] == '\0')
+            return false;
+        return true;
+    }
+    return false;
+}
+static bool is_dirsys(const char *name) {
+    if (name[0] == '.') {
+        if (name[1] == '\0')
+            return true;
+        if (name[1] == '.' && name[2] == '\0')
+            return true;
+    }
+    return false;
+}
+/** @brief Decode a regex fragment that contains no operators.
+    @param p Start of the fragment
+    @param end End of the fragment
+    @param out Buffer of at least end - p + 1 bytes for the literal
+    @return Length of the literal, or -1 if the fragment contains an
+   operator. Escaped punctuation is literal; escaped letters and digits are
+   GNU operators such as \\w and \\b.
+   */
+static ssize_t ere_literal(const char *p, const char *end, char *out) {
+    size_t n = 0;
+    while (p < end) {
+        if (*p == '\\') {
+            if (p + 1 >= end || isalnum((unsigned char)p[1]))
+                return -1;
+            out[n++] = p[1];
+            p += 2;
+        } else if (strchr(".[]()*+?{}|^$", *p))
+            return -1;
+        else
+            out[n++] = *p++;
+    }
+    out[n] = '\0';
+    return n;
+}
+/** @brief Test whether the character at q is preceded by an odd number of
+   backslashes, making it a literal. */
+static bool is_escaped(const char *start, const char *q) {
+    int n = 0;
+    while (q > start && q[-1] == '\\') {
+        n++;
+        q--;
+    }
+    return n & 1;
+}
+/** @brief Skip a bracket expression.
+    @param p Points at the opening '['
+    @return Pointer past the closing ']', or NULL if it is not closed
+   */
+static const char *skip_bracket(const char *p) {
+    p++;
+    if (*p == '^')
+        p++;
+    if (*p == ']')
+        p++;
+    while (*p && *p != ']') {
+        if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+            const char *q = strchr(p + 2, ']');
+            if (!q)
+                return NULL;
+            p = q;
+        }
+        p++;
+    }
+    return *p ? p + 1 : NULL;
+}
+/** @brief Add a literal to a prefilter. */
+static bool add_literal(Prefilter *pf, const char *lit, size_t len) {
+    if (pf->lit_cnt == PF_MAX_LITS)
+        return false;
+    pf->lits[pf->lit_cnt] = strndup(lit, len);
+    pf->lit_lens[pf->lit_cnt++] = len;
+    return true;
+}
+/** @brief Derive a literal prefilter from an extended regular expression.
+    @param re The regular expression
+    @param icase true if the expression is matched ignoring case
+    @param pf Prefilter to fill in, type PF_NONE if nothing was found
+    @details The analysis recognizes, in order:
+   - a literal, optionally anchored with ^ and $, or with a leading or
+     trailing .*, which is decided without regexec (e.g. 'Makefile',
+     '.*\\.c$')
+   - a literal followed by a group of literal alternatives or a bracket of
+     plain characters, anchored with $, as a set of suffixes decided
+     without regexec (e.g. '\\.(c|h|cpp)$', '\\.[ch]$')
+   - otherwise, the longest run of literal characters that every match
+     must contain, used to reject entries before regexec. Expressions with
+     top level alternation have no such run.
+   */
+static void compile_prefilter(const char *re, bool icase, Prefilter *pf) {
+    memset(pf, 0, sizeof(Prefilter));
+    pf->icase = icase;
+    const char *p = re;
+    const char *end = re + strlen(re);
+    bool anchor_start = false, anchor_end = false;
+    if (*p == '^') {
+        anchor_start = true;
+        p++;
+    }
+    if (end - p >= 2 && p[0] == '.' && p[1] == '*' &&
+        !(end - p >= 3 && strchr("*+?{", p[2]))) {
+        anchor_start = false;
+        p += 2;
+    }
+    if (end > p && end[-1] == '$' && !is_escaped(p, end - 1)) {
+        anchor_end = true;
+        end--;
+    }
+    if (end - p >= 2 && end[-2] == '.' && end[-1] == '*' &&
+        !is_escaped(p, end - 2)) {
+        anchor_end = false;
+        end -= 2;
+    }
+    char *buf = malloc(end - p + 1);
+    ssize_t len = ere_literal(p, end, buf);
+    if (len >= 0) {
+        // The whole expression is a literal
+        if (anchor_start && anchor_end)
+            pf->type = PF_EQUAL;
+        else if (anchor_start)
+            pf->type = PF_PREFIX;
+        else if (anchor_end)
+            pf->type = PF_SUFFIX;
+        else
+            pf->type = PF_CONTAINS;
+        add_literal(pf, buf, len);
+        pf->exact = true;
+        free(buf);
+        return;
+    }
+    if (anchor_end && !anchor_start && end > p &&
+        (end[-1] == ')' || end[-1] == ']') && !is_escaped(p, end - 1)) {
+        // literal(alt1|alt2|...)$ or literal[chars]$
+        const char *open = end - 1;
+        char close = *open;
+        while (open > p && !(*open == (close == ')' ? '(' : '[') &&
+                             !is_escaped(p, open)))
+            open--;
+        ssize_t pre_len = ere_literal(p, open, buf);
+        if (pre_len >= 0 && *open == (close == ')' ? '(' : '[')) {
+            char *alt = malloc(end - p + 1);
+            bool ok = true;
+            if (close == ')') {
+                const char *a = open + 1;
+                while (ok && a < end) {
+                    const char *bar = a;
+                    while (bar < end - 1 && !(*bar == '|' && !is_escaped(a, bar)))
+                        bar++;
+                    ssize_t alt_len = ere_literal(a, bar, alt + pre_len);
+                    memcpy(alt, buf, pre_len);
+                    ok = alt_len >= 0 && add_literal(pf, alt, pre_len + alt_len);
+                    a = bar + 1;
+                }
+            } else {
+                for (const char *c = open + 1; ok && c < end - 1; c++) {
+                    ok = !strchr("^-[]\\", *c);
+                    memcpy(alt, buf, pre_len);
+                    alt[pre_len] = *c;
+                    ok = ok && add_literal(pf, alt, pre_len + 1);
+                }
+                ok = ok && pf->lit_cnt > 0;
+            }
+            free(alt);
+            if (ok) {
+                pf->type = PF_SUFFIX;
+                pf->exact = true;
+                free(buf);
+                return;
+            }
+            free_prefilter(pf);
+            pf->icase = icase;
+        }
+    }
+    // Longest run of literal characters that every match must contain
+    const char *best = NULL;
+    size_t best_len = 0;
+    char *run = buf;
+    size_t run_len = 0;
+    bool alternation = false;
+    for (const char *q = p; q < end && !alternation;) {
+        if (*q == '\\' && q + 1 < end && !isalnum((unsigned char)q[1])) {
+            run[run_len++] = q[1];
+            q += 2;
+        } else if (strchr("*?{", *q)) {
+            // The preceding atom may be absent or repeated. In a UTF-8
+            // locale it is a whole character, so a multibyte one goes
+            // back to its lead byte.
+            if (run_len > 0) {
+                unsigned char c = run[--run_len];
+                while (c >= 0x80 && c < 0xC0 && run_len > 0)
+                    c = run[--run_len];
+            }
+            if (run_len > best_len) {
+                best_len = run_len;
+                best = run;
+            }
+            run += run_len + 1;
+            run_len = 0;
+            if (*q == '{') {
+                const char *brace = strchr(q, '}');
+                q = brace ? brace + 1 : end;
+            } else
+                q++;
+        } else if (*q == '+' || *q == '.' || *q == '^' || *q == '$' ||
+                   *q == '\\' || *q == '[' || *q == '(' || *q == '|') {
+            // '+' keeps the preceding atom but ends the run
+            if (run_len > best_len) {
+                best_len = run_len;
+                best = run;
+            }
+            run += run_len + 1;
+            run_len = 0;
+            if (*q == '[') {
+                q = skip_bracket(q);
+                if (!q)
+                    break;
+            } else if (*q == '(') {
+                int depth = 0;
+                for (; q < end; q++) {
+                    if (*q == '\\')
+                        q++;
+                    else if (*q == '[') {
+                        const char *b = skip_bracket(q);
+                        q = b ? b - 1 : end;
+                    } else if (*q == '(')
+                        depth++;
+                    else if (*q == ')' && --depth == 0)
+                        break;
+                }
+                q++;
+            } else if (*q == '|')
+                alternation = true;
+            else
+                q += (*q == '\\') ? 2 : 1;
+        } else
+            run[run_len++] = *q++;
+    }
+    if (run_len > best_len) {
+        best_len = run_len;
+        best = run;
+    }
+    if (!alternation && best_len > 0) {
+        pf->type = PF_CONTAINS;
+        add_literal(pf, best, best_len);
+    }
+    free(buf);
+}
+/** @brief Free the literals of a prefilter. */
+static void free_prefilter(Prefilter *pf) {
+    for (int i = 0; i < pf->lit_cnt; i++)
+        free(pf->lits[i]);
+    memset(pf, 0, sizeof(Prefilter));
+}
+/** @brief Free the patterns lf_search() compiled, and their prefilters.
+    @param f SearchFilters struct
+    @param compiled PAT_RE, PAT_ERE, PAT_PRUNE and PAT_CONTAINS bits of
+   the patterns compiled so far
+   */
+static void free_patterns(SearchFilters *f, unsigned int compiled) {
+    if (compiled & PAT_RE)
+        regfree(&f->compiled_re);
+    if (compiled & PAT_ERE)
+        regfree(&f->compiled_ere);
+    if (compiled & PAT_PRUNE)
+        regfree(&f->compiled_prune);
+    if (compiled & PAT_CONTAINS) {
+        regfree(&f->compiled_contains);
+        sem_destroy(&content_slots);
+    }
+    free_prefilter(&f->re_pf);
+    free_prefilter(&f->ere_pf);
+    free_prefilter(&f->contains_pf);
+}
+/** @brief Match a string against a regular expression, trying its
+   prefilter first.
+    @param re Compiled regular expression
+    @param pf Prefilter derived from it
+    @param s String to match
+    @param len Length of s
+    @return 0 on a match, REG_NOMATCH, or a regexec error code
+   */
+static int regex_match(const regex_t *re, const Prefilter *pf, const char *s,
+                       size_t len) {
+    if (pf->type != PF_NONE) {
+        bool hit = false;
+        for (int i = 0; i < pf->lit_cnt && !hit; i++) {
+            const char *lit = pf->lits[i];
+            size_t n = pf->lit_lens[i];
+            switch (pf->type) {
+            case PF_EQUAL:
+                hit = len == n && (pf->icase ? strncasecmp(s, lit, n)
+                                             : memcmp(s, lit, n)) == 0;
+                break;
+            case PF_PREFIX:
+                hit = len >= n && (pf->icase ? strncasecmp(s, lit, n)
+                                             : memcmp(s, lit, n)) == 0;
+                break;
+            case PF_SUFFIX:
+                hit = len >= n &&
+                      (pf->icase ? strncasecmp(s + len - n, lit, n)
+                                 : memcmp(s + len - n, lit, n)) == 0;
+                break;
+            case PF_CONTAINS:
+                hit = pf->icase ? strcasestr(s, lit) != NULL
+                                : memmem(s, len, lit, n) != NULL;
+                break;
+            default:
+                break;
+            }
+        }
+        if (!hit)
+            return REG_NOMATCH;
+        if (pf->exact)
+            return 0;
+    }
+    return regexec(re, s, 0, nullptr, 0);
+}
+/** @brief scan a single file against search filters
+ * @param file_spec specification of file being scanned
+ * @param f SearchFilters struct
+ * @param effective_type type of file being scanned
+ * @param name_off offset of the file name in file_spec
+ * @param len length of file_spec
+ * @param st stat of the file, or of its target if it is a link, or NULL
+ * if the filters must stat it themselves
+ * @return true if file selected, false otherwise
+ */
+static int scan_file(char *file_spec, const SearchFilters *f,
+                     const unsigned char effective_type, size_t name_off,
+                     size_t len, const struct stat *st) {
+    bool stat_cached = false;
+
+    while (1) {
+        if (f->debug && (f->report_trace || f->report_all)) {
+            printf("suppress %08b, effective %08b, lf_mask %08b, & %08b %s\n",
+                   f->suppress_types, effective_type, lf_mask[effective_type], f->suppress_types & lf_mask[effective_type], file_spec);
+        }
+        if (f->suppress_types & lf_mask[effective_type])
+            break;
+        // Exclude non-matching files
+        if (f->flags & LF_REGEX) {
+            int reti = f->basename
+                           ? regex_match(&f->compiled_re, &f->re_pf,
+                                         file_spec + name_off, len - name_off)
+                           : regex_match(&f->compiled_re, &f->re_pf,
+                                         file_spec, len);
+            if (reti == REG_NOMATCH) {
+                if (f->debug && (f->report_info || f->report_all))
+                    fprintf(errout, "Regex no match: %s\n", file_spec);
+                break;
+            } else if (reti) {
+                char errbuf[MAXLEN];
+                regerror(reti, &f->compiled_re, errbuf, sizeof(errbuf));
+                if (f->debug && (f->report_errors || f->report_all))
+                    fprintf(errout, "regex error: %s\n", errbuf);
+                termination_status = EXIT_FAILURE;
+                return 0;
+            }
+        }
+        // Exclude matching files
+        if (f->flags & LF_EXC_REGEX) {
+            int reti = regex_match(&f->compiled_ere, &f->ere_pf, file_spec, len);
+            if (reti == 0) // Match
+                break;
+            if (reti != REG_NOMATCH) {
+                if (reti) {
+                    char errbuf[MAXLEN];
+                    regerror(reti, &f->compiled_ere, errbuf, sizeof(errbuf));
+                    if (f->debug && (f->report_errors || f->report_all))
+                        fprintf(errout, "Exclude regex error: %s\n", errbuf);
+                    termination_status = EXIT_FAILURE;
+                    return 0;
+                }
+            }
+        }
+        stat_cached = false;
+        struct stat sb;
+        if (st) {
+            sb = *st;
+            stat_cached = true;
+        }
+        //  Exclude files not owned by specified user
+        if ((f->flags & LF_USER) &&
+            (stat_cached || stat(file_spec, &sb) == 0)) {
+            stat_cached = true;
+            if (sb.st_uid != f->user_id)
+                break;
+        }
+        if (f->include_perms) {
+            if (!stat_cached) {
+                if (stat(file_spec, &sb) == 0)
+                    stat_cached = true;
+            }
+            if ((f->include_perms & LF_IRUSR) && !(sb.st_mode & S_IRUSR))
+                break;
+            else if ((f->include_perms & LF_IWUSR) && !(sb.st_mode & S_IWUSR))
+                break;
+            else if ((f->include_perms & LF_IXUSR) && !(sb.st_mode & S_IXUSR))
+                break;
+            else if ((f->include_perms & LF_ISUID) && !(sb.st_mode & S_ISUID))
+                break;
+            else if ((f->include_perms & LF_ISGID) && !(sb.st_mode & S_ISGID))
+                break;
+        }
+        if (f->before) {
+            if (!stat_cached) {
+                if (stat(file_spec, &sb) == 0)
+                    stat_cached = true;
+            }
+            if (stat_cached && sb.st_mtime > f->before)
+                break;
+        }
+        if (f->after) {
+            if (!stat_cached) {
+                if (stat(file_spec, &sb) == 0)
+                    stat_cached = true;
+            }
+            if (stat_cached && sb.st_mtime < f->after)
+                break;
+        }
+        if (f->file_size_min) {
+            if (!stat_cached) {
+                if (stat(file_spec, &sb) == 0)
+                    stat_cached = true;
+            }
+            if (stat_cached && sb.st_size < f->file_size_min)
+                break;
+        }
+        // Each inode is listed once, under the first name to get here.
+        // Only a file with other links, or one reached through symbolic
+        // links, can have been seen already, so most files skip the set.
+        // A link that isn't followed is listed as itself.
+        if (f->unique_inode && effective_type != DT_LNK) {
+            if (!stat_cached) {
+                if (stat(file_spec, &sb) == 0)
+                    stat_cached = true;
+            }
+            if (stat_cached &&
+                (f->follow_links ||
+                 (effective_type != DT_DIR && sb.st_nlink > 1)) &&
+                !inode_set_insert(&seen_files, sb.st_dev, sb.st_ino))
+                break;
+        }
+        // Only regular files are searched for --contains, each by
+        // whichever finder thread dequeues it
+        if (f->contains) {
+            if (effective_type == DT_REG && !f->only_errors)
+                enqueue_dir(new_content_task(file_spec));
+            break;
+        }
+        if (f->dupes) {
+            if (effective_type == DT_REG && !f->only_errors)
+                dupe_add(file_spec, stat_cached ? &sb : NULL, f);
+            break;
+        }
+        list_file(file_spec, f, effective_type, stat_cached ? &sb : NULL);
+        break;
+    }
+    return true;
+}
+/** @brief Count a selected file and print it, unless only counting. The
+ * search is stopped once --max_results files have been listed.
+ * @param file_spec specification of the file
+ * @param f SearchFilters struct
+ * @param effective_type type of the file
+ * @param st stat of the file, or NULL if it must be stated for --format
+ * or --json
+ */
+static void list_file(char *file_spec, const SearchFilters *f,
+                      const unsigned char effective_type,
+                      const struct stat *st) {
+    if (effective_type == DT_DIR) {
+        char *file_p = file_spec;
+        while (*file_p++ != '\0')
+            ;
+        *file_p = '/';
+    }
+    if (f->only_errors)
+        return;
+    bool last = false;
+    if (f->max_results) {
+        size_t n = atomic_fetch_add(&result_count, 1) + 1;
+        if (n > f->max_results)
+            return;
+        last = n == f->max_results;
+    }
+    file_count++;
+    if (f->exec) {
+        // Keep the "./" so that a name beginning with '-' is not taken
+        // for an option by the command
+        exec_enqueue(file_spec);
+    } else if (f->on_match) {
+        match_emit(file_spec[0] == '.' && file_spec[1] == '/' ? &file_spec[2]
+                                                              : file_spec,
+                   f);
+    } else if (!f->count_silently) {
+        const char *path = file_spec;
+        if (path[0] == '.' && path[1] == '/')
+            path += 2;
+        // A link that isn't followed is described by its own lstat,
+        // while the filters have been given its target's stat
+        struct stat sb;
+        if (output_stat && effective_type == DT_LNK)
+            st = lstat(file_spec, &sb) == 0 ? &sb : NULL;
+        else if (output_stat && !st) {
+            if (stat(file_spec, &sb) == 0 || lstat(file_spec, &sb) == 0)
+                st = &sb;
+        }
+        if (!out_buf) {
+            out_buf = malloc(sizeof(OutBuf));
+            out_buf->len = 0;
+        }
+        OutBuf *o = out_buf;
+        if (f->format)
+            format_record(o, f->format, path, effective_type, st);
+        else if (f->json)
+            json_record(o, path, effective_type, st);
+        else
+            out_add(o, path, strlen(path));
+        if (!f->format)
+            o->buf[o->len++] = f->null_sep ? '\0' : '\n';
+        if (o->len > OUT_BUF_SIZE - OUT_RECORD_MAX)
+            out_flush();
+    }
+    if (last)
+        stop_finders();
+}
+/** @brief Write this thread's output buffer. The search is stopped if the
+   output fails, usually because the reader has closed the pipe, as
+   nothing more can be listed.
+   */
+static void out_flush(void) {
+    OutBuf *o = out_buf;
+    if (!o || o->len == 0)
+        return;
+    fwrite(o->buf, 1, o->len, stdout);
+    o->len = 0;
+    if (ferror(stdout))
+        stop_finders();
+}
+/** @brief Append to a record in an output buffer. A record longer than
+   OUT_RECORD_MAX, which only an unusual --format can produce, is written
+   in pieces.
+   */
+static void out_add(OutBuf *o, const char *s, size_t n) {
+    while (n > OUT_BUF_SIZE - 1 - o->len) {
+        size_t room = OUT_BUF_SIZE - 1 - o->len;
+        memcpy(o->buf + o->len, s, room);
+        o->len += room;
+        s += room;
+        n -= room;
+        out_flush();
+    }
+    memcpy(o->buf + o->len, s, n);
+    o->len += n;
+}
+/** @brief Append a number in decimal, or octal if base is 8. */
+static void out_num(OutBuf *o, uintmax_t v, int base) {
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+    do {
+        *--p = '0' + v % base;
+        v /= base;
+    } while (v);
+    out_add(o, p, tmp + sizeof(tmp) - p);
+}
+/** @brief Letter of a DT_* type, as for -t */
+static char type_char(unsigned char dt_type) {
+    switch (dt_type) {
+    case DT_FIFO:
+        return 'p';
+    case DT_CHR:
+        return 'c';
+    case DT_DIR:
+        return 'd';
+    case DT_BLK:
+        return 'b';
+    case DT_REG:
+        return 'f';
+    case DT_LNK:
+        return 'l';
+    case DT_SOCK:
+        return 's';
+    default:
+        return 'u';
+    }
+}
+/** @brief Check a --format string for unknown directives.
+    @return true if the format is valid, else a message has been written
+   to stderr
+   */
+static bool format_check(const char *fmt) {
+    for (const char *p = fmt; *p; p++) {
+        if (*p == '%') {
+            if (!p[1] || !strchr("pfhstTmMUGiny%", p[1])) {
+                fprintf(errout, "lf: unknown directive %%%.1s in --format\n",
+                        p + 1);
+                return false;
+            }
+            p++;
+        } else if (*p == '\\' && p[1])
+            p++;
+    }
+    return true;
+}
+/** @brief Check whether a --format string has directives that need the
+   file's stat.
+   */
+static bool format_stat(const char *fmt) {
+    for (const char *p = fmt; *p; p++) {
+        if (*p == '%' && p[1]) {
+            if (strchr("stTmMUGin", *++p))
+                return true;
+        } else if (*p == '\\' && p[1])
+            p++;
+    }
+    return false;
+}
+/** @brief Append a record formatted by --format.
+    @param o Output buffer
+    @param fmt The format
+    @param path Path of the file
+    @param dt_type DT_* type of the file
+    @param st stat of the file, or NULL if it couldn't be stated, in which
+   case the stat directives print nothing
+    @details Directives are %p path, %f file name, %h directory, %s size,
+   %t mtime in seconds since the epoch, %T mtime as YYYY-MM-DDTHH:MM:SS,
+   %m octal permissions, %M permissions as by ls -l, %U uid, %G gid, %i
+   inode, %n link count, %y type letter, and %%. The escapes \n, \t, \0
+   and \\ are recognized. As with find -printf, no newline is added.
+   */
+static void format_record(OutBuf *o, const char *fmt, const char *path,
+                          unsigned char dt_type, const struct stat *st) {
+    for (const char *p = fmt; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            char c = *p == 'n' ? '\n' : *p == 't' ? '\t' : *p == '0' ? '\0' : *p;
+            out_add(o, &c, 1);
+            continue;
+        }
+        if (*p != '%' || !p[1]) {
+            out_add(o, p, 1);
+            continue;
+        }
+        p++;
+        const char *name = strrchr(path, '/');
+        switch (*p) {
+        case 'p':
+            out_add(o, path, strlen(path));
+            continue;
+        case 'f':
+            name = name ? name + 1 : path;
+            out_add(o, name, strlen(name));
+            continue;
+        case 'h':
+            if (name)
+                out_add(o, path, name - path);
+            else
+                out_add(o, ".", 1);
+            continue;
+        case 'y': {
+            char c = type_char(dt_type);
+            out_add(o, &c, 1);
+            continue;
+        }
+        case '%':
+            out_add(o, "%", 1);
+            continue;
+        }
+        if (!st)
+            continue;
+        switch (*p) {
+        case 's':
+            out_num(o, st->st_size, 10);
+            break;
+        case 't':
+            if (st->st_mtime < 0)
+                out_add(o, "-", 1);
+            out_num(o, st->st_mtime < 0 ? -st->st_mtime : st->st_mtime, 10);
+            break;
+        case 'T': {
+            struct tm tm;
+            char tmp[32];
+            localtime_r(&st->st_mtime, &tm);
+            out_add(o, tmp, strftime(tmp, sizeof(tmp), "%FT%T", &tm));
+            break;
+        }
+        case 'm':
+            out_num(o, st->st_mode & 07777, 8);
+            break;
+        case 'M': {
+            char m[10];
+            const char *rwx = "rwxrwxrwx";
+            for (int i = 0; i < 9; i++)
+                m[i] = st->st_mode & (0400 >> i) ? rwx[i] : '-';
+            if (st->st_mode & S_ISUID)
+                m[2] = st->st_mode & S_IXUSR ? 's' : 'S';
+            if (st->st_mode & S_ISGID)
+                m[5] = st->st_mode & S_IXGRP ? 's' : 'S';
+            if (st->st_mode & S_ISVTX)
+                m[8] = st->st_mode & S_IXOTH ? 't' : 'T';
+            char c = type_char((st->st_mode & S_IFMT) >> 12);
+            out_add(o, c == 'f' ? "-" : &c, 1);
+            out_add(o, m, 9);
+            break;
+        }
+        case 'U':
+            out_num(o, st->st_uid, 10);
+            break;
+        case 'G':
+            out_num(o, st->st_gid, 10);
+            break;
+        case 'i':
+            out_num(o, st->st_ino, 10);
+            break;
+        case 'n':
+            out_num(o, st->st_nlink, 10);
+            break;
+        }
+    }
+}
+/** @brief Append a path as a JSON string. Control characters, quotes and
+   backslashes are escaped.
+   */
+static void json_string(OutBuf *o, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    out_add(o, "\"", 1);
+    const char *run = s;
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        out_add(o, run, s - run);
+        run = s + 1;
+        char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+        if (c == '"' || c == '\\') {
+            esc[1] = c;
+            out_add(o, esc, 2);
+        } else
+            out_add(o, esc, 6);
+    }
+    out_add(o, run, s - run);
+    out_add(o, "\"", 1);
+}
+/** @brief Check that a path is valid UTF-8, as a JSON string must be. */
+static bool is_utf8(const char *s) {
+    const unsigned char *p = (const unsigned char *)s;
+    while (*p) {
+        if (*p < 0x80) {
+            p++;
+            continue;
+        }
+        int n = *p >= 0xf0 && *p <= 0xf4   ? 3
+                : *p >= 0xe0               ? 2
+                : *p >= 0xc2 && *p < 0xe0 ? 1
+                                           : 0;
+        if (n == 0 || (*p == 0xe0 && p[1] < 0xa0) ||
+            (*p == 0xed && p[1] > 0x9f) || (*p == 0xf0 && p[1] < 0x90) ||
+            (*p == 0xf4 && p[1] > 0x8f))
+            return false;
+        for (int i = 1; i <= n; i++)
+            if ((p[i] & 0xc0) != 0x80)
+                return false;
+        p += n + 1;
+    }
+    return true;
+}
+/** @brief Append a record for --json.
+    @param o Output buffer
+    @param path Path of the file
+    @param dt_type DT_* type of the file
+    @param st stat of the file, or NULL if it couldn't be stated, in which
+   case only the path and type are given
+    @details A path that isn't valid UTF-8 is given as "path_bytes", base64
+   encoded, instead of "path".
+   */
+static void json_record(OutBuf *o, const char *path, unsigned char dt_type,
+                        const struct stat *st) {
+    if (is_utf8(path)) {
+        out_lit(o, "{\"path\":");
+        json_string(o, path);
+    } else {
+        static const char b64[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        out_lit(o, "{\"path_bytes\":\"");
+        const unsigned char *p = (const unsigned char *)path;
+        size_t n = strlen(path);
+        for (size_t i = 0; i < n; i += 3) {
+            uint32_t v = p[i] << 16 | (i + 1 < n ? p[i + 1] << 8 : 0) |
+                         (i + 2 < n ? p[i + 2] : 0);
+            char q[4] = {b64[v >> 18], b64[v >> 12 & 63],
+                         i + 1 < n ? b64[v >> 6 & 63] : '=',
+                         i + 2 < n ? b64[v & 63] : '='};
+            out_add(o, q, 4);
+        }
+        out_lit(o, "\"");
+    }
+    char type[] = ",\"type\":\"f\"";
+    type[9] = type_char(dt_type);
+    out_add(o, type, sizeof(type) - 1);
+    if (st) {
+        out_lit(o, ",\"size\":");
+        out_num(o, st->st_size, 10);
+        out_lit(o, ",\"mtime\":");
+        if (st->st_mtime < 0)
+            out_lit(o, "-");
+        out_num(o, st->st_mtime < 0 ? -st->st_mtime : st->st_mtime, 10);
+        out_lit(o, ",\"mode\":\"0");
+        out_num(o, st->st_mode & 07777, 8);
+        out_lit(o, "\",\"uid\":");
+        out_num(o, st->st_uid, 10);
+        out_lit(o, ",\"gid\":");
+        out_num(o, st->st_gid, 10);
+        out_lit(o, ",\"ino\":");
+        out_num(o, st->st_ino, 10);
+        out_lit(o, ",\"nlink\":");
+        out_num(o, st->st_nlink, 10);
+    }
+    out_lit(o, "}");
+}
+/** @brief Add a selected path to this thread's batch for on_match,
+   passing the batch on first if the path doesn't fit.
+    @param path Path of the file
+    @param f SearchFilters struct
+   */
+static void match_emit(const char *path, const SearchFilters *f) {
+    size_t len = strlen(path) + 1;
+    if (!match_batch) {
+        match_batch = malloc(sizeof(MatchBatch));
+        match_batch->cnt = 0;
+        match_batch->used = 0;
+    }
+    MatchBatch *b = match_batch;
+    if (b->cnt == MATCH_BATCH_MAX || b->used + len > MATCH_BATCH_BYTES)
+        match_flush(f);
+    b->paths[b->cnt++] = memcpy(b->buf + b->used, path, len);
+    b->used += len;
+}
+/** @brief Pass this thread's batch of matches to on_match.
+    @param f SearchFilters struct
+    @details Calls are serialized, so on_match needs no locking of its own.
+   Once the search has been stopped, remaining batches are dropped. If
+   on_match returns false, the search is cancelled.
+   */
+static void match_flush(const SearchFilters *f) {
+    MatchBatch *b = match_batch;
+    if (!b || b->cnt == 0)
+        return;
+    bool more = true;
+    pthread_mutex_lock(&match_mutex);
+    if (!atomic_load(&stop_search))
+        more = f->on_match(f->match_ctx, b->paths, b->cnt);
+    pthread_mutex_unlock(&match_mutex);
+    b->cnt = 0;
+    b->used = 0;
+    if (!more)
+        lf_cancel();
+}
+/** @brief Gather a regular file for --dupes.
+    @param path Path of the file
+    @param st stat of the file, or NULL to stat it here
+    @param f SearchFilters struct
+    @details Empty files are left out, as they are all alike.
+   */
+static void dupe_add(const char *path, const struct stat *st,
+                     const SearchFilters *f) {
+    struct stat sb;
+    if (!st) {
+        if (stat(path, &sb) == -1) {
+            if (f->debug && (f->report_errors || f->report_all))
+                fprintf(errout, "STAT_FAIL,%s,%s\n", path, strerror(errno));
+            termination_status = EXIT_FAILURE;
+            return;
+        }
+        st = &sb;
+    }
+    if (!S_ISREG(st->st_mode) || st->st_size == 0)
+        return;
+    DupeList *l = &dupe_local;
+    if (l->cnt == l->max) {
+        size_t max = l->max ? l->max * 2 : 1024;
+        DupeFile *v = realloc(l->v, max * sizeof(DupeFile));
+        if (!v) {
+            no_memory();
+            return;
+        }
+        l->v = v;
+        l->max = max;
+    }
+    l->v[l->cnt++] = (DupeFile){.path = strdup(path), .size = st->st_size};
+}
+/** @brief Add this thread's files to dupe_files. */
+static void dupe_merge(void) {
+    DupeList *l = &dupe_local;
+    if (l->cnt == 0) {
+        free(l->v);
+        *l = (DupeList){0};
+        return;
+    }
+    pthread_mutex_lock(&dupe_mutex);
+    if (dupe_files.cnt + l->cnt > dupe_files.max) {
+        size_t max = dupe_files.cnt + l->cnt;
+        DupeFile *v = realloc(dupe_files.v, max * sizeof(DupeFile));
+        if (!v) {
+            pthread_mutex_unlock(&dupe_mutex);
+            for (size_t i = 0; i < l->cnt; i++)
+                free(l->v[i].path);
+            free(l->v);
+            *l = (DupeList){0};
+            no_memory();
+            return;
+        }
+        dupe_files.v = v;
+        dupe_files.max = max;
+    }
+    memcpy(dupe_files.v + dupe_files.cnt, l->v, l->cnt * sizeof(DupeFile));
+    dupe_files.cnt += l->cnt;
+    pthread_mutex_unlock(&dupe_mutex);
+    free(l->v);
+    *l = (DupeList){0};
+}
+/** Primes and round of XXH64, used to hash file contents for --dupes */
+#define HASH_P1 0x9E3779B185EBCA87ULL
+#define HASH_P2 0xC2B2AE3D27D4EB4FULL
+#define HASH_P3 0x165667B19E3779F9ULL
+#define HASH_P4 0x85EBCA77C2B2AE63ULL
+#define HASH_P5 0x27D4EB2F165667C5ULL
+static inline uint64_t hash_round(uint64_t acc, uint64_t w) {
+    acc += w * HASH_P2;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * HASH_P1;
+}
+static inline uint64_t hash_merge(uint64_t h, uint64_t v) {
+    h ^= hash_round(0, v);
+    return h * HASH_P1 + HASH_P4;
+}
+/** @brief Hash the contents of a file, in the manner of XXH64.
+    @param d The file. d->hash is set and d->hashed is true if exactly
+   d->size bytes were read.
+    @param buf Buffer of DUPE_READ_SIZE bytes
+    @param f SearchFilters struct
+   */
+static void dupe_hash(DupeFile *d, char *buf, const SearchFilters *f) {
+    int fd = open(d->path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd == -1) {
+        if (f->debug && (f->report_warnings || f->report_errors ||
+                         f->report_all))
+            fprintf(errout, "OPEN_FAIL,%s,%s\n", d->path, strerror(errno));
+        termination_status = EXIT_FAILURE;
+        return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    uint64_t v[4] = {HASH_P1 + HASH_P2, HASH_P2, 0, -HASH_P1};
+    uint64_t total = 0;
+    size_t len;
+    do {
+        // Fill the buffer, so that only the last block has a tail
+        ssize_t n = 0;
+        len = 0;
+        while (len < DUPE_READ_SIZE &&
+               (n = read(fd, buf + len, DUPE_READ_SIZE - len)) > 0)
+            len += n;
+        if (n == -1) {
+            if (f->debug && (f->report_errors || f->report_all))
+                fprintf(errout, "READ_FAIL,%s,%s\n", d->path,
+                        strerror(errno));
+            termination_status = EXIT_FAILURE;
+            close(fd);
+            return;
+        }
+        total += len;
+        if (len < DUPE_READ_SIZE)
+            break;
+        for (size_t i = 0; i < len; i += 32) {
+            uint64_t w[4];
+            memcpy(w, buf + i, sizeof(w));
+            for (int j = 0; j < 4; j++)
+                v[j] = hash_round(v[j], w[j]);
+        }
+    } while (!atomic_load_explicit(&stop_search, memory_order_relaxed));
+    close(fd);
+    // A file that changed size since it was stated is left out
+    if (total != (uint64_t)d->size ||
+        atomic_load_explicit(&stop_search, memory_order_relaxed))
+        return;
+    const unsigned char *p = (const unsigned char *)buf;
+    const unsigned char *end = p + len;
+    for (; p + 32 <= end; p += 32) {
+        uint64_t w[4];
+        memcpy(w, p, sizeof(w));
+        for (int j = 0; j < 4; j++)
+            v[j] = hash_round(v[j], w[j]);
+    }
+    uint64_t h = ((v[0] << 1) | (v[0] >> 63)) + ((v[1] << 7) | (v[1] >> 57)) +
+                 ((v[2] << 12) | (v[2] >> 52)) + ((v[3] << 18) | (v[3] >> 46));
+    for (int j = 0; j < 4; j++)
+        h = hash_merge(h, v[j]);
+    h += total;
+    for (; p + 8 <= end; p += 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h ^= hash_round(0, w);
+        h = ((h << 27) | (h >> 37)) * HASH_P1 + HASH_P4;
+    }
+    if (p + 4 <= end) {
+        uint32_t w;
+        memcpy(&w, p, sizeof(w));
+        h ^= (uint64_t)w * HASH_P1;
+        h = ((h << 23) | (h >> 41)) * HASH_P2 + HASH_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * HASH_P5;
+        h = ((h << 11) | (h >> 53)) * HASH_P1;
+    }
+    h ^= h >> 33;
+    h *= HASH_P2;
+    h ^= h >> 29;
+    h *= HASH_P3;
+    h ^= h >> 32;
+    d->hash = h;
+    d->hashed = true;
+}
+/** @brief Hashing thread for --dupes, takes files from dupe_files in turn
+   until none are left.
+    @param arg SearchFilters struct
+   */
+static void *dupe_hasher(void *arg) {
+    const SearchFilters *f = arg;
+    char *buf = malloc(DUPE_READ_SIZE);
+    if (!buf)
+        return NULL;
+    size_t i;
+    while ((i = atomic_fetch_add(&dupe_next, 1)) < dupe_files.cnt &&
+           !atomic_load_explicit(&stop_search, memory_order_relaxed))
+        dupe_hash(&dupe_files.v[i], buf, f);
+    free(buf);
+    return NULL;
+}
+/** @brief qsort comparison for --dupes, largest files first, then by
+   hash, then by path.
+   */
+static int dupe_cmp(const void *a, const void *b) {
+    const DupeFile *x = a, *y = b;
+    if (x->size != y->size)
+        return x->size < y->size ? 1 : -1;
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+/** @brief Read from fd until buf holds DUPE_READ_SIZE bytes or the file
+   ends.
+    @return Bytes read, or -1 on a read error */
+static ssize_t dupe_fill(int fd, char *buf) {
+    size_t len = 0;
+    ssize_t n;
+    while (len < DUPE_READ_SIZE &&
+           (n = read(fd, buf + len, DUPE_READ_SIZE - len)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        len += n;
+    }
+    return len;
+}
+/** @brief Compare the contents of two files of the same size.
+    @param a Path of one file
+    @param b Path of the other
+    @param buf_a, buf_b Buffers of DUPE_READ_SIZE bytes
+    @return true if both were read to the end and no byte differs
+   */
+static bool dupe_same(const char *a, const char *b, char *buf_a,
+                      char *buf_b) {
+    int fd_a = open(a, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    int fd_b = open(b, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    bool same = fd_a != -1 && fd_b != -1;
+    while (same && !atomic_load_explicit(&stop_search, memory_order_relaxed)) {
+        ssize_t n_a = dupe_fill(fd_a, buf_a);
+        ssize_t n_b = dupe_fill(fd_b, buf_b);
+        same = n_a != -1 && n_a == n_b && memcmp(buf_a, buf_b, n_a) == 0;
+        if (n_a == 0)
+            break;
+    }
+    if (fd_a != -1)
+        close(fd_a);
+    if (fd_b != -1)
+        close(fd_b);
+    return same;
+}
+/** @brief List the groups of files with the same contents.
+    @param f SearchFilters struct
+    @param nthreads Number of threads to hash with
+    @details Files are sorted by size, and only those whose size is shared
+   by another file are read. They are hashed in parallel. Files with the
+   same size and hash are then compared byte by byte, as a hash match
+   alone may be a collision, and each group of two or more files with the
+   same contents is listed. In printed output, groups are separated by an
+   empty line.
+   */
+static void dupes_report(const SearchFilters *f, unsigned int nthreads) {
+    DupeFile *v = dupe_files.v;
+    size_t n = dupe_files.cnt;
+    qsort(v, n, sizeof(DupeFile), dupe_cmp);
+    size_t m = 0;
+    for (size_t i = 0, j; i < n; i = j) {
+        for (j = i + 1; j < n && v[j].size == v[i].size; j++)
+            ;
+        if (j - i == 1) {
+            free(v[i].path);
+            continue;
+        }
+        memmove(v + m, v + i, (j - i) * sizeof(DupeFile));
+        m += j - i;
+    }
+    dupe_files.cnt = m;
+    atomic_store(&dupe_next, 0);
+    pthread_t threads[nthreads];
+    for (unsigned int i = 0; i < nthreads; i++)
+        pthread_create(&threads[i], NULL, dupe_hasher, (void *)f);
+    for (unsigned int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    qsort(v, m, sizeof(DupeFile), dupe_cmp);
+    bool print = !f->exec && !f->on_match && !f->count_silently;
+    size_t groups = 0;
+    char *buf_a = malloc(DUPE_READ_SIZE), *buf_b = malloc(DUPE_READ_SIZE);
+    bool bufs = buf_a && buf_b;
+    if (!bufs)
+        no_memory();
+    for (size_t i = 0, j; i < m && bufs; i = j) {
+        for (j = i + 1; j < m && v[j].size == v[i].size &&
+                        v[j].hash == v[i].hash && v[j].hashed == v[i].hashed;
+             j++)
+            ;
+        // Split the files alike by hash into those alike byte by byte,
+        // the first of the files left against the rest in turn
+        for (size_t start = i, end; start < j; start = end) {
+            if (!v[i].hashed || j - i == 1 || atomic_load(&stop_search))
+                break;
+            end = start + 1;
+            for (size_t k = start + 1; k < j; k++) {
+                if (dupe_same(v[start].path, v[k].path, buf_a, buf_b)) {
+                    DupeFile t = v[end];
+                    v[end++] = v[k];
+                    v[k] = t;
+                }
+            }
+            if (end - start == 1 || atomic_load(&stop_search))
+                continue;
+            qsort(v + start, end - start, sizeof(DupeFile), dupe_cmp);
+            if (print && groups) {
+                out_buf->buf[out_buf->len++] = f->null_sep ? '\0' : '\n';
+                if (out_buf->len > OUT_BUF_SIZE - OUT_RECORD_MAX)
+                    out_flush();
+            }
+            groups++;
+            for (size_t k = start; k < end; k++)
+                list_file(v[k].path, f, DT_REG, NULL);
+        }
+    }
+    free(buf_a);
+    free(buf_b);
+    out_flush();
+    if (f->debug && (f->report_info || f->report_all))
+        fprintf(errout, "DUPES,%zu files,%zu of a shared size,%zu groups\n",
+                n, m, groups);
+    for (size_t i = 0; i < m; i++)
+        free(v[i].path);
+    free(v);
+    dupe_files = (DupeList){0};
+}
+/** @brief Search a line, or run of lines, for the --contains pattern.
+    @param f SearchFilters struct
+    @param s Start of the text, at the start of a line
+    @param len Length of the text
+    @return true if a line matches
+   */
+static bool content_regexec(const SearchFilters *f, const char *s, size_t len) {
+    regmatch_t pmatch = {.rm_so = 0, .rm_eo = len};
+    return regexec(&f->compiled_contains, s, 1, &pmatch, REG_STARTEND) == 0;
+}
+/** @brief Search a file's contents for the --contains pattern.
+    @param file_spec Path of the file
+    @param f SearchFilters struct
+    @return true if any line of the file matches
+    @details Files up to CONTENT_READ_MAX bytes are read into a per-thread
+   buffer and larger ones are mapped. A file with a NUL byte in its first
+   CONTENT_BINARY_PEEK bytes is taken to be binary and skipped. When the
+   pattern contains a literal, occurrences of the literal are found with
+   memmem and only the lines holding them are given to regexec; a pattern
+   that is a plain literal never reaches regexec. Searching stops at the
+   first match.
+   */
+static bool content_match(const char *file_spec, const SearchFilters *f) {
+    sem_wait(&content_slots);
+    int fd = open(file_spec, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd == -1) {
+        sem_post(&content_slots);
+        if (f->debug && (f->report_warnings || f->report_errors ||
+                         f->report_all))
+            fprintf(errout, "OPEN_FAIL,%s,%s\n", file_spec, strerror(errno));
+        termination_status = EXIT_FAILURE;
+        return false;
+    }
+    struct stat sb;
+    char *buf = NULL;
+    size_t len = 0;
+    bool mapped = false;
+    if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+        if (sb.st_size <= CONTENT_READ_MAX) {
+            if (content_buf_size < (size_t)sb.st_size) {
+                free(content_buf);
+                content_buf = malloc(CONTENT_READ_MAX);
+                content_buf_size = content_buf ? CONTENT_READ_MAX : 0;
+            }
+            buf = content_buf;
+            ssize_t n;
+            while (buf && len < (size_t)sb.st_size &&
+                   (n = read(fd, buf + len, sb.st_size - len)) > 0)
+                len += n;
+        } else {
+            buf = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (buf == MAP_FAILED)
+                buf = NULL;
+            else {
+                madvise(buf, sb.st_size, MADV_SEQUENTIAL);
+                mapped = true;
+                len = sb.st_size;
+            }
+        }
+    }
+    close(fd);
+    sem_post(&content_slots);
+    bool found = false;
+    if (!buf || len == 0 ||
+        memchr(buf, '\0', len < CONTENT_BINARY_PEEK ? len : CONTENT_BINARY_PEEK)) {
+        if (buf && len && f->debug && (f->report_info || f->report_all))
+            fprintf(errout, "BINARY,%s\n", file_spec);
+    } else {
+        const Prefilter *pf = &f->contains_pf;
+        if (pf->lit_cnt == 1 && !pf->icase) {
+            const char *end = buf + len;
+            const char *p = buf;
+            while (!found &&
+                   (p = memmem(p, end - p, pf->lits[0], pf->lit_lens[0]))) {
+                if (pf->exact && pf->type == PF_CONTAINS) {
+                    found = true;
+                    break;
+                }
+                const char *line = memrchr(buf, '\n', p - buf);
+                line = line ? line + 1 : buf;
+                const char *eol = memchr(p, '\n', end - p);
+                if (!eol)
+                    eol = end;
+                found = content_regexec(f, line, eol - line);
+                p = eol;
+            }
+        } else
+            found = content_regexec(f, buf, len);
+    }
+    if (mapped)
+        munmap(buf, len);
+    return found;
+}
+/** @brief Bytes of ARG_MAX a command's arguments may take.
+    @return ARG_MAX less the space taken by the environment and a margin,
+   and no more than 128K, as find and xargs do. Each argument takes its
+   pointer as well as its text.
+   */
+size_t lf_arg_room(void) {
+    long arg_max = sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0)
+        arg_max = 128 * 1024;
+    for (char **e = environ; *e; e++)
+        arg_max -= strlen(*e) + 1 + sizeof(char *);
+    arg_max -= 2048;
+    if (arg_max > 128 * 1024)
+        arg_max = 128 * 1024;
+    if (arg_max < 4096)
+        arg_max = 4096;
+    return (size_t)arg_max;
+}
+/** @brief Parse the -x command and start the launcher thread.
+    @param f SearchFilters struct
+    @return true if the command is usable
+    @details The command is split into arguments once, here. Batches are
+   limited to lf_arg_room().
+   */
+static bool exec_init(const SearchFilters *f) {
+    ExecPool *x = &exec_pool;
+    *x = (ExecPool){0};
+    char *cmd = strdup(f->exec);
+    x->argc = str_to_args(x->argv, cmd, MAXARGS - 1);
+    free(cmd);
+    if (x->argc > 1 && strcmp(x->argv[x->argc - 1], "+") == 0 &&
+        strcmp(x->argv[x->argc - 2], "{}") == 0) {
+        x->batch = true;
+        free(x->argv[--x->argc]);
+        free(x->argv[--x->argc]);
+        x->argv[x->argc] = nullptr;
+    }
+    if (x->argc == 0) {
+        fprintf(errout, "lf: -x requires a command\n");
+        return false;
+    }
+    x->arg_max = lf_arg_room();
+    x->max_jobs = f->max_jobs > 0 ? f->max_jobs : 1;
+    x->jobs = calloc(x->max_jobs, sizeof(ExecJob));
+    x->pfds = calloc(x->max_jobs, sizeof(struct pollfd));
+    pthread_mutex_init(&x->lock, NULL);
+    pthread_cond_init(&x->cond, NULL);
+    if (pthread_create(&x->thread, NULL, exec_launcher, (void *)f) != 0) {
+        fprintf(errout, "lf: cannot start command launcher: %s\n",
+                strerror(errno));
+        for (int i = 0; i < x->argc; i++)
+            free(x->argv[i]);
+        free(x->jobs);
+        free(x->pfds);
+        pthread_mutex_destroy(&x->lock);
+        pthread_cond_destroy(&x->cond);
+        return false;
+    }
+    return true;
+}
+/** @brief Queue a selected path for the -x command.
+    @param path Path of the file
+    @details Paths are held in a per-thread list and passed on by
+   exec_flush(). If the path can't be queued the search is cancelled.
+   */
+static void exec_enqueue(const char *path) {
+    size_t len = strlen(path);
+    ExecItem *item = malloc(sizeof(ExecItem) + len + 1);
+    if (!item) {
+        no_memory();
+        return;
+    }
+    item->next = NULL;
+    memcpy(item->path, path, len + 1);
+    if (exec_pending_tail)
+        exec_pending_tail->next = item;
+    else
+        exec_pending_head = item;
+    exec_pending_tail = item;
+    if (++exec_pending_cnt >= EXEC_FLUSH_ITEMS)
+        exec_flush();
+}
+/** @brief Pass this thread's pending -x paths to the launcher thread. */
+static void exec_flush(void) {
+    if (!exec_pending_head)
+        return;
+    pthread_mutex_lock(&exec_pool.lock);
+    if (exec_pool.tail)
+        exec_pool.tail->next = exec_pending_head;
+    else {
+        // The launcher takes the whole queue at once, so it only needs
+        // waking when the queue was empty
+        exec_pool.head = exec_pending_head;
+        pthread_cond_signal(&exec_pool.cond);
+    }
+    exec_pool.tail = exec_pending_tail;
+    pthread_mutex_unlock(&exec_pool.lock);
+    exec_pending_head = exec_pending_tail = NULL;
+    exec_pending_cnt = 0;
+}
+/** @brief Tell the launcher thread a --watch round has ended, so that it
+   runs the partial batch rather than hold it for the next change.
+   */
+static void exec_round(void) {
+    pthread_mutex_lock(&exec_pool.lock);
+    exec_pool.round = true;
+    pthread_cond_signal(&exec_pool.cond);
+    pthread_mutex_unlock(&exec_pool.lock);
+}
+/** @brief Report how a command ended and release its job slot.
+    @param f SearchFilters struct
+    @param i Index of the job in exec_pool.jobs
+    @param wstatus Status from waitpid
+   */
+static void exec_report(const SearchFilters *f, int i, int wstatus) {
+    ExecPool *x = &exec_pool;
+    char *desc = x->jobs[i].desc;
+    if (WIFEXITED(wstatus)) {
+        if (WEXITSTATUS(wstatus) != 0) {
+            fprintf(errout, "lf: %s: %s exited with status %d\n", desc,
+                    x->argv[0], WEXITSTATUS(wstatus));
+            termination_status = EXIT_FAILURE;
+        } else if (f->debug && (f->report_info || f->report_all))
+            fprintf(errout, "EXEC,0,%s\n", desc);
+    } else if (WIFSIGNALED(wstatus)) {
+        fprintf(errout, "lf: %s: %s killed by signal %d\n", desc, x->argv[0],
+                WTERMSIG(wstatus));
+        termination_status = EXIT_FAILURE;
+    }
+    free(desc);
+    if (x->jobs[i].pidfd >= 0)
+        close(x->jobs[i].pidfd);
+    x->jobs[i] = x->jobs[--x->running];
+}
+/** @brief Reap finished commands.
+    @param f SearchFilters struct
+    @param block Wait for at least one command to finish
+    @details Only the commands started here are waited for, so that a
+   program using lf as a library keeps its own children. While blocked,
+   the commands' pidfds are polled, or the oldest command is waited for
+   where the kernel has no pidfds.
+   */
+static void exec_reap(const SearchFilters *f, bool block) {
+    ExecPool *x = &exec_pool;
+    while (x->running > 0) {
+        bool reaped = false;
+        for (int i = 0; i < x->running;) {
+            int wstatus = 0;
+            pid_t pid = waitpid(x->jobs[i].pid, &wstatus, WNOHANG);
+            if (pid == 0 || (pid < 0 && errno == EINTR)) {
+                i++;
+                continue;
+            }
+            // ECHILD: reaped elsewhere, so there is nothing to report
+            exec_report(f, i, wstatus);
+            reaped = true;
+        }
+        if (reaped || !block || x->running == 0)
+            return;
+        int n = 0;
+        for (int i = 0; i < x->running; i++)
+            if (x->jobs[i].pidfd >= 0)
+                x->pfds[n++] = (struct pollfd){x->jobs[i].pidfd, POLLIN, 0};
+        if (n == x->running)
+            poll(x->pfds, n, -1);
+        else {
+            int wstatus;
+            if (waitpid(x->jobs[0].pid, &wstatus, 0) == x->jobs[0].pid)
+                exec_report(f, 0, wstatus);
+        }
+    }
+}
+/** @brief Start a command, waiting for a free job slot first.
+    @param f SearchFilters struct
+    @param argv Arguments, ending with nullptr
+    @param desc Description for the exit status report, freed when reaped
+   */
+static void exec_spawn(const SearchFilters *f, char **argv, char *desc) {
+    ExecPool *x = &exec_pool;
+    while (x->running >= x->max_jobs)
+        exec_reap(f, true);
+    pid_t pid;
+    int rc = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if (rc != 0) {
+        fprintf(errout, "lf: cannot run %s: %s\n", argv[0], strerror(rc));
+        termination_status = EXIT_FAILURE;
+        free(desc);
+        return;
+    }
+    x->jobs[x->running].pid = pid;
+    x->jobs[x->running].pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+    x->jobs[x->running].desc = desc;
+    x->running++;
+}
+/** @brief Run the command once for a path.
+    @param f SearchFilters struct
+    @param path Path of the file
+    @details Each "{}" within an argument is replaced by the path. If no
+   argument contains "{}", the path is appended.
+   */
+static void exec_one(const SearchFilters *f, const char *path) {
+    ExecPool *x = &exec_pool;
+    char *argv[MAXARGS + 1];
+    bool owned[MAXARGS + 1];
+    bool placed = false;
+    size_t path_len = strlen(path);
+    int argc;
+    for (argc = 0; argc < x->argc; argc++) {
+        const char *tmpl = x->argv[argc];
+        owned[argc] = false;
+        argv[argc] = (char *)tmpl;
+        if (!strstr(tmpl, "{}"))
+            continue;
+        size_t n = 0;
+        for (const char *s = tmpl; (s = strstr(s, "{}")); s += 2)
+            n++;
+        char *arg = malloc(strlen(tmpl) + n * path_len + 1);
+        char *d = arg;
+        for (const char *s = tmpl; *s;) {
+            if (s[0] == '{' && s[1] == '}') {
+                memcpy(d, path, path_len);
+                d += path_len;
+                s += 2;
+            } else
+                *d++ = *s++;
+        }
+        *d = '\0';
+        argv[argc] = arg;
+        owned[argc] = true;
+        placed = true;
+    }
+    if (!placed) {
+        owned[argc] = false;
+        argv[argc++] = (char *)path;
+    }
+    argv[argc] = nullptr;
+    exec_spawn(f, argv, strdup(path));
+    for (int i = 0; i < argc; i++)
+        if (owned[i])
+            free(argv[i]);
+}
+/** @brief Run the command with a batch of paths.
+    @param f SearchFilters struct
+    @param argv Command template followed by the paths, ending with nullptr
+    @param n Number of paths
+   */
+static void exec_batch(const SearchFilters *f, char **argv, size_t n) {
+    char desc[64];
+    snprintf(desc, sizeof(desc), "%zu file%s", n, n == 1 ? "" : "s");
+    exec_spawn(f, argv, strdup(desc));
+}
+/** @brief Launcher thread for -x.
+    @param arg SearchFilters struct
+    @details Takes paths from the queue and runs the command for each one,
+   or for each batch of them, keeping at most max_jobs commands running. A
+   partial batch is held until it is full, a --watch round ends, or no more
+   paths will be queued.
+   While commands are running the queue is checked with a timeout, so that
+   finished commands are reaped promptly.
+   */
+static void *exec_launcher(void *arg) {
+    const SearchFilters *f = arg;
+    ExecPool *x = &exec_pool;
+    size_t fixed = 0;
+    for (int i = 0; i < x->argc; i++)
+        fixed += strlen(x->argv[i]) + 1 + sizeof(char *);
+    char **bargv = NULL;
+    ExecItem **bitems = NULL;
+    size_t bcnt = 0, bmax = 0, bbytes = fixed;
+
+    for (;;) {
+        pthread_mutex_lock(&x->lock);
+        while (!x->head && !x->round && !x->done) {
+            if (x->running > 0) {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_nsec += 100 * 1000000L;
+                if (ts.tv_nsec >= 1000000000L) {
+                    ts.tv_sec++;
+                    ts.tv_nsec -= 1000000000L;
+                }
+                pthread_cond_timedwait(&x->cond, &x->lock, &ts);
+                break;
+            }
+            pthread_cond_wait(&x->cond, &x->lock);
+        }
+        ExecItem *items = x->head;
+        bool round = x->round, done = x->done;
+        x->head = x->tail = NULL;
+        x->round = false;
+        pthread_mutex_unlock(&x->lock);
+
+        exec_reap(f, false);
+        while (items) {
+            ExecItem *item = items;
+            items = items->next;
+            if (!x->batch) {
+                exec_one(f, item->path);
+                free(item);
+                continue;
+            }
+            size_t need = strlen(item->path) + 1 + sizeof(char *);
+            if (bcnt > 0 && bbytes + need > x->arg_max) {
+                bargv[x->argc + bcnt] = nullptr;
+                exec_batch(f, bargv, bcnt);
+                for (size_t i = 0; i < bcnt; i++)
+                    free(bitems[i]);
+                bcnt = 0;
+                bbytes = fixed;
+            }
+            if (bcnt + 1 >= bmax) {
+                bmax = bmax ? bmax * 2 : 1024;
+                bargv = realloc(bargv, (x->argc + bmax + 1) * sizeof(char *));
+                bitems = realloc(bitems, bmax * sizeof(ExecItem *));
+                memcpy(bargv, x->argv, x->argc * sizeof(char *));
+            }
+            bargv[x->argc + bcnt] = item->path;
+            bitems[bcnt++] = item;
+            bbytes += need;
+        }
+        if ((round || done) && bcnt > 0) {
+            bargv[x->argc + bcnt] = nullptr;
+            exec_batch(f, bargv, bcnt);
+            for (size_t i = 0; i < bcnt; i++)
+                free(bitems[i]);
+            bcnt = 0;
+            bbytes = fixed;
+        }
+        if (done)
+            break;
+    }
+    free(bargv);
+    free(bitems);
+    while (x->running > 0)
+        exec_reap(f, true);
+    return NULL;
+}
+/** @brief Wait for the launcher thread to run the remaining paths and for
+   every command to finish, then release the pool.
+   */
+static void exec_finish(void) {
+    ExecPool *x = &exec_pool;
+    pthread_mutex_lock(&x->lock);
+    x->done = true;
+    pthread_cond_signal(&x->cond);
+    pthread_mutex_unlock(&x->lock);
+    pthread_join(x->thread, NULL);
+    for (int i = 0; i < x->argc; i++)
+        free(x->argv[i]);
+    free(x->jobs);
+    free(x->pfds);
+    pthread_mutex_destroy(&x->lock);
+    pthread_cond_destroy(&x->cond);
+}
@@ -0,0 +1,457 @@
+/** @file lf_test.c
+    @brief Tests of the lf search engine through its library API
+    @details Each test builds a small tree in a temporary directory, runs
+    lf_search() on it with on_match set, as pick does, and checks what
+    arrives. lf_ring_enter is replaced, so that each io_uring fails
+    partway through its first batch. Prints a PASS or FAIL line for each
+    test, and exits non-zero if any failed.
+    @author Bill Waller
+    Copyright (c) 2025
+    MIT License
+    billxwaller@gmail.com
+    @date 2026-02-09
+ */
+
+#define _GNU_SOURCE
+#include "lf.h"
+#include <argp.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_FILES 1000 /**< entries in one directory, several batches */
+#define DUPE_FILES 3    /**< files alike */
+#define EXEC_FILES 5    /**< files removed by -x, fewer than a batch */
+#define WATCH_WAIT_MS 5000 /**< longest wait for a --watch round */
+#define RING_ENTERS 2      /**< io_uring_enter calls before it fails */
+
+static char root[] = "/tmp/lf_test.XXXXXX";
+static int failed;
+static bool finished; /**< main() got to the end, see early_exit() */
+static LfRingEnterFn real_ring_enter;
+static atomic_size_t live_matches; /**< matches so far, see run_lf() */
+
+static bool count_matches(void *, char **, size_t);
+static size_t run_lf(int, char **);
+static bool make_files(const char *, int, const char *);
+static void make_dir(char *, size_t, const char *);
+static size_t count_entries(const char *);
+static size_t count_fds(void);
+static int failing_ring_enter(int, unsigned, unsigned, unsigned);
+static void *watch_thread(void *);
+static size_t watch_until(char **, bool (*)(const char *), size_t);
+static bool link_file(const char *);
+static bool make_loop(const char *);
+static void check(const char *, size_t, size_t);
+static void early_exit(void);
+static void test_ring_fallback(void);
+static void test_dupes(void);
+static void test_exec_watch(void);
+static void test_watch_link(void);
+static void test_watch_cycle(void);
+static void test_exec(void);
+static void test_follow_links(void);
+static void test_utf8_quantifier(void);
+static void test_index_link(void);
+static void test_quiet(void);
+static void test_config_only(void);
+
+/** @brief on_match callback, counting the paths. */
+static bool count_matches(void *ctx, char **paths, size_t cnt) {
+    atomic_fetch_add((atomic_size_t *)ctx, cnt);
+    return true;
+}
+
+/** @brief Run lf with the given arguments, counting the matches in
+    live_matches as they arrive.
+    @return Count of matches */
+static size_t run_lf(int argc, char **argv) {
+    size_t found = 0;
+    SearchFilters *f = lf_new_filters();
+    if (!lf_parse_args(f, argc, argv, ARGP_NO_EXIT)) {
+        fprintf(stderr, "lf_test: bad arguments\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_store(&live_matches, 0);
+    f->on_match = count_matches;
+    f->match_ctx = &live_matches;
+    lf_search(f, argc, argv, &found);
+    lf_free_filters(f);
+    return atomic_load(&live_matches);
+}
+
+/** @brief Create files 0..cnt-1 in dir, holding text. */
+static bool make_files(const char *dir, int cnt, const char *text) {
+    char path[4096];
+    for (int i = 0; i < cnt; i++) {
+        snprintf(path, sizeof(path), "%s/%d", dir, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1)
+            return false;
+        bool ok = write(fd, text, strlen(text)) == (ssize_t)strlen(text);
+        close(fd);
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+/** @brief Create a directory under root, exiting if it can't be. */
+static void make_dir(char *dir, size_t size, const char *name) {
+    snprintf(dir, size, "%s/%s", root, name);
+    if (mkdir(dir, 0755) == -1) {
+        fprintf(stderr, "lf_test: %s: %s\n", dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+}
+
+/** @brief Count the entries of dir, other than . and .. */
+static size_t count_entries(const char *dir) {
+    size_t cnt = 0;
+    DIR *d = opendir(dir);
+    if (!d)
+        return 0;
+    for (struct dirent *e; (e = readdir(d));)
+        if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0)
+            cnt++;
+    closedir(d);
+    return cnt;
+}
+
+/** @brief Count this process's open file descriptors. */
+static size_t count_fds(void) {
+    return count_entries("/proc/self/fd");
+}
+
+/** @brief lf_ring_enter for the tests, failing each finder's ring after
+    RING_ENTERS calls, while some of its requests may be in flight. */
+static int failing_ring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+    static _Thread_local unsigned calls;
+    if (++calls > RING_ENTERS) {
+        errno = EIO;
+        return -1;
+    }
+    return real_ring_enter(fd, to_submit, min_complete, flags);
+}
+
+/** @brief Runs lf with the arguments in arg, until lf_cancel(). */
+static void *watch_thread(void *arg) {
+    char **argv = arg;
+    int argc = 0;
+    while (argv[argc])
+        argc++;
+    run_lf(argc, argv);
+    return NULL;
+}
+
+/** @brief Run lf --watch in argv, call change with the watched directory
+    once the scan is done, and wait for want matches.
+    @return Count of matches when lf was cancelled */
+static size_t watch_until(char **argv, bool (*change)(const char *),
+                          size_t want) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, watch_thread, argv) != 0) {
+        fprintf(stderr, "lf_test: cannot start search thread\n");
+        exit(EXIT_FAILURE);
+    }
+    struct timespec ts = {0, 10 * 1000000L};
+    // The scan of a small tree is done well before this
+    for (int ms = 0; ms < 200; ms += 10)
+        nanosleep(&ts, NULL);
+    int argc = 0;
+    while (argv[argc])
+        argc++;
+    if (!change(argv[argc - 1])) {
+        fprintf(stderr, "lf_test: %s: %s\n", argv[argc - 1], strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    for (int ms = 0; ms < WATCH_WAIT_MS && atomic_load(&live_matches) < want;
+         ms += 10)
+        nanosleep(&ts, NULL);
+    // Time for any extra matches to arrive
+    for (int ms = 0; ms < 200; ms += 10)
+        nanosleep(&ts, NULL);
+    size_t got = atomic_load(&live_matches);
+    lf_cancel();
+    pthread_join(thread, NULL);
+    return got;
+}
+
+/** @brief atexit() handler, failing the tests if the library called
+    exit() before they were all run. */
+static void early_exit(void) {
+    if (!finished) {
+        printf("lf_test: exit() called before the tests were done, FAIL\n");
+        fflush(stdout);
+        _exit(EXIT_FAILURE);
+    }
+}
+
+static void check(const char *name, size_t got, size_t want) {
+    printf("%s: got %zu, expected %zu, %s\n", name, got, want,
+           got == want ? "PASS" : "FAIL");
+    if (got != want)
+        failed++;
+}
+
+/** @brief A directory of several batches is read to the end after the
+    ring fails in the first, and the ring is closed. */
+static void test_ring_fallback(void) {
+    char dir[sizeof(root) + 16];
+    make_dir(dir, sizeof(dir), "ring");
+    if (!make_files(dir, RING_FILES, "")) {
+        fprintf(stderr, "lf_test: %s: %s\n", dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    char *argv[] = {"lf", "--io_uring", "-T", "1", dir, NULL};
+    size_t fds = count_fds();
+    check("ring_fallback", run_lf(5, argv), RING_FILES);
+    check("ring_fds", count_fds(), fds);
+}
+
+/** @brief Duplicates, listed after the search, reach on_match. */
+static void test_dupes(void) {
+    char dir[sizeof(root) + 16], other[sizeof(root) + 32];
+    make_dir(dir, sizeof(dir), "dupes");
+    make_dir(other, sizeof(other), "dupes/other");
+    if (!make_files(dir, DUPE_FILES, "alike\n") ||
+        !make_files(other, 1, "apart\n")) {
+        fprintf(stderr, "lf_test: %s: %s\n", dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    char *argv[] = {"lf", "--dupes", dir, NULL};
+    check("dupes", run_lf(3, argv), DUPE_FILES);
+}
+
+/** @brief With --watch, a partial "{} +" batch runs once the round ends. */
+static void test_exec_watch(void) {
+    char dir[sizeof(root) + 16];
+    make_dir(dir, sizeof(dir), "watch");
+    if (!make_files(dir, EXEC_FILES, "")) {
+        fprintf(stderr, "lf_test: %s: %s\n", dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    char *argv[] = {"lf", "--watch", "-x", "rm {} +", dir, NULL};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, watch_thread, argv) != 0) {
+        fprintf(stderr, "lf_test: cannot start search thread\n");
+        exit(EXIT_FAILURE);
+    }
+    struct timespec ts = {0, 10 * 1000000L};
+    for (int ms = 0; ms < WATCH_WAIT_MS && count_entries(dir) > 0; ms += 10)
+        nanosleep(&ts, NULL);
+    size_t left = count_entries(dir);
+    lf_cancel();
+    pthread_join(thread, NULL);
+    check("exec_watch", left, 0);
+}
+
+/** @brief Hard link root/linked into dir. */
+static bool link_file(const char *dir) {
+    char from[4096], to[4096];
+    snprintf(from, sizeof(from), "%s/linked", root);
+    snprintf(to, sizeof(to), "%s/linked", dir);
+    return link(from, to) == 0;
+}
+
+/** @brief Create dir/0/sub, holding a link back to dir. */
+static bool make_loop(const char *dir) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/0/sub", dir);
+    if (mkdir(path, 0755) == -1)
+        return false;
+    snprintf(path, sizeof(path), "%s/0/sub/loop", dir);
+    return symlink("../..", path) == 0;
+}
+
+/** @brief With --watch, a file hard linked into the tree is listed,
+    though it is never written. */
+static void test_watch_link(void) {
+    char dir[sizeof(root) + 16], from[sizeof(root) + 16];
+    make_dir(dir, sizeof(dir), "link");
+    snprintf(from, sizeof(from), "%s/linked", root);
+    if (!make_files(dir, 1, "") ||
+        close(open(from, O_WRONLY | O_CREAT, 0644)) == -1) {
+        fprintf(stderr, "lf_test: %s: %s\n", dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    char *argv[] = {"lf", "--watch", dir, NULL};
+    check("watch_link", watch_until(argv, link_file, 2), 2);
+}
+
+/** @brief With --watch -L, a link made back to an ancestor of a watched
+    directory is a cycle, as it is during the scan. */
+static void test_watch_cycle(void) {
+    char dir[sizeof(root) + 16], sub[sizeof(root) + 16];
+    make_dir(dir, sizeof(dir), "cycle");
+    make_dir(sub, sizeof(sub), "cycle/0");
+    char *argv[] = {"lf", "-L", "--watch", dir, NULL};
+    // 0, then 0/sub, but not 0/sub/loop
+    check("watch_cycle", watch_until(argv, make_loop, 2), 2);
+}
+
+/** @brief -x runs for every file in a search after an earlier -x search,
+    once per file this time, and leaves the caller's children alone. */
+static void test_exec(void) {
+    char dir[sizeof(root) + 16];
+    make_dir(dir, sizeof(dir), "exec");
+    if (!make_files(dir, EXEC_FILES, "")) {
+        fprintf(stderr, "lf_test: %s: %s\n", dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    pid_t child = fork();
+    if (child == 0)
+        _exit(EXIT_SUCCESS);
+    char *argv[] = {"lf", "-x", "rm {}", dir, NULL};
+    run_lf(4, argv);
+    check("exec", count_entries(dir), 0);
+    check("exec_children", waitpid(child, NULL, 0) == child, 1);
+}
+
+/** @brief With -L, a directory reached through a link is listed under
+    both paths, whichever thread reaches it first. */
+static void test_follow_links(void) {
+    char dir[sizeof(root) + 16], sub[sizeof(root) + 16],
+        link_path[sizeof(root) + 16];
+    make_dir(dir, sizeof(dir), "follow");
+    make_dir(sub, sizeof(sub), "follow/0");
+    snprintf(link_path, sizeof(link_path), "%s/follow/1", root);
+    if (!make_files(sub, 1, "") || symlink("0", link_path) == -1) {
+        fprintf(stderr, "lf_test: %s: %s\n", dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    char *argv[] = {"lf", "-L", dir, NULL};
+    // 0, 0/0, 1 and 1/0
+    check("follow_links", run_lf(3, argv), 4);
+}
+
+/** @brief A quantifier after a multibyte character makes the whole
+    character optional, not just its last byte, in the prefilter too. */
+static void test_utf8_quantifier(void) {
+    char dir[sizeof(root) + 16], path[sizeof(root) + 32];
+    make_dir(dir, sizeof(dir), "utf8");
+    const char *names[] = {"x", "\xc3\xa9x", "y"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        if (close(open(path, O_WRONLY | O_CREAT, 0644)) == -1) {
+            fprintf(stderr, "lf_test: %s: %s\n", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (!setlocale(LC_CTYPE, "C.UTF-8")) {
+        printf("utf8_quantifier: no C.UTF-8 locale, skipped\n");
+        return;
+    }
+    char *argv[] = {"lf", dir, "\xc3\xa9?x", NULL};
+    check("utf8_quantifier", run_lf(3, argv), 2);
+    setlocale(LC_CTYPE, "C");
+}
+
+/** @brief With -L and --use_index, a link whose target has become a
+    directory is descended, though the link's directory is unchanged. */
+static void test_index_link(void) {
+    char dir[sizeof(root) + 16], sub[sizeof(root) + 16],
+        path[sizeof(root) + 32], index[sizeof(root) + 16];
+    make_dir(dir, sizeof(dir), "index");
+    make_dir(sub, sizeof(sub), "index/s");
+    snprintf(path, sizeof(path), "%s/l", dir);
+    snprintf(index, sizeof(index), "%s/lf.index", root);
+    // Older than the index, so that it is trusted
+    struct timespec old[2] = {{time(NULL) - 3600, 0}, {time(NULL) - 3600, 0}};
+    if (!make_files(sub, 1, "") || symlink("s/0", path) == -1 ||
+        utimensat(AT_FDCWD, sub, old, 0) == -1 ||
+        utimensat(AT_FDCWD, dir, old, 0) == -1) {
+        fprintf(stderr, "lf_test: %s: %s\n", dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    char opt[sizeof(index) + 16];
+    snprintf(opt, sizeof(opt), "--index=%s", index);
+    char *build[] = {"lf", "-L", opt, dir, NULL};
+    run_lf(4, build);
+    // s/0 becomes a directory, holding s/0/0
+    snprintf(path, sizeof(path), "%s/0", sub);
+    if (unlink(path) == -1 || mkdir(path, 0755) == -1 ||
+        !make_files(path, 1, "")) {
+        fprintf(stderr, "lf_test: %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    snprintf(opt, sizeof(opt), "--use_index=%s", index);
+    char *argv[] = {"lf", "-L", opt, dir, NULL};
+    // l, l/0, s, s/0 and s/0/0
+    check("index_link", run_lf(4, argv), 5);
+}
+
+/** @brief With quiet set, lf writes nothing to stderr. */
+static void test_quiet(void) {
+    char path[sizeof(root) + 16];
+    snprintf(path, sizeof(path), "%s/stderr", root);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int save_fd = dup(STDERR_FILENO);
+    if (fd == -1 || save_fd == -1) {
+        fprintf(stderr, "lf_test: %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    // Sorting is dropped, with a warning, when watching
+    char *argv[] = {"lf", "--watch", "-S", root, NULL};
+    SearchFilters *f = lf_new_filters();
+    f->quiet = true;
+    lf_parse_args(f, 4, argv, ARGP_NO_EXIT);
+    lf_free_filters(f);
+    dup2(save_fd, STDERR_FILENO);
+    close(save_fd);
+    struct stat st;
+    check("quiet", stat(path, &st) == 0 ? (size_t)st.st_size : 1, 0);
+}
+
+/** @brief -D1 reports the configuration and returns, rather than exit. */
+static void test_config_only(void) {
+    char *argv[] = {"lf", "-D1", root, NULL};
+    size_t found = 0;
+    SearchFilters *f = lf_new_filters();
+    f->quiet = true;
+    lf_parse_args(f, 3, argv, ARGP_NO_EXIT);
+    int status = lf_search(f, 3, argv, &found);
+    lf_free_filters(f);
+    check("config_only", (size_t)status, EXIT_SUCCESS);
+}
+
+int main(void) {
+    if (mkdtemp(root) == NULL) {
+        fprintf(stderr, "lf_test: %s: %s\n", root, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    atexit(early_exit);
+    real_ring_enter = lf_ring_enter;
+    lf_ring_enter = failing_ring_enter;
+    test_ring_fallback();
+    test_dupes();
+    test_exec_watch();
+    test_watch_link();
+    test_watch_cycle();
+    test_exec();
+    test_follow_links();
+    test_utf8_quantifier();
+    test_index_link();
+    test_quiet();
+    test_config_only();
+    char cmd[sizeof(root) + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd) != 0)
+        fprintf(stderr, "lf_test: can't remove %s\n", root);
+    finished = true;
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -195,21 +195,23 @@ Pick *new_pick(Init *init, int argc, char **argv, uint begy, uint begx) {
         abend(-1, "init_pick_files failed");
         return nullptr;
     }
-    pick->m_object = calloc(OBJ_MAXCNT + 1, sizeof(char *));
-    if (pick->m_object == nullptr) {
-        ssnprintf(em0, MAXLEN - 1, "%s, line: %d", __FILE__, __LINE__ - 1);
-        ssnprintf(em1, MAXLEN - 1,
-                  "calloc pick->m_object = calloc(%d, %d) failed\n",
-                  OBJ_MAXCNT + 1, sizeof(char *));
-        display_error(em0, em1, nullptr, nullptr);
-        abend(-1, "User terminated program");
-    }
-    pick->d_object = calloc(OBJ_MAXCNT + 1, sizeof(char *));
-    if (pick->d_object == nullptr) {
-        ssnprintf(em0, MAXLEN - 1, "%s, line: %d", __FILE__, __LINE__ - 1);
-        ssnprintf(em1, MAXLEN - 1,
-                  "calloc pick->d_object = calloc(%d, %d) failed\n",
-                  OBJ_MAXCNT + 1, sizeof(char *));
+    // The object tables grow in save_object()
+    pick->obj_size = OBJ_TBL_INIT;
+    pick->pool_size = OBJ_POOL_INIT;
+    pick->obj_pool = malloc(pick->pool_size);
+    pick->obj_off = malloc(pick->obj_size * sizeof(size_t));
+    pick->obj_len = malloc(pick->obj_size * sizeof(uint));
+    pick->obj_mask = malloc(pick->obj_size * sizeof(uint64_t));
+    pick->d_object = malloc(pick->obj_size * sizeof(uint));
+    pick->d_score = malloc(pick->obj_size * sizeof(int));
+    pick->f_selected = calloc(pick->obj_size / 64, sizeof(uint64_t));
+    if (pick->obj_pool == nullptr || pick->obj_off == nullptr ||
+        pick->obj_len == nullptr || pick->obj_mask == nullptr ||
+        pick->d_object == nullptr || pick->d_score == nullptr ||
+        pick->f_selected == nullptr) {
+        ssnprintf(em0, MAXLEN - 1, "%s, line: %d", __FILE__, __LINE__ - 4);
+        ssnprintf(em1, MAXLEN - 1, "malloc pick object tables (%d) failed\n",
+                  OBJ_TBL_INIT);
         display_error(em0, em1, nullptr, nullptr);
         abend(-1, "User terminated program");
     }
@@ -226,14 +228,17 @@ Pick *destroy_pick(Init *init) {
     if (!init->pick)
         return nullptr;
 
-    for (pick->m_idx = 0; pick->m_idx < OBJ_MAXCNT; pick->m_idx++) {
-        if (pick->m_object[pick->m_idx] != nullptr)
-            free(pick->m_object[pick->m_idx]);
-        // if (pick->d_object[pick->d_idx] != nullptr)
-        //    free(pick->d_object[pick->d_idx]);
-    }
-    free(pick->m_object);
+    free_search(pick);
+    free(pick->obj_pool);
+    free(pick->obj_off);
+    free(pick->obj_len);
+    free(pick->obj_mask);
     free(pick->d_object);
+    free(pick->d_score);
+    free(pick->f_selected);
+    free_match(pick);
+    free_filters(pick);
+    free_frecency(pick);
     free(pick);
     init->pick = nullptr;
     init->pick_cnt--;
@@ -627,9 +632,15 @@ bool init_pick_files(Init *init, int argc, char **argv) {
     if (pick->receiver_cmd[0] != '\0')
         expand_tilde(pick->receiver_cmd, MAXLEN - 1);
     pick->select_max = init->select_max;
+    pick->p_jobs = init->p_jobs > 0 ? init->p_jobs : 0;
     pick->f_read_theme = init->f_read_theme;
     pick->f_multiple_cmd_args = init->f_multiple_cmd_args;
     pick->p_view_files = init->p_view_files;
+    pick->f_ignore_case = init->f_ignore_case;
+    pick->match_mode = str_to_match_mode(init->match_mode);
+    pick->f_frecency = init->f_frecency;
+    if (init->mapp_spec[0] != '\0')
+        strnz__cpy(pick->mapp_spec, init->mapp_spec, MAXLEN - 1);
     return true;
 }
 /** @brief Initialize Form file specifications
@@ -0,0 +1,326 @@
+/** @file pick_bench.c
+    @brief Benchmark Pick's search on a synthetic list
+    @details Fills a Pick with a reproducible list of paths, or the lines of
+    a file, and types each search term into it a character at a time, then
+    backspaces it away, as a user would in the line editor. Each keystroke
+    derives and ranks the objects for one page, and its time is kept.
+    Prints one JSON object per line: the list and host, then each term with
+    the median and slowest keystroke, typing and backspacing. Lines from two
+    builds, or with and without --no_cache, can be compared.
+    @author Bill Waller
+    Copyright (c) 2025
+    MIT License
+    billxwaller@gmail.com
+    @date 2026-02-09
+ */
+
+#define _GNU_SOURCE
+#include "common.h"
+#include <argp.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysinfo.h>
+#include <time.h>
+
+#define MAX_RUNS 100
+#define PAGE_OBJECTS 50 /**< objects ranked for display at each keystroke */
+
+typedef struct {
+    uint objects;  /**< Paths in the synthetic list */
+    unsigned seed; /**< Seed of the list's random numbers */
+    int runs;      /**< Runs of each term */
+    bool no_cache; /**< Search all objects at each keystroke */
+    char *input;   /**< File to read the list from instead */
+    char *terms;   /**< Comma separated search terms */
+    char *mode;    /**< fuzzy, exact or regex */
+} BenchOpts;
+
+/** Keystroke times of one term, in ms, over all runs */
+typedef struct {
+    double *ms;
+    size_t cnt;
+} Times;
+
+static const char *words[] = {
+    "src",     "lib",     "include", "docs",   "test",    "build",
+    "usr",     "share",   "local",   "config", "data",    "cache",
+    "project", "module",  "core",    "util",   "net",     "ui",
+    "engine",  "parser",  "render",  "store",  "index",   "http",
+    "Widget",  "Layout",  "Buffer",  "Event",  "Session", "Theme",
+    "pick",    "menu",    "form",    "view",   "python3", "node_modules"};
+#define WORD_CNT (sizeof(words) / sizeof(words[0]))
+
+static const char *exts[] = {".c", ".h", ".py", ".md", ".txt", ".json", ""};
+#define EXT_CNT (sizeof(exts) / sizeof(exts[0]))
+
+static uint64_t rng_next(uint64_t *);
+static bool fill_synthetic(Pick *, const BenchOpts *);
+static bool fill_file(Pick *, const char *);
+static void run_term(Pick *, const BenchOpts *, const char *, Times *,
+                     Times *, uint *);
+static double keystroke(Pick *, const BenchOpts *, char *);
+static double median(Times *);
+static double slowest(const Times *);
+static bool add_time(Times *, double);
+static void json_str(const char *);
+static int cmp_double(const void *, const void *);
+
+static struct argp_option options[] = {
+    {"objects", 'n', "number", 0, "Paths in the synthetic list (1000000)", 0},
+    {"seed", 's', "number", 0, "Seed of the list's random numbers (1)", 0},
+    {"runs", 'r', "number", 0, "Runs of each term (5)", 0},
+    {"input", 'i', "file_spec", 0, "Read the list from a file instead", 0},
+    {"terms", 't', "terms", 0,
+     "Comma separated search terms (src,pickeng,WidgetLayout,py,utilc)", 0},
+    {"match_mode", 'm', "mode", 0, "fuzzy, exact or regex (fuzzy)", 0},
+    {"no_cache", 'N', 0, 0, "Search every object at each keystroke", 0},
+    {0}};
+
+/** @brief Parse a single option. */
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+    BenchOpts *o = state->input;
+    switch (key) {
+    case 'n':
+        o->objects = strtoul(arg, NULL, 10);
+        break;
+    case 's':
+        o->seed = strtoul(arg, NULL, 10);
+        break;
+    case 'r':
+        o->runs = atoi(arg);
+        break;
+    case 'i':
+        o->input = arg;
+        break;
+    case 't':
+        o->terms = arg;
+        break;
+    case 'm':
+        o->mode = arg;
+        break;
+    case 'N':
+        o->no_cache = true;
+        break;
+    case ARGP_KEY_ARG:
+        argp_usage(state);
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static struct argp argp = {
+    options, parse_opt, NULL,
+    "Benchmark Pick's search by typing each term into a list of paths, a "
+    "character at a time, and backspacing it away.",
+    NULL, NULL, NULL};
+
+int main(int argc, char **argv) {
+    BenchOpts o = {1000000, 1, 5, false, NULL,
+                   "src,pickeng,WidgetLayout,py,utilc", "fuzzy"};
+    argp_parse(&argp, argc, argv, 0, 0, &o);
+    if (o.objects < 1 || o.runs < 1 || o.runs > MAX_RUNS ||
+        (strcmp(o.mode, "fuzzy") != 0 && strcmp(o.mode, "exact") != 0 &&
+         strcmp(o.mode, "regex") != 0)) {
+        fprintf(stderr, "pick_bench: parameter out of range\n");
+        exit(EXIT_FAILURE);
+    }
+    Init *init = calloc(1, sizeof(Init));
+    if (init == NULL || new_pick(init, 0, NULL, 0, 0) == NULL) {
+        fprintf(stderr, "pick_bench: %s\n", strerror(ENOMEM));
+        exit(EXIT_FAILURE);
+    }
+    Pick *p = init->pick;
+    p->match_mode = str_to_match_mode(o.mode);
+    // A page, as the search workers rank it
+    p->lines = PAGE_OBJECTS;
+    p->tbl_cols = 1;
+    if (!(o.input ? fill_file(p, o.input) : fill_synthetic(p, &o)))
+        exit(EXIT_FAILURE);
+
+    printf("{\"pick_bench\":1,\"version\":");
+    json_str(CM_VERSION);
+    printf(",\"input\":");
+    if (o.input)
+        json_str(o.input);
+    else
+        printf("null");
+    printf(",\"nprocs\":%d,\"objects\":%u,\"pool_kb\":%zu,\"seed\":%u,"
+           "\"runs\":%d,\"match_mode\":",
+           get_nprocs(), p->m_cnt, p->pool_len / 1024, o.seed, o.runs);
+    json_str(o.mode);
+    printf(",\"cache\":%s}\n", o.no_cache ? "false" : "true");
+    fflush(stdout);
+
+    char *terms = strdup(o.terms);
+    for (char *term = strtok(terms, ","); term; term = strtok(NULL, ",")) {
+        Times typed = {0}, back = {0};
+        uint matches = 0;
+        for (int r = 0; r < o.runs; r++)
+            run_term(p, &o, term, &typed, &back, &matches);
+        printf("{\"term\":");
+        json_str(term);
+        printf(",\"keystrokes\":%zu,\"matches\":%u,"
+               "\"type_ms_median\":%.3f,\"type_ms_max\":%.3f,"
+               "\"back_ms_median\":%.3f,\"back_ms_max\":%.3f}\n",
+               (typed.cnt + back.cnt) / o.runs, matches, median(&typed),
+               slowest(&typed), median(&back), slowest(&back));
+        fflush(stdout);
+        free(typed.ms);
+        free(back.ms);
+    }
+    free(terms);
+    destroy_pick(init);
+    free(init);
+    return EXIT_SUCCESS;
+}
+
+/** @brief xorshift64*, so a seed always gives the same list */
+static uint64_t rng_next(uint64_t *s) {
+    uint64_t x = *s;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *s = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/** @brief Fill the pick with paths of two to six directories, made of a
+    few dozen words, some numbered, and a file name with an extension. */
+static bool fill_synthetic(Pick *p, const BenchOpts *o) {
+    uint64_t rng = 0x9E3779B97F4A7C15ULL ^ o->seed;
+    char path[MAXLEN];
+    for (uint i = 0; i < o->objects; i++) {
+        uint64_t r = rng_next(&rng);
+        int depth = 2 + (int)(r % 5), len = 0;
+        for (int d = 0; d < depth; d++) {
+            r = rng_next(&rng);
+            len += snprintf(path + len, sizeof(path) - len, "/%s",
+                            words[r % WORD_CNT]);
+            if ((r >> 8) % 4 == 0)
+                len += snprintf(path + len, sizeof(path) - len, "%u",
+                                (unsigned)((r >> 16) % 100));
+        }
+        r = rng_next(&rng);
+        snprintf(path + len, sizeof(path) - len, "/%s_%u%s",
+                 words[r % WORD_CNT], (unsigned)((r >> 8) % 1000),
+                 exts[(r >> 24) % EXT_CNT]);
+        if (!save_object(p, path))
+            return false;
+    }
+    p->m_cnt = p->m_idx;
+    return true;
+}
+
+/** @brief Fill the pick with the lines of a file. */
+static bool fill_file(Pick *p, const char *file) {
+    FILE *fp = fopen(file, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "pick_bench: %s: %s\n", file, strerror(errno));
+        return false;
+    }
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, fp) != -1)
+        if (!save_object(p, line))
+            break;
+    free(line);
+    fclose(fp);
+    p->m_cnt = p->m_idx;
+    if (p->m_cnt == 0) {
+        fprintf(stderr, "pick_bench: %s: no objects\n", file);
+        return false;
+    }
+    return true;
+}
+
+/** @brief Type a term a character at a time, then backspace it away.
+    @param p Pick
+    @param o Options
+    @param term Search term
+    @param typed Receives the time of each character typed
+    @param back Receives the time of each backspace
+    @param matches Receives the count of objects the whole term matches
+   */
+static void run_term(Pick *p, const BenchOpts *o, const char *term,
+                     Times *typed, Times *back, uint *matches) {
+    char field[MAXLEN];
+    size_t len = strlen(term);
+    if (len >= MAXLEN)
+        len = MAXLEN - 1;
+    free_filters(p);
+    for (size_t i = 1; i <= len; i++) {
+        memcpy(field, term, i);
+        field[i] = '\0';
+        add_time(typed, keystroke(p, o, field));
+    }
+    *matches = p->d_cnt;
+    for (size_t i = len; i-- > 0;) {
+        field[i] = '\0';
+        add_time(back, keystroke(p, o, field));
+    }
+}
+
+/** @brief Derive and rank a page of objects for the field, as the line
+    editor does after each key.
+    @return Elapsed ms */
+static double keystroke(Pick *p, const BenchOpts *o, char *field) {
+    struct timespec t0, t1;
+    if (o->no_cache)
+        free_filters(p);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    match_objects(p, field);
+    rank_objects(p, PAGE_OBJECTS);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+}
+
+/** @brief Keep a keystroke time. */
+static bool add_time(Times *t, double ms) {
+    if ((t->cnt & (t->cnt - 1)) == 0) {
+        double *a = realloc(t->ms, (t->cnt ? t->cnt * 2 : 1) * sizeof(double));
+        if (a == NULL)
+            return false;
+        t->ms = a;
+    }
+    t->ms[t->cnt++] = ms;
+    return true;
+}
+
+/** @brief Median keystroke time, 0 if there are none. */
+static double median(Times *t) {
+    if (t->cnt == 0)
+        return 0;
+    qsort(t->ms, t->cnt, sizeof(double), cmp_double);
+    return t->ms[t->cnt / 2];
+}
+
+/** @brief Slowest keystroke time, 0 if there are none. */
+static double slowest(const Times *t) {
+    double max_ms = 0;
+    for (size_t i = 0; i < t->cnt; i++)
+        if (t->ms[i] > max_ms)
+            max_ms = t->ms[i];
+    return max_ms;
+}
+
+/** @brief Print a JSON string. */
+static void json_str(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            putchar('\\');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
@@ -12,18 +12,49 @@
  */
 
 #include "common.h"
+#include "lf.h"
+#include <argp.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
+
+/** @struct ExecArgs
+    @brief A command for execvp(), grown as arguments are added
+    @details bytes counts each argument's text and pointer, as they take
+   ARG_MAX. */
+typedef struct {
+    char **v; /**< arguments, nullptr terminated */
+    uint n;
+    uint max;
+    size_t bytes;
+} ExecArgs;
+
+/** @struct ExecJob
+    @brief A command running for one selected object, see exec_jobs() */
+typedef struct {
+    pid_t pid; /**< or 0 if the slot is free */
+    int pidfd; /**< readable once it ends, -1 if unsupported */
+    int fd;    /**< memfd of its output */
+    uint obj;  /**< index of its object */
+} ExecJob;
+
 int tbl_col, tbl_line, tbl_page, tbl_cols, pg_lines, tbl_pages;
 int obj_idx, calculated_idx;
 int pick_engine(Init *);
-void save_object(Pick *, char *);
+bool save_object(Pick *, char *);
 int picker(Init *, char *field);
 void display_pick_page(Pick *);
 void reverse_object(Pick *);
@@ -31,18 +62,36 @@ void unreverse_object(Pick *);
 void toggle_object(Pick *);
 int output_objects(Pick *);
 int exec_objects(Init *);
+static bool add_exec_arg(ExecArgs *, const char *);
+static void clear_exec_args(ExecArgs *);
+static bool join_exec_arg(String *, size_t *, const char *);
+static bool build_exec_args(Pick *, uint *, ExecArgs *, char **, uint, int,
+                            size_t);
+static void write_exec_job(int, ExecJob *, const char *, int);
+static int wait_exec_job(ExecJob *, struct pollfd *, uint, int *);
+static int exec_jobs(Init *, char **, uint, int);
 int open_pick_win(Init *);
 void display_pick_help(Init *);
 int read_pick_input(Init *);
+int read_lf_input(Init *, int, char **);
+int read_pipe_input(Init *, int, pid_t);
+void wait_pick_input(Pick *);
+void update_pick_input(Pick *, bool);
+void stop_pick_input(Pick *, bool);
 void deselect_object(Pick *);
 int read_theme(Init *);
 int new_pick_view(Init *);
-void new_view_file(Init *, char *);
 void end_pick_view(Init *);
 void destroy_pick_view(Init *);
-int match_objects(Pick *pick, char *s);
 void remove_right_angle(Pick *);
 void pick_std_chyron(Pick *);
+static void set_match_chyron_key(Pick *);
+static void show_pick_chyron(Pick *);
+static void show_pick_position(Pick *);
+#ifdef DEBUG_RENDER
+static unsigned long long written_bytes(void);
+static void log_pick_render(int);
+#endif
 int pipe_fd[2];
 
 char const pagers_editors[12][10] = {"view", "view", "less", "more",
@@ -62,20 +111,36 @@ char const pagers_editors[12][10] = {"view", "view", "less", "more",
     If provider_cmd is not specified, in_spec is used to read pick
     input from a file or stdin
     If provider_cmd is specified, it is executed and its output is
-    read as pick input */
+    read as pick input. An lf provider_cmd is run in-process instead,
+    see read_lf_input(). Provider and stdin input is read in the
+    background, pick opens once the first page is full, see
+    wait_pick_input(), and the rest is shown as it arrives. */
 int init_pick(Init *init, int argc, char **argv, uint by, uint bx) {
     struct stat sb;
     char *s_argv[MAXARGS];
     int s_argc;
     char tmp_str[MAXLEN];
     pid_t pid = 0;
+    bool f_lf = false;
 
     Pick *pick = new_pick(init, argc, argv, by, bx);
     if (init->pick != pick)
         abend(-1, "init->pick != pick\n");
+    open_frecency(pick);
     // SIO *sio = init->sio;
     if (pick->provider_cmd[0] != '\0') {
         s_argc = str_to_args(s_argv, pick->provider_cmd, MAXARGS - 1);
+        f_lf = base_name(tmp_str, s_argv[0]) && strcmp(tmp_str, "lf") == 0;
+    }
+    if (f_lf) {
+        if (read_lf_input(init, s_argc, s_argv) == -1) {
+            stop_pick_input(pick, true);
+            strnz__cpy(tmp_str, "Can't run pick lf provider: ", MAXLEN - 1);
+            strnz__cat(tmp_str, pick->provider_cmd, MAXLEN - 1);
+            Perror(tmp_str);
+            return (1);
+        }
+    } else if (pick->provider_cmd[0] != '\0') {
         if (pipe(pipe_fd) == -1) {
             Perror("pipe(pipe_fd) failed in init_pick");
             return (1);
@@ -108,18 +173,24 @@ int init_pick(Init *init, int argc, char **argv, uint by, uint bx) {
         /** Return to Parent
             Close write end of pipe as Parent only needs to read from pipe */
         close(pipe_fd[P_WRITE]);
-        /** Open a file pointer on read end of pipe */
-        pick->in_fp = fdopen(pipe_fd[P_READ], "rb");
+        /** Read the pipe as the provider writes it */
         pick->f_in_pipe = true;
         destroy_argv(s_argc, s_argv);
+        if (read_pipe_input(init, pipe_fd[P_READ], pid) == -1) {
+            close(pipe_fd[P_READ]);
+            kill(pid, SIGTERM);
+            waitpid(pid, nullptr, 0);
+            return (1);
+        }
     } else {
         if ((pick->in_spec[0] == '\0') || strcmp(pick->in_spec, "-") == 0 || strcmp(pick->in_spec, "/dev/stdin") == 0) {
             strnz__cpy(pick->in_spec, "/dev/stdin", MAXLEN - 1);
-            pick->in_fp = fdopen(STDIN_FILENO, "rb");
             pick->f_in_pipe = true;
+            if (read_pipe_input(init, STDIN_FILENO, 0) == -1)
+                return (1);
         }
     }
-    if (!pick->f_in_pipe) {
+    if (!pick->f_in_pipe && !f_lf) {
         /** No provider_cmd specified, so read pick input from file or stdin */
         if (lstat(pick->in_spec, &sb) == -1) {
             strnz__cpy(tmp_str, "Can\'t stat pick input file: ", MAXLEN - 1);
@@ -141,27 +212,32 @@ int init_pick(Init *init, int argc, char **argv, uint by, uint bx) {
         }
     }
     /*------------------------------------------------------------*/
-    if (pick->in_fp == nullptr) {
+    if (pick->in_fp == nullptr && pick->input == nullptr) {
         Perror("No pick input available");
         return (1);
     }
     /*------------------------------------------------------------*/
-    read_pick_input(init);
-    if (pick->f_in_pipe && pid > 0) {
-        waitpid(pid, nullptr, 0);
-        close(pipe_fd[P_READ]);
-        restore_curses_tioctl();
-        sig_prog_mode();
-    }
+    if (pick->input == nullptr)
+        read_pick_input(init);
+    else
+        wait_pick_input(pick);
     if (pick->m_cnt == 0) {
+        stop_pick_input(pick, true);
         Perror("No pick objects available");
         return (1);
     }
-    /** Enter pick_engine */
+    /** Enter pick_engine, ranked by frecency if it loads in time */
+    wait_frecency(pick, PICK_FRECENCY_WAIT_MS);
+    if (!compile_match(pick, "")) {
+        stop_pick_input(pick, true);
+        return (1);
+    }
     pick->m_idx = 0;
     pick->d_idx = 0;
-    while (pick->m_idx < pick->m_cnt)
-        pick->d_object[pick->d_idx++] = pick->m_object[pick->m_idx++];
+    while (pick->m_idx < pick->m_cnt) {
+        match_object(pick, pick->m_idx, &pick->d_score[pick->d_idx]);
+        pick->d_object[pick->d_idx++] = pick->m_idx++;
+    }
     pick->d_cnt = pick->d_idx;
     pick->chyron = new_chyron();
     set_chyron_key(pick->chyron, 1, "F1 Help", KEY_F01);
@@ -171,6 +247,7 @@ int init_pick(Init *init, int argc, char **argv, uint by, uint bx) {
     set_chyron_key(pick->chyron, 5, "<q> Quit View", 'q');
     set_chyron_key(pick->chyron, 6, "<Sp> Process", ' ');
     set_chyron_key(pick->chyron, 7, "<Sp> Edit", ' ');
+    set_match_chyron_key(pick);
     set_chyron_key(pick->chyron, 9, "<Tab> Search", '\t');
     set_chyron_key(pick->chyron, 10, "<Tab> Select", '\t');
     set_chyron_key(pick->chyron, 11, "PgUp", KEY_PPAGE);
@@ -179,6 +256,7 @@ int init_pick(Init *init, int argc, char **argv, uint by, uint bx) {
     pick_std_chyron(pick);
     compile_chyron(pick->chyron);
     pick_engine(init);
+    stop_pick_input(pick, true);
     cm_surface_destroy(pick->surface);
     if (pick->p_view_files)
         destroy_pick_view(init);
@@ -195,6 +273,7 @@ int init_pick(Init *init, int argc, char **argv, uint by, uint bx) {
 void destroy_pick_view(Init *init) {
     Pick *pick = init->pick;
     View *view = init->view;
+    free_preview(pick);
     ui_surface_destroy(view->sfc);
     if (pick->p_view_files) {
         if (view->buf != nullptr) {
@@ -211,20 +290,24 @@ void destroy_pick_view(Init *init) {
     @param init Pointer to Init structure containing pick information
     @return 0 on success, -1 if no objects were read
     @details Reads lines from pick->in_fp and saves them as objects in the pick
-   structure using save_object function. If no objects are read, returns -1.
+   structure using save_object function. Lines of any length are read whole.
+   If no objects are read, returns -1.
    Otherwise, sets obj_cnt to the number of objects read and resets obj_idx to 0
    before returning 0. */
 int read_pick_input(Init *init) {
     int i;
+    char *line = nullptr;
+    size_t line_size = 0;
 
     Pick *pick = init->pick;
     pick->select_cnt = 0;
     pick->tbl_pages = 1;
 
     if (pick->in_fp) {
-        while (fgets(pick->in_buf, sizeof(pick->in_buf), pick->in_fp) != nullptr)
-            save_object(pick, pick->in_buf);
-
+        while (getline(&line, &line_size, pick->in_fp) != -1)
+            if (!save_object(pick, line))
+                break;
+        free(line);
     } else
         for (i = 1; i < pick->argc; i++)
             save_object(pick, pick->argv[i]);
@@ -235,6 +318,385 @@ int read_pick_input(Init *init) {
     pick->m_cnt = pick->m_idx;
     return 0;
 }
+/** @struct PickInput
+    @brief Provider input, read by a background thread
+    @details The reader thread only appends what arrives to buf. The pick
+   thread turns it into objects in update_pick_input(), so the object store,
+   and everything else pick displays, is only ever used by one thread. */
+struct PickInput {
+    pthread_t thread;
+    bool f_thread;       /**< thread was started, and is to be joined */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; /**< signaled as input arrives, and at its end */
+    char *buf;           /**< input not yet seen by the pick thread */
+    size_t len;
+    size_t size;
+    bool done;           /**< all input has arrived */
+    atomic_bool cancel;  /**< pick is closing */
+    char *work;          /**< pick thread's copy, a partial line at the end */
+    size_t work_len;
+    size_t work_size;
+    int fd;              /**< pipe from the provider, or -1 for lf */
+    int wake[2];         /**< wakes a reader blocked in poll() to cancel */
+    pid_t pid;           /**< forked provider, or 0 */
+    SearchFilters *f;    /**< in-process lf provider */
+    int argc;            /**< lf argument count */
+    char **argv;         /**< lf arguments, used until the search ends */
+};
+
+/** @brief Appends input for the pick thread, growing the buffer as needed
+ *  @ingroup pick_engine
+    @param in PickInput, with its mutex held
+    @param s Input
+    @param n Bytes of input
+    @return false if memory is exhausted */
+static bool append_input(PickInput *in, const char *s, size_t n) {
+    if (in->len + n > in->size) {
+        size_t size = in->size ? in->size : BUFSIZ;
+        while (in->len + n > size)
+            size *= 2;
+        char *buf = realloc(in->buf, size);
+        if (buf == nullptr)
+            return false;
+        in->buf = buf;
+        in->size = size;
+    }
+    memcpy(in->buf + in->len, s, n);
+    in->len += n;
+    return true;
+}
+/** @brief Ends the input, waking the pick thread
+ *  @ingroup pick_engine */
+static void end_input(PickInput *in) {
+    pthread_mutex_lock(&in->mutex);
+    in->done = true;
+    pthread_cond_signal(&in->cond);
+    pthread_mutex_unlock(&in->mutex);
+}
+/** @brief Reader thread for a provider pipe or stdin
+ *  @ingroup pick_engine
+    @param arg PickInput
+    @details Reads until end of file, or until woken through in->wake when
+   pick is closing. */
+static void *read_pipe_thread(void *arg) {
+    PickInput *in = arg;
+    char buf[65536];
+    struct pollfd pfd[2] = {{.fd = in->fd, .events = POLLIN},
+                            {.fd = in->wake[0], .events = POLLIN}};
+    while (!atomic_load(&in->cancel)) {
+        if (poll(pfd, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (pfd[1].revents)
+            break;
+        ssize_t n = read(in->fd, buf, sizeof(buf));
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        pthread_mutex_lock(&in->mutex);
+        bool ok = append_input(in, buf, n);
+        pthread_cond_signal(&in->cond);
+        pthread_mutex_unlock(&in->mutex);
+        if (!ok)
+            break;
+    }
+    end_input(in);
+    return nullptr;
+}
+/** @brief lf_search() callback, passes a batch of paths to the pick thread
+ *  @ingroup pick_engine
+    @param ctx Pointer to PickInput
+    @param paths Paths found by lf
+    @param cnt Number of paths
+    @return false once pick is closing, which ends the search */
+static bool save_lf_objects(void *ctx, char **paths, size_t cnt) {
+    PickInput *in = (PickInput *)ctx;
+    bool ok = true;
+    pthread_mutex_lock(&in->mutex);
+    for (size_t i = 0; i < cnt && ok; i++)
+        ok = append_input(in, paths[i], strlen(paths[i])) &&
+             append_input(in, "\n", 1);
+    pthread_cond_signal(&in->cond);
+    pthread_mutex_unlock(&in->mutex);
+    return ok && !atomic_load(&in->cancel);
+}
+/** @brief Search thread for an in-process lf provider
+ *  @ingroup pick_engine */
+static void *read_lf_thread(void *arg) {
+    PickInput *in = arg;
+    if (!atomic_load(&in->cancel))
+        lf_search(in->f, in->argc, in->argv, nullptr);
+    end_input(in);
+    return nullptr;
+}
+/** @brief Attaches a PickInput to pick and starts its thread
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param in PickInput, filled in by the caller
+    @param reader Thread function, or nullptr if there is nothing to read
+    @details If the thread can't be started, the input is read before
+   returning, as it was before pick read it in the background. */
+static void start_pick_input(Pick *pick, PickInput *in,
+                             void *(*reader)(void *)) {
+    pthread_mutex_init(&in->mutex, nullptr);
+    pthread_cond_init(&in->cond, nullptr);
+    atomic_init(&in->cancel, false);
+    pick->input = in;
+    if (reader == nullptr)
+        in->done = true;
+    else if (pthread_create(&in->thread, nullptr, reader, in) == 0)
+        in->f_thread = true;
+    else
+        reader(in);
+}
+/** @brief Reads a provider pipe, or stdin, on a background thread
+ *  @ingroup pick_engine
+    @param init Pointer to Init structure containing pick information
+    @param fd Read end of the provider's pipe, or STDIN_FILENO
+    @param pid Provider process, or 0 for stdin
+    @return 0 on success, -1 on failure
+    @details The objects arrive as pick runs, see update_pick_input(). The
+   provider is killed if pick closes first. */
+int read_pipe_input(Init *init, int fd, pid_t pid) {
+    Pick *pick = init->pick;
+    pick->select_cnt = 0;
+    pick->tbl_pages = 1;
+    PickInput *in = calloc(1, sizeof(PickInput));
+    if (in == nullptr) {
+        Perror("calloc PickInput failed");
+        return -1;
+    }
+    in->fd = fd;
+    in->pid = pid;
+    if (pipe(in->wake) == -1) {
+        Perror("pipe(in->wake) failed in read_pipe_input");
+        free(in);
+        return -1;
+    }
+    start_pick_input(pick, in, read_pipe_thread);
+    return 0;
+}
+/** @brief Runs an lf provider_cmd in-process on a background thread
+ *  @ingroup pick_engine
+    @param init Pointer to Init structure containing pick information
+    @param argc Argument count of provider_cmd
+    @param argv Argument vector of provider_cmd, argv[0] being "lf", freed
+   with the PickInput once the search is over
+    @return 0 on success, -1 if lf's arguments are not usable
+    @details Matches are passed straight from the lf finder threads to the
+   pick thread, so there is no fork, exec or pipe, and the search is
+   cancelled if pick closes first. As with a forked provider, lf's messages
+   are discarded rather than written over the screen. */
+int read_lf_input(Init *init, int argc, char **argv) {
+    Pick *pick = init->pick;
+    pick->select_cnt = 0;
+    pick->tbl_pages = 1;
+
+    PickInput *in = calloc(1, sizeof(PickInput));
+    if (in == nullptr) {
+        Perror("calloc PickInput failed");
+        destroy_argv(argc, argv);
+        return -1;
+    }
+    in->fd = -1;
+    in->wake[0] = in->wake[1] = -1;
+    in->argc = argc;
+    in->argv = argv;
+    in->f = lf_new_filters();
+    in->f->quiet = true;
+    // --help and --usage would be written over the screen
+    if (!lf_parse_args(in->f, argc, argv,
+                       ARGP_NO_EXIT | ARGP_NO_ERRS | ARGP_NO_HELP) ||
+        in->f->exec) {
+        // Nothing to read, so no objects
+        start_pick_input(pick, in, nullptr);
+        return -1;
+    }
+    // Pick ends the search, it doesn't watch for new files
+    in->f->watch = false;
+    in->f->on_match = save_lf_objects;
+    in->f->match_ctx = in;
+    start_pick_input(pick, in, read_lf_thread);
+    return 0;
+}
+/** @brief Saves the input that has arrived as objects
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @return true once all input has arrived and been saved
+    @details Only complete lines are saved, a partial last line waits for
+   the rest of it, or for the end of the input. */
+static bool save_pick_input(Pick *pick) {
+    PickInput *in = pick->input;
+    bool done;
+
+    pthread_mutex_lock(&in->mutex);
+    if (in->work_len + in->len + 1 > in->work_size) {
+        size_t size = in->work_len + in->len + 1;
+        char *work = realloc(in->work, size);
+        if (work == nullptr) {
+            pthread_mutex_unlock(&in->mutex);
+            return true;
+        }
+        in->work = work;
+        in->work_size = size;
+    }
+    memcpy(in->work + in->work_len, in->buf, in->len);
+    in->work_len += in->len;
+    in->len = 0;
+    done = in->done;
+    pthread_mutex_unlock(&in->mutex);
+
+    char *s = in->work;
+    char *end = in->work + in->work_len;
+    char *nl;
+    while ((nl = memchr(s, '\n', end - s)) != nullptr) {
+        *nl = '\0';
+        if (!save_object(pick, s))
+            return true;
+        s = nl + 1;
+    }
+    if (done && s < end) {
+        *end = '\0';
+        if (!save_object(pick, s))
+            return true;
+        s = end;
+    }
+    in->work_len = end - s;
+    memmove(in->work, s, in->work_len);
+    pick->m_cnt = pick->m_idx;
+    return done;
+}
+/** @brief Waits until the input fills the first page, or ends
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @details A provider that is slow to start leaves pick waiting for its
+   first object, but no longer than PICK_FIRST_PAGE_MS for a full page, so
+   the time to the first interaction doesn't depend on the provider's
+   runtime. */
+void wait_pick_input(Pick *pick) {
+    uint maxy, maxx;
+    struct timespec deadline, ts;
+
+    ui_get_screen_size(&maxy, &maxx);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += PICK_FIRST_PAGE_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    while (pick->input) {
+        if (save_pick_input(pick)) {
+            stop_pick_input(pick, false);
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        if (pick->m_cnt >= maxy ||
+            (pick->m_cnt > 0 && (ts.tv_sec > deadline.tv_sec ||
+                                 (ts.tv_sec == deadline.tv_sec &&
+                                  ts.tv_nsec >= deadline.tv_nsec))))
+            break;
+        // Wake up for new input, or at the deadline
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += PICK_INPUT_TICK_MS * 1000000L / 4;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        PickInput *in = pick->input;
+        pthread_mutex_lock(&in->mutex);
+        if (in->len == 0 && !in->done)
+            pthread_cond_timedwait(&in->cond, &in->mutex, &ts);
+        pthread_mutex_unlock(&in->mutex);
+    }
+}
+/** @brief Shows the input that has arrived since the last call
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param highlight Redraw the highlighted object, as the pick objects
+   loop does, rather than the plain page of the line editor loop
+    @details New objects are saved, and those matching the current search
+   term are appended to the derived object table. The current page is
+   redrawn if they land on it, and the page count is updated. Called by
+   pick_get_event() on each PICK_INPUT_TICK_MS timeout while input is
+   arriving. */
+void update_pick_input(Pick *pick, bool highlight) {
+    uint m = pick->m_cnt;
+    uint d_cnt = pick->d_cnt;
+    uint d_idx = pick->d_idx;
+    uint y = pick->y, x = pick->x;
+    int score;
+
+    if (save_pick_input(pick))
+        stop_pick_input(pick, false);
+    for (; m < pick->m_cnt; m++)
+        if (match_object(pick, m, &score)) {
+            pick->d_score[pick->d_cnt] = score;
+            pick->d_object[pick->d_cnt++] = m;
+        }
+    if (pick->d_cnt == d_cnt)
+        return;
+    if (d_cnt < (pick->tbl_page + 1) * pick->lines * pick->tbl_cols) {
+        display_pick_page(pick);
+        pick->d_idx = d_idx;
+        pick->y = y;
+        pick->x = x;
+        if (highlight)
+            reverse_object(pick);
+    } else
+        pick->tbl_pages = (pick->d_cnt + pick->lines * pick->tbl_cols - 1) /
+                          (pick->lines * pick->tbl_cols);
+    show_pick_position(pick);
+}
+/** @brief Ends the input, cancelling the provider if it is still running
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param cancel Stop the provider, as pick is closing
+    @details Waits for the reader thread and the provider, then restores
+   the terminal and stderr as they were before the provider started. */
+void stop_pick_input(Pick *pick, bool cancel) {
+    PickInput *in = pick->input;
+    if (in == nullptr)
+        return;
+    if (cancel) {
+        atomic_store(&in->cancel, true);
+        if (in->wake[1] != -1)
+            write(in->wake[1], "", 1);
+        if (in->pid > 0)
+            kill(in->pid, SIGTERM);
+    }
+    if (in->f_thread && cancel && in->f) {
+        // lf_cancel() is lost if it comes before lf_search() starts
+        struct timespec ts;
+        do {
+            lf_cancel();
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += PICK_INPUT_TICK_MS * 1000000L;
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+        } while (pthread_timedjoin_np(in->thread, nullptr, &ts) == ETIMEDOUT);
+    } else if (in->f_thread)
+        pthread_join(in->thread, nullptr);
+    if (in->fd > STDIN_FILENO)
+        close(in->fd);
+    if (in->wake[0] != -1) {
+        close(in->wake[0]);
+        close(in->wake[1]);
+    }
+    if (in->pid > 0) {
+        waitpid(in->pid, nullptr, 0);
+        restore_curses_tioctl();
+        sig_prog_mode();
+    }
+    if (in->f) {
+        lf_free_filters(in->f);
+        destroy_argv(in->argc, in->argv);
+    }
+    pthread_mutex_destroy(&in->mutex);
+    pthread_cond_destroy(&in->cond);
+    free(in->buf);
+    free(in->work);
+    free(in);
+    pick->input = nullptr;
+}
 /** @brief Initializes pick interface, calculates window size and position, and
    enters picker loop
  *  @ingroup pick_engine
@@ -280,15 +742,17 @@ int pick_engine(Init *init) {
         pick->lines = usable_lines;
 
     pick->tbl_col_width = max(pick->tbl_col_width, 4);
-    pick->tbl_col_width = min(pick->tbl_col_width, (maxx - (2 + pick->begx)));
-    if (pick->d_cnt <= pick->lines) {
+    // Room for at least one column, however long the objects are
+    pick->tbl_col_width = min(pick->tbl_col_width, (maxx - (3 + pick->begx)));
+    // Input still arriving is expected to fill more than one page
+    if (pick->d_cnt <= pick->lines && pick->input == nullptr) {
         pick->tbl_lines = pick->d_cnt;
         pick->lines = pick->d_cnt;
         pick->tbl_cols = 1;
     } else {
         tbl_max_cols = ((maxx - (2 + pick->begx)) / (pick->tbl_col_width + 1));
         pg_max_objs = pick->lines * tbl_max_cols;
-        if (pick->d_cnt > pg_max_objs)
+        if (pick->d_cnt > pg_max_objs || pick->input)
             pick->tbl_cols = tbl_max_cols;
         else
             pick->tbl_cols = pick->d_cnt / pick->lines;
@@ -343,6 +807,7 @@ int pick_engine(Init *init) {
                     f_processed = true;
                 }
                 if (f_processed) {
+                    record_frecency(pick);
                     ui_mvwaddstr(pick->surface, WIN2, 0, 0, "Selection Processed");
                     ui_wclrtoeol(pick->surface, WIN2);
                 }
@@ -370,6 +835,7 @@ void pick_std_chyron(Pick *pick) {
     // ?   5  <q> Quit View   <q>
     // ?   6  <Sp> Toggle     <Sp>
     // ?   7  <Sp> Edit       <Sp>
+    // ?   8  ^R Fuzzy        Ctrl('r')
     // ?   9  <Tab> Search    <Tab>
     // ?  10  <Tab> Select"   <Tab>
     // ?  11  PgUp            KEY_PPAGE
@@ -382,34 +848,272 @@ void pick_std_chyron(Pick *pick) {
     pick->chyron->key[5]->active = false;                                                // <q> Quit View
     pick->chyron->key[6]->active = pick->select_max == 1 ? false : true;                 // <Sp> Toggle
     pick->chyron->key[7]->active = pick->select_max == 1 ? true : false;                 // <Sp> Process
+    pick->chyron->key[8]->active = false;                                                // ^R Match mode
     pick->chyron->key[9]->active = true;                                                 // <Tab> Search;
     pick->chyron->key[10]->active = false;                                               // <Tab> Select;
     pick->chyron->key[11]->active = pick->tbl_page > 0 ? true : false;                   // PgUp
     pick->chyron->key[12]->active = pick->tbl_page < pick->tbl_pages - 1 ? true : false; // PgDn
     pick->chyron->key[13]->active = false;                                               // INS
 }
+/** @brief Labels the chyron key that selects the match mode
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure */
+static void set_match_chyron_key(Pick *pick) {
+    static char *const label[] = {"^R Fuzzy", "^R Exact", "^R Regex"};
+    set_chyron_key(pick->chyron, 8, label[pick->match_mode], Ctrl('r'));
+    pick->f_chyron_shown = false;
+}
+/** @brief Shows the chyron, if its keys have changed since it was shown
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @details The keys are set active or not on every pass of the picker,
+   but seldom change. Compiling the chyron and drawing it again is left
+   for when they do, or when a label has changed, which its setter marks
+   by clearing f_chyron_shown. */
+static void show_pick_chyron(Pick *pick) {
+    uint keys = 0;
+    for (uint k = 0; k < CHYRON_KEYS; k++)
+        if (pick->chyron->key[k]->active)
+            keys |= 1u << k;
+    if (pick->f_chyron_shown && keys == pick->chyron_keys)
+        return;
+    compile_chyron(pick->chyron);
+    display_chyron(pick->surface, WIN2, pick->chyron, 1, pick->chyron->l);
+    pick->chyron_keys = keys;
+    pick->f_chyron_shown = true;
+}
+/** @brief Shows "Line x, Page y/z" in the separator, if it has changed
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure */
+static void show_pick_position(Pick *pick) {
+    char tmp_str[sizeof(pick->position)];
+    ssnprintf(tmp_str, sizeof(tmp_str) - 1, "Line %d, Page %d/%d",
+              pick->tbl_line + 1, pick->tbl_page + 1, pick->tbl_pages);
+    if (strcmp(tmp_str, pick->position) == 0)
+        return;
+    strnz__cpy(pick->position, tmp_str, sizeof(pick->position) - 1);
+    border_ysplit_text(pick->surface, tmp_str, pick->separator_line);
+}
+#ifdef DEBUG_RENDER
+/** @brief Bytes this process has written, from /proc/self/io
+ *  @ingroup pick_engine */
+static unsigned long long written_bytes(void) {
+    char buf[512];
+    unsigned long long wchar = 0;
+    int fd = open("/proc/self/io", O_RDONLY);
+    if (fd < 0)
+        return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    char *p = strstr(buf, "wchar:");
+    if (p)
+        wchar = strtoull(p + 6, nullptr, 10);
+    return wchar;
+}
+/** @brief Logs the frames and bytes it took to show a key's effect
+ *  @ingroup pick_engine
+    @param in_key The key just received
+    @details Called as each key arrives. What was rendered, and written to
+   the terminal, since the key before is what it took to show that key,
+   along with any input that arrived while waiting for this one. */
+static void log_pick_render(int in_key) {
+    static int prev_key = -1;
+    static unsigned long prev_frames;
+    static unsigned long long prev_bytes;
+    char tmp_str[MAXLEN];
+    unsigned long frames = ui_render_count();
+    unsigned long long bytes = written_bytes();
+    if (prev_key != -1 && cmenu_log_fd > STDERR_FILENO) {
+        ssnprintf(tmp_str, MAXLEN - 1, "pick key %d: %lu frames, %llu bytes",
+                  prev_key, frames - prev_frames, bytes - prev_bytes);
+        write_cmenu_log(tmp_str);
+    }
+    prev_key = in_key;
+    prev_frames = ui_render_count();
+    prev_bytes = written_bytes();
+}
+#endif
+/** @brief Grows the object tables and the selection bitset
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @return false if memory is exhausted
+    @details The tables double, so saving n objects copies each entry about
+   once. d_object and d_score are grown with them, since they can hold
+   every object. */
+static bool grow_object_tables(Pick *pick) {
+    uint size = pick->obj_size * 2;
+    if (size <= pick->obj_size)
+        return false;
+    size_t *off = realloc(pick->obj_off, size * sizeof(size_t));
+    if (off == nullptr)
+        return false;
+    pick->obj_off = off;
+    uint *len = realloc(pick->obj_len, size * sizeof(uint));
+    if (len == nullptr)
+        return false;
+    pick->obj_len = len;
+    uint64_t *mask = realloc(pick->obj_mask, size * sizeof(uint64_t));
+    if (mask == nullptr)
+        return false;
+    pick->obj_mask = mask;
+    uint *d_object = realloc(pick->d_object, size * sizeof(uint));
+    if (d_object == nullptr)
+        return false;
+    pick->d_object = d_object;
+    int *d_score = realloc(pick->d_score, size * sizeof(int));
+    if (d_score == nullptr)
+        return false;
+    pick->d_score = d_score;
+    uint64_t *sel = realloc(pick->f_selected, size / 64 * sizeof(uint64_t));
+    if (sel == nullptr)
+        return false;
+    memset(sel + pick->obj_size / 64, 0, (size - pick->obj_size) / 64 *
+                                             sizeof(uint64_t));
+    pick->f_selected = sel;
+    pick->obj_size = size;
+    return true;
+}
 /** @brief Saves a string as an object in the pick structure
  *  @ingroup pick_engine
     @param pick Pointer to Pick structure
-    @param s String to save as an object
-    @details If the current object index is less than the maximum allowed, saves
-   the string as an object in the pick structure. Updates the column width if
-   necessary and marks the object as not selected. Increments the object index
-   for the next object to be saved. */
-void save_object(Pick *pick, char *s) {
-    uint l;
-
-    if (pick->m_idx < OBJ_MAXCNT - 1) {
-        l = strlen(s);
-        if (l > OBJ_MAXLEN - 1)
-            s[OBJ_MAXLEN - 1] = '\0';
-        pick->tbl_col_width = max(pick->tbl_col_width, l);
-        l = max(l, 1);
-        pick->m_object[pick->m_idx] = (char *)calloc(l + 1, sizeof(char));
-        strnz__cpy(pick->m_object[pick->m_idx], s, l);
-        pick->f_selected[pick->m_idx] = false;
-        pick->m_idx++;
+    @param s String to save as an object, ending at a newline or nul
+    @return false if memory is exhausted, which ends the input
+    @details The string is appended to the object pool and its offset and
+   length to the master object table, both growing as needed, so neither the
+   number of objects nor their length is limited. Updates the column width if
+   necessary. Increments the object index for the next object to be saved. */
+bool save_object(Pick *pick, char *s) {
+    size_t l = strcspn(s, "\r\n");
+    if (pick->m_idx == pick->obj_size && !grow_object_tables(pick)) {
+        Perror("Out of memory, pick input truncated");
+        return false;
+    }
+    if (pick->pool_len + l + 1 > pick->pool_size) {
+        size_t size = pick->pool_size * 2;
+        while (pick->pool_len + l + 1 > size)
+            size *= 2;
+        char *pool = realloc(pick->obj_pool, size);
+        if (pool == nullptr) {
+            Perror("Out of memory, pick input truncated");
+            return false;
+        }
+        pick->obj_pool = pool;
+        pick->pool_size = size;
     }
+    memcpy(pick->obj_pool + pick->pool_len, s, l);
+    pick->obj_pool[pick->pool_len + l] = '\0';
+    pick->obj_off[pick->m_idx] = pick->pool_len;
+    pick->obj_len[pick->m_idx] = l;
+    pick->obj_mask[pick->m_idx] = object_mask(s, l);
+    pick->pool_len += l + 1;
+    pick->tbl_col_width = max(pick->tbl_col_width, l);
+    pick->m_idx++;
+    return true;
+}
+/** @brief Returns a master object
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param m Master object index
+    @return The object's string in the object pool, valid until the next
+   save_object() */
+char *pick_object(Pick *pick, uint m) {
+    return pick->obj_pool + pick->obj_off[m];
+}
+/** @brief Returns a displayed object
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param d Derived (display) object index
+    @return The object's string in the object pool */
+char *display_object(Pick *pick, uint d) {
+    return pick->obj_pool + pick->obj_off[pick->d_object[d]];
+}
+/** @brief Tells whether a master object is selected
+ *  @ingroup pick_engine */
+bool object_selected(Pick *pick, uint m) {
+    return (pick->f_selected[m / 64] >> (m % 64)) & 1;
+}
+/** @brief Selects or deselects a master object, keeping select_cnt
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param m Master object index
+    @param selected New state */
+void select_object(Pick *pick, uint m, bool selected) {
+    uint64_t bit = (uint64_t)1 << (m % 64);
+    if (object_selected(pick, m) == selected)
+        return;
+    pick->f_selected[m / 64] ^= bit;
+    if (selected)
+        pick->select_cnt++;
+    else
+        pick->select_cnt--;
+}
+/** @brief Finds the next selected master object
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param m Master object index to start from
+    @return Index of the first selected object at or after m, or m_cnt if
+   there is none
+    @details Skips 64 unselected objects at a time, so walking a few
+   selections among millions of objects is fast. */
+uint next_selected(Pick *pick, uint m) {
+    while (m < pick->m_cnt) {
+        uint64_t w = pick->f_selected[m / 64] >> (m % 64);
+        if (w)
+            return min(m + (uint)__builtin_ctzll(w), pick->m_cnt);
+        m = (m / 64 + 1) * 64;
+    }
+    return pick->m_cnt;
+}
+/** @brief Counts the selected master objects
+ *  @ingroup pick_engine */
+static uint count_selected(Pick *pick) {
+    uint cnt = 0;
+    for (uint w = 0; w < (pick->m_cnt + 63) / 64; w++)
+        cnt += __builtin_popcountll(pick->f_selected[w]);
+    return cnt;
+}
+/** @brief Clears the selection bits past the last master object
+ *  @ingroup pick_engine */
+static void clear_tail_bits(Pick *pick) {
+    if (pick->m_cnt % 64)
+        pick->f_selected[pick->m_cnt / 64] &=
+            ((uint64_t)1 << (pick->m_cnt % 64)) - 1;
+}
+/** @brief Selects every displayed object
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @details Without a search term every object is displayed, and the bitset
+   is filled a word at a time. */
+void select_all_objects(Pick *pick) {
+    if (pick->d_cnt == pick->m_cnt) {
+        memset(pick->f_selected, 0xff, (pick->m_cnt + 63) / 64 *
+                                           sizeof(uint64_t));
+        clear_tail_bits(pick);
+        pick->select_cnt = pick->m_cnt;
+        return;
+    }
+    for (uint d = 0; d < pick->d_cnt; d++)
+        select_object(pick, pick->d_object[d], true);
+}
+/** @brief Inverts the selection of the displayed objects
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @details Without a search term every object is displayed, and the bitset
+   is inverted a word at a time. */
+void invert_selection(Pick *pick) {
+    if (pick->d_cnt == pick->m_cnt) {
+        for (uint w = 0; w < (pick->m_cnt + 63) / 64; w++)
+            pick->f_selected[w] = ~pick->f_selected[w];
+        clear_tail_bits(pick);
+        pick->select_cnt = count_selected(pick);
+        return;
+    }
+    for (uint d = 0; d < pick->d_cnt; d++)
+        select_object(pick, pick->d_object[d],
+                      !object_selected(pick, pick->d_object[d]));
 }
 
 /** @brief Displays current page of objects in pick window
@@ -425,49 +1129,30 @@ void display_pick_page(Pick *pick) {
     uint col;
     ui_bkgdset(sfc, WIN, &cell_nt);
     pick->d_idx = pick->tbl_page * pick->lines * pick->tbl_cols;
+    rank_objects(pick, pick->d_idx + pick->lines * pick->tbl_cols);
     for (col = 0; col < pick->tbl_cols; col++) {
         pick->x = col * (pick->tbl_col_width + 1) + 1;
         pick->y = 0;
         while (pick->d_idx < pick->d_cnt && pick->y < pick->lines) {
-            if (pick->f_selected[pick->d_idx])
-                ui_mvwaddstr(sfc, WIN, pick->y, pick->x - 1, "*");
+            ui_mvwaddstr(sfc, WIN, pick->y, pick->x - 1,
+                         object_selected(pick, pick->d_object[pick->d_idx])
+                             ? "*"
+                             : " ");
             ui_mvwaddstr_fill(sfc, 1, pick->y++, pick->x,
-                              pick->d_object[pick->d_idx++], pick->tbl_col_width - 1);
-            ui_render();
+                              display_object(pick, pick->d_idx++),
+                              pick->tbl_col_width - 1);
         }
     }
     pick->d_idx -= 1;
     pick->tbl_lines = pick->d_cnt;
     pick->tbl_pages = ((pick->tbl_lines + pick->lines - 1) / pick->lines);
-    if (pick->y < pick->lines) {
+    // The rest of a page still filling is added below the last object
+    if (pick->y < pick->lines && pick->input == nullptr) {
         pick->y_offset = pick->lines - pick->y;
         ui_wscrl(sfc, WIN, -pick->y_offset);
     } else
         pick->y_offset = 0;
 }
-/** @brief Displays current page of objects in pick window
-    @ingroup pick_engine
-    @param pick Pointer to Pick structure containing objects and display
-   information
-    @param s String to filter objects by
-    @details Clears the pick window and displays the current page of objects
-   based on the current table page, line, and column. Marks selected objects
-   with an asterisk. Updates the chyron with page information at the bottom of
-   the pick window. */
-int match_objects(Pick *pick, char *s) {
-    /** pick->m_idx  Master  (as read from input) */
-    /** pick->d_idx  Display (to display) */
-    pick->m_idx = 0;
-    pick->d_idx = 0;
-    while (pick->m_idx < pick->m_cnt) {
-        if (s == nullptr || s[0] == '\0' || strstr(pick->m_object[pick->m_idx], s) != nullptr) {
-            pick->d_object[pick->d_idx++] = pick->m_object[pick->m_idx];
-        }
-        pick->m_idx++;
-    }
-    pick->d_cnt = pick->d_idx;
-    return pick->d_cnt;
-}
 /** @brief Reverses the display of the currently selected object in pick window
  *  @ingroup pick_engine
     @param pick Pointer to Pick structure containing object and display
@@ -486,10 +1171,13 @@ void reverse_object(Pick *pick) {
     pick->tbl_line = (pick->d_idx / pick->tbl_cols) % pick->lines;
     pick->y = pick->tbl_line + pick->y_offset;
     pick->d_idx = pick->tbl_page * pick->lines * pick->tbl_cols + pick->tbl_col * pick->lines + pick->tbl_line;
+    // Nothing, or not merged yet by poll_search()
+    if (pick->d_idx >= pick->d_cnt)
+        return;
     ui_bkgdset(sfc, WIN, &cell_nt_rev);
-    ui_mvwaddstr_fill(sfc, WIN, pick->y, pick->x, pick->d_object[pick->d_idx],
+    ui_mvwaddstr_fill(sfc, WIN, pick->y, pick->x, display_object(pick, pick->d_idx),
                       pick->tbl_col_width - 1);
-    if (pick->f_selected[pick->d_idx])
+    if (object_selected(pick, pick->d_object[pick->d_idx]))
         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0, &cell_chk, 1);
     else
         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0, &cell_sp, 1);
@@ -514,10 +1202,12 @@ void unreverse_object(Pick *pick) {
     pick->tbl_line = (pick->d_idx / pick->tbl_cols) % pick->lines;
     pick->y = pick->tbl_line + pick->y_offset;
     pick->d_idx = pick->tbl_page * pick->lines * pick->tbl_cols + pick->tbl_col * pick->lines + pick->tbl_line;
+    if (pick->d_idx >= pick->d_cnt)
+        return;
     ui_bkgdset(sfc, WIN, &cell_nt);
-    ui_mvwaddstr_fill(sfc, WIN, pick->y, pick->x, pick->d_object[pick->d_idx],
+    ui_mvwaddstr_fill(sfc, WIN, pick->y, pick->x, display_object(pick, pick->d_idx),
                       pick->tbl_col_width - 1);
-    if (pick->f_selected[pick->d_idx])
+    if (object_selected(pick, pick->d_object[pick->d_idx]))
         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0, &cell_chk, 1);
     else
         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0, &cell_sp, 1);
@@ -530,7 +1220,9 @@ void remove_right_angle(Pick *pick) {
     pick->tbl_line = (pick->d_idx / pick->tbl_cols) % pick->lines;
     pick->y = pick->tbl_line + pick->y_offset;
     pick->d_idx = pick->tbl_page * pick->lines * pick->tbl_cols + pick->tbl_col * pick->lines + pick->tbl_line;
-    if (pick->f_selected[pick->d_idx])
+    if (pick->d_idx >= pick->d_cnt)
+        return;
+    if (object_selected(pick, pick->d_object[pick->d_idx]))
         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0, &cell_chk, 1);
     else
         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0, &cell_sp, 1);
@@ -552,13 +1244,12 @@ void remove_right_angle(Pick *pick) {
 void toggle_object(Pick *pick) {
     UiSurface *sfc = pick->surface;
     pick->x = pick->tbl_col * (pick->tbl_col_width + 1) + 1;
-    if (pick->f_selected[pick->d_idx]) {
-        pick->select_cnt--;
-        pick->f_selected[pick->d_idx] = false;
+    uint m = pick->d_object[pick->d_idx];
+    if (object_selected(pick, m)) {
+        select_object(pick, m, false);
         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0, &cell_sp, 1);
     } else {
-        pick->select_cnt++;
-        pick->f_selected[pick->d_idx] = true;
+        select_object(pick, m, true);
         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0, &cell_chk, 1);
     }
 }
@@ -568,9 +1259,9 @@ void toggle_object(Pick *pick) {
 void deselect_object(Pick *pick) {
     UiSurface *sfc = pick->surface;
     pick->x = pick->tbl_col * (pick->tbl_col_width + 1) + 1;
-    if (pick->f_selected[pick->d_idx]) {
-        pick->select_cnt--;
-        pick->f_selected[pick->d_idx] = false;
+    if (pick->d_idx < pick->d_cnt &&
+        object_selected(pick, pick->d_object[pick->d_idx])) {
+        select_object(pick, pick->d_object[pick->d_idx], false);
         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0, &cell_sp, 1);
     }
 }
@@ -604,64 +1295,354 @@ int output_objects(Pick *pick) {
         m -= strlen(pick->in_spec);
         strnz__cat(tmp_str, pick->out_spec, m);
     }
-    for (pick->d_idx = 0; pick->d_idx < pick->d_cnt; pick->d_idx++) {
-        if (pick->f_selected[pick->d_idx])
-            fprintf(stdout, "%s\n", pick->d_object[pick->d_idx]);
-    }
+    for (uint i = next_selected(pick, 0); i < pick->m_cnt;
+         i = next_selected(pick, i + 1))
+        fprintf(stdout, "%s\n", pick_object(pick, i));
     fflush(stdout);
     if (pick->out_fp != nullptr)
         fclose(pick->out_fp);
     return (0);
 }
+/** @brief Adds an argument, doubling the vector as needed
+   @ingroup pick_engine
+    @param args Arguments, kept nullptr terminated
+    @param s Argument to copy
+    @return false if memory is exhausted */
+static bool add_exec_arg(ExecArgs *args, const char *s) {
+    if (args->n + 1 >= args->max) {
+        uint max = args->max ? args->max * 2 : MAXARGS;
+        char **v = realloc(args->v, max * sizeof(char *));
+        if (v == nullptr)
+            return false;
+        args->v = v;
+        args->max = max;
+    }
+    args->v[args->n] = strdup(s);
+    if (args->v[args->n] == nullptr)
+        return false;
+    args->bytes += strlen(s) + 1 + sizeof(char *);
+    args->v[++args->n] = nullptr;
+    return true;
+}
+/** @brief Frees the arguments, leaving the vector for the next batch
+   @ingroup pick_engine */
+static void clear_exec_args(ExecArgs *args) {
+    for (uint i = 0; i < args->n; i++)
+        free(args->v[i]);
+    args->n = 0;
+    args->bytes = 0;
+}
+/** @brief Appends an object to a space separated list
+   @ingroup pick_engine
+    @param list List, whose size is doubled as needed
+    @param len Length of the list, kept so it isn't scanned again
+    @param s Object
+    @return false if memory is exhausted */
+static bool join_exec_arg(String *list, size_t *len, const char *s) {
+    size_t s_len = strlen(s);
+    size_t need = *len + 1 + s_len + 1;
+    if (need > list->l) {
+        size_t l = list->l ? list->l : MAXLEN;
+        while (l < need)
+            l *= 2;
+        char *p = realloc(list->s, l);
+        if (p == nullptr)
+            return false;
+        list->s = p;
+        list->l = l;
+    }
+    if (*len > 0)
+        list->s[(*len)++] = ' ';
+    memcpy(list->s + *len, s, s_len + 1);
+    *len += s_len;
+    return true;
+}
+/** @brief Builds the command for a batch of selected objects
+   @ingroup pick_engine
+    @param pick Pick
+    @param idx Index of the first selected object, advanced past those
+   taken
+    @param args Receives the command
+    @param eargv Command template
+    @param eargc Arguments in the template
+    @param eargx Template argument with "%%", or -1
+    @param room Bytes the arguments may take, see lf_arg_room()
+    @return false if memory is exhausted, or an object can't replace "%%"
+    @details With "%%", or f_multiple_cmd_args, the objects are joined with
+   spaces into one argument, replacing "%%" or after the template, of at
+   most 128K, the most Linux takes in one argument. Otherwise each object
+   is an argument after the template. Objects are taken while the
+   arguments fit in room, but at least one always is, so a room of 0 takes
+   one object. */
+static bool build_exec_args(Pick *pick, uint *idx, ExecArgs *args,
+                            char **eargv, uint eargc, int eargx,
+                            size_t room) {
+    String list = {nullptr, 0};
+    size_t len = 0, fixed = 0, max_len = 128 * 1024, s_len;
+    uint i = *idx, j;
+    bool f_join = pick->f_multiple_cmd_args || eargx >= 0;
+    bool ok = true;
+    char *arg;
+
+    if (!f_join) {
+        for (j = 0; j < eargc && ok; j++)
+            ok = add_exec_arg(args, eargv[j]);
+        for (; i < pick->m_cnt && ok; i = next_selected(pick, i + 1)) {
+            s_len = strlen(pick_object(pick, i)) + 1 + sizeof(char *);
+            if (args->n > eargc && args->bytes + s_len > room)
+                break;
+            ok = add_exec_arg(args, pick_object(pick, i));
+        }
+        *idx = i;
+        return ok;
+    }
+    for (j = 0; j < eargc; j++)
+        fixed += strlen(eargv[j]) + 1 + sizeof(char *);
+    if (eargx >= 0)
+        max_len -= strlen(eargv[eargx]);
+    for (; i < pick->m_cnt && ok; i = next_selected(pick, i + 1)) {
+        s_len = strlen(pick_object(pick, i)) + 1;
+        if (len > 0 && (fixed + len + s_len > room || len + s_len > max_len))
+            break;
+        ok = join_exec_arg(&list, &len, pick_object(pick, i));
+    }
+    *idx = i;
+    for (j = 0; j < eargc && ok; j++) {
+        if ((int)j != eargx) {
+            ok = add_exec_arg(args, eargv[j]);
+            continue;
+        }
+        arg = rep_substring(eargv[j], "%%", list.s);
+        ok = arg != nullptr && arg[0] != '\0' && add_exec_arg(args, arg);
+        free(arg);
+    }
+    if (ok && eargx < 0)
+        ok = add_exec_arg(args, list.s);
+    free_string(list);
+    return ok;
+}
+/** @brief Appends a finished command's output to the combined output
+   @ingroup pick_engine
+    @param out_fd Combined output
+    @param job Finished command
+    @param obj Its object
+    @param status Its wait status
+    @details The output follows a header naming the object, with the exit
+   status if the command failed, as tail does for several files. */
+static void write_exec_job(int out_fd, ExecJob *job, const char *obj,
+                           int status) {
+    char hdr[MAXLEN];
+    const char *sep = lseek(out_fd, 0, SEEK_CUR) > 0 ? "\n" : "";
+    struct stat sb;
+    off_t off = 0;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        ssnprintf(hdr, MAXLEN - 1, "%s==> %s <==\n", sep, obj);
+    else if (WIFEXITED(status))
+        ssnprintf(hdr, MAXLEN - 1, "%s==> %s <== exit %d\n", sep, obj,
+                  WEXITSTATUS(status));
+    else
+        ssnprintf(hdr, MAXLEN - 1, "%s==> %s <== signal %d\n", sep, obj,
+                  WTERMSIG(status));
+    if (write(out_fd, hdr, strlen(hdr)) == -1 || fstat(job->fd, &sb) == -1)
+        return;
+    while (off < sb.st_size &&
+           sendfile(out_fd, job->fd, &off, sb.st_size - off) > 0)
+        ;
+}
+/** @brief Waits for one of the running commands to finish
+   @ingroup pick_engine
+    @param jobs Command slots
+    @param pfds Room for a pollfd per slot
+    @param n Slots
+    @param status Its wait status
+    @return Index of the command, or -1 on error
+    @details Only the commands' own pids are waited for, so that other
+   children, like the preview's highlighter, are left to their owners.
+   Their pidfds are polled, or the first command is waited for where the
+   kernel has no pidfds. */
+static int wait_exec_job(ExecJob *jobs, struct pollfd *pfds, uint n,
+                         int *status) {
+    uint i, cnt;
+    pid_t pid;
+
+    for (;;) {
+        cnt = 0;
+        for (i = 0; i < n; i++) {
+            if (jobs[i].pid == 0)
+                continue;
+            pid = waitpid(jobs[i].pid, status, WNOHANG);
+            if (pid == jobs[i].pid)
+                return (int)i;
+            if (pid == -1 && errno != EINTR)
+                return -1;
+            if (jobs[i].pidfd == -1) {
+                pid = waitpid(jobs[i].pid, status, 0);
+                if (pid == jobs[i].pid)
+                    return (int)i;
+                if (pid == -1 && errno != EINTR)
+                    return -1;
+                break;
+            }
+            pfds[cnt++] = (struct pollfd){jobs[i].pidfd, POLLIN, 0};
+        }
+        if (i == n && cnt == 0)
+            return -1;
+        if (i == n && poll(pfds, cnt, -1) == -1 && errno != EINTR)
+            return -1;
+    }
+}
+/** @brief Runs the command once for each selected object, p_jobs at a time
+   @ingroup pick_engine
+    @param init Pointer to Init structure
+    @param eargv Command template
+    @param eargc Arguments in the template
+    @param eargx Template argument with "%%", or -1
+    @return 0 on success, 1 on failure
+    @details Each command reads /dev/null and writes to a memfd, so they
+   can't interleave on the terminal. As each finishes, its output is
+   appended to a temporary file, which is shown in a view when all are
+   done. The chyron line counts them meanwhile. */
+static int exec_jobs(Init *init, char **eargv, uint eargc, int eargx) {
+    Pick *pick = init->pick;
+    ExecJob *jobs = calloc(pick->p_jobs, sizeof(ExecJob));
+    struct pollfd *pfds = calloc(pick->p_jobs, sizeof(struct pollfd));
+    ExecArgs args = {0};
+    char out_spec[MAXLEN];
+    char tmp_str[MAXLEN];
+    char *vargv[3];
+    uint i = next_selected(pick, 0), running = 0, done = 0, j;
+    int out_fd, status, rc = 0, k;
+    pid_t pid;
+
+    if (jobs == nullptr || pfds == nullptr) {
+        Perror("calloc ExecJob failed in exec_objects");
+        free(jobs);
+        free(pfds);
+        return 1;
+    }
+    strnz__cpy(out_spec, "/tmp/pick-XXXXXX", MAXLEN - 1);
+    out_fd = mkstemp(out_spec);
+    if (out_fd == -1) {
+        Perror("Unable to create temporary file");
+        free(jobs);
+        free(pfds);
+        return 1;
+    }
+    while (i < pick->m_cnt || running > 0) {
+        while (i < pick->m_cnt && running < pick->p_jobs) {
+            for (j = 0; jobs[j].pid != 0; j++)
+                ;
+            jobs[j].obj = i;
+            clear_exec_args(&args);
+            if (!build_exec_args(pick, &i, &args, eargv, eargc, eargx, 0) ||
+                (jobs[j].fd = memfd_create("pick_job", MFD_CLOEXEC)) == -1) {
+                Perror("Unable to start command in exec_objects");
+                i = pick->m_cnt;
+                rc = 1;
+                break;
+            }
+            if ((pid = fork()) == 0) {
+                int dev_null = open("/dev/null", O_RDONLY);
+                if (dev_null != -1)
+                    dup2(dev_null, STDIN_FILENO);
+                dup2(jobs[j].fd, STDOUT_FILENO);
+                dup2(jobs[j].fd, STDERR_FILENO);
+                execvp(args.v[0], args.v);
+                /** only async-signal-safe calls after fork() */
+                const char *why = errno == ENOENT ? ": command not found\n"
+                                                  : ": cannot execute\n";
+                if (write(STDERR_FILENO, args.v[0], strlen(args.v[0])) >= 0)
+                    (void)!write(STDERR_FILENO, why, strlen(why));
+                _exit(127);
+            }
+            if (pid == -1) {
+                close(jobs[j].fd);
+                Perror("fork() failed in exec_objects");
+                i = pick->m_cnt;
+                rc = 1;
+                break;
+            }
+            jobs[j].pid = pid;
+            jobs[j].pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+            running++;
+        }
+        if (running == 0)
+            break;
+        ssnprintf(tmp_str, MAXLEN - 1, "Running %u, %u of %u done", running,
+                  done, pick->select_cnt);
+        ui_mvwaddstr(pick->surface, WIN2, 0, 0, tmp_str);
+        ui_wclrtoeol(pick->surface, WIN2);
+        ui_render();
+        k = wait_exec_job(jobs, pfds, pick->p_jobs, &status);
+        if (k == -1)
+            break;
+        write_exec_job(out_fd, &jobs[k], pick_object(pick, jobs[k].obj),
+                       status);
+        close(jobs[k].fd);
+        if (jobs[k].pidfd != -1)
+            close(jobs[k].pidfd);
+        jobs[k].pid = 0;
+        running--;
+        done++;
+    }
+    for (j = 0; j < pick->p_jobs; j++) {
+        if (jobs[j].pid == 0)
+            continue;
+        close(jobs[j].fd);
+        if (jobs[j].pidfd != -1)
+            close(jobs[j].pidfd);
+    }
+    clear_exec_args(&args);
+    free(args.v);
+    free(jobs);
+    free(pfds);
+    if (lseek(out_fd, 0, SEEK_END) > 0) {
+        vargv[0] = "view";
+        vargv[1] = out_spec;
+        vargv[2] = nullptr;
+        init->lines = 60;
+        init->cols = 80;
+        init->begy = pick->begy + 1;
+        init->begx = pick->begx + 1;
+        strnz__cpy(init->title, pick->cmd, MAXLEN - 1);
+        popup_view(init, 2, vargv, init->lines, init->cols, init->begy,
+                   init->begx);
+    }
+    close(out_fd);
+    unlink(out_spec);
+    return rc;
+}
 /** @brief Executes specified command with selected objects as arguments
    @ingroup pick_engine
    @param init Pointer to Init structure
    @return 0 on success, 1 on failure
-   @details Parses command string and appends selected objects as arguments to
-   the command. If command contains "%%", it is replaced with a space- separated
-   list of selected objects. Executes the command using execvp in a child
-   process and waits for it to finish. If the command is a pager or editor, it
-   is executed within the pick interface using popup_view instead of execvp.
-   If f_append_objects is true, the argument containing %% is replaced with
-   the concatenated selected objects. If f_append_objects is false, selected
-   objects are added as separate arguments and the original command arguments
-   remain unchanged.
-   eargv should be null-terminated to indicate the end of arguments for
-   execvp
-   Memory allocated for arguments is freed after execution to prevent
-   memory leaks.
-   If execvp fails, an error message is printed and the child process
-   exits with failure status
-   The parent process waits for the child process to finish before
-   proceeding and restores terminal settings
-   If the command is a pager or editor, it is executed within the pick
-   interface using popup_view instead of execvp
-   The base name of the command is extracted to check if it is a pager or
-   editor
-   If the command is a pager or editor, the pick interface is used to
-   display the command output instead of executing it in a separate terminal
-   This allows the user to view the command output without leaving the pick
-   interface and provides a more seamless user experience.
-   If the command is not a pager or editor, it is executed in a separate
-   terminal and the pick interface is restored after execution
-   If the command to be executed is view, an external command is not
-   needed, instead the popup_view function can be used to display the output
-   within the pick interface */
+   @details Parses the command string into a template, and builds the
+   command from it and the selected objects with build_exec_args(). If an
+   argument contains "%%", it is replaced with a space separated list of
+   the selected objects. With f_multiple_cmd_args, that list is added as
+   one argument. Otherwise each selected object is added as an argument.
+   If the command is view, it is run within the pick interface with
+   popup_view, with all the selected objects. Otherwise the terminal is
+   given to the command, run with execvp, once for each batch of objects
+   that fits in ARG_MAX, as xargs does, and restored afterwards.
+   With p_jobs, the command is run once for each selected object instead,
+   that many at a time, and their output is shown in a view, see
+   exec_jobs(). */
 int exec_objects(Init *init) {
-    int rc = -1;
+    int rc = 0;
     uint eargc;
     char *eargv[MAXARGS];
-    char tmp_str[MAXLEN] = {'\0'};
-    char title[MAXLEN];
-    char sav_arg[MAXLEN];
-    char *out_s;
-    int eargx = 0;
+    char tmp_str[MAXLEN];
+    char cmd_name[MAXLEN];
+    ExecArgs args = {0};
+    int eargx = -1;
     uint i = 0;
     pid_t pid = 0;
-    bool f_append_objects = false;
+    bool f_view;
+    size_t room;
 
     Pick *pick = init->pick;
-    title[0] = '\0';
     if (pick->cmd[0] == '\0')
         return -1;
     if (pick->cmd[0] == '\\' || pick->cmd[0] == '\"') {
@@ -672,123 +1653,76 @@ int exec_objects(Init *init) {
         }
     }
     eargc = str_to_args(eargv, pick->cmd, MAXARGS - 1);
-    tmp_str[0] = '\0';
-    if (pick->f_multiple_cmd_args) {
-        for (i = 0; i < pick->d_cnt; i++) {
-            if (pick->f_selected[i] && eargc < MAXARGS) {
-                if (tmp_str[0] != '\0')
-                    strnz__cat(tmp_str, " ", MAXLEN - 1);
-                strnz__cat(tmp_str, pick->d_object[i], MAXLEN - 1);
-            }
-        }
-        eargv[eargc++] = strdup(tmp_str);
-    } else {
-        f_append_objects = false;
-        i = 0;
-        while (i < eargc) {
-            /** This is the line that gets the selected objects */
+    if (eargc == 0)
+        return -1;
+    eargv[eargc] = nullptr;
+    if (!pick->f_multiple_cmd_args) {
+        /** This is the argument that gets the selected objects */
+        for (i = 0; i < eargc; i++)
             if (strstr(eargv[i], "%%") != nullptr) {
-                tmp_str[0] = '\0';
-                f_append_objects = true;
-                strnz__cpy(sav_arg, eargv[i], MAXLEN - 1);
                 eargx = i;
                 break;
             }
-            i++;
-        }
-        for (i = 0; i < pick->d_cnt; i++) {
-            /** append arguments onto tmp_str */
-            if (pick->f_selected[i] && eargc < MAXARGS - 1) {
-                if (f_append_objects == true) {
-                    if (tmp_str[0] != '\0')
-                        strnz__cat(tmp_str, " ", MAXLEN - 1);
-                    strnz__cat(tmp_str, pick->d_object[i], MAXLEN - 1);
-                    continue;
-                }
-                eargv[eargc++] = strdup(pick->d_object[i]);
-            }
-        }
-        if (f_append_objects == true) {
-            if (eargv[eargx] != nullptr) {
-                free(eargv[eargx]);
-                eargv[eargx] = nullptr;
-            }
-            out_s = rep_substring(sav_arg, "%%", tmp_str);
-            if (out_s == nullptr || out_s[0] == '\0') {
-                i = 0;
-                while (i < eargc) {
-                    if (eargv[i] != nullptr)
-                        free(eargv[i]);
-                    i++;
-                }
-                Perror("rep_substring() failed in exec_objects");
-                return 1;
-            }
-            strnz__cpy(title, out_s, MAXLEN - 1);
-            eargv[eargx] = strdup(out_s);
-            if (out_s != nullptr) {
-                free(out_s);
-                out_s = nullptr;
-            }
-        }
     }
     strnz__cpy(tmp_str, eargv[0], MAXLEN - 1);
-    eargv[eargc] = nullptr;
     char *sav_ptr;
     char *tok;
     tok = strtok_r(tmp_str, " ", &sav_ptr);
-    strnz__cpy(sav_arg, tok, MAXLEN - 1);
-    base_name(tmp_str, sav_arg);
-    if (tmp_str[0] != '\0' && (strcmp(tmp_str, "view") == 0 || strcmp(tmp_str, "view") == 0)) {
-        /** initialize popup_view arguments and execute popup_view to display
-           command output within pick interface */
-        init->lines = 60;
-        init->cols = 80;
-        init->begy = pick->begy + 1;
-        init->begx = pick->begx + 1;
-        if (title[0] != '\0')
-            strnz__cpy(init->title, title, MAXLEN - 1);
-        else
-            strnz__cpy(init->title, eargv[eargc], MAXLEN - 1);
-        popup_view(init, eargc, eargv, init->lines, init->cols, init->begy,
-                   init->begx);
-        i = 0;
-        while (i < eargc) {
-            if (eargv[i] != nullptr)
-                free(eargv[i]);
-            i++;
-        }
-        return 0;
-    } else {
+    strnz__cpy(cmd_name, tok, MAXLEN - 1);
+    base_name(tmp_str, cmd_name);
+    f_view = strcmp(tmp_str, "view") == 0;
+    if (pick->p_jobs > 0 && !f_view) {
+        rc = exec_jobs(init, eargv, eargc, eargx);
+        destroy_argv(eargc, eargv);
+        return rc;
+    }
+    /** view needs no exec, so it gets all the objects at once */
+    room = f_view ? SIZE_MAX : lf_arg_room();
+    if (!f_view) {
         ui_werase(stdsfc, 0);
         ui_endwin();
+    }
+    i = next_selected(pick, 0);
+    while (i < pick->m_cnt) {
+        clear_exec_args(&args);
+        if (!build_exec_args(pick, &i, &args, eargv, eargc, eargx, room)) {
+            Perror("build_exec_args() failed in exec_objects");
+            rc = 1;
+            break;
+        }
+        if (f_view) {
+            /** initialize popup_view arguments and execute popup_view to
+               display command output within pick interface */
+            init->lines = 60;
+            init->cols = 80;
+            init->begy = pick->begy + 1;
+            init->begx = pick->begx + 1;
+            if (eargx >= 0)
+                strnz__cpy(init->title, args.v[eargx], MAXLEN - 1);
+            else
+                init->title[0] = '\0';
+            popup_view(init, args.n, args.v, init->lines, init->cols,
+                       init->begy, init->begx);
+            continue;
+        }
         if ((pid = fork()) == -1) {
-            /** fork failed, free eargv and return error */
-            i = 0;
-            while (i < eargc) {
-                if (eargv[i] != nullptr)
-                    free(eargv[i]);
-                i++;
-            }
             Perror("fork() failed in exec_objects");
-            return (1);
+            rc = 1;
+            break;
         } else if (pid == 0) {
-            /** Prevent child process from writing to terminal */
-            // int dev_null = open("/dev/null", O_WRONLY);
-            // if (dev_null == -1) {
-            //     Perror("open(/dev/null) failed in init_pick child process");
-            //     exit(EXIT_FAILURE);
-            // }
-            // dup2(dev_null, STDERR_FILENO);
-            // close(dev_null);
-            execvp(eargv[0], eargv);
+            execvp(args.v[0], args.v);
+            fprintf(stderr, "%s: %s\n", args.v[0], strerror(errno));
             exit(EXIT_FAILURE);
         }
+        waitpid(pid, nullptr, 0);
     }
-    waitpid(pid, nullptr, 0);
+    clear_exec_args(&args);
+    free(args.v);
     destroy_argv(eargc, eargv);
-    sig_prog_mode();
-    ui_restore_wins();
+    if (!f_view) {
+        sig_prog_mode();
+        ui_restore_wins();
+    }
     return rc;
 }
 /** @brief Initializes the pick window based on the parameters specified in the
@@ -816,6 +1750,10 @@ int open_pick_win(Init *init) {
     UiSurface *sfc = pick->surface;
     ui_setscrreg(sfc, WIN, 0, pick->lines - 1);
     ui_scrollok(sfc, WIN, true);
+    // Drawn in full, then rendered once per event, see picker()
+    ui_immedok(sfc, WIN, false);
+    ui_immedok(sfc, WIN2, false);
+    ui_immedok(sfc, BOX, false);
     assign_chyron_win(pick->chyron, pick->surface, WIN2, "-");
     pick->separator_line = pick->lines + 1;
     ui_keypad(sfc, WIN, true);
@@ -857,6 +1795,69 @@ void display_pick_help(Init *init) {
     destroy_argv(eargc, eargv);
     return;
 }
+/** @brief Waits for an event, showing pick input as it arrives
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param win Window to read the event from
+    @param event Event
+    @param highlight See update_pick_input()
+    @return Key, as from ui_get_event_multi(), or 0 when a search has just
+   finished
+    @details While input is arriving, the wait times out every
+   PICK_INPUT_TICK_MS to show it. While a search is running, it times out
+   every PICK_SEARCH_TICK_MS to merge what the workers have found, showing
+   the first page as soon as it is complete, and input waits until the
+   search is done. While the preview's highlighter has work to do, it
+   times out every PICK_PREVIEW_TICK_MS for poll_preview(). Otherwise it
+   blocks as before. */
+static int pick_get_event(Pick *pick, uint win, UiEvent *event,
+                          bool highlight) {
+    UiSurface *sfc = pick->surface;
+    uint y, x;
+    int in_key, tick;
+    SearchState state = poll_search(pick);
+    bool f_preview = poll_preview(pick);
+
+    while (state != SEARCH_DONE &&
+           (state != SEARCH_IDLE || pick->input || f_preview)) {
+        if (state == SEARCH_FIRST_PAGE) {
+            ui_getyx(sfc, win, &y, &x);
+            display_pick_page(pick);
+            ui_cursor_move(sfc, win, y, x);
+            ui_render();
+        }
+        if (state != SEARCH_IDLE)
+            tick = PICK_SEARCH_TICK_MS;
+        else if (f_preview)
+            tick = PICK_PREVIEW_TICK_MS;
+        else
+            tick = PICK_INPUT_TICK_MS;
+        in_key = ui_get_event_multi(sfc, win, event, tick);
+        if ((in_key != ERR && in_key != 0) ||
+            event->mouse_action != UI_MOUSE_NONE)
+            return in_key;
+        if (f_preview) {
+            ui_getyx(sfc, win, &y, &x);
+            f_preview = poll_preview(pick);
+            ui_cursor_move(sfc, win, y, x);
+            ui_render();
+        }
+        if (state != SEARCH_IDLE) {
+            state = poll_search(pick);
+            continue;
+        }
+        if (pick->input) {
+            ui_getyx(sfc, win, &y, &x);
+            update_pick_input(pick, highlight);
+            ui_cursor_move(sfc, win, y, x);
+            ui_render();
+        }
+    }
+    // The line editor shows a finished search as it would a key's
+    if (state == SEARCH_DONE)
+        return 0;
+    return ui_get_event_multi(sfc, win, event, -1);
+}
 /** @brief Main loop for handling user input and interactions in the pick
    interface
    @ingroup pick_engine
@@ -893,7 +1894,6 @@ int picker(Init *init, char *field) {
     uint maxy, maxx;
     ptr = accept_s;
     ptr = str_end;
-    char tmp_str[MAXLEN];
 
 #ifdef UAL_UI
     ui_mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION);
@@ -914,32 +1914,33 @@ int picker(Init *init, char *field) {
                 reverse_object(pick);
                 pick->tbl_line = (pick->d_idx / pick->tbl_cols) % pick->lines;
                 pick->y = pick->tbl_line + pick->y_offset;
-                /** box display_pick_page_info */
-                ssnprintf(tmp_str, MAXLEN - 1, "Line %d, Page %d/%d",
-                          pick->tbl_line + 1, pick->tbl_page + 1,
-                          pick->tbl_pages);
-                border_ysplit_text(pick->surface, tmp_str, pick->separator_line);
-                if (pick->p_view_files)
-                    if (strcmp(pick->d_object[pick->d_idx], view_file) != 0) {
-                        strnz__cpy(view_file, pick->d_object[pick->d_idx], MAXLEN - 1);
+                show_pick_position(pick);
+                // The preview waits for the search, see search_running()
+                if (pick->p_view_files && !search_running(pick) &&
+                    pick->d_idx < pick->d_cnt)
+                    if (strcmp(display_object(pick, pick->d_idx), view_file) != 0) {
+                        strnz__cpy(view_file, display_object(pick, pick->d_idx), MAXLEN - 1);
                         new_view_file(init, view_file);
                     }
                 // 1
                 pick_std_chyron(pick);
-                compile_chyron(pick->chyron);
-                display_chyron(sfc, WIN2, pick->chyron, 1, pick->chyron->l);
+                show_pick_chyron(pick);
                 reverse_object(pick);
                 ui_top_panel(sfc, WIN);
                 ui_cursor_move(sfc, WIN, pick->y, pick->x);
                 ui_curs_set(2);
                 ui_render();
-                in_key = ui_get_event_multi(sfc, WIN, &event, -1);
+                in_key = pick_get_event(pick, WIN, &event, true);
+#ifdef DEBUG_RENDER
+                log_pick_render(in_key);
+#endif
                 if (event.mouse_action != UI_MOUSE_NONE) {
                     ui_getmaxyx(sfc, WIN2, &maxy, &maxx);
                     if (event.in_win == pick->chyron->win && event.y == pick->chyron->y)
                         in_key = get_chyron_key(pick->chyron, event.x);
                 } else {
-                    if (pick->f_selected[pick->d_idx])
+                    if (pick->d_idx < pick->d_cnt &&
+                        object_selected(pick, pick->d_object[pick->d_idx]))
                         ui_mvwadd_cellnstr(sfc, WIN, pick->y, 0,
                                            &cell_chk, 1);
                     else
@@ -979,22 +1980,19 @@ int picker(Init *init, char *field) {
                 pick->chyron->key[5]->active = true;   // <q> Quit View
                 pick->chyron->key[6]->active = false;  // <Sp> Toggle
                 pick->chyron->key[7]->active = false;  // <Sp> Edit
+                pick->chyron->key[8]->active = false;  // ^R Match mode
                 pick->chyron->key[9]->active = false;  // <Tab> Search;
                 pick->chyron->key[10]->active = false; // <Tab> Select;
                 pick->chyron->key[11]->active = true;  // PgUp
                 pick->chyron->key[12]->active = true;  // PgDn
                 pick->chyron->key[13]->active = false; // INS
                 remove_right_angle(pick);
-                compile_chyron(pick->chyron);
-                display_chyron(sfc, WIN2, pick->chyron, 1, pick->chyron->l);
+                show_pick_chyron(pick);
                 // update_panels();
                 // doupdate();
                 ui_render();
                 if (pick->p_view_files)
                     view_cmd_processor(init);
-                pick_std_chyron(pick);
-                compile_chyron(pick->chyron);
-                display_chyron(sfc, WIN2, pick->chyron, 1, pick->chyron->l);
                 in_key = 0;
                 continue;
 
@@ -1007,6 +2005,20 @@ int picker(Init *init, char *field) {
                 in_key = 0;
                 continue;
 
+            /** 'a' selects all displayed objects, 'i' inverts their
+               selection, when the number of selections is not limited */
+            case 'a':
+            case 'i':
+                if (pick->select_max == 0) {
+                    if (in_key == 'a')
+                        select_all_objects(pick);
+                    else
+                        invert_selection(pick);
+                    display_pick_page(pick);
+                }
+                in_key = 0;
+                continue;
+
             /** 'q', or KEY_F09 cancel selection and exit picker */
             case 'q':
             case KEY_F09:
@@ -1024,7 +2036,7 @@ int picker(Init *init, char *field) {
             /** KEY_END Moves selection to last object in list */
             case KEY_END:
                 ui_mvwaddstr_fill(sfc, WIN, pick->y, pick->x,
-                                  pick->d_object[pick->d_idx],
+                                  display_object(pick, pick->d_idx),
                                   pick->tbl_col_width - 1);
                 uint display_tbl_page = pick->tbl_page;
                 pick->d_idx = pick->d_cnt - 1;
@@ -1053,7 +2065,7 @@ int picker(Init *init, char *field) {
                 }
                 unreverse_object(pick);
                 ui_mvwaddstr_fill(sfc, WIN, pick->y, pick->x,
-                                  pick->d_object[pick->d_idx],
+                                  display_object(pick, pick->d_idx),
                                   pick->tbl_col_width - 1);
                 if (pick->tbl_col > 0)
                     pick->tbl_col--;
@@ -1068,7 +2080,7 @@ int picker(Init *init, char *field) {
                 if (pick->tbl_line == pick->tbl_lines - 1)
                     break;
                 ui_mvwaddstr_fill(sfc, WIN, pick->y, pick->x,
-                                  pick->d_object[pick->d_idx],
+                                  display_object(pick, pick->d_idx),
                                   pick->tbl_col_width - 1);
                 unreverse_object(pick);
                 if (pick->tbl_page * pick->lines * pick->tbl_cols + pick->tbl_col * pick->lines + pick->tbl_line < pick->d_cnt - 1 && pick->tbl_line < pick->lines - 1)
@@ -1082,7 +2094,7 @@ int picker(Init *init, char *field) {
             case 'k':
             case KEY_UP:
                 ui_mvwaddstr_fill(sfc, WIN, pick->y, pick->x,
-                                  pick->d_object[pick->d_idx],
+                                  display_object(pick, pick->d_idx),
                                   pick->tbl_col_width - 1);
                 unreverse_object(pick);
                 if (pick->tbl_line > 0)
@@ -1100,7 +2112,7 @@ int picker(Init *init, char *field) {
                     continue;
                 }
                 ui_mvwaddstr_fill(sfc, WIN, pick->y, pick->x,
-                                  pick->d_object[pick->d_idx],
+                                  display_object(pick, pick->d_idx),
                                   pick->tbl_col_width - 1);
                 unreverse_object(pick);
                 /** pick->obj_idx += pick->tbl_lines -> next column */
@@ -1198,6 +2210,7 @@ int picker(Init *init, char *field) {
         pick->chyron->key[5]->active = false;  // <q> Quit View
         pick->chyron->key[6]->active = false;  // <Sp> Toggle
         pick->chyron->key[7]->active = false;  // <Sp> Edit
+        pick->chyron->key[8]->active = true;   // ^R Match mode
         pick->chyron->key[9]->active = false;  // <Tab> Search
         pick->chyron->key[10]->active = true;  // <Tab> Select
         pick->chyron->key[11]->active = false; // PgDn
@@ -1209,31 +2222,30 @@ int picker(Init *init, char *field) {
             if (in_key == 0) {
                 // mouse_win = nullptr;
                 if (accept_s != nullptr && accept_s[0] != '\0') {
-                    if (match_objects(pick, accept_s) == 0) {
+                    if (!search_objects(pick, accept_s)) {
+                        // Shown as it runs, see pick_get_event()
+                    } else if (pick->d_cnt == 0) {
                         strnz__cpy(field, prev_field, MAXLEN - 1);
                         pos = prev_pos;
                         ptr = prev_ptr;
+                        // Back to the objects the previous term matched
+                        search_objects(pick, accept_s);
                     } else {
                         display_pick_page(pick);
-                        ssnprintf(tmp_str, MAXLEN - 1, "Line %d, Page %d/%d",
-                                  pick->tbl_line + 1, pick->tbl_page + 1,
-                                  pick->tbl_pages);
-                        strnz__cat(tmp_str, "     ", MAXLEN - 1);
-                        tmp_str[21] = '\0';
-                        ui_mvwaddstr(sfc, BOX, pick->separator_line, 3, tmp_str);
+                        show_pick_position(pick);
                     }
                 }
-                compile_chyron(pick->chyron);
-                display_chyron(sfc, WIN2, pick->chyron, 1, pick->chyron->l);
+                show_pick_chyron(pick);
                 ui_cursor_move(sfc, WIN2, 0, 1);
                 /** display_field_content */
                 rtrim(accept_s);
                 col = 1;
                 ui_mvwaddstr(sfc, WIN2, 0, col, accept_s);
                 ui_wclrtoeol(sfc, WIN2);
-                if (pick->p_view_files)
-                    if (strcmp(pick->d_object[pick->d_idx], view_file) != 0) {
-                        strnz__cpy(view_file, pick->d_object[pick->d_idx], MAXLEN - 1);
+                if (pick->p_view_files && !search_running(pick) &&
+                    pick->d_idx < pick->d_cnt)
+                    if (strcmp(display_object(pick, pick->d_idx), view_file) != 0) {
+                        strnz__cpy(view_file, display_object(pick, pick->d_idx), MAXLEN - 1);
                         new_view_file(init, view_file);
                     }
                 // mouse_win = nullptr;
@@ -1243,7 +2255,10 @@ int picker(Init *init, char *field) {
                 ui_top_panel(sfc, WIN2);
                 ui_curs_set(2);
                 ui_render();
-                in_key = ui_get_event_multi(sfc, WIN2, &event, -1);
+                in_key = pick_get_event(pick, WIN2, &event, false);
+#ifdef DEBUG_RENDER
+                log_pick_render(in_key);
+#endif
                 ui_getmaxyx(sfc, WIN2, &maxy, &maxx);
                 if (event.mouse_action != UI_MOUSE_NONE) {
                     if (event.in_win == WIN2 && event.y == maxy - 1)
@@ -1272,6 +2287,7 @@ int picker(Init *init, char *field) {
                 break;
 
             case KEY_F01:
+                finish_search(pick);
                 return (in_key);
 
             case KEY_F02:
@@ -1283,13 +2299,22 @@ int picker(Init *init, char *field) {
             /** KEY_F09 Cancels the current operation */
             case KEY_BREAK:
             case KEY_F09:
+                finish_search(pick);
                 in_key = KEY_F09;
                 return (in_key);
 
             /** KEY_F10 is the default key for accepting the field */
             case KEY_F10:
+                finish_search(pick);
                 return (in_key);
 
+            /** Ctrl-R selects the next way of matching the search term */
+            case Ctrl('r'):
+                pick->match_mode = (pick->match_mode + 1) % (MATCH_REGEX + 1);
+                set_match_chyron_key(pick);
+                in_key = 0;
+                continue;
+
             case KEY_END:
             case Ctrl('e'):
                 while (*ptr != '\0')
@@ -1308,8 +2333,8 @@ int picker(Init *init, char *field) {
                     set_chyron_key_cb(pick->chyron, 12, "INS", KEY_IC,
                                       cell_nt_hl_rev);
                 }
-                compile_chyron(pick->chyron);
-                display_chyron(sfc, WIN2, pick->chyron, 1, pick->chyron->l);
+                pick->f_chyron_shown = false;
+                show_pick_chyron(pick);
                 in_key = 0;
                 continue;
 
@@ -1351,12 +2376,7 @@ int picker(Init *init, char *field) {
                 if (ptr == accept_s) {
                     match_objects(pick, accept_s);
                     display_pick_page(pick);
-                    ssnprintf(tmp_str, MAXLEN - 1, "Line %d, Page %d/%d",
-                              pick->tbl_line + 1, pick->tbl_page + 1,
-                              pick->tbl_pages);
-                    strnz__cat(tmp_str, "     ", MAXLEN - 1);
-                    tmp_str[21] = '\0';
-                    ui_mvwaddstr(sfc, BOX, pick->separator_line, 3, tmp_str);
+                    show_pick_position(pick);
                 }
                 in_key = 0;
                 continue;
@@ -1432,6 +2452,8 @@ int picker(Init *init, char *field) {
             }
             break;
         }
+        // The pick objects loop needs all of the derived objects
+        finish_search(pick);
         ui_mvwadd_cellnstr(sfc, BOX, pick->separator_line + 1, 1, &cell_sp, 1);
     }
 }
@@ -1479,45 +2501,3 @@ int new_pick_view(Init *init) {
     int rc = init_view_boxwin(init);
     return rc;
 }
-/** @brief Initializes a new view for displaying the contents of a specified
-   file in the pick interface
-   @ingroup pick_engine
-    @param init Pointer to Init structure containing pick information
-    @param file Name of the file to be displayed in the view
-    @details If a view is already initialized, it destroys the existing line
-   table and unmaps the buffer. Then, it sets up the provider command for
-   highlighting the specified file, initializes the view input, and if successful,
-   resets various view parameters, initializes the line table, and displays the
-   first page of the file contents along with the prompt.
-    */
-void new_view_file(Init *init, char *file) {
-    View *view = init->view;
-    if (view->buf != nullptr) {
-        destroy_line_table(view);
-        munmap(view->buf, view->file_size);
-        view->buf = nullptr;
-    }
-    strnz__cpy(view->provider_cmd, "tree-sitter highlight ", MAXLEN - 1);
-    strnz__cat(view->provider_cmd, file, MAXLEN - 1);
-    strnz__cpy(view->title, file, MAXLEN - 1);
-    if (view_init_input(init, file) == 0) {
-        if (view->buf) {
-            view->f_eod = 0;
-            view->f_bod = 0;
-            view->maxcol = 0;
-            view->page_top_pos = 0;
-            view->page_top_ln_no = 0;
-            view->page_bot_ln_no = 0;
-            view->ln_max_pos = 0;
-            view->ln_no = 0;
-            view->page_bot_pos = 0;
-            view->file_pos = 0;
-            border_title(view->sfc, view->title);
-            initialize_line_table(view);
-            next_page(view);
-            build_prompt(view);
-            display_prompt(view, view->prompt_str);
-            pad_refresh(view);
-        }
-    }
-}
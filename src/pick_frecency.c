@@ -0,0 +1,378 @@
+/** @file pick_frecency.c
+    @brief rank pick objects by how often and how lately they were chosen
+    @author Bill Waller
+    Copyright (c) 2025
+    MIT License
+    billxwaller@gmail.com
+    @date 2026-02-09
+    @details With f_frecency, the objects selected and processed are
+   counted in a table for each Pick context: the description file, the
+   provider command, or the input file. The tables are kept in
+   $XDG_CACHE_HOME/cmenu/frecency or ~/.cache/cmenu/frecency, named for a
+   hash of the context. Each has PICK_FRECENCY_SLOTS slots, holding a hash
+   of an object's text, the times it was chosen and when it was last
+   chosen, found in a few probes whatever the length of the list. Once an
+   object's neighborhood is full, the least frecent object in it gives way.
+
+   The table is mapped by a thread started as Pick opens, so the first
+   page never waits on the disk for longer than PICK_FRECENCY_WAIT_MS, and
+   searches rank without it until it is loaded. Selections are written to
+   the shared mapping, under flock() so that picks of the same context
+   take turns, and the kernel writes them back to the file in its own
+   time. A new table is built under a temporary name and renamed into
+   place, so a file another pick has mapped is never truncated.
+ */
+
+#define _GNU_SOURCE
+#include "common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FRECENCY_MAGIC "cmfrec1"   /**< and version, see FrecencyTable */
+#define FRECENCY_PROBES 16         /**< slots an object may be in */
+#define FRECENCY_COUNT_MAX 65535   /**< times chosen are counted up to */
+
+/** @struct FrecencySlot
+    @brief An object chosen before, free if key is 0 */
+typedef struct {
+    uint64_t key;   /**< see text_key() */
+    uint32_t count; /**< times chosen */
+    uint32_t last;  /**< when it was last chosen, in seconds */
+} FrecencySlot;
+
+/** @struct FrecencyTable
+    @brief A Pick context's table, as it is in the file */
+typedef struct {
+    char magic[8];
+    uint32_t slots;
+    uint32_t reserved;
+    FrecencySlot slot[PICK_FRECENCY_SLOTS];
+} FrecencyTable;
+
+/** @struct PickFrecency
+    @brief The frecency table of a Pick, and the thread that loads it */
+struct PickFrecency {
+    pthread_t thread;
+    bool f_thread;                  /**< loader not yet joined */
+    char path[MAXLEN];              /**< table file */
+    int fd;                         /**< table file, for flock() */
+    _Atomic(FrecencyTable *) table; /**< mapped table, once loaded */
+};
+
+static uint64_t text_key(const char *, size_t);
+static void *load_frecency(void *);
+static bool frecency_valid(int);
+static int create_frecency(const char *, bool);
+static void join_loader(PickFrecency *);
+static FrecencyTable *frecency_table(Pick *);
+static uint slot_value(const FrecencySlot *, uint32_t);
+static void count_object(FrecencyTable *, uint64_t, uint32_t);
+
+/** @brief Identifies an object's text, or a Pick context
+ *  @ingroup pick_engine
+    @return FNV-1a hash, never 0 */
+static uint64_t text_key(const char *s, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h ? h : 1;
+}
+/** @brief Starts loading the frecency table of the Pick's context
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @details Does nothing unless f_frecency is set. The context is the
+   description file, else the provider command, else the input file. */
+void open_frecency(Pick *pick) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    const char *context;
+    char dir[MAXLEN];
+    PickFrecency *fr;
+
+    if (!pick->f_frecency || pick->frecency != nullptr)
+        return;
+    if (pick->mapp_spec[0] != '\0')
+        context = pick->mapp_spec;
+    else if (pick->provider_cmd[0] != '\0')
+        context = pick->provider_cmd;
+    else if (pick->in_spec[0] != '\0')
+        context = pick->in_spec;
+    else
+        context = "/dev/stdin";
+    if (xdg && xdg[0] == '/')
+        ssnprintf(dir, MAXLEN - 1, "%s/cmenu/frecency", xdg);
+    else if (home && home[0] != '\0')
+        ssnprintf(dir, MAXLEN - 1, "%s/.cache/cmenu/frecency", home);
+    else
+        return;
+    fr = calloc(1, sizeof(PickFrecency));
+    if (fr == nullptr) {
+        Perror("calloc PickFrecency failed");
+        return;
+    }
+    ssnprintf(fr->path, MAXLEN - 1, "%s/%016llx", dir,
+              (unsigned long long)text_key(context, strlen(context)));
+    fr->fd = -1;
+    atomic_init(&fr->table, nullptr);
+    fr->f_thread = pthread_create(&fr->thread, nullptr, load_frecency, fr) == 0;
+    pick->frecency = fr;
+}
+/** @brief Frecency loader thread
+ *  @ingroup pick_engine
+    @param arg PickFrecency
+    @details Creates the table if it isn't there, or replaces it if it
+   isn't a table, and maps it. A table that can't be opened is left
+   unloaded, and Pick ranks without it. */
+static void *load_frecency(void *arg) {
+    PickFrecency *fr = arg;
+    char dir[MAXLEN];
+    FrecencyTable *t;
+    int fd;
+
+    strnz__cpy(dir, fr->path, MAXLEN - 1);
+    for (char *p = strchr(dir + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        mkdir(dir, 0755);
+        *p = '/';
+    }
+    fd = open(fr->path, O_RDWR | O_CLOEXEC);
+    if (fd == -1 && errno == ENOENT) {
+        fd = create_frecency(fr->path, false);
+        // Another pick created it first
+        if (fd == -1 && errno == EEXIST)
+            fd = open(fr->path, O_RDWR | O_CLOEXEC);
+    }
+    if (fd != -1 && !frecency_valid(fd)) {
+        close(fd);
+        fd = create_frecency(fr->path, true);
+    }
+    if (fd == -1)
+        return nullptr;
+    t = mmap(nullptr, sizeof(FrecencyTable), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+    if (t == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+    fr->fd = fd;
+    atomic_store_explicit(&fr->table, t, memory_order_release);
+    return nullptr;
+}
+/** @brief Tells whether a file holds a frecency table
+ *  @ingroup pick_engine
+    @param fd The file
+    @return true if it is the size of a table and has its header */
+static bool frecency_valid(int fd) {
+    char magic[8];
+    uint32_t slots;
+    struct stat sb;
+
+    return fstat(fd, &sb) == 0 && sb.st_size == sizeof(FrecencyTable) &&
+           pread(fd, magic, sizeof(magic),
+                 offsetof(FrecencyTable, magic)) == sizeof(magic) &&
+           memcmp(magic, FRECENCY_MAGIC, sizeof(magic)) == 0 &&
+           pread(fd, &slots, sizeof(slots),
+                 offsetof(FrecencyTable, slots)) == sizeof(slots) &&
+           slots == PICK_FRECENCY_SLOTS;
+}
+/** @brief Creates an empty frecency table file
+ *  @ingroup pick_engine
+    @param path Table file
+    @param replace true to replace a file that isn't a table, false if
+   there is none, in which case one created meanwhile by another pick is
+   kept and errno is EEXIST
+    @return The table file, open for reading and writing, or -1
+    @details The table is written under a temporary name, then renamed or
+   linked into place, so no pick ever maps it half made, and the file it
+   replaces keeps its size for a pick that has it mapped. */
+static int create_frecency(const char *path, bool replace) {
+    char tmp[MAXLEN];
+    uint32_t slots = PICK_FRECENCY_SLOTS;
+    int fd, err;
+
+    ssnprintf(tmp, MAXLEN - 1, "%s.XXXXXX", path);
+    fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    if (fchmod(fd, 0644) == -1 ||
+        ftruncate(fd, sizeof(FrecencyTable)) == -1 ||
+        pwrite(fd, FRECENCY_MAGIC, sizeof(FRECENCY_MAGIC),
+               offsetof(FrecencyTable, magic)) != sizeof(FRECENCY_MAGIC) ||
+        pwrite(fd, &slots, sizeof(slots), offsetof(FrecencyTable, slots)) !=
+            sizeof(slots) ||
+        (replace ? rename(tmp, path) : link(tmp, path)) == -1) {
+        err = errno;
+        close(fd);
+        unlink(tmp);
+        errno = err;
+        return -1;
+    }
+    if (!replace)
+        unlink(tmp);
+    return fd;
+}
+/** @brief Waits for the loader thread to finish
+ *  @ingroup pick_engine */
+static void join_loader(PickFrecency *fr) {
+    if (!fr->f_thread)
+        return;
+    pthread_join(fr->thread, nullptr);
+    fr->f_thread = false;
+}
+/** @brief Waits a while for the frecency table to load
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param ms Longest wait */
+void wait_frecency(Pick *pick, long ms) {
+    PickFrecency *fr = pick->frecency;
+    struct timespec ts;
+
+    if (fr == nullptr || !fr->f_thread)
+        return;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    if (pthread_timedjoin_np(fr->thread, nullptr, &ts) == 0)
+        fr->f_thread = false;
+}
+/** @brief The loaded frecency table, or nullptr
+ *  @ingroup pick_engine */
+static FrecencyTable *frecency_table(Pick *pick) {
+    PickFrecency *fr = pick->frecency;
+
+    if (fr == nullptr)
+        return nullptr;
+    return atomic_load_explicit(&fr->table, memory_order_acquire);
+}
+/** @brief Tells whether the frecency table is loaded
+ *  @ingroup pick_engine */
+bool frecency_ready(Pick *pick) { return frecency_table(pick) != nullptr; }
+/** @brief A slot's frecency
+ *  @ingroup pick_engine
+    @return Times chosen, weighted by how lately: 16 times within the
+   hour, 8 times within the day, twice within the week */
+static uint slot_value(const FrecencySlot *s, uint32_t now) {
+    uint32_t age = now > s->last ? now - s->last : 0;
+
+    if (age < 3600)
+        return s->count * 16;
+    if (age < 86400)
+        return s->count * 8;
+    if (age < 7 * 86400)
+        return s->count * 2;
+    return s->count;
+}
+/** @brief An object's frecency
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param s Object text
+    @param len Its length
+    @param now Time frecency is reckoned from, in seconds
+    @return See slot_value(), 0 if it was never chosen or the table isn't
+   loaded
+    @details Called by the search workers, so it only reads the table. */
+uint frecency_of(Pick *pick, const char *s, uint len, uint32_t now) {
+    FrecencyTable *t = frecency_table(pick);
+    uint64_t key;
+
+    if (t == nullptr)
+        return 0;
+    key = text_key(s, len);
+    for (uint i = 0; i < FRECENCY_PROBES; i++) {
+        const FrecencySlot *slot =
+            &t->slot[(key + i) & (PICK_FRECENCY_SLOTS - 1)];
+        if (slot->key == key)
+            return slot_value(slot, now);
+        if (slot->key == 0)
+            break;
+    }
+    return 0;
+}
+/** @brief Counts an object as chosen
+ *  @ingroup pick_engine
+    @details Slots are only ever replaced, never freed, so an object is
+   always before the first free slot of its neighborhood. */
+static void count_object(FrecencyTable *t, uint64_t key, uint32_t now) {
+    FrecencySlot *slot, *victim = nullptr;
+
+    for (uint i = 0; i < FRECENCY_PROBES; i++) {
+        slot = &t->slot[(key + i) & (PICK_FRECENCY_SLOTS - 1)];
+        if (slot->key == key) {
+            if (slot->count < FRECENCY_COUNT_MAX)
+                slot->count++;
+            slot->last = now;
+            return;
+        }
+        if (slot->key == 0) {
+            victim = slot;
+            break;
+        }
+        if (victim == nullptr ||
+            slot_value(slot, now) < slot_value(victim, now))
+            victim = slot;
+    }
+    *victim = (FrecencySlot){key, 1, now};
+}
+/** @brief Counts the selected objects as chosen
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @details Called once the selection has been processed. A search still
+   running is finished first, since its workers read the table. The table
+   is locked while it is counted, since another pick of the same context
+   may be counting too. */
+void record_frecency(Pick *pick) {
+    PickFrecency *fr = pick->frecency;
+    FrecencyTable *t;
+    uint32_t now = (uint32_t)time(nullptr);
+
+    if (fr == nullptr)
+        return;
+    join_loader(fr);
+    t = frecency_table(pick);
+    if (t == nullptr)
+        return;
+    finish_search(pick);
+    flock(fr->fd, LOCK_EX);
+    for (uint m = next_selected(pick, 0); m < pick->m_cnt;
+         m = next_selected(pick, m + 1))
+        count_object(t, text_key(pick_object(pick, m), pick->obj_len[m]),
+                     now);
+    flock(fr->fd, LOCK_UN);
+    msync(t, sizeof(FrecencyTable), MS_ASYNC);
+}
+/** @brief Unmaps the frecency table
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure */
+void free_frecency(Pick *pick) {
+    PickFrecency *fr = pick->frecency;
+    FrecencyTable *t;
+
+    if (fr == nullptr)
+        return;
+    join_loader(fr);
+    t = frecency_table(pick);
+    if (t != nullptr)
+        munmap(t, sizeof(FrecencyTable));
+    if (fr->fd != -1)
+        close(fr->fd);
+    free(fr);
+    pick->frecency = nullptr;
+}
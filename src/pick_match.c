@@ -0,0 +1,1189 @@
+/** @file pick_match.c
+    @brief match pick objects against a search term
+    @author Bill Waller
+    Copyright (c) 2025
+    MIT License
+    billxwaller@gmail.com
+    @date 2026-02-09
+    @details Pick has three ways of matching the search term. Fuzzy, the
+   default, finds the term's characters in order anywhere in an object, and
+   scores the match the way fzf does, so that matches at the start of words,
+   after path separators and at camelCase humps, and runs of consecutive
+   characters, come first. Exact finds the term as a substring and regex as
+   an extended regular expression, both keeping the input order. A term in
+   lower case matches either case, one with an upper case letter matches
+   case exactly, unless f_ignore_case is set.
+
+   The objects each prefix of the term matched are kept, so typing another
+   character only searches the objects the term matched so far, and
+   backspacing searches nothing at all.
+
+   Large searches run on a pool of worker threads, in chunks that are
+   merged in order, while the line editor keeps reading keys. A key that
+   changes the term cancels the search, and the first page is shown as
+   soon as it has been found.
+
+   With f_frecency, objects chosen often and lately come first: ahead of
+   the rest for an empty, exact or regex term, which otherwise keep the
+   input order, and among equal scores for a fuzzy term. See
+   pick_frecency.c.
+ */
+
+#include "common.h"
+#include <pthread.h>
+#include <regex.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sysinfo.h>
+#include <time.h>
+
+/** Scores, as in fzf */
+#define SCORE_MATCH 16
+#define SCORE_GAP_START -3
+#define SCORE_GAP_EXT -1
+#define BONUS_BOUNDARY (SCORE_MATCH / 2)
+#define BONUS_NON_WORD (SCORE_MATCH / 2)
+#define BONUS_CAMEL (BONUS_BOUNDARY + SCORE_GAP_EXT)
+#define BONUS_CONSECUTIVE (-(SCORE_GAP_START + SCORE_GAP_EXT))
+#define BONUS_FIRST_CHAR 2
+#define BONUS_WHITE (BONUS_BOUNDARY + 2)
+#define BONUS_DELIMITER (BONUS_BOUNDARY + 1)
+
+/** Largest window, and window times term length, scored by dynamic
+   programming. Longer matches are scored in one pass, see fuzzy_match(). */
+#define MATCH_WIN_MAX 512
+#define MATCH_DP_MAX 4096
+
+/** Objects of equal score are ranked by length, up to this */
+#define RANK_LEN_MAX 1023
+/** and before that by frecency, in this many levels */
+#define RANK_FRECENCY_LEVELS 16
+
+/** Searches of fewer objects run on the calling thread. Larger ones are
+   split into chunks for the search workers, at most one per processor. */
+#define MATCH_THREAD_MIN 65536
+#define MATCH_CHUNK 8192
+#define MATCH_THREADS_MAX 16
+
+/** @enum CharClass
+    @brief Character classes, for the bonuses */
+typedef enum {
+    C_WHITE,
+    C_NON_WORD,
+    C_DELIMITER, /**< path and list separators */
+    C_LOWER,
+    C_UPPER,
+    C_LETTER,    /**< non ASCII */
+    C_NUMBER,
+    C_CLASSES
+} CharClass;
+
+/** @struct PickMatch
+    @brief A compiled search term */
+struct PickMatch {
+    MatchMode mode;
+    bool f_fold;             /**< either case matches */
+    uint len;                /**< term length */
+    char term[MAXLEN];       /**< term, in lower case if f_fold */
+    uint8_t fold[MAXLEN];    /**< or'ed into object characters to compare */
+    uint64_t mask;           /**< characters in term, see object_mask() */
+    bool f_regex;            /**< re is compiled */
+    regex_t re;
+    bool f_frecency;         /**< objects are ranked by frecency too */
+    uint32_t now;            /**< time frecency is reckoned from */
+};
+
+/** @struct TopObject
+    @brief A derived object among the best of a chunk */
+typedef struct {
+    int score;
+    uint m; /**< master object index */
+} TopObject;
+
+/** @struct PickChunk
+    @brief A chunk of a search, see search_span() */
+typedef struct {
+    bool f_done;    /**< searched */
+    uint cnt;       /**< objects matched */
+    TopObject *top; /**< heap of its best objects, worst first, or nullptr */
+    uint top_cnt;   /**< entries in top */
+} PickChunk;
+
+/** @struct PickSearch
+    @brief The search workers, and the search they are running. The
+   workers share the fields from f_quit to chunk[].f_done with the main
+   thread, under mutex. */
+struct PickSearch {
+    pthread_t thread[MATCH_THREADS_MAX];
+    uint threads;           /**< workers started */
+    bool f_started;         /**< workers were started, or failed to */
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;      /**< signaled when a search starts, and to quit */
+    pthread_cond_t done_cond; /**< signaled when all chunks are done, and
+                                 as workers leave a search */
+    bool f_quit;            /**< workers are to end */
+    bool f_job;             /**< a search is running */
+    uint gen;               /**< searches started */
+    uint busy;              /**< workers in the search */
+    uint next;              /**< next chunk to take */
+    uint chunk_cnt;         /**< chunks of the search */
+    uint done_cnt;          /**< chunks done */
+    PickChunk *chunk;
+    uint chunk_max;         /**< entries allocated to chunk */
+    TopObject *top;         /**< k entries for each chunk */
+    TopObject *cand;        /**< the chunks' best objects, see rank_chunks() */
+    uint top_max;           /**< entries allocated to top and cand */
+    atomic_bool f_cancel;   /**< workers are to leave the search */
+    /** The search: positions 0..src_cnt are objects of src, the rest are
+       master objects from m_lo on */
+    const uint *src;
+    uint src_cnt;
+    uint m_lo;
+    uint n;                 /**< positions */
+    uint base;              /**< derived objects taken from the cache */
+    uint k;                 /**< objects ranked by each chunk, a page */
+    PickFilter *f;          /**< result set searched, see save_filter() */
+    char term[MAXLEN];
+    MatchMode mode;
+    uint m_cnt;             /**< master objects when it ended */
+    bool f_valid;           /**< derived objects are the term's */
+    uint merged;            /**< chunks merged, main thread only */
+    bool f_page;            /**< first page shown */
+};
+
+static uint8_t char_class[256];
+static int8_t bonus_matrix[C_CLASSES][C_CLASSES];
+static uint64_t char_bit[256];
+static bool f_tables;
+
+/** @brief Bonus for matching a character of class cur after one of class
+   prev
+ *  @ingroup pick_engine */
+static int8_t bonus_for(CharClass prev, CharClass cur) {
+    if (cur > C_NON_WORD) {
+        if (prev == C_WHITE)
+            return BONUS_WHITE;
+        if (prev == C_DELIMITER)
+            return BONUS_DELIMITER;
+        if (prev == C_NON_WORD)
+            return BONUS_BOUNDARY;
+    }
+    if ((prev == C_LOWER && cur == C_UPPER) ||
+        (prev != C_NUMBER && cur == C_NUMBER))
+        return BONUS_CAMEL;
+    if (cur == C_NON_WORD || cur == C_DELIMITER)
+        return BONUS_NON_WORD;
+    if (cur == C_WHITE)
+        return BONUS_WHITE;
+    return 0;
+}
+/** @brief Builds the character class, bonus and character bit tables
+ *  @ingroup pick_engine */
+static void init_match_tables(void) {
+    for (uint c = 0; c < 256; c++) {
+        if (c >= 'a' && c <= 'z') {
+            char_class[c] = C_LOWER;
+            char_bit[c] = 1ULL << (c - 'a');
+        } else if (c >= 'A' && c <= 'Z') {
+            char_class[c] = C_UPPER;
+            char_bit[c] = 1ULL << (c - 'A');
+        } else if (c >= '0' && c <= '9') {
+            char_class[c] = C_NUMBER;
+            char_bit[c] = 1ULL << (26 + c - '0');
+        } else {
+            if (c == ' ' || c == '\t')
+                char_class[c] = C_WHITE;
+            else if (c == '/' || c == ',' || c == ':' || c == ';' || c == '|')
+                char_class[c] = C_DELIMITER;
+            else if (c >= 0x80)
+                char_class[c] = C_LETTER;
+            else
+                char_class[c] = C_NON_WORD;
+            char_bit[c] = 1ULL << (36 + c % 28);
+        }
+    }
+    for (uint p = 0; p < C_CLASSES; p++)
+        for (uint c = 0; c < C_CLASSES; c++)
+            bonus_matrix[p][c] = bonus_for(p, c);
+    f_tables = true;
+}
+/** @brief Summarizes the characters in an object
+ *  @ingroup pick_engine
+    @param s Object
+    @param len Length of s
+    @return A bit for each letter, either case, and digit, and one for each
+   of 28 groups of the other characters
+    @details An object can only match a term whose bits are all in its
+   mask, so most objects are rejected without looking at them. */
+uint64_t object_mask(const char *s, uint len) {
+    uint64_t mask = 0;
+    if (!f_tables)
+        init_match_tables();
+    for (uint i = 0; i < len; i++)
+        mask |= char_bit[(uint8_t)s[i]];
+    return mask;
+}
+/** @brief Finds a term character in an object
+ *  @ingroup pick_engine
+    @param t Object
+    @param i Index to start at
+    @param n Length of t
+    @param c Term character
+    @param fold 0x20 if c is a folded letter, otherwise 0
+    @return Index of the character, or n if there is none
+    @details Compares eight bytes at a time, finding the first that matches
+   with the zero byte test on the difference. */
+static inline uint find_char(const char *t, uint i, uint n, uint8_t c,
+                             uint8_t fold) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t highs = 0x8080808080808080ULL;
+    uint64_t or_w = ones * fold, c_w = ones * c, w, z;
+    for (; i + 8 <= n; i += 8) {
+        memcpy(&w, t + i, 8);
+        w = (w | or_w) ^ c_w;
+        z = (w - ones) & ~w & highs;
+        if (z)
+            return i + (__builtin_ctzll(z) >> 3);
+    }
+#endif
+    for (; i < n; i++)
+        if (((uint8_t)t[i] | fold) == c)
+            return i;
+    return n;
+}
+/** @brief Scores a match in one pass
+ *  @ingroup pick_engine
+    @param pm Compiled term
+    @param t Object
+    @param sidx Index of the match's first character
+    @param eidx Index after the match's last character
+    @return Score
+    @details The characters are matched as they come, so this can miss a
+   better alignment, but it takes no more than one look at each character
+   of the match. */
+static int scan_score(const PickMatch *pm, const char *t, uint sidx,
+                      uint eidx) {
+    uint p = 0, consecutive = 0;
+    int score = 0, first_bonus = 0, bonus;
+    bool in_gap = false;
+    uint8_t prev = sidx ? char_class[(uint8_t)t[sidx - 1]] : C_WHITE, cur;
+
+    for (uint i = sidx; i < eidx && p < pm->len; i++) {
+        cur = char_class[(uint8_t)t[i]];
+        if (((uint8_t)t[i] | pm->fold[p]) == (uint8_t)pm->term[p]) {
+            score += SCORE_MATCH;
+            bonus = bonus_matrix[prev][cur];
+            if (consecutive == 0)
+                first_bonus = bonus;
+            else {
+                // A boundary starts a new run
+                if (bonus >= BONUS_BOUNDARY && bonus > first_bonus)
+                    first_bonus = bonus;
+                bonus = max(bonus, first_bonus);
+                bonus = max(bonus, BONUS_CONSECUTIVE);
+            }
+            score += p == 0 ? bonus * BONUS_FIRST_CHAR : bonus;
+            in_gap = false;
+            consecutive++;
+            p++;
+        } else {
+            score += in_gap ? SCORE_GAP_EXT : SCORE_GAP_START;
+            in_gap = true;
+            consecutive = 0;
+            first_bonus = 0;
+        }
+        prev = cur;
+    }
+    return score;
+}
+/** @brief Scores the best alignment of the term in a window of the object
+ *  @ingroup pick_engine
+    @param pm Compiled term
+    @param t Object
+    @param first Index of the first possible match of each term character
+    @param last Index of the last occurrence of the term's last character
+    @return Score
+    @details Smith-Waterman, with fzf's scores and bonuses. Only two rows
+   of the table are kept, since the score is all that's needed, and each row
+   only spans the characters its term character can align with: from its
+   first possible match to before the last possible match of the next. */
+static int align_score(const PickMatch *pm, const char *t, const uint *first,
+                       uint last) {
+    uint f0 = first[0], w = last + 1 - f0;
+    uint end[MAXLEN];
+    int8_t bonus[MATCH_WIN_MAX];
+    int16_t h[2][MATCH_WIN_MAX];
+    uint8_t run[2][MATCH_WIN_MAX];
+    int16_t *ph = h[0], *ch = h[1], *th;
+    uint8_t *pr = run[0], *cr = run[1], *tr;
+    uint8_t prev = f0 ? char_class[(uint8_t)t[f0 - 1]] : C_WHITE, cur;
+    uint p = pm->len - 1, j;
+    int best = 0, s1, s2, b, fb;
+    bool in_gap = false;
+
+    for (j = 0; j < w; j++) {
+        cur = char_class[(uint8_t)t[f0 + j]];
+        bonus[j] = bonus_matrix[prev][cur];
+        prev = cur;
+    }
+    // Row ends, from the last possible match of each term character
+    end[p] = w;
+    for (j = w - 1; p > 0; j--)
+        if (((uint8_t)t[f0 + j] | pm->fold[p]) == (uint8_t)pm->term[p])
+            end[--p] = j;
+    // First term character
+    for (j = 0; j < end[0]; j++) {
+        if (((uint8_t)t[f0 + j] | pm->fold[0]) == (uint8_t)pm->term[0]) {
+            ph[j] = SCORE_MATCH + bonus[j] * BONUS_FIRST_CHAR;
+            pr[j] = 1;
+            in_gap = false;
+        } else {
+            s2 = j ? ph[j - 1] + (in_gap ? SCORE_GAP_EXT : SCORE_GAP_START)
+                   : 0;
+            ph[j] = max(s2, 0);
+            pr[j] = 0;
+            in_gap = true;
+        }
+        best = max(best, ph[j]);
+    }
+    // The others
+    for (p = 1; p < pm->len; p++) {
+        uint start = first[p] - f0;
+        uint8_t c = pm->term[p], fold = pm->fold[p];
+        best = 0;
+        in_gap = false;
+        for (j = start; j < end[p]; j++) {
+            s2 = j > start
+                     ? ch[j - 1] + (in_gap ? SCORE_GAP_EXT : SCORE_GAP_START)
+                     : 0;
+            if (((uint8_t)t[f0 + j] | fold) != c) {
+                ch[j] = max(s2, 0);
+                cr[j] = 0;
+                in_gap = true;
+                best = max(best, ch[j]);
+                continue;
+            }
+            s1 = ph[j - 1] + SCORE_MATCH;
+            b = bonus[j];
+            uint consecutive = pr[j - 1] + 1;
+            if (consecutive > 1) {
+                fb = bonus[j - consecutive + 1];
+                if (b >= BONUS_BOUNDARY && b > fb)
+                    consecutive = 1;
+                else {
+                    b = max(b, fb);
+                    b = max(b, BONUS_CONSECUTIVE);
+                }
+            }
+            if (s1 + b < s2) {
+                s1 += bonus[j];
+                consecutive = 0;
+            } else
+                s1 += b;
+            cr[j] = min(consecutive, 255);
+            in_gap = s1 < s2;
+            s1 = max(s1, s2);
+            ch[j] = max(s1, 0);
+            best = max(best, ch[j]);
+        }
+        th = ph, ph = ch, ch = th;
+        tr = pr, pr = cr, cr = tr;
+    }
+    return best;
+}
+/** @brief Matches the term's characters in order
+ *  @ingroup pick_engine
+    @param pm Compiled term
+    @param t Object
+    @param n Length of t
+    @param score Set to the match score
+    @return true if the object matches
+    @details A forward scan finds whether the object matches, and where
+   each term character can first be. Matches in a short enough window are
+   scored for their best alignment, longer ones in one pass over the
+   shortest match found by scanning back from the end of the first. */
+static bool fuzzy_match(const PickMatch *pm, const char *t, uint n,
+                        int *score) {
+    uint first[MAXLEN];
+    uint i = 0, p = 0, last, end;
+    uint8_t c, fold;
+
+    // The term is never empty, see match_object()
+    do {
+        i = find_char(t, i, n, pm->term[p], pm->fold[p]);
+        if (i == n)
+            return false;
+        first[p] = i++;
+    } while (++p < pm->len);
+    end = i;
+    c = pm->term[pm->len - 1];
+    fold = pm->fold[pm->len - 1];
+    if (pm->len == 1) {
+        // The best of its occurrences
+        int best = 0, bonus;
+        for (i = first[0]; i < n; i = find_char(t, i + 1, n, c, fold)) {
+            bonus = bonus_matrix[i ? char_class[(uint8_t)t[i - 1]] : C_WHITE]
+                                [char_class[(uint8_t)t[i]]];
+            best = max(best, bonus);
+        }
+        *score = SCORE_MATCH + best * BONUS_FIRST_CHAR;
+        return true;
+    }
+    for (last = n - 1; last > end - 1; last--)
+        if (((uint8_t)t[last] | fold) == c)
+            break;
+    uint w = last + 1 - first[0];
+    if (w <= MATCH_WIN_MAX && w * pm->len <= MATCH_DP_MAX) {
+        *score = align_score(pm, t, first, last);
+        return true;
+    }
+    // Shortest match ending where the first one does
+    p = pm->len;
+    for (i = end; i-- > first[0];)
+        if (((uint8_t)t[i] | pm->fold[p - 1]) == (uint8_t)pm->term[p - 1] &&
+            --p == 0)
+            break;
+    *score = scan_score(pm, t, i, end);
+    return true;
+}
+/** @brief Places a frecency among RANK_FRECENCY_LEVELS, by powers of 2
+ *  @ingroup pick_engine */
+static inline uint frecency_level(uint frecency) {
+    if (frecency == 0)
+        return 0;
+    return min(32 - (uint)__builtin_clz(frecency), RANK_FRECENCY_LEVELS - 1);
+}
+/** @brief Compiles a search term for match_object()
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param s Search term
+    @return false if s is not a valid regular expression, in which case the
+   previous term is kept
+    @details Sets f_rank for a non-empty fuzzy term, or any term once the
+   frecency table is loaded, see rank_objects(). */
+bool compile_match(Pick *pick, const char *s) {
+    PickMatch *pm = pick->match;
+    bool f_fold = pick->f_ignore_case;
+    bool f_frecency;
+    uint i;
+
+    if (pm == nullptr) {
+        pm = calloc(1, sizeof(PickMatch));
+        if (pm == nullptr) {
+            Perror("calloc PickMatch failed");
+            return false;
+        }
+        pick->match = pm;
+    }
+    if (!f_tables)
+        init_match_tables();
+    // Smart case
+    if (!f_fold) {
+        for (i = 0; s[i] != '\0' && !(s[i] >= 'A' && s[i] <= 'Z'); i++)
+            ;
+        f_fold = s[i] == '\0';
+    }
+    if (pick->match_mode == MATCH_REGEX && s[0] != '\0') {
+        regex_t re;
+        if (regcomp(&re, s, REG_EXTENDED | REG_NOSUB |
+                                (f_fold ? REG_ICASE : 0)) != 0)
+            return false;
+        if (pm->f_regex)
+            regfree(&pm->re);
+        pm->re = re;
+        pm->f_regex = true;
+    }
+    f_frecency = frecency_ready(pick);
+    // Results kept so far were ranked without it
+    if (f_frecency && !pm->f_frecency)
+        free_filters(pick);
+    pm->f_frecency = f_frecency;
+    pm->now = (uint32_t)time(nullptr);
+    pm->mode = pick->match_mode;
+    pm->f_fold = f_fold;
+    pm->mask = 0;
+    for (i = 0; s[i] != '\0' && i < MAXLEN - 1; i++) {
+        uint8_t c = s[i];
+        bool f_letter = (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+        pm->fold[i] = f_fold && f_letter ? 0x20 : 0;
+        pm->term[i] = c | pm->fold[i];
+        pm->mask |= char_bit[c];
+    }
+    pm->term[i] = '\0';
+    pm->len = i;
+    pick->f_rank = (pm->mode == MATCH_FUZZY && pm->len > 0) || pm->f_frecency;
+    pick->d_ranked = 0;
+    return true;
+}
+/** @brief Matches a master object against the compiled search term
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param m Master object index
+    @param score Set to the object's rank: its match score, and among equal
+   scores, the more frecent, then shorter objects first. Its frecency
+   unless fuzzy, 0 without f_frecency.
+    @return true if the object matches */
+bool match_object(Pick *pick, uint m, int *score) {
+    const PickMatch *pm = pick->match;
+    const char *t = pick_object(pick, m);
+    uint n = pick->obj_len[m];
+    uint level;
+    bool f_match;
+
+    *score = 0;
+    if (pm->len == 0)
+        f_match = true;
+    else
+        switch (pm->mode) {
+        case MATCH_REGEX:
+            f_match = regexec(&pm->re, t, 0, nullptr, 0) == 0;
+            break;
+        case MATCH_EXACT:
+            if ((pick->obj_mask[m] & pm->mask) != pm->mask)
+                f_match = false;
+            else if (pm->f_fold)
+                f_match = strcasestr(t, pm->term) != nullptr;
+            else
+                f_match = memmem(t, n, pm->term, pm->len) != nullptr;
+            break;
+        case MATCH_FUZZY:
+        default:
+            if ((pick->obj_mask[m] & pm->mask) != pm->mask ||
+                !fuzzy_match(pm, t, n, score))
+                return false;
+            level = pm->f_frecency
+                        ? frecency_level(frecency_of(pick, t, n, pm->now))
+                        : 0;
+            // More frecent, then shorter objects break ties
+            *score = min(*score, 100000);
+            *score = max(*score, -100000);
+            *score = (*score * RANK_FRECENCY_LEVELS + (int)level) *
+                         (RANK_LEN_MAX + 1) -
+                     (int)min(n, RANK_LEN_MAX);
+            return true;
+        }
+    if (f_match && pm->f_frecency)
+        *score = (int)frecency_of(pick, t, n, pm->now);
+    return f_match;
+}
+/** @brief Frees a cached result set
+ *  @ingroup pick_engine */
+static void free_filter(PickFilter *f) {
+    free(f->term);
+    free(f->object);
+    free(f->score);
+    *f = (PickFilter){0};
+}
+/** @brief Frees the cached result sets
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure */
+void free_filters(Pick *pick) {
+    while (pick->filter_cnt > 0)
+        free_filter(&pick->filter[--pick->filter_cnt]);
+}
+/** @brief Finds the cached result set to derive a search term's from
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param s Search term
+    @return The result set of s itself or of its longest cached prefix, or
+   nullptr if there is none, and the master objects must be searched
+    @details A term only matches objects its prefixes matched, except as a
+   regular expression, so the result sets of other terms are dropped. */
+static PickFilter *prefix_filter(Pick *pick, const char *s) {
+    uint i;
+    for (i = 0; i < pick->filter_cnt; i++) {
+        PickFilter *f = &pick->filter[i];
+        size_t l = strlen(f->term);
+        if (f->mode != pick->match_mode || strncmp(f->term, s, l) != 0 ||
+            (s[l] != '\0' && f->mode == MATCH_REGEX))
+            break;
+    }
+    while (pick->filter_cnt > i)
+        free_filter(&pick->filter[--pick->filter_cnt]);
+    return i > 0 ? &pick->filter[i - 1] : nullptr;
+}
+/** @brief Caches the derived objects as the result set of a search term
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param f The result set they were derived from, replaced if it is the
+   term's own
+    @param s Search term
+    @details Once PICK_FILTER_MAX terms are kept, longer ones are derived
+   from the longest, without being kept. */
+static void save_filter(Pick *pick, PickFilter *f, const char *s) {
+    if (f == nullptr || strcmp(f->term, s) != 0) {
+        if (pick->filter_cnt == PICK_FILTER_MAX)
+            return;
+        f = &pick->filter[pick->filter_cnt];
+        if ((f->term = strdup(s)) == nullptr)
+            return;
+        pick->filter_cnt++;
+    } else if (f->m_cnt == pick->m_cnt)
+        return;
+    uint *object = realloc(f->object, (pick->d_cnt + 1) * sizeof(uint));
+    int *score = realloc(f->score, (pick->d_cnt + 1) * sizeof(int));
+    if (object != nullptr)
+        f->object = object;
+    if (score != nullptr)
+        f->score = score;
+    if (object == nullptr || score == nullptr) {
+        free_filter(f);
+        pick->filter_cnt--;
+        return;
+    }
+    memcpy(f->object, pick->d_object, pick->d_cnt * sizeof(uint));
+    memcpy(f->score, pick->d_score, pick->d_cnt * sizeof(int));
+    f->mode = pick->match_mode;
+    f->m_cnt = pick->m_cnt;
+    f->cnt = pick->d_cnt;
+    f->ranked = pick->d_ranked;
+}
+/** @brief Tells whether a search term can be compiled
+ *  @ingroup pick_engine
+    @details Checked before a running search is cancelled for it, since an
+   invalid regular expression leaves the derived objects as they were. */
+static bool valid_term(const Pick *pick, const char *s) {
+    regex_t re;
+    if (pick->match_mode != MATCH_REGEX || s[0] == '\0')
+        return true;
+    if (regcomp(&re, s, REG_EXTENDED | REG_NOSUB) != 0)
+        return false;
+    regfree(&re);
+    return true;
+}
+/** @brief Tells whether a ranks before b, as ranks_before() does
+ *  @ingroup pick_engine */
+static inline bool top_before(const TopObject *a, const TopObject *b) {
+    if (a->score != b->score)
+        return a->score > b->score;
+    return a->m < b->m;
+}
+/** @brief qsort() comparison of TopObjects, best first */
+static int cmp_top(const void *a, const void *b) {
+    return top_before(a, b) ? -1 : top_before(b, a);
+}
+/** @brief Keeps an object if it is among the k best of a chunk so far
+ *  @ingroup pick_engine
+    @details The chunk's best objects are a heap with the worst of them
+   first, which most objects need only be compared with. */
+static void keep_top(PickChunk *ch, uint k, int score, uint m) {
+    TopObject o = {score, m}, *top = ch->top;
+    uint i, c;
+
+    if (ch->top_cnt < k) {
+        for (i = ch->top_cnt++; i > 0 && top_before(&top[(i - 1) / 2], &o);
+             i = (i - 1) / 2)
+            top[i] = top[(i - 1) / 2];
+        top[i] = o;
+        return;
+    }
+    if (!top_before(&o, &top[0]))
+        return;
+    for (i = 0; (c = 2 * i + 1) < k; i = c) {
+        if (c + 1 < k && top_before(&top[c], &top[c + 1]))
+            c++;
+        if (top_before(&top[c], &o))
+            break;
+        top[i] = top[c];
+    }
+    top[i] = o;
+}
+/** @brief Matches positions lo..hi of the search
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param lo First position
+    @param hi Position after the last
+    @param ch Set to the count of objects matched, and their best, if
+   ch->top is set
+    @return false if the search was cancelled
+    @details Position i is the i'th object of the result set searched, then
+   the master objects that arrived after it. The objects that match are
+   written to the derived object table from position base + lo on, in
+   order, so no two ranges write the same entries. */
+static bool search_span(Pick *pick, uint lo, uint hi, PickChunk *ch) {
+    PickSearch *ps = pick->search;
+    const uint *src = ps->src;
+    uint src_cnt = ps->src_cnt, m_lo = ps->m_lo, k = ps->k;
+    uint *d_object = pick->d_object;
+    int *d_score = pick->d_score;
+    uint d = ps->base + lo, i, m;
+    int score;
+
+    for (i = lo; i < hi; i++) {
+        if ((i & 1023) == 0 &&
+            atomic_load_explicit(&ps->f_cancel, memory_order_relaxed))
+            return false;
+        m = i < src_cnt ? src[i] : m_lo + (i - src_cnt);
+        if (match_object(pick, m, &score)) {
+            d_score[d] = score;
+            d_object[d++] = m;
+            if (ch->top != nullptr)
+                keep_top(ch, k, score, m);
+        }
+    }
+    ch->cnt = d - (ps->base + lo);
+    return true;
+}
+/** @brief Search worker thread
+ *  @ingroup pick_engine
+    @param arg Pick
+    @details Takes chunks of each search until none are left, the search is
+   cancelled or the workers are told to quit. */
+static void *search_worker(void *arg) {
+    Pick *pick = arg;
+    PickSearch *ps = pick->search;
+    uint gen = 0, c;
+    bool f_done;
+
+    pthread_mutex_lock(&ps->mutex);
+    while (1) {
+        while (!ps->f_quit &&
+               !(ps->f_job && ps->gen != gen && ps->next < ps->chunk_cnt))
+            pthread_cond_wait(&ps->cond, &ps->mutex);
+        if (ps->f_quit)
+            break;
+        gen = ps->gen;
+        ps->busy++;
+        while (ps->f_job && ps->next < ps->chunk_cnt) {
+            c = ps->next++;
+            pthread_mutex_unlock(&ps->mutex);
+            f_done = search_span(pick, c * MATCH_CHUNK,
+                                 min((c + 1) * MATCH_CHUNK, ps->n),
+                                 &ps->chunk[c]);
+            pthread_mutex_lock(&ps->mutex);
+            if (!f_done)
+                break;
+            ps->chunk[c].f_done = true;
+            if (++ps->done_cnt == ps->chunk_cnt)
+                pthread_cond_signal(&ps->done_cond);
+        }
+        if (--ps->busy == 0)
+            pthread_cond_signal(&ps->done_cond);
+    }
+    pthread_mutex_unlock(&ps->mutex);
+    return nullptr;
+}
+/** @brief Starts the search workers, one for each processor
+ *  @ingroup pick_engine
+    @return false if none could be started, and searches run on the
+   calling thread */
+static bool start_workers(Pick *pick) {
+    PickSearch *ps = pick->search;
+    uint threads = min((uint)get_nprocs(), MATCH_THREADS_MAX);
+
+    pthread_mutex_lock(&ps->mutex);
+    while (ps->threads < threads &&
+           pthread_create(&ps->thread[ps->threads], nullptr, search_worker,
+                          pick) == 0)
+        ps->threads++;
+    pthread_mutex_unlock(&ps->mutex);
+    ps->f_started = true;
+    return ps->threads > 0;
+}
+/** @brief Cancels the running search, waiting for the workers to leave it
+ *  @ingroup pick_engine
+    @details Workers check for cancellation every 1024 objects, so this
+   waits well under a keystroke's time. */
+static void cancel_search(Pick *pick) {
+    PickSearch *ps = pick->search;
+
+    atomic_store(&ps->f_cancel, true);
+    pthread_mutex_lock(&ps->mutex);
+    ps->f_job = false;
+    while (ps->busy > 0)
+        pthread_cond_wait(&ps->done_cond, &ps->mutex);
+    pthread_mutex_unlock(&ps->mutex);
+    atomic_store(&ps->f_cancel, false);
+    ps->f_valid = false;
+}
+/** @brief Ranks the best page of the merged chunks
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param chunks Chunks merged
+    @details Each chunk kept its best page of objects, so the best page of
+   all is among them. It is selected and moved to the front of the derived
+   objects in rank order, and the rest move up behind it, in the order
+   they were found. The result set cached for the next search is not in
+   input order then, but it need not be: a longer term is only derived
+   from it in the same mode, so it is ranked too, and ties are broken by
+   master index, so its ranking doesn't depend on the order searched. */
+static void rank_chunks(Pick *pick, uint chunks) {
+    PickSearch *ps = pick->search;
+    TopObject *cand = ps->cand, last, o;
+    uint n = 0, i, r, w, k;
+
+    for (i = 0; i < chunks; i++) {
+        memcpy(&cand[n], ps->chunk[i].top,
+               ps->chunk[i].top_cnt * sizeof(TopObject));
+        n += ps->chunk[i].top_cnt;
+    }
+    qsort(cand, n, sizeof(TopObject), cmp_top);
+    k = min(ps->k, n);
+    pick->d_ranked = k;
+    if (k == 0)
+        return;
+    last = cand[k - 1];
+    for (w = r = pick->d_cnt; r-- > 0;) {
+        o = (TopObject){pick->d_score[r], pick->d_object[r]};
+        if (top_before(&last, &o)) {
+            pick->d_score[--w] = o.score;
+            pick->d_object[w] = o.m;
+        }
+    }
+    for (i = 0; i < k; i++) {
+        pick->d_score[i] = cand[i].score;
+        pick->d_object[i] = cand[i].m;
+    }
+}
+/** @brief Ends a search, once all its chunks are merged
+ *  @ingroup pick_engine
+    @details Ranks the first page, if the workers ranked their chunks, and
+   caches the result set. */
+static void end_search(Pick *pick) {
+    PickSearch *ps = pick->search;
+
+    if (ps->chunk_cnt > 0 && ps->chunk[0].top != nullptr)
+        rank_chunks(pick, ps->chunk_cnt);
+    pthread_mutex_lock(&ps->mutex);
+    ps->f_job = false;
+    pthread_mutex_unlock(&ps->mutex);
+    if (ps->term[0] != '\0')
+        save_filter(pick, ps->f, ps->term);
+    ps->m_cnt = pick->m_cnt;
+    ps->f_valid = true;
+    pick->m_idx = pick->m_cnt;
+    pick->d_idx = pick->d_cnt > 0 ? pick->d_cnt - 1 : 0;
+}
+/** @brief Allocates the chunks of a search
+ *  @ingroup pick_engine
+    @return false if they could not be, and it runs on the calling thread
+    @details A fuzzy search of objects from the master objects or a set
+   that was not ranked has each chunk keep its best page. */
+static bool alloc_chunks(Pick *pick) {
+    PickSearch *ps = pick->search;
+    uint chunk_cnt = (ps->n + MATCH_CHUNK - 1) / MATCH_CHUNK, i;
+    bool f_top = pick->f_rank && ps->k > 0 && ps->base == 0;
+
+    if (chunk_cnt > ps->chunk_max) {
+        PickChunk *chunk = realloc(ps->chunk, chunk_cnt * sizeof(PickChunk));
+        if (chunk == nullptr)
+            return false;
+        ps->chunk = chunk;
+        ps->chunk_max = chunk_cnt;
+    }
+    if (f_top && chunk_cnt * ps->k > ps->top_max) {
+        size_t size = chunk_cnt * ps->k * sizeof(TopObject);
+        TopObject *top = realloc(ps->top, size);
+        if (top != nullptr)
+            ps->top = top;
+        TopObject *cand = realloc(ps->cand, size);
+        if (cand != nullptr)
+            ps->cand = cand;
+        if (top == nullptr || cand == nullptr)
+            return false;
+        ps->top_max = chunk_cnt * ps->k;
+    }
+    for (i = 0; i < chunk_cnt; i++)
+        ps->chunk[i] = (PickChunk){false, 0,
+                                   f_top ? &ps->top[i * ps->k] : nullptr, 0};
+    return true;
+}
+/** @brief Starts deriving the objects that match a search term
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param s Search term
+    @return true if the derived objects are complete, false if the search
+   is running on the worker threads, see poll_search()
+    @details Matches the objects against s as set by match_mode. A term that
+   extends the previous one only searches the objects that one matched, and
+   one that was searched before, as when backspacing, takes its result set
+   back, searching only objects that have arrived since. Other terms search
+   the master objects. A fuzzy term ranks them as they are displayed. If s
+   is not a valid regular expression, the derived objects are left as they
+   were.
+
+   Searches of MATCH_THREAD_MIN objects or more are split into chunks of
+   MATCH_CHUNK, which the workers take in turn. A search still running for
+   another term is cancelled first, so a keystroke never waits for a
+   search that is out of date. */
+bool search_objects(Pick *pick, char *s) {
+    PickSearch *ps = pick->search;
+    PickFilter *f;
+
+    if (s == nullptr)
+        s = "";
+    if (ps == nullptr) {
+        ps = calloc(1, sizeof(PickSearch));
+        if (ps == nullptr) {
+            Perror("calloc PickSearch failed");
+            return true;
+        }
+        pthread_mutex_init(&ps->mutex, nullptr);
+        pthread_cond_init(&ps->cond, nullptr);
+        pthread_cond_init(&ps->done_cond, nullptr);
+        pick->search = ps;
+    }
+    if (ps->f_job || ps->f_valid) {
+        bool f_same = ps->mode == pick->match_mode && strcmp(ps->term, s) == 0;
+        if (ps->f_job && f_same)
+            return false;
+        if (f_same && ps->m_cnt == pick->m_cnt)
+            return true;
+    }
+    if (!valid_term(pick, s))
+        return !ps->f_job;
+    if (ps->f_job)
+        cancel_search(pick);
+    ps->f_valid = false;
+    if (!compile_match(pick, s))
+        return true;
+    strnz__cpy(ps->term, s, MAXLEN - 1);
+    ps->mode = pick->match_mode;
+    f = prefix_filter(pick, s);
+    ps->f = f;
+    ps->src = nullptr;
+    ps->src_cnt = 0;
+    ps->m_lo = 0;
+    pick->d_cnt = 0;
+    if (f != nullptr) {
+        if (strcmp(f->term, s) == 0) {
+            memcpy(pick->d_object, f->object, f->cnt * sizeof(uint));
+            memcpy(pick->d_score, f->score, f->cnt * sizeof(int));
+            pick->d_cnt = f->cnt;
+            if (f->m_cnt == pick->m_cnt)
+                pick->d_ranked = f->ranked;
+        } else {
+            ps->src = f->object;
+            ps->src_cnt = f->cnt;
+        }
+        ps->m_lo = f->m_cnt;
+    }
+    ps->base = pick->d_cnt;
+    ps->n = ps->src_cnt + (pick->m_cnt - ps->m_lo);
+    ps->k = pick->lines * pick->tbl_cols;
+    ps->f_page = false;
+    ps->chunk_cnt = 0;
+    if (ps->n < MATCH_THREAD_MIN ||
+        (ps->threads == 0 && (ps->f_started || !start_workers(pick))) ||
+        !alloc_chunks(pick)) {
+        PickChunk ch = {0};
+        search_span(pick, 0, ps->n, &ch);
+        pick->d_cnt += ch.cnt;
+        end_search(pick);
+        return true;
+    }
+    pthread_mutex_lock(&ps->mutex);
+    ps->chunk_cnt = (ps->n + MATCH_CHUNK - 1) / MATCH_CHUNK;
+    ps->next = 0;
+    ps->done_cnt = 0;
+    ps->merged = 0;
+    ps->gen++;
+    ps->f_job = true;
+    pthread_cond_broadcast(&ps->cond);
+    pthread_mutex_unlock(&ps->mutex);
+    return false;
+}
+/** @brief Merges the chunks of the running search that are done
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @return SEARCH_IDLE if no search is running, SEARCH_DONE if it has just
+   finished, SEARCH_FIRST_PAGE the first time a page of objects is found,
+   and SEARCH_RUNNING otherwise
+    @details Chunks are merged in order, moving their objects down to
+   follow the previous chunk's, so the derived objects searched so far are
+   in order and may be displayed. A fuzzy search shows the best of them,
+   until it is done. */
+SearchState poll_search(Pick *pick) {
+    PickSearch *ps = pick->search;
+    uint merged, c;
+
+    if (ps == nullptr || !ps->f_job)
+        return SEARCH_IDLE;
+    pthread_mutex_lock(&ps->mutex);
+    for (merged = ps->merged;
+         merged < ps->chunk_cnt && ps->chunk[merged].f_done; merged++)
+        ;
+    pthread_mutex_unlock(&ps->mutex);
+    for (c = ps->merged; c < merged; c++) {
+        PickChunk *ch = &ps->chunk[c];
+        uint from = ps->base + c * MATCH_CHUNK;
+        if (from != pick->d_cnt) {
+            memmove(&pick->d_object[pick->d_cnt], &pick->d_object[from],
+                    ch->cnt * sizeof(uint));
+            memmove(&pick->d_score[pick->d_cnt], &pick->d_score[from],
+                    ch->cnt * sizeof(int));
+        }
+        pick->d_cnt += ch->cnt;
+    }
+    ps->merged = merged;
+    if (merged == ps->chunk_cnt) {
+        end_search(pick);
+        return SEARCH_DONE;
+    }
+    if (ps->f_page || ps->k == 0 || pick->d_cnt < ps->k)
+        return SEARCH_RUNNING;
+    ps->f_page = true;
+    if (ps->chunk[0].top != nullptr)
+        rank_chunks(pick, merged);
+    return SEARCH_FIRST_PAGE;
+}
+/** @brief Waits for the running search to finish
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure */
+void finish_search(Pick *pick) {
+    PickSearch *ps = pick->search;
+
+    if (ps == nullptr || !ps->f_job)
+        return;
+    pthread_mutex_lock(&ps->mutex);
+    while (ps->done_cnt < ps->chunk_cnt)
+        pthread_cond_wait(&ps->done_cond, &ps->mutex);
+    pthread_mutex_unlock(&ps->mutex);
+    poll_search(pick);
+}
+/** @brief Tells whether a search is running on the worker threads
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @return true until poll_search() or finish_search() has ended it
+    @details While it is, the workers may be writing d_object beyond
+   d_cnt, and the cursor and preview leave it alone. */
+bool search_running(Pick *pick) {
+    return pick->search != nullptr && pick->search->f_job;
+}
+/** @brief Derives the objects that match a search term
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param s Search term
+    @return Count of derived objects
+    @details As search_objects(), waiting for the search to finish. */
+int match_objects(Pick *pick, char *s) {
+    if (!search_objects(pick, s))
+        finish_search(pick);
+    return pick->d_cnt;
+}
+/** @brief Stops the search workers
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure */
+void free_search(Pick *pick) {
+    PickSearch *ps = pick->search;
+
+    if (ps == nullptr)
+        return;
+    if (ps->f_job)
+        cancel_search(pick);
+    pthread_mutex_lock(&ps->mutex);
+    ps->f_quit = true;
+    pthread_cond_broadcast(&ps->cond);
+    pthread_mutex_unlock(&ps->mutex);
+    while (ps->threads > 0)
+        pthread_join(ps->thread[--ps->threads], nullptr);
+    pthread_mutex_destroy(&ps->mutex);
+    pthread_cond_destroy(&ps->cond);
+    pthread_cond_destroy(&ps->done_cond);
+    free(ps->chunk);
+    free(ps->top);
+    free(ps->cand);
+    free(ps);
+    pick->search = nullptr;
+}
+/** @brief Tells whether derived object a ranks before derived object b
+ *  @ingroup pick_engine */
+static inline bool ranks_before(const Pick *pick, uint a, uint b) {
+    if (pick->d_score[a] != pick->d_score[b])
+        return pick->d_score[a] > pick->d_score[b];
+    return pick->d_object[a] < pick->d_object[b];
+}
+/** @brief Swaps two derived objects
+ *  @ingroup pick_engine */
+static inline void swap_ranked(Pick *pick, uint a, uint b) {
+    uint m = pick->d_object[a];
+    int score = pick->d_score[a];
+    pick->d_object[a] = pick->d_object[b];
+    pick->d_score[a] = pick->d_score[b];
+    pick->d_object[b] = m;
+    pick->d_score[b] = score;
+}
+/** @brief Sorts the first k derived objects of lo..hi into rank order
+ *  @ingroup pick_engine
+    @details Quicksort that only sorts the partitions reaching below k, so
+   the rest is partitioned, in linear time, but not sorted. */
+static void partial_sort(Pick *pick, uint lo, uint hi, uint k) {
+    uint mid, store, i;
+    while (lo < k && hi - lo > 16) {
+        // Median of three, as the pivot, at hi - 1
+        mid = lo + (hi - lo) / 2;
+        if (ranks_before(pick, mid, lo))
+            swap_ranked(pick, mid, lo);
+        if (ranks_before(pick, hi - 1, lo))
+            swap_ranked(pick, hi - 1, lo);
+        if (ranks_before(pick, mid, hi - 1))
+            swap_ranked(pick, mid, hi - 1);
+        for (store = i = lo; i < hi - 1; i++)
+            if (ranks_before(pick, i, hi - 1))
+                swap_ranked(pick, i, store++);
+        swap_ranked(pick, store, hi - 1);
+        // Recurse into the smaller side
+        if (store + 1 < k && store - lo < hi - store) {
+            partial_sort(pick, lo, store, k);
+            lo = store + 1;
+        } else {
+            if (store + 1 < k)
+                partial_sort(pick, store + 1, hi, k);
+            hi = store;
+        }
+    }
+    if (lo >= k)
+        return;
+    for (i = lo + 1; i < hi; i++)
+        for (uint j = i; j > lo && ranks_before(pick, j, j - 1); j--)
+            swap_ranked(pick, j, j - 1);
+}
+/** @brief Ranks the derived objects as far as they are to be displayed
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @param upto Derived objects needed in rank order
+    @details The objects already ranked are kept, the next are selected
+   from the rest and sorted, so paging through the table sorts it a page at
+   a time. Objects that arrive later are ranked among the rest. */
+void rank_objects(Pick *pick, uint upto) {
+    if (!pick->f_rank) {
+        pick->d_ranked = pick->d_cnt;
+        return;
+    }
+    upto = min(upto, pick->d_cnt);
+    if (pick->d_ranked >= upto)
+        return;
+    partial_sort(pick, pick->d_ranked, pick->d_cnt, upto);
+    pick->d_ranked = upto;
+}
+/** @brief Frees the compiled search term
+ *  @ingroup pick_engine */
+void free_match(Pick *pick) {
+    if (pick->match == nullptr)
+        return;
+    if (pick->match->f_regex)
+        regfree(&pick->match->re);
+    free(pick->match);
+    pick->match = nullptr;
+}
+/** @brief Converts a match_mode option to a MatchMode
+ *  @ingroup pick_engine
+    @param s "fuzzy", "exact" or "regex"
+    @return MatchMode, MATCH_FUZZY if s is none of them */
+MatchMode str_to_match_mode(const char *s) {
+    if (strcmp(s, "exact") == 0)
+        return MATCH_EXACT;
+    if (strcmp(s, "regex") == 0)
+        return MATCH_REGEX;
+    return MATCH_FUZZY;
+}
+/** @brief Name of a MatchMode, as in the match_mode option
+ *  @ingroup pick_engine */
+const char *match_mode_name(MatchMode mode) {
+    return mode == MATCH_EXACT   ? "exact"
+           : mode == MATCH_REGEX ? "regex"
+                                 : "fuzzy";
+}
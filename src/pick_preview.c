@@ -0,0 +1,580 @@
+/** @file pick_preview.c
+    @brief preview the file under the pick cursor
+    @author Bill Waller
+    Copyright (c) 2025
+    MIT License
+    billxwaller@gmail.com
+    @date 2026-02-09
+    @details With p_view_files, the view below the pick window shows the
+   file under the cursor. Its raw text is shown at once, and the
+   highlighter, tree-sitter, runs in the background, once the cursor has
+   rested for PICK_PREVIEW_DEBOUNCE_MS. Its output goes straight to a
+   memfd, which replaces the raw text when the highlighter exits, if the
+   file is still under the cursor. A highlighter for a file the cursor has
+   left is killed.
+
+   Highlighted files are kept, up to PICK_PREVIEW_CACHE of them, and while
+   the cursor rests, the objects before and after it are highlighted too,
+   so moving to them shows them highlighted at once. pick_get_event()
+   calls poll_preview() on each PICK_PREVIEW_TICK_MS timeout while there
+   is work to do, so cursor movement never waits for the highlighter.
+
+   Highlighted files are also kept on disk, in $XDG_CACHE_HOME/cmenu/hl or
+   ~/.cache/cmenu/hl, named for a hash of the file's path, device, inode,
+   size and modification time, the highlighter command, and its theme, so
+   a file is highlighted once until it changes, even across runs. A file
+   found there is mapped as the view's buffer. The cache is kept under
+   PICK_HL_CACHE_MB by removing the files least recently shown.
+ */
+
+#include "common.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PREVIEW_NEAR 2 /**< neighbors highlighted ahead, after and before */
+#define HL_CMD "tree-sitter highlight" /**< part of the cache key */
+
+/** @struct PreviewEntry
+    @brief A file, highlighted or being highlighted. Free if file is empty,
+   running if pid is set, otherwise highlighted if fd is set, and failed if
+   it is not. */
+typedef struct {
+    char file[MAXLEN];
+    pid_t pid;         /**< highlighter still running, or 0 */
+    int fd;            /**< memfd or cache file of its output, or -1 */
+    uint64_t key;      /**< see file_key(), 0 if it can't be highlighted */
+    unsigned long use; /**< when it was last shown, for eviction */
+} PreviewEntry;
+
+/** @struct PickPreview
+    @brief The preview of the file under the pick cursor */
+struct PickPreview {
+    View *view;
+    PreviewEntry entry[PICK_PREVIEW_CACHE];
+    unsigned long uses;
+    char want[MAXLEN];               /**< file under the cursor */
+    char near[PREVIEW_NEAR][MAXLEN]; /**< its neighbors, or "" */
+    bool f_shown;                    /**< want is shown highlighted */
+    struct timespec moved;           /**< when the cursor got to want */
+    char cache_dir[MAXLEN];          /**< on-disk cache, or "" */
+    char theme[MAXLEN];              /**< identifies the highlighter theme */
+};
+
+/** @struct CachedFile
+    @brief A file in the on-disk cache, see trim_cache() */
+typedef struct {
+    char name[32];
+    off_t size;
+    struct timespec mtime; /**< when it was last shown */
+} CachedFile;
+
+static void init_cache(PickPreview *);
+static uint64_t file_key(PickPreview *, const char *);
+static int open_cached(PickPreview *, uint64_t);
+static void store_cached(PickPreview *, PreviewEntry *);
+static int cmp_cached(const void *, const void *);
+static void trim_cache(PickPreview *);
+static PreviewEntry *find_entry(PickPreview *, const char *);
+static PreviewEntry *new_entry(PickPreview *, const char *, uint64_t);
+static void free_entry(PreviewEntry *);
+static bool start_highlight(PickPreview *, const char *);
+static void reap_highlight(PickPreview *, PreviewEntry *);
+static void show_buf(View *, char *, char *, off_t);
+static void show_raw(PickPreview *);
+static void show_entry(PickPreview *, PreviewEntry *);
+static long ms_since(const struct timespec *);
+
+/** @brief Finds the on-disk cache and the highlighter's theme
+ *  @ingroup pick_engine
+    @details tree-sitter's theme is in its config.json, so its size and
+   modification time stand for the theme. */
+static void init_cache(PickPreview *pp) {
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    const char *ts_dir = getenv("TREE_SITTER_DIR");
+    char config[MAXLEN];
+    struct stat sb;
+
+    if (xdg && xdg[0] == '/')
+        ssnprintf(pp->cache_dir, MAXLEN - 1, "%s/cmenu/hl", xdg);
+    else if (home && home[0] != '\0')
+        ssnprintf(pp->cache_dir, MAXLEN - 1, "%s/.cache/cmenu/hl", home);
+    xdg = getenv("XDG_CONFIG_HOME");
+    if (ts_dir && ts_dir[0] != '\0')
+        ssnprintf(config, MAXLEN - 1, "%s/config.json", ts_dir);
+    else if (xdg && xdg[0] == '/')
+        ssnprintf(config, MAXLEN - 1, "%s/tree-sitter/config.json", xdg);
+    else if (home && home[0] != '\0')
+        ssnprintf(config, MAXLEN - 1, "%s/.config/tree-sitter/config.json",
+                  home);
+    else
+        config[0] = '\0';
+    if (config[0] != '\0' && stat(config, &sb) == 0)
+        ssnprintf(pp->theme, MAXLEN - 1, "%s %lld %lld.%09ld", config,
+                  (long long)sb.st_size, (long long)sb.st_mtim.tv_sec,
+                  sb.st_mtim.tv_nsec);
+}
+/** @brief Identifies a file's highlighted text
+ *  @ingroup pick_engine
+    @return A hash of the file's path, device, inode, size and modification
+   time, the highlighter command and its theme, or 0 if the file is not a
+   regular file with something in it */
+static uint64_t file_key(PickPreview *pp, const char *file) {
+    char id[MAXLEN * 3];
+    struct stat sb;
+    uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+
+    if (stat(file, &sb) == -1 || !S_ISREG(sb.st_mode) || sb.st_size == 0)
+        return 0;
+    ssnprintf(id, sizeof(id) - 1, "%s\n%llu %llu %lld %lld.%09ld\n%s\n%s",
+              file, (unsigned long long)sb.st_dev,
+              (unsigned long long)sb.st_ino, (long long)sb.st_size,
+              (long long)sb.st_mtim.tv_sec, sb.st_mtim.tv_nsec, HL_CMD,
+              pp->theme);
+    for (const char *p = id; *p; p++) {
+        h ^= (unsigned char)*p;
+        h *= 0x100000001b3ULL;
+    }
+    return h ? h : 1;
+}
+/** @brief Opens a file's highlighted text in the on-disk cache
+ *  @ingroup pick_engine
+    @return File descriptor, or -1 if it isn't there
+    @details Marks it as just shown, for trim_cache(). */
+static int open_cached(PickPreview *pp, uint64_t key) {
+    char path[MAXLEN];
+    struct stat sb;
+    int fd;
+
+    if (pp->cache_dir[0] == '\0' || key == 0)
+        return -1;
+    ssnprintf(path, MAXLEN - 1, "%s/%016llx", pp->cache_dir,
+              (unsigned long long)key);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, &sb) == -1 || sb.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    futimens(fd, nullptr);
+    return fd;
+}
+/** @brief Writes a highlighter's output to the on-disk cache
+ *  @ingroup pick_engine
+    @details It is written to a temporary file and renamed, so a reader
+   never sees part of it. */
+static void store_cached(PickPreview *pp, PreviewEntry *e) {
+    char path[MAXLEN], tmp_path[MAXLEN];
+    struct stat sb;
+    off_t off = 0;
+    bool ok;
+    int fd;
+
+    if (pp->cache_dir[0] == '\0' || fstat(e->fd, &sb) == -1)
+        return;
+    strnz__cpy(tmp_path, pp->cache_dir, MAXLEN - 1);
+    for (char *p = strchr(tmp_path + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        mkdir(tmp_path, 0755);
+        *p = '/';
+    }
+    mkdir(tmp_path, 0755);
+    ssnprintf(path, MAXLEN - 1, "%s/%016llx", pp->cache_dir,
+              (unsigned long long)e->key);
+    ssnprintf(tmp_path, MAXLEN - 1, "%s.%d", path, (int)getpid());
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return;
+    while (off < sb.st_size && sendfile(fd, e->fd, &off, sb.st_size - off) > 0)
+        ;
+    ok = off == sb.st_size;
+    if (close(fd) == -1)
+        ok = false;
+    if (!ok || rename(tmp_path, path) == -1) {
+        unlink(tmp_path);
+        return;
+    }
+    trim_cache(pp);
+}
+/** @brief Orders cached files least recently shown first */
+static int cmp_cached(const void *a, const void *b) {
+    const CachedFile *x = a, *y = b;
+    if (x->mtime.tv_sec != y->mtime.tv_sec)
+        return x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1;
+    return (x->mtime.tv_nsec > y->mtime.tv_nsec) -
+           (x->mtime.tv_nsec < y->mtime.tv_nsec);
+}
+/** @brief Keeps the on-disk cache under PICK_HL_CACHE_MB
+ *  @ingroup pick_engine
+    @details When it is over, the files least recently shown are removed
+   until it is under three quarters of it, so it isn't trimmed on every
+   write. */
+static void trim_cache(PickPreview *pp) {
+    const off_t max = (off_t)PICK_HL_CACHE_MB * 1024 * 1024;
+    CachedFile *files = nullptr, *grown;
+    size_t cnt = 0, cap = 0, i;
+    off_t total = 0;
+    struct dirent *de;
+    struct stat sb;
+    DIR *dir = opendir(pp->cache_dir);
+
+    if (dir == nullptr)
+        return;
+    while ((de = readdir(dir)) != nullptr) {
+        if (de->d_name[0] == '.' || strlen(de->d_name) >= sizeof(files->name) ||
+            fstatat(dirfd(dir), de->d_name, &sb, AT_SYMLINK_NOFOLLOW) == -1 ||
+            !S_ISREG(sb.st_mode))
+            continue;
+        if (cnt == cap) {
+            cap = cap ? cap * 2 : 256;
+            grown = realloc(files, cap * sizeof(CachedFile));
+            if (grown == nullptr)
+                break;
+            files = grown;
+        }
+        strnz__cpy(files[cnt].name, de->d_name, sizeof(files->name) - 1);
+        files[cnt].size = sb.st_size;
+        files[cnt].mtime = sb.st_mtim;
+        total += sb.st_size;
+        cnt++;
+    }
+    if (total > max) {
+        qsort(files, cnt, sizeof(CachedFile), cmp_cached);
+        for (i = 0; i < cnt && total > max / 4 * 3; i++)
+            if (unlinkat(dirfd(dir), files[i].name, 0) == 0)
+                total -= files[i].size;
+    }
+    closedir(dir);
+    free(files);
+}
+/** @brief Finds a file among the highlighted files
+ *  @ingroup pick_engine */
+static PreviewEntry *find_entry(PickPreview *pp, const char *file) {
+    for (int i = 0; i < PICK_PREVIEW_CACHE; i++)
+        if (pp->entry[i].file[0] != '\0' &&
+            strcmp(pp->entry[i].file, file) == 0)
+            return &pp->entry[i];
+    return nullptr;
+}
+/** @brief Frees an entry, killing its highlighter if it is still running
+ *  @ingroup pick_engine */
+static void free_entry(PreviewEntry *e) {
+    if (e->pid > 0) {
+        kill(e->pid, SIGKILL);
+        waitpid(e->pid, nullptr, 0);
+    }
+    if (e->fd >= 0)
+        close(e->fd);
+    *e = (PreviewEntry){.fd = -1};
+}
+/** @brief Makes an entry for a file
+ *  @ingroup pick_engine
+    @return The entry, reusing the least recently shown one that is not
+   running, or nullptr if all are running */
+static PreviewEntry *new_entry(PickPreview *pp, const char *file,
+                               uint64_t key) {
+    PreviewEntry *e = nullptr;
+
+    for (int i = 0; i < PICK_PREVIEW_CACHE; i++) {
+        PreviewEntry *c = &pp->entry[i];
+        if (c->pid == 0 && (e == nullptr || c->file[0] == '\0' ||
+                            (e->file[0] != '\0' && c->use < e->use)))
+            e = c;
+    }
+    if (e == nullptr)
+        return nullptr;
+    free_entry(e);
+    strnz__cpy(e->file, file, MAXLEN - 1);
+    e->key = key;
+    e->use = ++pp->uses;
+    return e;
+}
+/** @brief Starts the highlighter for a file
+ *  @ingroup pick_engine
+    @param pp PickPreview
+    @param file File to highlight
+    @return false if it could not be started, in which case the file is
+   kept as failed, so it is not tried again
+    @details A file in the on-disk cache needs no highlighter. Otherwise
+   the highlighter writes to a memfd, so nothing need be read while it
+   runs. */
+static bool start_highlight(PickPreview *pp, const char *file) {
+    uint64_t key = file_key(pp, file);
+    PreviewEntry *e = new_entry(pp, file, key);
+
+    if (e == nullptr || key == 0)
+        return false;
+    e->fd = open_cached(pp, key);
+    if (e->fd >= 0)
+        return true;
+    e->fd = memfd_create("pick_preview", MFD_CLOEXEC);
+    if (e->fd == -1)
+        return false;
+    e->pid = fork();
+    if (e->pid == 0) {
+        int dev_null = open("/dev/null", O_RDWR);
+        if (dev_null != -1) {
+            dup2(dev_null, STDIN_FILENO);
+            dup2(dev_null, STDERR_FILENO);
+        }
+        dup2(e->fd, STDOUT_FILENO);
+        execlp("tree-sitter", "tree-sitter", "highlight", file,
+               (char *)nullptr);
+        _exit(127);
+    }
+    if (e->pid == -1) {
+        e->pid = 0;
+        close(e->fd);
+        e->fd = -1;
+        return false;
+    }
+    return true;
+}
+/** @brief Collects a highlighter's output
+ *  @ingroup pick_engine
+    @param pp PickPreview
+    @param e Entry with a running highlighter
+    @details Once it has exited, the entry is highlighted, and stored in
+   the on-disk cache, if it succeeded with some output, and failed
+   otherwise. If a wait elsewhere reaped it first, its output decides. */
+static void reap_highlight(PickPreview *pp, PreviewEntry *e) {
+    struct stat sb;
+    int status = 0;
+    pid_t pid = waitpid(e->pid, &status, WNOHANG);
+
+    if (pid == 0)
+        return;
+    e->pid = 0;
+    if ((pid > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) ||
+        fstat(e->fd, &sb) == -1 || sb.st_size == 0) {
+        close(e->fd);
+        e->fd = -1;
+        return;
+    }
+    store_cached(pp, e);
+}
+/** @brief Shows a buffer in the view
+ *  @ingroup pick_engine
+    @param view View
+    @param file File it holds
+    @param buf Buffer, mapped, or nullptr if there is nothing to show
+    @param size Its size
+    @details Replaces the view's buffer, and shows its first page. */
+static void show_buf(View *view, char *file, char *buf, off_t size) {
+    if (view->buf != nullptr) {
+        destroy_line_table(view);
+        munmap(view->buf, view->file_size);
+        view->buf = nullptr;
+    }
+    strnz__cpy(view->title, file, MAXLEN - 1);
+    strnz__cpy(view->cur_file_str, file, MAXLEN - 1);
+    base_name(view->file_name, view->cur_file_str);
+    border_title(view->sfc, view->title);
+    if (buf == nullptr) {
+        ui_cursor_move(view->sfc, PAD, 0, 0);
+        ui_wclrtobot(view->sfc, PAD);
+        if (view->f_ln) {
+            ui_cursor_move(view->sfc, LNNO, 0, 0);
+            ui_wclrtobot(view->sfc, LNNO);
+        }
+        pad_refresh(view);
+        return;
+    }
+    view->buf = buf;
+    view->file_size = size;
+    view->f_in_pipe = false;
+    view->prev_file_pos = NULL_POSITION;
+    view->buf_curr_ptr = view->buf;
+    if (view->cmd_all[0] != '\0')
+        strnz__cpy(view->cmd, view->cmd_all, MAXLEN - 1);
+    for (int i = 0; i < NMARKS; i++)
+        view->mark_tbl[i] = NULL_POSITION;
+    view->f_eod = 0;
+    view->f_bod = 0;
+    view->maxcol = 0;
+    view->page_top_pos = 0;
+    view->page_top_ln_no = 0;
+    view->page_bot_ln_no = 0;
+    view->ln_max_pos = 0;
+    view->ln_no = 0;
+    view->page_bot_pos = 0;
+    view->file_pos = 0;
+    initialize_line_table(view);
+    next_page(view);
+    build_prompt(view);
+    display_prompt(view, view->prompt_str);
+    pad_refresh(view);
+}
+/** @brief Shows the raw text of the file under the cursor
+ *  @ingroup pick_engine
+    @details Files that can't be read, and empty files, show an empty
+   view. */
+static void show_raw(PickPreview *pp) {
+    char *buf = nullptr;
+    struct stat sb;
+    int fd = open(pp->want, O_RDONLY);
+
+    if (fd != -1) {
+        if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0) {
+            buf = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (buf == MAP_FAILED)
+                buf = nullptr;
+        }
+        close(fd);
+    }
+    show_buf(pp->view, pp->want, buf, buf ? sb.st_size : 0);
+}
+/** @brief Shows a highlighted file
+ *  @ingroup pick_engine */
+static void show_entry(PickPreview *pp, PreviewEntry *e) {
+    struct stat sb;
+    char *buf;
+
+    if (fstat(e->fd, &sb) == -1)
+        return;
+    buf = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, e->fd, 0);
+    if (buf == MAP_FAILED)
+        return;
+    e->use = ++pp->uses;
+    show_buf(pp->view, e->file, buf, sb.st_size);
+    pp->f_shown = true;
+}
+/** @brief Milliseconds since a time */
+static long ms_since(const struct timespec *t) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - t->tv_sec) * 1000 +
+           (now.tv_nsec - t->tv_nsec) / 1000000;
+}
+/** @brief Shows the file under the pick cursor in the view
+ *  @ingroup pick_engine
+    @param init Pointer to Init structure containing pick information
+    @param file Name of the file to be displayed in the view
+    @details Shows the file highlighted if it has been, here or in the
+   on-disk cache, and its raw text otherwise, with the highlighter to
+   follow. A highlighter still running for a file the cursor has left is
+   killed, unless it is one of the file's neighbors. */
+void new_view_file(Init *init, char *file) {
+    Pick *pick = init->pick;
+    PickPreview *pp = pick->preview;
+    PreviewEntry *e;
+    uint64_t key;
+    int fd, i;
+
+    if (pp == nullptr) {
+        pp = calloc(1, sizeof(PickPreview));
+        if (pp == nullptr) {
+            Perror("calloc PickPreview failed");
+            return;
+        }
+        for (i = 0; i < PICK_PREVIEW_CACHE; i++)
+            pp->entry[i].fd = -1;
+        init_cache(pp);
+        pick->preview = pp;
+    }
+    pp->view = init->view;
+    strnz__cpy(pp->want, file, MAXLEN - 1);
+    expand_tilde(pp->want, MAXLEN - 1);
+    for (i = 0; i < PREVIEW_NEAR; i++) {
+        uint d = i == 0 ? pick->d_idx + 1 : pick->d_idx - 1;
+        pp->near[i][0] = '\0';
+        if (d < pick->d_cnt) {
+            strnz__cpy(pp->near[i], display_object(pick, d), MAXLEN - 1);
+            expand_tilde(pp->near[i], MAXLEN - 1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &pp->moved);
+    pp->f_shown = false;
+    for (i = 0; i < PICK_PREVIEW_CACHE; i++) {
+        e = &pp->entry[i];
+        if (e->pid > 0 && strcmp(e->file, pp->want) != 0 &&
+            strcmp(e->file, pp->near[0]) != 0 &&
+            strcmp(e->file, pp->near[1]) != 0)
+            free_entry(e);
+    }
+    key = file_key(pp, pp->want);
+    e = find_entry(pp, pp->want);
+    // A file changed since it was highlighted is highlighted again
+    if (e != nullptr && e->pid == 0 && e->key != key) {
+        free_entry(e);
+        e = nullptr;
+    }
+    if (e == nullptr && (fd = open_cached(pp, key)) >= 0) {
+        e = new_entry(pp, pp->want, key);
+        if (e == nullptr)
+            close(fd);
+        else
+            e->fd = fd;
+    }
+    if (e != nullptr && e->pid == 0 && e->fd >= 0) {
+        show_entry(pp, e);
+        return;
+    }
+    show_raw(pp);
+}
+/** @brief Does the preview's background work
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure
+    @return true while there is more to do, and it should be called again
+   after PICK_PREVIEW_TICK_MS
+    @details Collects highlighters that have exited, showing the file under
+   the cursor once it is highlighted. When the cursor has rested for
+   PICK_PREVIEW_DEBOUNCE_MS, starts the highlighter for it, then for its
+   neighbors, one at a time. */
+bool poll_preview(Pick *pick) {
+    PickPreview *pp = pick->preview;
+    PreviewEntry *e;
+    int i;
+    bool f_running = false;
+
+    if (pp == nullptr || pp->want[0] == '\0')
+        return false;
+    for (i = 0; i < PICK_PREVIEW_CACHE; i++) {
+        e = &pp->entry[i];
+        if (e->pid > 0)
+            reap_highlight(pp, e);
+        if (e->pid > 0)
+            f_running = true;
+    }
+    e = find_entry(pp, pp->want);
+    if (!pp->f_shown && e != nullptr && e->pid == 0 && e->fd >= 0)
+        show_entry(pp, e);
+    if (f_running)
+        return true;
+    if (ms_since(&pp->moved) < PICK_PREVIEW_DEBOUNCE_MS)
+        return true;
+    if (e == nullptr) {
+        start_highlight(pp, pp->want);
+        return true;
+    }
+    for (i = 0; i < PREVIEW_NEAR; i++)
+        if (pp->near[i][0] != '\0' &&
+            find_entry(pp, pp->near[i]) == nullptr) {
+            start_highlight(pp, pp->near[i]);
+            return true;
+        }
+    return false;
+}
+/** @brief Ends the preview, killing any highlighter still running
+ *  @ingroup pick_engine
+    @param pick Pointer to Pick structure */
+void free_preview(Pick *pick) {
+    PickPreview *pp = pick->preview;
+    if (pp == nullptr)
+        return;
+    for (int i = 0; i < PICK_PREVIEW_CACHE; i++)
+        free_entry(&pp->entry[i]);
+    free(pp);
+    pick->preview = nullptr;
+}
@@ -634,6 +634,15 @@ int ui_idcok(UiSurface *s, uint w, bool enable) {
         idcok(s->mwin[w], false);
     return 0;
 }
+int ui_immedok(UiSurface *s, uint w, bool enable) {
+    if (!s->mwin[w])
+        return -1;
+    if (enable)
+        immedok(s->mwin[w], true);
+    else
+        immedok(s->mwin[w], false);
+    return 0;
+}
 int ui_setscrreg(UiSurface *s, uint w, uint top, uint bottom) {
     if (!s->mwin[w])
         return -1;
@@ -759,7 +768,16 @@ int ui_setcchar(cchar_t *wch, const wchar_t *wc, const attr_t attrs, short pair,
    Rendering
    ------------------------------------------------------------------------- */
 
+#ifdef DEBUG_RENDER
+static unsigned long render_count; /**< frames rendered, see ui_render() */
+unsigned long ui_render_count() {
+    return render_count;
+}
+#endif
 void ui_render() {
+#ifdef DEBUG_RENDER
+    render_count++;
+#endif
     update_panels();
     doupdate();
 }
@@ -107,6 +107,7 @@ int ui_get_event(UiSurface *s, uint w, UiEvent *ev, int timeout_ms) {
     tcflush(2, TCIFLUSH);
     if (timeout_ms <= 0) {
         timeout_ms = -1;
+        wtimeout(s->mwin[w], -1);
     } else
         wtimeout(s->mwin[w], timeout_ms);
     mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION | BUTTON_SHIFT | BUTTON_CTRL | BUTTON_ALT, NULL);
@@ -151,12 +152,17 @@ int ui_get_event_multi(UiSurface *s, uint w, UiEvent *ev, int timeout_ms) {
     keypad(s->mwin[w], true);
     if (timeout_ms <= 0) {
         timeout_ms = -1;
+        wtimeout(s->mwin[w], -1);
     } else
         wtimeout(s->mwin[w], timeout_ms);
     mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION | BUTTON_SHIFT | BUTTON_CTRL | BUTTON_ALT, NULL);
     ev->chyron = -1;
-    qiflush();
-    tcflush(2, TCIFLUSH);
+    // Typeahead is discarded before a blocking read, but is kept by a timed
+    // read, where the caller polls and keys can arrive between the calls
+    if (timeout_ms < 0) {
+        qiflush();
+        tcflush(2, TCIFLUSH);
+    }
     cbreak();
     curs_set(2);
     int ch = wgetch(s->mwin[w]);
@@ -370,9 +370,18 @@ void ui_update_panels() {
     notcurses_render(ui->nc);
 }
 
+#ifdef DEBUG_RENDER
+static unsigned long render_count; /**< frames rendered, see ui_render() */
+unsigned long ui_render_count() {
+    return render_count;
+}
+#endif
 void ui_render() {
     if (!ui)
         return;
+#ifdef DEBUG_RENDER
+    render_count++;
+#endif
     notcurses_render(ui->nc);
 }
 
@@ -753,6 +762,13 @@ int ui_idlok(UiSurface *s, uint w, bool enable) {
     (void)enable;
     return 0;
 }
+int ui_immedok(UiSurface *s, uint w, bool enable) {
+    if (!s)
+        return -1;
+    (void)w;
+    (void)enable;
+    return 0;
+}
 int ui_setscrreg(UiSurface *s, uint w, uint top, uint bottom) {
     (void)s;
     (void)w;